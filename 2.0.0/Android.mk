@@ -135,11 +135,18 @@ LOCAL_SRC_FILES := \
 	pq_interface.cpp \
 	grallocdev.cpp \
 	hrt_common.cpp \
+	hrt_model.cpp \
+	sim_hrt.cpp \
 	platform_wrap.cpp \
 	mml_asyncblitstream.cpp \
 	data_express.cpp \
 	color_histogram.cpp \
-	pq_xml_parser.cpp
+	pq_xml_parser.cpp \
+	mcycle_model.cpp \
+	slack_controller.cpp \
+	fence_monitor.cpp \
+	frame_tracer.cpp \
+	hwc2_recorder.cpp
 
 ifeq ($(MTK_DX_HDCP_SUPPORT),yes)
 LOCAL_CFLAGS += -DFT_HDCP_FEATURE
@@ -197,6 +204,14 @@ LOCAL_SRC_FILES += \
 	legacy/pqdev_legacy.cpp
 endif
 
+# null device is used to run hwcomposer without display hardware
+ifeq ($(MTK_HWC_USE_NULL_DEVICE), yes)
+LOCAL_CFLAGS += -DMTK_HWC_USE_NULL_DEVICE
+LOCAL_SRC_FILES += \
+	nulldev.cpp \
+	hwc2_bench.cpp
+endif
+
 ifeq ($(strip $(TARGET_BUILD_VARIANT)), user)
 LOCAL_CFLAGS += -DMTK_USER_BUILD
 endif
@@ -271,3 +286,30 @@ LOCAL_CFLAGS += -Wconversion \
 
 include $(MTK_STATIC_LIBRARY)
 
+
+
+#
+# hrt_model_replay runs HrtModel on the host against a HWCRecorder file
+#
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := hrt_model_replay
+LOCAL_MODULE_OWNER := mtk
+
+LOCAL_SRC_FILES := \
+	hrt_model.cpp \
+	hrt_model_replay.cpp
+
+LOCAL_HEADER_LIBRARIES := \
+	libhardware_headers \
+	libsystem_headers \
+	libutils_headers
+
+LOCAL_CFLAGS += -Wconversion \
+	-Wunused \
+	-Wformat \
+	-Wsign-compare \
+	-Wall \
+	-Werror
+
+include $(BUILD_HOST_EXECUTABLE)
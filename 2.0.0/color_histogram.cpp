@@ -12,9 +12,8 @@
 #include "sync.h"
 #include "platform_wrap.h"
 
-FenceState::FenceState(unsigned int index, int fence_fd, hwc2_config_t active_config)
+FenceState::FenceState(unsigned int index, hwc2_config_t active_config)
     : m_index(index)
-    , m_fence_fd(fence_fd)
     , m_invalid(false)
     , m_is_signal(false)
     , m_signal_time(0)
@@ -24,10 +23,6 @@ FenceState::FenceState(unsigned int index, int fence_fd, hwc2_config_t active_co
 
 FenceState::~FenceState()
 {
-    if (m_fence_fd > 0)
-    {
-        closeFenceFd(&m_fence_fd);
-    }
 }
 
 unsigned int FenceState::getFenceIndex()
@@ -45,35 +40,26 @@ bool FenceState::isSignal()
     return m_is_signal;
 }
 
-int FenceState::waitSignal()
+void FenceState::setSignal(nsecs_t signal_time)
 {
-    int res =  SyncFence::waitWithoutCloseFd(m_fence_fd, 1000, "FenceState");
-    if (res == 0)
+    if (signal_time == SIGNAL_TIME_INVALID)
     {
-        m_is_signal = true;
+        m_invalid = true;
     }
-    else if (res < 0)
+    else
     {
-        m_invalid = true;
+        m_is_signal = true;
+        m_signal_time = static_cast<uint64_t>(signal_time);
     }
-    m_signal_time = SyncFence::getSignalTime(m_fence_fd);
-    return res;
+}
+
+void FenceState::setInvalid()
+{
+    m_invalid = true;
 }
 
 uint64_t FenceState::getSingalTime()
 {
-    if (m_signal_time == 0)
-    {
-        m_signal_time = SyncFence::getSignalTime(m_fence_fd);
-        if (m_signal_time == static_cast<uint64_t>(SIGNAL_TIME_INVALID))
-        {
-            m_invalid = true;
-        }
-        else if (m_signal_time != static_cast<uint64_t>(SIGNAL_TIME_PENDING))
-        {
-            m_is_signal = true;
-        }
-    }
     return m_signal_time;
 }
 
@@ -629,6 +615,7 @@ ColorHistogram::ColorHistogram(uint64_t disp_id)
     , m_retry_count(0)
     , m_active_config(0)
     , m_refresh(0)
+    , m_pf_listener(new PresentFenceListener(this))
 {
     m_histogram = getHwDevice();
     if (m_histogram == nullptr)
@@ -657,6 +644,36 @@ ColorHistogram::ColorHistogram(uint64_t disp_id)
 
 ColorHistogram::~ColorHistogram()
 {
+    m_pf_listener->detach();
+}
+
+void ColorHistogram::PresentFenceListener::onFenceSignaled(unsigned int fence_idx, nsecs_t signal_time)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_owner)
+    {
+        m_owner->onPresentFenceSignaled(fence_idx, signal_time);
+    }
+}
+
+void ColorHistogram::PresentFenceListener::detach()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_owner = nullptr;
+}
+
+void ColorHistogram::onPresentFenceSignaled(unsigned int index, nsecs_t signal_time)
+{
+    std::lock_guard<std::mutex> lock_guarder(m_mutex_control_guarder);
+    for (auto& fstate : m_pf_table)
+    {
+        if (fstate->getFenceIndex() == index && fstate->needCheck())
+        {
+            fstate->setSignal(signal_time);
+            m_condition_guarder.notify_one();
+            break;
+        }
+    }
 }
 
 void ColorHistogram::updateActiveBinNumber()
@@ -804,15 +821,18 @@ int32_t ColorHistogram::addPresentInfo(unsigned int index, int fd, hwc2_config_t
     }
 
     std::lock_guard<std::mutex> lock_pf(m_mutex_control_guarder);
-    int dup_fd = dup(fd);
-    HWC_LOGD("%s: index=%u  fd=%d", __func__, index, dup_fd);
-    std::shared_ptr<FenceState> ptr = std::make_shared<FenceState>(index, dup_fd, active_config);
+    HWC_LOGD("%s: index=%u  fd=%d", __func__, index, fd);
+    std::shared_ptr<FenceState> ptr = std::make_shared<FenceState>(index, active_config);
     if (m_pf_table.size() > 16)
     {
         HWC_LOGW("(%" PRIu64 ")%s: too many present info, so clear all", m_disp_id, __func__);
         m_pf_table.clear();
     }
     m_pf_table.push_back(ptr);
+    if (FenceMonitor::getInstance().addFence(fd, m_pf_listener, index, 1000, "histogram") != NO_ERROR)
+    {
+        ptr->setInvalid();
+    }
     m_condition_guarder.notify_one();
 
     return NO_ERROR;
@@ -869,8 +889,8 @@ void ColorHistogram::dump(String8* dump_str)
             size_t i = 0;
             for (auto iter = m_pf_table.begin(); iter != m_pf_table.end(); ++iter, i++)
             {
-                dump_str->appendFormat("\t[%zu] idx=%u fd=%d invalid=%d signal=%d time=%" PRIu64 "\n",
-                        i, (*iter)->m_index, (*iter)->m_fence_fd,
+                dump_str->appendFormat("\t[%zu] idx=%u invalid=%d signal=%d time=%" PRIu64 "\n",
+                        i, (*iter)->m_index,
                         (*iter)->m_invalid, (*iter)->m_is_signal,
                         (*iter)->m_signal_time);
             }
@@ -920,7 +940,22 @@ void ColorHistogram::gatherThread()
                         break;
                     }
                 }
-                if (fstate == nullptr)
+
+                if (fstate != nullptr)
+                {
+                    // FenceMonitor reports the signal by onPresentFenceSignaled()
+                    bool signaled = m_condition_guarder.wait_for(lock_guarder, std::chrono::milliseconds(1000),
+                            [this, &fstate] { return m_stop_guarder || !fstate->needCheck(); });
+                    if (!signaled)
+                    {
+                        fstate->setInvalid();
+                    }
+                    else if (m_stop_guarder)
+                    {
+                        continue;
+                    }
+                }
+                else
                 {
                     auto res = m_condition_guarder.wait_for(lock_guarder, std::chrono::milliseconds(32));
                     if (res == std::cv_status::timeout)
@@ -940,7 +975,6 @@ void ColorHistogram::gatherThread()
         {
             logger.printf("[%s] pf_table_size=%zu, wait_fence=%u| ", DEBUG_LOG_TAG, pf_table_size,
                     fstate->getFenceIndex());
-            fstate->waitSignal();
         }
         else
         {
@@ -13,6 +13,7 @@
 #include <hardware/hwcomposer2.h>
 
 #include "dev_interface.h"
+#include "fence_monitor.h"
 
 using namespace android;
 
@@ -27,20 +28,23 @@ enum
 class FenceState
 {
 public:
-    FenceState(unsigned int index, int fence_fd, hwc2_config_t active_config);
+    FenceState(unsigned int index, hwc2_config_t active_config);
     ~FenceState();
 
     unsigned int getFenceIndex();
     bool needCheck();
     bool isSignal();
-    int waitSignal();
+    // setSignal() is called when FenceMonitor reports the fence,
+    // SIGNAL_TIME_INVALID means the fence is timeout or has an error
+    void setSignal(nsecs_t signal_time);
+    // setInvalid() gives up the fence which is not reported in time
+    void setInvalid();
     uint64_t getSingalTime();
     hwc2_config_t getActiveConfig();
 
 private:
 public:
     unsigned int m_index;
-    int m_fence_fd;
     bool m_invalid;
     bool m_is_signal;
     uint64_t m_signal_time;
@@ -152,10 +156,24 @@ public:
     void dump(String8* dump_str);
 
 private:
+    // PresentFenceListener forwards the signal of present fences from
+    // FenceMonitor, it is detached when ColorHistogram is destroyed
+    struct PresentFenceListener : public FenceMonitorListener {
+        explicit PresentFenceListener(ColorHistogram* owner) : m_owner(owner) {}
+        virtual void onFenceSignaled(unsigned int fence_idx, nsecs_t signal_time);
+        void detach();
+
+        std::mutex m_mutex;
+        ColorHistogram* m_owner;
+    };
+
     void gatherThread();
 
     void updateActiveBinNumber();
 
+    // onPresentFenceSignaled() updates the state of present fence index
+    void onPresentFenceSignaled(unsigned int index, nsecs_t signal_time);
+
 private:
     uint64_t m_disp_id;
     sp<IOverlayDevice> m_histogram;
@@ -187,6 +205,7 @@ private:
 
     // present fence info
     std::list<std::shared_ptr<FenceState> > m_pf_table;
+    sp<PresentFenceListener> m_pf_listener;
 
     // histogram data
     HistogramCollector m_collector;
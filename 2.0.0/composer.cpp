@@ -10,6 +10,7 @@
 #include "display.h"
 #include "overlay.h"
 #include "dispatcher.h"
+#include "frame_tracer.h"
 #include "worker.h"
 #include "platform_wrap.h"
 #include "hwc2.h"
@@ -47,6 +48,10 @@ void ComposerHandler::set(
     auto&& layers = display->getCommittedLayers();
     HWC_LOGV("+ ComposerHandler::set() commit_layers size:%zu", layers.size());
 
+    // all release fences of a frame signal when the next frame is on screen,
+    // so HWCFrameTracer only watches the first one
+    bool is_release_fence_traced = false;
+
     //DbgLogger logger(DbgLogger::TYPE_HWC_LOG, 'D', "(%d) ComposerHandler::set()", display->getId());
     for (uint32_t i = 0; i < total_num; i++)
     {
@@ -110,6 +115,12 @@ void ComposerHandler::set(
             }
             else
             {
+                if (!is_release_fence_traced && prepare_param.fence_fd >= 0)
+                {
+                    HWCFrameTracer::getInstance().watchFence(m_disp_id, job->sequence,
+                            HWC_FRAME_STAGE_RELEASE_FENCE, prepare_param.fence_fd);
+                    is_release_fence_traced = true;
+                }
                 layer->setReleaseFenceFd(prepare_param.fence_fd, display->isConnected());
             }
             // logger.printf(" [i:%u id:%" PRIu64 " ion_fd:%d rel_fence:%d is_ct:%d]",
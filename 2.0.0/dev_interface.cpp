@@ -15,6 +15,10 @@
 #include "drm/drmdev.h"
 #endif
 
+#ifdef MTK_HWC_USE_NULL_DEVICE
+#include "nulldev.h"
+#endif
+
 SessionInfo::SessionInfo()
     : maxLayerNum(0)
     , isHwVsyncAvailable(0)
@@ -36,7 +40,9 @@ SessionInfo::SessionInfo()
 
 unsigned int IOverlayDevice::getHwVersion()
 {
-#ifndef MTK_HWC_USE_DRM_DEVICE
+#ifdef MTK_HWC_USE_NULL_DEVICE
+    return NullDevice::getHwVersion();
+#elif !defined(MTK_HWC_USE_DRM_DEVICE)
     return DispDevice::getHwVersion();
 #else
     return DrmDevice::getHwVersion();
@@ -45,7 +51,9 @@ unsigned int IOverlayDevice::getHwVersion()
 
 IOverlayDevice* getHwDevice()
 {
-#ifndef MTK_HWC_USE_DRM_DEVICE
+#ifdef MTK_HWC_USE_NULL_DEVICE
+    return &NullDevice::getInstance();
+#elif !defined(MTK_HWC_USE_DRM_DEVICE)
     return &DispDevice::getInstance();
 #else
     return &DrmDevice::getInstance();
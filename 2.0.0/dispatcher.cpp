@@ -2,6 +2,7 @@
 #define ATRACE_TAG ATRACE_TAG_GRAPHICS
 
 #include <android-base/stringprintf.h>
+#include <algorithm>
 #include <sched.h>
 #include <string>
 
@@ -14,6 +15,8 @@
 #include "data_express.h"
 #include "dispatcher.h"
 #include "display.h"
+#include "frame_tracer.h"
+#include "hwc2_bench.h"
 #include "overlay.h"
 #include "queue.h"
 #include "sync.h"
@@ -35,6 +38,9 @@
 
 HWLayer::HWLayer()
 {
+    hdr_static_metadata_keys.reserve(HWC_HDR_STATIC_METADATA_RESERVE);
+    hdr_static_metadata_values.reserve(HWC_HDR_STATIC_METADATA_RESERVE);
+    hdr_dynamic_metadata.reserve(HWC_HDR_DYNAMIC_METADATA_RESERVE);
     resetData();
 }
 
@@ -67,6 +73,9 @@ void HWLayer::resetData()
     camera_preview_hdr = false;
     mdp_output_compressed = false;
     mdp_output_format = 0;
+    hdr_static_metadata_keys.clear();
+    hdr_static_metadata_values.clear();
+    hdr_dynamic_metadata.clear();
 }
 
 DispatcherJob::DispatcherJob(unsigned int max_ovl_inputs)
@@ -89,6 +98,7 @@ DispatcherJob::~DispatcherJob()
 
 void DispatcherJob::resetData()
 {
+    queue_state.store(HWC_JOB_QUEUE_STATE_NONE, std::memory_order_relaxed);
     enable = false;
     secure = false;
     mirrored = false;
@@ -153,7 +163,8 @@ void DispatcherJob::resetData()
     ovl_mc = FLT_MAX;
     ovl_mc_atomic_ratio = 1.f;
     ovl_wo_atomic_work_time = -1;
-    mc_info = nullptr;
+    mc_info = {};
+    mc_info.id = -1;
 
     aibld_enable = false;
 
@@ -183,6 +194,8 @@ HWCDispatcher::HWCDispatcher()
     for (uint32_t i = 0; i < DisplayManager::MAX_DISPLAYS; i++)
     {
         m_prev_createjob_time[i] = 0;
+        m_prev_job_vsync[i] = 0;
+        m_queued_jobs[i].reserve(HWC_DISPATCH_JOB_QUEUE_SIZE);
     }
 }
 
@@ -197,7 +210,25 @@ HWCDispatcher::~HWCDispatcher()
     }
 }
 
-int HWCDispatcher::getJob(uint64_t dpy)
+nsecs_t HWCDispatcher::predictNextVSync(uint64_t dpy, nsecs_t cur_time, nsecs_t refresh)
+{
+    nsecs_t next_vsync = -1;
+
+    // HWVSyncEstimator is fed by the present fences of primary display
+    if (dpy == HWC_DISPLAY_PRIMARY)
+    {
+        next_vsync = HWVSyncEstimator::getInstance().getNextHWVsync(cur_time);
+    }
+
+    if (next_vsync <= cur_time && m_workers[dpy].dp_thread != NULL)
+    {
+        next_vsync = m_workers[dpy].dp_thread->predictNextVSync(cur_time, refresh);
+    }
+
+    return next_vsync;
+}
+
+int HWCDispatcher::getJob(uint64_t dpy, nsecs_t sf_target_ts)
 {
 #ifndef MTK_USER_BUILD
     HWC_ATRACE_CALL();
@@ -213,13 +244,66 @@ int HWCDispatcher::getJob(uint64_t dpy)
         if (DisplayManager::getInstance().getDisplayData(dpy)->trigger_by_vsync && m_workers[dpy].enable)
         {
             const nsecs_t cur_time = systemTime();
-            bool should_drop_job = (cur_time - m_prev_createjob_time[dpy]) <
-                                   (DisplayManager::getInstance().getDisplayData(dpy)->refresh -
-                                    Platform::getInstance().m_config.tolerance_time_to_refresh);
-            if (should_drop_job || m_workers[dpy].dp_thread->getQueueSize() > 2)
+            const nsecs_t refresh = DisplayManager::getInstance().getDisplayData(dpy)->refresh;
+            size_t queue_size = m_workers[dpy].dp_thread->getQueueSize();
+            const nsecs_t next_vsync = predictNextVSync(dpy, cur_time, refresh);
+            bool should_drop_job = false;
+            nsecs_t job_vsync = 0;
+            if (next_vsync > 0 && refresh > 0)
+            {
+                // each queued job is presented at its own vsync before this one
+                job_vsync = next_vsync + static_cast<nsecs_t>(queue_size) * refresh;
+
+                // the vsync of the last admitted job was over-predicted, e.g.
+                // the refresh rate is changed, so it cannot be compared with
+                if (m_prev_job_vsync[dpy] - job_vsync >= refresh / 2)
+                {
+                    HWC_LOGD("(%" PRIu64 ") reset prev job vsync %" PRId64 " > %" PRId64,
+                             dpy, m_prev_job_vsync[dpy], job_vsync);
+                    m_prev_job_vsync[dpy] = 0;
+                }
+
+                // the last admitted job is presented at the same vsync, so this
+                // job could only replace its content
+                const bool vsync_taken = (job_vsync - m_prev_job_vsync[dpy]) < refresh / 2;
+
+                // the queued jobs push this job after the vsync expected by
+                // SurfaceFlinger, so it is stale when it is presented
+                const bool miss_target = queue_size > 0 && sf_target_ts > cur_time &&
+                                         (job_vsync - sf_target_ts) > refresh / 2;
+
+                // collapse the late jobs into this one, which has the newest
+                // content: the queued jobs give their vsyncs to it and are
+                // dropped by DispatchThread
+                if (vsync_taken || miss_target)
+                {
+                    const size_t superseded = supersedeQueuedJobsLocked(dpy, miss_target);
+                    job_vsync -= static_cast<nsecs_t>(superseded) * refresh;
+                    queue_size -= superseded;
+
+                    // the last job is taken by DispatchThread already, so this
+                    // one follows it
+                    if (superseded == 0 && vsync_taken)
+                    {
+                        job_vsync = m_prev_job_vsync[dpy] + refresh;
+                    }
+
+                    HWC_LOGD("(%" PRIu64 ") collapse %zu jobs: vsync %" PRId64 " prev %" PRId64
+                             " target %" PRId64 " queue %zu", dpy, superseded, job_vsync,
+                             m_prev_job_vsync[dpy], sf_target_ts, queue_size);
+                }
+            }
+            else
+            {
+                // no vsync phase, fall back to limit the rate of jobs with refresh
+                should_drop_job = (cur_time - m_prev_createjob_time[dpy]) <
+                                  (refresh - Platform::getInstance().m_config.tolerance_time_to_refresh);
+            }
+
+            if (should_drop_job || queue_size > 2)
             {
                 HWC_LOGD("Return null job, dpy(%" PRIu64 ") queue size(%zu)",
-                         dpy, m_workers[dpy].dp_thread->getQueueSize());
+                         dpy, queue_size);
                 m_curr_jobs[dpy] = job;
                 if (m_workers[dpy].idle_thread != NULL)
                 {
@@ -227,6 +311,11 @@ int HWCDispatcher::getJob(uint64_t dpy)
                 }
                 return HWC_DISPACHERJOB_INVALID_DROPJOB;
             }
+            // only an admitted job takes its vsync
+            if (job_vsync > 0)
+            {
+                m_prev_job_vsync[dpy] = job_vsync;
+            }
             m_prev_createjob_time[dpy] = cur_time;
         }
         if (!m_workers[dpy].enable)
@@ -324,15 +413,7 @@ bool HWCDispatcher::decideDirtyAndFlush(uint64_t dpy,
         hw_layer.dirty_reason |= HW_LAYER_DIRTY_HWC_LAYER_STATE;
     }
 
-    const WorkerCluster::PrevHwcLayer* prev_hwc_layer = nullptr;
-    for (const WorkerCluster::PrevHwcLayer& l : m_workers[dpy].prev_hwc_layers)
-    {
-        if (l.hwc2_layer_id == hwc2_layer_id)
-        {
-            prev_hwc_layer = &l;
-            break;
-        }
-    }
+    const WorkerCluster::PrevHwcLayer* prev_hwc_layer = m_workers[dpy].prev_hwc_layers.find(hwc2_layer_id);
 
     if (!prev_hwc_layer)
     {
@@ -390,38 +471,26 @@ void HWCDispatcher::fillPrevHwLayers(const sp<HWCDisplay>& display, DispatcherJo
     AutoMutex l(m_workers[disp_id].plug_lock_main);
     if (CC_UNLIKELY(!m_workers[disp_id].enable)) return;
 
-    bool already_in[job->num_layers];
-    memset(already_in, 0, sizeof(already_in));
-
     auto& prev_hwc_layers = m_workers[disp_id].prev_hwc_layers;
 
-    prev_hwc_layers.remove_if(
-        [&](WorkerCluster::PrevHwcLayer& l)
-        {
-            for (unsigned int i = 0; i < job->num_layers; ++i)
-            {
-                if (l.hwc2_layer_id == job->hw_layers[i].hwc2_layer_id)
-                {
-                    // update and don't remove
-                    l.update(job->hw_layers[i]);
-                    already_in[i] = true;
-                    return false;
-                }
-            }
-            return true;
-        });
-
-    // add not in list
+    // layers which are not in this job are expired with the last generation
+    prev_hwc_layers.nextGeneration();
     for (unsigned int i = 0; i < job->num_layers; ++i)
     {
-        if (already_in[i] || !job->hw_layers[i].enable)
+        if (!job->hw_layers[i].enable)
         {
             continue;
         }
 
-        WorkerCluster::PrevHwcLayer prev_hwc_layer(job->hw_layers[i].hwc2_layer_id);
-        prev_hwc_layer.update(job->hw_layers[i]);
-        prev_hwc_layers.push_back(prev_hwc_layer);
+        const uint64_t hwc2_layer_id = job->hw_layers[i].hwc2_layer_id;
+        WorkerCluster::PrevHwcLayer* prev_hwc_layer =
+            prev_hwc_layers.insert(hwc2_layer_id, WorkerCluster::PrevHwcLayer(hwc2_layer_id));
+        if (prev_hwc_layer == nullptr)
+        {
+            HWC_LOGW("(%" PRIu64 ") prev_hwc_layers is full, layer_id:%" PRIu64, disp_id, hwc2_layer_id);
+            continue;
+        }
+        prev_hwc_layer->update(job->hw_layers[i]);
     }
 }
 
@@ -596,6 +665,7 @@ void HWCDispatcher::setJob(const sp<HWCDisplay>& display)
 #ifndef MTK_USER_BUILD
     HWC_ATRACE_CALL();
 #endif
+    HWC_BENCH_STAGE(HWC_BENCH_STAGE_SET_JOB);
     const uint64_t dpy = display->getId();
 
     if (dpy >= DisplayManager::MAX_DISPLAYS)
@@ -722,6 +792,8 @@ void HWCDispatcher::setJob(const sp<HWCDisplay>& display)
             }
         }
 
+        HWCFrameTracer::getInstance().stamp(dpy, job->sequence, HWC_FRAME_STAGE_SET_JOB);
+
 #ifndef MTK_USER_BUILD
         HWC_ATRACE_JOB("set", dpy, job->fbt_exist, job->num_ui_layers, job->num_mm_layers, job->num_glai_layers);
 #endif
@@ -803,6 +875,16 @@ void HWCDispatcher::trigger(const hwc2_display_t& dpy)
             HWC_LOGW("(%" PRIu64 ") Jobs have piled up, wait for clearing!!", dpy);
         }
 
+        // drop the jobs taken by DispatchThread, so their references do not
+        // keep them out of the pool
+        auto& queued_jobs = m_queued_jobs[dpy];
+        queued_jobs.erase(std::remove_if(queued_jobs.begin(), queued_jobs.end(),
+            [](const sp<DispatcherJob>& queued_job) {
+                return queued_job->queue_state.load(std::memory_order_acquire) != HWC_JOB_QUEUE_STATE_QUEUED;
+            }), queued_jobs.end());
+        m_curr_jobs[dpy]->queue_state.store(HWC_JOB_QUEUE_STATE_QUEUED, std::memory_order_release);
+        queued_jobs.push_back(m_curr_jobs[dpy]);
+
         m_workers[dpy].dp_thread->trigger(m_curr_jobs[dpy]);
         m_curr_jobs[dpy] = NULL;
     }
@@ -815,8 +897,34 @@ void HWCDispatcher::trigger(const hwc2_display_t& dpy)
     }
 }
 
+size_t HWCDispatcher::supersedeQueuedJobsLocked(uint64_t dpy, bool is_all)
+{
+    size_t count = 0;
+    auto& queued_jobs = m_queued_jobs[dpy];
+    for (auto iter = queued_jobs.rbegin(); iter != queued_jobs.rend(); ++iter)
+    {
+        int state = HWC_JOB_QUEUE_STATE_QUEUED;
+        if ((*iter)->queue_state.compare_exchange_strong(state, HWC_JOB_QUEUE_STATE_SUPERSEDED,
+                                                         std::memory_order_acq_rel))
+        {
+            HWC_LOGD("(%" PRIu64 ") supersede job %" PRIu64, dpy, (*iter)->sequence);
+            ++count;
+            if (!is_all)
+                break;
+        }
+        else if (state == HWC_JOB_QUEUE_STATE_TAKEN)
+        {
+            // the older jobs are taken as well
+            break;
+        }
+    }
+    return count;
+}
+
 void HWCDispatcher::releaseResourceLocked(uint64_t dpy)
 {
+    m_queued_jobs[dpy].clear();
+
     // wait until all threads are idle
     if (m_workers[dpy].idle_thread != NULL)
     {
@@ -1146,6 +1254,11 @@ void HWCDispatcher::setPowerMode(uint64_t dpy, int mode)
             m_workers[dpy].ovl_engine->setPowerMode(mode);
         }
 
+        if (m_workers[dpy].dp_thread != NULL)
+        {
+            m_workers[dpy].dp_thread->resetSlackControl();
+        }
+
         if (HWC2_POWER_MODE_OFF == mode || HWC2_POWER_MODE_DOZE_SUSPEND == mode)
         {
             if (m_workers[dpy].composer != NULL) m_workers[dpy].composer->nullop();
@@ -1153,6 +1266,28 @@ void HWCDispatcher::setPowerMode(uint64_t dpy, int mode)
     }
 }
 
+void HWCDispatcher::onIdle(uint64_t dpy)
+{
+    if (HWC_DISPLAY_VIRTUAL <= dpy)
+        return;
+
+    // releaseResourceLocked() joins IdleThread with plug_lock_main held, so
+    // only try the lock. A busy lock means a new job is coming, and the
+    // display is not idle any more
+    if (m_workers[dpy].plug_lock_main.tryLock() != NO_ERROR)
+        return;
+
+    if (m_workers[dpy].dp_thread != NULL)
+    {
+        m_workers[dpy].dp_thread->resetSlackControl();
+    }
+    if (m_workers[dpy].ovl_engine != NULL)
+    {
+        m_workers[dpy].ovl_engine->resetSlackControl();
+    }
+    m_workers[dpy].plug_lock_main.unlock();
+}
+
 void HWCDispatcher::onVSync(uint64_t dpy)
 {
 #ifndef MTK_USER_BUILD
@@ -1196,6 +1331,14 @@ void HWCDispatcher::dump(String8 *dump_str)
 
         if (m_workers[dpy].enable)
         {
+            if (m_workers[dpy].dp_thread != NULL)
+            {
+                m_workers[dpy].dp_thread->dump(dump_str);
+            }
+            if (m_workers[dpy].m_job_pool != NULL)
+            {
+                m_workers[dpy].m_job_pool->dump(dump_str);
+            }
             m_workers[dpy].ovl_engine->dump(dump_str);
         }
     }
@@ -1340,7 +1483,9 @@ void HWCDispatcher::prepareMirror(const std::vector<sp<HWCDisplay> >& displays)
 
 DispatchThread::DispatchThread(uint64_t dpy)
     : m_disp_id(dpy)
+    , m_last_vsync_ts(0)
     , m_continue_skip(0)
+    , m_slack_controller("pd_", dpy)
 {
     m_thread_name = std::string("Dispatcher_") + std::to_string(dpy);
     m_queue_name = std::string("JobQueue_") + std::to_string(dpy);
@@ -1352,6 +1497,7 @@ DispatchThread::DispatchThread(uint64_t dpy)
     m_perf_target_cpu_mhz_str = std::string("pd_target_cpu_mhz_") + std::to_string(dpy);
     m_perf_uclamp_str = std::string("pd_uclamp_") + std::to_string(dpy);
     m_perf_extension_time_str = std::string("pd_extension_time_") + std::to_string(dpy);
+    m_frame_alloc_str = std::string("frame_alloc_") + std::to_string(dpy);
 }
 
 void DispatchThread::onFirstRef()
@@ -1365,15 +1511,31 @@ void DispatchThread::trigger(sp<DispatcherJob> job)
     HWC_ATRACE_NAME("dispatcher_set");
 #endif
 
-    AutoMutex l(m_lock);
-
     if (job != NULL)
     {
-        m_job_queue.push_back(job);
+        if (!m_job_queue.push(std::move(job)))
+        {
+            HWC_LOGW("(%" PRIu64 ") job queue is full, wait for clearing", m_disp_id);
+            {
+                AutoMutex l(m_lock);
+                m_state = HWC_THREAD_TRIGGER;
+            }
+            sem_post(&m_event);
+            wait();
+            if (!m_job_queue.push(std::move(job)))
+            {
+                LOG_FATAL("%s(), job queue is still full", __FUNCTION__);
+            }
+        }
         HWC_ATRACE_INT(m_queue_name.c_str(), static_cast<int32_t>(m_job_queue.size()));
     }
 
-    m_state = HWC_THREAD_TRIGGER;
+    // m_lock only guards the state with threadLoop() going idle, and it is
+    // never held while a job is handled
+    {
+        AutoMutex l(m_lock);
+        m_state = HWC_THREAD_TRIGGER;
+    }
     sem_post(&m_event);
 }
 
@@ -1393,52 +1555,79 @@ bool DispatchThread::dropJob()
     if (res)
     {
         sp<DispatcherJob> job = NULL;
+        if (!m_job_queue.pop(&job))
         {
-            AutoMutex l(m_lock);
-            Fifo::iterator front(m_job_queue.begin());
-            if (front)
-            {
-                job = *front;
-                m_job_queue.erase(front);
-                HWC_ATRACE_INT(m_queue_name.c_str(), static_cast<int32_t>(m_job_queue.size()));
-            }
-            else
-            {
-                LOG_FATAL("%s(), front invalid", __FUNCTION__);
-                return false;
-            }
+            LOG_FATAL("%s(), front invalid", __FUNCTION__);
+            return false;
         }
+        HWC_ATRACE_INT(m_queue_name.c_str(), static_cast<int32_t>(m_job_queue.size()));
         HWC_LOGD("(%" PRIu64 ") Drop a job %" PRIu64, m_disp_id, job->sequence);
+        discardJob(job);
+    }
 
-        if (job->enable)
+    return res;
+}
+
+void DispatchThread::discardJob(const sp<DispatcherJob>& job)
+{
+    HWCDispatcher::WorkerCluster& worker(
+                HWCDispatcher::getInstance().m_workers[m_disp_id]);
+
+    if (job->enable)
+    {
+        AutoMutex l(worker.plug_lock_loop);
+        if (job->num_mm_layers || job->num_ui_layers || job->num_glai_layers)
         {
-            AutoMutex l(worker.plug_lock_loop);
-            if (job->num_mm_layers || job->num_ui_layers || job->num_glai_layers)
+            if (worker.composer != NULL)
             {
-                if (worker.composer != NULL)
-                {
-                    worker.composer->cancelLayers(job.get());
-                }
-                else
-                {
-                    HWC_LOGE("No LayerComposer");
-                }
+                worker.composer->cancelLayers(job.get());
+            }
+            else
+            {
+                HWC_LOGE("No LayerComposer");
             }
         }
-        clearUsedJob(job.get());
     }
-
-    return res;
+    clearUsedJob(job.get());
 }
 
 size_t DispatchThread::getQueueSize()
 {
-    AutoMutex l(m_lock);
     return m_job_queue.size();
 }
 
+void DispatchThread::dump(String8* dump_str)
+{
+    dump_str->appendFormat("  %s size:%zu/%zu max:%zu pushed:%" PRIu64 " full:%" PRIu64 "\n",
+                           m_queue_name.c_str(), m_job_queue.size(), m_job_queue.capacity(),
+                           m_job_queue.getMaxDepth(), m_job_queue.getPushCount(),
+                           m_job_queue.getFullCount());
+    dump_str->appendFormat("  %s last:%" PRIu64 " jobs_with_alloc:%" PRIu64 " total:%" PRIu64 "\n",
+                           m_frame_alloc_str.c_str(), m_job_frame_alloc, m_alloc_job_count,
+                           getFrameAllocCount());
+    m_slack_controller.dump(dump_str);
+}
+
+nsecs_t DispatchThread::predictNextVSync(nsecs_t cur_time, nsecs_t refresh) const
+{
+    // vsync is only requested when there are jobs, so the phase drifts away
+    // after the display is idle for a while
+    const nsecs_t VSYNC_PHASE_VALID_PERIODS = 8;
+
+    const nsecs_t last_vsync = m_last_vsync_ts.load(std::memory_order_relaxed);
+    if (last_vsync <= 0 || refresh <= 0 || cur_time < last_vsync ||
+        cur_time - last_vsync > refresh * VSYNC_PHASE_VALID_PERIODS)
+    {
+        return -1;
+    }
+
+    return last_vsync + ((cur_time - last_vsync) / refresh + 1) * refresh;
+}
+
 void DispatchThread::calculatePerf(DispatcherJob* job)
 {
+    m_perf_deadline = -1;
+
     if (!job)
     {
         return;
@@ -1474,7 +1663,11 @@ void DispatchThread::calculatePerf(DispatcherJob* job)
     }
 
     // get million cpu cycle needed
-    const HwcMCycleInfo& info = job->mc_info ? *job->mc_info : getScenarioMCInfo(job);
+    if (job->mc_info.id < 0)
+    {
+        job->mc_info = getScenarioMCInfo(job);
+    }
+    const HwcMCycleInfo& info = job->mc_info;
     float dispatcher_mc = info.dispatcher_mc;
     job->ovl_mc = info.ovl_mc;
     job->ovl_mc_atomic_ratio = info.ovl_mc_atomic_ratio;
@@ -1503,7 +1696,8 @@ void DispatchThread::calculatePerf(DispatcherJob* job)
 
     remain_time = std::min(remain_time, info.dispatcher_target_work_time);
 
-    uint32_t target_cpu_mhz = calculateCpuMHz(dispatcher_mc, remain_time);
+    uint32_t target_cpu_mhz = m_slack_controller.adjust(calculateCpuMHz(dispatcher_mc, remain_time));
+    m_perf_deadline = cur_time + remain_time;
 
     dispatcher_uclamp = cpuMHzToUClamp(target_cpu_mhz).uclamp;
 
@@ -1529,13 +1723,10 @@ bool DispatchThread::threadLoop()
     {
         sp<DispatcherJob> job = NULL;
 
+        if (m_job_queue.empty())
         {
-            AutoMutex l(m_lock);
-            if (m_job_queue.empty())
-            {
-                HWC_LOGV("(%" PRIu64 ") Job is empty...", m_disp_id);
-                break;
-            }
+            HWC_LOGV("(%" PRIu64 ") Job is empty...", m_disp_id);
+            break;
         }
 
 #ifndef MTK_USER_BUILD
@@ -1547,24 +1738,31 @@ bool DispatchThread::threadLoop()
             continue;
         }
 
+        if (!m_job_queue.pop(&job))
+        {
+            LOG_FATAL("%s(), front invalid", __FUNCTION__);
+            continue;
+        }
+
+        // a job queued by HWCDispatcher is QUEUED, and it may have been
+        // superseded by a newer job before it is taken here
+        int queue_state = HWC_JOB_QUEUE_STATE_QUEUED;
+        if (!job->queue_state.compare_exchange_strong(queue_state, HWC_JOB_QUEUE_STATE_TAKEN,
+                                                      std::memory_order_acq_rel) &&
+            queue_state == HWC_JOB_QUEUE_STATE_SUPERSEDED)
         {
-            AutoMutex l(m_lock);
-            Fifo::iterator front(m_job_queue.begin());
-            if (front)
-            {
-                job = *front;
-            }
-            else
-            {
-                LOG_FATAL("%s(), front invalid", __FUNCTION__);
-                continue;
-            }
-            m_job_queue.erase(front);
             HWC_ATRACE_INT(m_queue_name.c_str(), static_cast<int32_t>(m_job_queue.size()));
+            HWC_LOGD("(%" PRIu64 ") Drop superseded job %" PRIu64, m_disp_id, job->sequence);
+            discardJob(job);
+            continue;
         }
+        FrameAllocScope alloc_scope;
+        HWC_ATRACE_INT(m_queue_name.c_str(), static_cast<int32_t>(m_job_queue.size()));
+        HWCFrameTracer::getInstance().stamp(m_disp_id, job->sequence, HWC_FRAME_STAGE_DISPATCH);
 
         calculatePerf(job.get());
         updateCpuSet(m_tid, job.get());
+        const uint64_t start_cycles = m_cycle_counter.read();
 
         // handle jobs
         // 1. set synchronization between composer threads
@@ -1572,6 +1770,7 @@ bool DispatchThread::threadLoop()
         // 3. wait until the composition of ui/mm threads is done
         // 4. clear used job
         {
+            HWC_BENCH_STAGE(HWC_BENCH_STAGE_DISPATCH);
             HWCDispatcher::WorkerCluster& worker(
                 HWCDispatcher::getInstance().m_workers[m_disp_id]);
 
@@ -1628,12 +1827,33 @@ bool DispatchThread::threadLoop()
             }
 #endif
 
+            if (m_perf_deadline > 0)
+            {
+                m_slack_controller.update(m_perf_deadline - systemTime(), job->disp_data->refresh);
+            }
+
+            HWCMCycleModel::getInstance().addDispatcherSample(job->mc_info.id,
+                                                              m_cycle_counter.read() - start_cycles);
+
             // clear used job
             clearUsedJob(job.get());
         }
+
+        // the counter is shared by all threads in FrameAllocScope, so the
+        // allocations of validate and present may also be sampled here
+        const uint64_t frame_alloc_count = getFrameAllocCount();
+        m_job_frame_alloc = frame_alloc_count - m_last_frame_alloc_count;
+        m_last_frame_alloc_count = frame_alloc_count;
+        if (m_job_frame_alloc > 0)
+        {
+            m_alloc_job_count++;
+        }
+        HWC_ATRACE_INT(m_frame_alloc_str.c_str(), static_cast<int32_t>(m_job_frame_alloc));
     }
 
     {
+        // trigger() pushes the job before it takes m_lock to set the state,
+        // so a job queued after this check always turns the state back
         AutoMutex l(m_lock);
         if (m_job_queue.empty())
         {
@@ -1678,6 +1898,8 @@ void DispatchThread::onVSync()
     HWC_ATRACE_CALL();
 #endif
 
+    m_last_vsync_ts.store(systemTime(), std::memory_order_relaxed);
+
     AutoMutex l(m_vsync_lock);
     m_vsync_cond.signal();
 
@@ -1827,13 +2049,13 @@ void HWCDispatcher::PhyPostHandler::set(
             Platform::getInstance().m_config.is_support_mdp_pmqos) {
             if (prepare_param.is_sf_fence_support)
             {
-                HWVSyncEstimator::getInstance().pushPresentFence(
-                    prepare_param.sf_fence_fd >= 0 ? ::dup(prepare_param.sf_fence_fd): -1, job->disp_data->refresh);
+                HWVSyncEstimator::getInstance().pushPresentFence(prepare_param.sf_fence_fd,
+                                                                 job->disp_data->refresh);
             }
             else
             {
-                HWVSyncEstimator::getInstance().pushPresentFence(
-                    m_curr_present_fence_fd >= 0 ? ::dup(m_curr_present_fence_fd): -1, job->disp_data->refresh);
+                HWVSyncEstimator::getInstance().pushPresentFence(m_curr_present_fence_fd,
+                                                                 job->disp_data->refresh);
             }
         }
 
@@ -1873,6 +2095,9 @@ void HWCDispatcher::PhyPostHandler::set(
             }
         }
 
+        HWCFrameTracer::getInstance().watchFence(m_disp_id, job->sequence, HWC_FRAME_STAGE_PRESENT_FENCE,
+                prepare_param.is_sf_fence_support ? prepare_param.sf_fence_fd : prepare_param.fence_fd);
+
         if (prepare_param.is_sf_fence_support)
         {
             display->setRetireFenceFd(prepare_param.sf_fence_fd, display->isConnected());
@@ -2188,6 +2413,8 @@ void HWCDispatcher::VirPostHandler::set(
             }
         }
 
+        HWCFrameTracer::getInstance().watchFence(m_disp_id, job->sequence, HWC_FRAME_STAGE_PRESENT_FENCE,
+                                                 prepare_param.fence_fd);
         display->setRetireFenceFd(prepare_param.fence_fd, display->isConnected());
 
         DbgLogger* logger = &Debugger::getInstance().m_logger->set_info[static_cast<size_t>(job->disp_ori_id)];
@@ -1,12 +1,15 @@
 #ifndef HWC_DISPATCHER_H_
 #define HWC_DISPATCHER_H_
 
+#include <atomic>
 #include <bitset>
 #include <vector>
 #include <utils/threads.h>
 #include <utils/SortedVector.h>
 
 #include "hwc_priv.h"
+#include "mcycle_model.h"
+#include "slack_controller.h"
 
 #include "utils/tools.h"
 
@@ -19,7 +22,9 @@
 #include "overlay.h"
 #include "queue.h"
 #include "vsync_listener.h"
+#include <hwc_common/flat_map.h>
 #include <hwc_common/pool.h>
+#include <hwc_common/ring.h>
 
 using namespace android;
 
@@ -31,6 +36,10 @@ class DisplayBufferQueue;
 class OverlayEngine;
 // ---------------------------------------------------------------------------
 
+// HWC_PREV_HWC_LAYER_MAP_SIZE is the capacity of WorkerCluster::prev_hwc_layers,
+// it should be at least twice of the overlay inputs of a display
+#define HWC_PREV_HWC_LAYER_MAP_SIZE 64
+
 // HWLayer::type values
 enum {
     HWC_LAYER_TYPE_INVALID      = 0,
@@ -204,6 +213,11 @@ struct LayerListInfo
     uint32_t hrt_idx;
 };
 
+// capacity reserved for HDR metadata of HWLayer, the buffers are reused by
+// every frame so metadata within these sizes does not allocate memory
+#define HWC_HDR_STATIC_METADATA_RESERVE 16
+#define HWC_HDR_DYNAMIC_METADATA_RESERVE 1024
+
 // HWLayer is used to store information of layers selected
 // to be processed by hardware composer
 struct HWLayer
@@ -310,7 +324,7 @@ struct HWLayer
     bool mdp_output_compressed;
     uint32_t mdp_output_format;
 
-    // HDR metadata
+    // HDR metadata, resetData() keeps the capacity of them
     std::vector<int32_t> hdr_static_metadata_keys;
     std::vector<float> hdr_static_metadata_values;
     std::vector<uint8_t> hdr_dynamic_metadata;
@@ -436,6 +450,21 @@ struct MdpJob
 };
 
 // DispatcherJob is a display job unit and is used by DispatchThread
+enum HWC_JOB_QUEUE_STATE
+{
+    // the job is not in the queue of DispatchThread
+    HWC_JOB_QUEUE_STATE_NONE = 0,
+
+    // the job is queued and can still be superseded by a newer job
+    HWC_JOB_QUEUE_STATE_QUEUED,
+
+    // DispatchThread has taken the job
+    HWC_JOB_QUEUE_STATE_TAKEN,
+
+    // a newer job takes the vsync of this one, DispatchThread drops it
+    HWC_JOB_QUEUE_STATE_SUPERSEDED,
+};
+
 class DispatcherJob : public LightPoolBase<DispatcherJob>
 {
 public:
@@ -501,6 +530,10 @@ public:
     // used as a sequence number for profiling latency purpose
     uint64_t sequence;
 
+    // HWC_JOB_QUEUE_STATE, it is moved from QUEUED by a compare and swap, so
+    // either DispatchThread takes the job or HWCDispatcher supersedes it
+    std::atomic<int> queue_state;
+
     // used for video frame
     unsigned int timestamp;
 
@@ -582,7 +615,9 @@ public:
     float ovl_mc_atomic_ratio;
     nsecs_t ovl_wo_atomic_work_time;
 
-    const HwcMCycleInfo* mc_info;
+    // cycles of scenario, it is copied since the learned values of
+    // HWCMCycleModel are updated while the job is handled. id < 0 means unset
+    HwcMCycleInfo mc_info;
 
     bool aibld_enable;
 
@@ -605,6 +640,10 @@ public:
     // setPowerMode() is used to wait display thread idle when display changes power mode
     void setPowerMode(uint64_t dpy, int mode);
 
+    // onIdle() is called when the display enters idle, the slack of the
+    // frames before idle does not tell the load after it
+    void onIdle(uint64_t dpy);
+
     // onVSync() is used to receive vsync signal
     void onVSync(uint64_t dpy);
 
@@ -622,8 +661,11 @@ public:
     void configMirrorJob(DispatcherJob* job);
     void configMirrorOutput(DispatcherJob* job, const int& display_color_mode);
 
-    // getJob() is used for HWCMediator to get a new job for filling in
-    int getJob(uint64_t dpy);
+    // getJob() is used for HWCMediator to get a new job for filling in.
+    // If the display is triggered by vsync, the job is only admitted when it
+    // gets a vsync of its own and can still meet sf_target_ts, otherwise it
+    // is dropped and its content is presented by the next job
+    int getJob(uint64_t dpy, nsecs_t sf_target_ts = -1);
 
     // getExistJob() is used for HWCMediator to get an exist job for re-filling
     DispatcherJob* getExistJob(uint64_t dpy);
@@ -857,7 +899,7 @@ private:
             bool is_ai_pq;
             bool is_camera_preview_hdr;
 
-            PrevHwcLayer(uint64_t id)
+            PrevHwcLayer(uint64_t id = 0)
                 : hwc2_layer_id(id)
                 , pool_id(-1)
                 , layer_caps(0)
@@ -873,7 +915,10 @@ private:
 
             void update(const HWLayer& hw_layers);
         };
-        std::list<PrevHwcLayer> prev_hwc_layers;
+
+        // prev_hwc_layers is indexed by hwc2_layer_id and holds the layers of
+        // last job, fillPrevHwLayers() starts a new generation for each job
+        GenerationMap<PrevHwcLayer, HWC_PREV_HWC_LAYER_MAP_SIZE> prev_hwc_layers;
     };
 
     // m_workers is the WorkerCluster array used by different display composition.
@@ -890,10 +935,34 @@ public:
     void fillPrevHwLayers(const sp<HWCDisplay>& display, DispatcherJob* job);
 
     nsecs_t m_prev_createjob_time[DisplayManager::MAX_DISPLAYS];
+
+private:
+    // predictNextVSync() returns the predicted timestamp of next HW vsync of
+    // display, or -1 if there is no reliable vsync phase
+    nsecs_t predictNextVSync(uint64_t dpy, nsecs_t cur_time, nsecs_t refresh);
+
+    // m_prev_job_vsync is the vsync which the last admitted job is expected
+    // to be presented at
+    nsecs_t m_prev_job_vsync[DisplayManager::MAX_DISPLAYS];
+
+    // supersedeQueuedJobsLocked() marks the queued jobs which are not taken by
+    // DispatchThread yet as superseded, from the newest one, and returns the
+    // number of them. Only the newest one is marked if is_all is false
+    size_t supersedeQueuedJobsLocked(uint64_t dpy, bool is_all);
+
+    // m_queued_jobs keeps the jobs pushed to DispatchThread until it takes
+    // them, so a late job can be collapsed into the newest one. It is
+    // protected by plug_lock_main
+    std::vector<sp<DispatcherJob> > m_queued_jobs[DisplayManager::MAX_DISPLAYS];
 };
 
 // DispatchThread handles DispatcherJobs
 // from UILayerComposer and MMLayerComposer
+// HWC_DISPATCH_JOB_QUEUE_SIZE is the capacity of job queue of DispatchThread.
+// HWCDispatcher::trigger() waits when more than 5 jobs are queued, so the
+// queue should never be full
+#define HWC_DISPATCH_JOB_QUEUE_SIZE 16
+
 class DispatchThread : public HWCThread,
                        public HWCVSyncListener
 {
@@ -904,8 +973,20 @@ public:
     // then triggers DispatchThread
     void trigger(sp<DispatcherJob> job);
 
+    // getQueueSize() does not take any lock, so it can be called by
+    // SurfaceFlinger thread without waiting for DispatchThread
     size_t getQueueSize();
 
+    // dump() shows the counters of job queue
+    void dump(String8* dump_str);
+
+    // predictNextVSync() extrapolates the next vsync from the last vsync
+    // received by DispatchThread, it returns -1 if the phase is too old
+    nsecs_t predictNextVSync(nsecs_t cur_time, nsecs_t refresh) const;
+
+    // resetSlackControl() drops the correction of m_slack_controller
+    void resetSlackControl() { m_slack_controller.reset(); }
+
 private:
     virtual void onFirstRef();
     virtual bool threadLoop();
@@ -921,6 +1002,9 @@ private:
     // implementation of drop job
     bool dropJob();
 
+    // discardJob() releases a popped job without handling it
+    void discardJob(const sp<DispatcherJob>& job);
+
     void clearUsedJob(DispatcherJob* job);
 
     void calculatePerf(DispatcherJob* job);
@@ -932,15 +1016,21 @@ private:
     // DispatchThread needs to handle
     uint64_t m_disp_id;
 
-    // m_job_queue is a job queue
-    // which new job would be queued in set()
-    typedef Vector<sp<DispatcherJob>> Fifo;
+    // m_job_queue is a job queue which new job would be queued in trigger().
+    // trigger() is always called with WorkerCluster::plug_lock_main held, so
+    // there is only one producer at a time, and DispatchThread is the only
+    // consumer
+    typedef SpscRing<sp<DispatcherJob>, HWC_DISPATCH_JOB_QUEUE_SIZE> Fifo;
     Fifo m_job_queue;
 
     // access must be protected by m_vsync_lock
     mutable Mutex m_vsync_lock;
     Condition m_vsync_cond;
 
+    // m_last_vsync_ts is the time of the last onVSync(), it is read by
+    // SurfaceFlinger thread without any lock
+    std::atomic<nsecs_t> m_last_vsync_ts;
+
     // To record skiping times of trigger() when trigger_by_vsync is enabled
     // This is useful to detecting whether the VSync source is fine or not.
     int32_t m_continue_skip;
@@ -959,6 +1049,21 @@ private:
 
     // store the last cpu set from DispatcherJob
     unsigned int m_cpu_set = HWC_CPUSET_NONE;
+
+    // m_cycle_counter measures the cycles of each job for HWCMCycleModel
+    HWCCycleCounter m_cycle_counter;
+
+    // m_slack_controller corrects the uclamp with the slack of each job,
+    // m_perf_deadline is the end of the work time planned by calculatePerf()
+    HWCSlackController m_slack_controller;
+    nsecs_t m_perf_deadline = -1;
+
+    // operator new calls on the frame path counted by FrameAllocScope, they
+    // are sampled after each job and should be zero in the steady state
+    std::string m_frame_alloc_str;
+    uint64_t m_last_frame_alloc_count = 0;
+    uint64_t m_job_frame_alloc = 0;
+    uint64_t m_alloc_job_count = 0;
 };
 
 #endif // HWC_DISPATCHER_H_
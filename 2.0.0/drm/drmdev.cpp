@@ -11,6 +11,7 @@
 #include <string>
 
 #include <fcntl.h>
+#include <sys/resource.h>
 #include <sys/ioctl.h>
 
 #include <linux/fb.h>
@@ -131,6 +132,22 @@
 
 #define AFBC_COMPRESSION_NAME "arm.graphics.Compression"
 #define PVRIC_COMPRESSION_NAME "android.hardware.graphics.common.Compression"
+
+// the max number of layer caches of a display, the least recently used one
+// is evicted when a new layer comes
+#define FB_CACHE_MAX_LAYER_NUM 64
+
+// the trash cleaner removes fb_id for at most TRASH_CLEAN_BUDGET_NS after a
+// commit, and it also runs if no commit comes in TRASH_IDLE_TIMEOUT_NS
+#define TRASH_CLEAN_BUDGET_NS 2000000
+#define TRASH_IDLE_TIMEOUT_NS 50000000
+
+// the trash cleaner runs at TRASH_CLEANER_NICE, and it is boosted to the
+// default nice value without the budget if more fb_id than
+// TRASH_BACKLOG_LIMIT are waiting, until half of them are removed
+#define TRASH_CLEANER_NICE 10
+#define TRASH_BACKLOG_LIMIT 256
+
 // ---------------------------------------------------------------------------
 
 #define DLOGD(i, x, ...) HWC_LOGD("(%" PRIu64 ") " x " id:%x", i, ##__VA_ARGS__, m_frame_cfg[i].session_id)
@@ -359,6 +376,7 @@ DrmDevice::FbCacheInfo::FbCacheInfo(const OverlayPortParam* param)
     , count(0)
     , last_alloc_id(static_cast<uint64_t>(-1))
     , last_buf_update(systemTime(CLOCK_MONOTONIC))
+    , used_at_frame(0)
 {
 }
 
@@ -393,6 +411,47 @@ void DrmDevice::FbCacheInfo::updateParam(const OverlayPortParam* param)
     secure = param->secure;
 }
 
+DrmDevice::FbCacheEntry* DrmDevice::FbCacheInfo::findEntry(uint64_t alloc_id, unsigned int format)
+{
+    auto index = m_entry_index.find(alloc_id);
+    if (index == m_entry_index.end() || index->second->format != format)
+    {
+        return nullptr;
+    }
+    return &(*index->second);
+}
+
+void DrmDevice::FbCacheInfo::addEntry(const FbCacheEntry& entry)
+{
+    fb_caches.push_back(entry);
+    m_entry_index[entry.alloc_id] = std::prev(fb_caches.end());
+}
+
+void DrmDevice::FbCacheInfo::replaceLastEntry(const FbCacheEntry& entry)
+{
+    auto last = std::prev(fb_caches.end());
+    eraseEntryIndex(last);
+    *last = entry;
+    m_entry_index[entry.alloc_id] = last;
+}
+
+void DrmDevice::FbCacheInfo::clearEntries()
+{
+    fb_caches.clear();
+    m_entry_index.clear();
+}
+
+void DrmDevice::FbCacheInfo::eraseEntryIndex(std::list<FbCacheEntry>::iterator it)
+{
+    // an alloc_id may have an older entry with another format, which is not
+    // indexed, so only the indexed one clears the index
+    auto index = m_entry_index.find(it->alloc_id);
+    if (index != m_entry_index.end() && index->second == it)
+    {
+        m_entry_index.erase(index);
+    }
+}
+
 void DrmDevice::FbCache::moveFbCachesToRemove(FbCacheEntry& entry)
 {
     fb_caches_pending_remove.push_back(entry);
@@ -407,7 +466,7 @@ void DrmDevice::FbCache::moveFbCachesToRemove(FbCacheInfo* cache)
     fb_caches_pending_remove.insert(fb_caches_pending_remove.end(),
                                     cache->fb_caches.begin(),
                                     cache->fb_caches.end());
-    cache->fb_caches.clear();
+    cache->clearEntries();
 }
 
 void DrmDevice::FbCache::moveFbCachesToRemoveExcept(FbCacheInfo* cache, uint32_t fb_id)
@@ -416,7 +475,7 @@ void DrmDevice::FbCache::moveFbCachesToRemoveExcept(FbCacheInfo* cache, uint32_t
     {
         return;
     }
-    cache->fb_caches.remove_if(
+    cache->removeEntriesIf(
         [&](FbCacheEntry& entry)
         {
             if (entry.fb_id != fb_id)
@@ -430,14 +489,45 @@ void DrmDevice::FbCache::moveFbCachesToRemoveExcept(FbCacheInfo* cache, uint32_t
 
 DrmDevice::FbCacheInfo* DrmDevice::FbCache::getLayerCacheForId(uint64_t id)
 {
-    for (FbCacheInfo& cache : layer_caches)
+    auto index = layer_cache_index.find(id);
+    if (index == layer_cache_index.end())
+    {
+        return nullptr;
+    }
+    return &(*index->second);
+}
+
+DrmDevice::FbCacheInfo* DrmDevice::FbCache::addLayerCache(const OverlayPortParam* param)
+{
+    if (layer_caches.size() >= FB_CACHE_MAX_LAYER_NUM)
     {
-        if (cache.id == id)
+        auto lru = layer_caches.end();
+        for (auto it = layer_caches.begin(); it != layer_caches.end(); ++it)
         {
-            return &cache;
+            // the layers of this frame are never evicted
+            if (it->used_at_frame != frame_count &&
+                (lru == layer_caches.end() || it->used_at_frame < lru->used_at_frame))
+            {
+                lru = it;
+            }
+        }
+
+        if (lru != layer_caches.end())
+        {
+            HWC_LOGV("%s(), evict hwc_layer_id %" PRIu64 ", size %zu",
+                     __FUNCTION__, lru->id, lru->fb_caches.size());
+            evict_count += lru->fb_caches.size();
+            moveFbCachesToRemove(&(*lru));
+            layer_cache_index.erase(lru->id);
+            layer_caches.erase(lru);
         }
     }
-    return nullptr;
+
+    layer_caches.emplace_back(param);
+    auto it = std::prev(layer_caches.end());
+    it->used_at_frame = frame_count;
+    layer_cache_index[it->id] = it;
+    return &(*it);
 }
 
 void DrmDevice::FbCache::dump(String8* str)
@@ -447,6 +537,8 @@ void DrmDevice::FbCache::dump(String8* str)
         return;
     }
 
+    str->appendFormat("layers %zu, hit %" PRIu64 ", miss %" PRIu64 ", evict %" PRIu64 "\n",
+                      layer_caches.size(), hit_count, miss_count, evict_count);
     for (FbCacheInfo& cache : layer_caches)
     {
         for (FbCacheEntry& entry : cache.fb_caches)
@@ -494,11 +586,6 @@ DrmDevice::DrmDevice()
         }
     }
 
-    for (unsigned int i = 0; i < DisplayManager::MAX_DISPLAYS; i++)
-    {
-        m_prev_commit_color_transform[i] = 0;
-    }
-
     queryCapsInfo();
 
     getMSyncDefaultParamTableInternal();
@@ -522,12 +609,18 @@ DrmDevice::~DrmDevice()
 
     removeFbCacheAllDisplay();
 
+    for (unsigned int i = 0; i < DisplayManager::MAX_DISPLAYS; i++)
+    {
+        removeColorBlobCache(i);
+    }
+
     {
         std::lock_guard<std::mutex> lock(m_trash_mutex);
         m_trash_cleaner_thread_stop = true;
         m_condition.notify_all();
     }
     m_trash_cleaner_thread.join();
+    m_trash_head = nullptr;
 }
 
 void DrmDevice::initOverlay()
@@ -772,6 +865,7 @@ void DrmDevice::destroyOverlaySession(uint64_t dpy)
     }
 
     removeFbCacheDisplay(dpy);
+    removeColorBlobCache(dpy);
 
     DLOGD(dpy, "Destroy DispSession");
 }
@@ -805,6 +899,12 @@ status_t DrmDevice::triggerOverlaySession(uint64_t dpy, int present_fence_idx, i
 
     DbgLogger logger(DbgLogger::TYPE_HWC_LOG, 'D', "(%" PRIu64 ") drmModeAtomicCommit: ", dpy);
     uint32_t blob_color_transform = 0;
+
+    // the virtual display waits for its output buffer, so it is always committed
+    // synchronously
+    bool is_nonblock = Platform::getInstance().m_config.drm_nonblock_commit &&
+                       dpy != HWC_DISPLAY_VIRTUAL;
+    bool is_blocking_committed = false;
     if (m_atomic_req[dpy] != nullptr)
     {
         uint32_t flags = DRM_MODE_ATOMIC_ALLOW_MODESET;
@@ -834,23 +934,23 @@ status_t DrmDevice::triggerOverlaySession(uint64_t dpy, int present_fence_idx, i
 
         if (dpy != HWC_DISPLAY_VIRTUAL)
         {
-            ret |= crtc->addProperty(m_atomic_req[dpy], DRM_PROP_CRTC_DISP_MODE_IDX, config) < 0;
+            ret |= crtc->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_CRTC_DISP_MODE_IDX, config) < 0;
             //HRT index is zero, that means HWC want to disable all plane, need to hint driver this behavior
             if (hrt_idx == 0)
             {
-                ret |= crtc->addProperty(m_atomic_req[dpy], DRM_PROP_CRTC_USER_SCEN, 1) < 0;
+                ret |= crtc->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_CRTC_USER_SCEN, 1) < 0;
             }
             else
             {
-                ret |= crtc->addProperty(m_atomic_req[dpy], DRM_PROP_CRTC_USER_SCEN, 0) < 0;
+                ret |= crtc->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_CRTC_USER_SCEN, 0) < 0;
             }
 
             if (m_caps_info.disp_feature_flag & DRM_DISP_FEATURE_MSYNC2_0)
             {
                 updateMSyncEnable(dpy, trigger_param.package, trigger_param.late_package);
-                ret |= crtc->addProperty(m_atomic_req[dpy],
-                                         DRM_PROP_CRTC_MSYNC_2_0_ENABLE,
-                                         static_cast<uint64_t>(m_msync2_enable[dpy])) < 0;
+                ret |= crtc->addPropertyIfChanged(m_atomic_req[dpy],
+                                                  DRM_PROP_CRTC_MSYNC_2_0_ENABLE,
+                                                  static_cast<uint64_t>(m_msync2_enable[dpy])) < 0;
                 updateMSyncParamTable(dpy, trigger_param.package, trigger_param.late_package);
             }
         }
@@ -858,7 +958,7 @@ status_t DrmDevice::triggerOverlaySession(uint64_t dpy, int present_fence_idx, i
 #ifdef MTK_IN_DISPLAY_FINGERPRINT
         if (dpy == HWC_DISPLAY_PRIMARY)
         {
-            ret |= crtc->addProperty(m_atomic_req[dpy], DRM_PROP_CRTC_HBM_ENABLE, trigger_param.is_HBM) < 0;
+            ret |= crtc->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_CRTC_HBM_ENABLE, trigger_param.is_HBM) < 0;
             logger.printf("is_hbm:%d ", trigger_param.is_HBM);
         }
 #endif
@@ -866,8 +966,8 @@ status_t DrmDevice::triggerOverlaySession(uint64_t dpy, int present_fence_idx, i
 #ifdef MTK_HDR_SET_DISPLAY_COLOR
         if (dpy == HWC_DISPLAY_PRIMARY)
         {
-            ret |= crtc->addProperty(m_atomic_req[dpy], DRM_PROP_CRTC_HDR_ENABLE,
-                                     static_cast<uint64_t>(trigger_param.is_HDR)) < 0;
+            ret |= crtc->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_CRTC_HDR_ENABLE,
+                                              static_cast<uint64_t>(trigger_param.is_HDR)) < 0;
             logger.printf("is_hdr:%d ", trigger_param.is_HDR);
         }
 #endif
@@ -878,10 +978,10 @@ status_t DrmDevice::triggerOverlaySession(uint64_t dpy, int present_fence_idx, i
         {
             if (color_transform != nullptr && color_transform->dirty)
             {
-                status_t res = createColorTransformBlob(dpy, color_transform, &blob_color_transform);
+                status_t res = getColorTransformBlob(dpy, color_transform, &blob_color_transform);
                 if (res < 0)
                 {
-                    HWC_LOGE("(%" PRIu64 ") failed to create a blob of color transform", dpy);
+                    HWC_LOGE("(%" PRIu64 ") failed to get a blob of color transform", dpy);
                 }
             }
 
@@ -904,7 +1004,42 @@ status_t DrmDevice::triggerOverlaySession(uint64_t dpy, int present_fence_idx, i
                                         static_cast<uint64_t>(trigger_param.skip_config)) < 0;
         }
 
-        ret = m_drm->atomicCommit(m_atomic_req[dpy], flags, nullptr);
+        if (is_nonblock)
+        {
+            // only one commit of a crtc can be in flight, and the fb_id
+            // released by it can be removed after it is applied. If it is
+            // not applied yet, its fb_id may still be scanned out, so they
+            // are kept until a page flip or a blocking commit
+            if (m_drm->waitCommitDone(dpy, ms2ns(100)) == 0)
+            {
+                trashAddFbId(m_fb_caches[dpy].fb_caches_in_flight);
+                m_fb_caches[dpy].fb_caches_in_flight.clear();
+            }
+            else
+            {
+                HWC_LOGW("(%" PRIu64 ") the last nonblocking commit is not done, keep %zu fb_id",
+                         dpy, m_fb_caches[dpy].fb_caches_in_flight.size());
+            }
+
+            ret = m_drm->atomicCommitNonblock(dpy, m_atomic_req[dpy], flags);
+            if (ret)
+            {
+                HWC_LOGW("(%" PRIu64 ") failed to do nonblocking commit: ret=%d, commit again", dpy, ret);
+                is_nonblock = false;
+                ret = m_drm->atomicCommit(m_atomic_req[dpy], flags, nullptr);
+            }
+        }
+        else
+        {
+            ret = m_drm->atomicCommit(m_atomic_req[dpy], flags, nullptr);
+        }
+
+        if (!is_nonblock && ret == 0)
+        {
+            m_drm->finishCommits(dpy);
+            is_blocking_committed = true;
+        }
+        updateCommittedProperties(crtc, ret == 0);
         if (ret)
         {
             HWC_LOGE("(%" PRIu64 ") failed to drmModeAtomicCommit: ret=%d ovlp:%d pf_idx:%d sf_pf_idx:%d hrt_idx:%d mode:%d",
@@ -917,20 +1052,35 @@ status_t DrmDevice::triggerOverlaySession(uint64_t dpy, int present_fence_idx, i
                     sf_present_fence_idx, hrt_idx, config);
         }
 
-        releaseAtomicRequirement(dpy);
-        createAtomicRequirement(dpy);
+        // reuse the request of this display, it only drops the added properties
+        drmModeAtomicSetCursor(m_atomic_req[dpy], 0);
+        trashNotifyCommit();
     }
 
     // handle pending remove cache
-    trashAddFbId(m_fb_caches[dpy].fb_caches_pending_remove);
-    m_fb_caches[dpy].fb_caches_pending_remove.clear();
+    if (is_nonblock)
+    {
+        m_fb_caches[dpy].fb_caches_in_flight.splice(m_fb_caches[dpy].fb_caches_in_flight.end(),
+                                                    m_fb_caches[dpy].fb_caches_pending_remove);
+    }
+    else
+    {
+        // a blocking commit also finishes the nonblocking one before it
+        if (is_blocking_committed)
+        {
+            trashAddFbId(m_fb_caches[dpy].fb_caches_in_flight);
+            m_fb_caches[dpy].fb_caches_in_flight.clear();
+        }
+        trashAddFbId(m_fb_caches[dpy].fb_caches_pending_remove);
+        m_fb_caches[dpy].fb_caches_pending_remove.clear();
+    }
 
     // remove unused cache
     if (trigger_param.package && trigger_param.package->m_need_free_fb_cache)
     {
         HWC_ATRACE_FORMAT_NAME("fb_id_remove_cache");
         std::lock_guard<std::mutex> l(m_layer_caches_mutex[dpy]);
-        m_fb_caches[dpy].layer_caches.remove_if(
+        m_fb_caches[dpy].removeLayerCachesIf(
             [&](FbCacheInfo& cache)
             {
                 for (unsigned int i = 0; params != NULL && i < getMaxOverlayInputNum() && i < num; i++)
@@ -945,7 +1095,16 @@ status_t DrmDevice::triggerOverlaySession(uint64_t dpy, int present_fence_idx, i
                 HWC_ATRACE_FORMAT_NAME("remove_cache, hwc_layer_id %" PRIu64 ", size %zu",
                                        cache.id, cache.fb_caches.size());
                 // no one use this cache in this frame, remove cache
-                trashAddFbId(cache.fb_caches);
+                if (is_nonblock)
+                {
+                    m_fb_caches[dpy].fb_caches_in_flight.insert(m_fb_caches[dpy].fb_caches_in_flight.end(),
+                                                                cache.fb_caches.begin(),
+                                                                cache.fb_caches.end());
+                }
+                else
+                {
+                    trashAddFbId(cache.fb_caches);
+                }
                 return true;
             });
     }
@@ -956,15 +1115,9 @@ status_t DrmDevice::triggerOverlaySession(uint64_t dpy, int present_fence_idx, i
                 dpy, num, getMaxOverlayInputNum());
     }
 
-    if (blob_color_transform != 0 && blob_color_transform != m_prev_commit_color_transform[dpy])
+    if (blob_color_transform != 0)
     {
-        status_t res = destroyBlob(m_prev_commit_color_transform[dpy]);
-        if (res < 0)
-        {
-            HWC_LOGE("(%" PRIu64 ") failed to destroy blob(%u) of color transform: %d",
-                    dpy, m_prev_commit_color_transform[dpy], res);
-        }
-        m_prev_commit_color_transform[dpy] = blob_color_transform;
+        commitColorTransformBlob(dpy, blob_color_transform);
     }
 
     return ret;
@@ -1226,6 +1379,7 @@ void DrmDevice::updateOverlayInputs(
     DbgLogger logger(DbgLogger::TYPE_HWC_LOG, 'D', "(%" PRIu64 ") Input: ", dpy);
     size_t i;
     size_t plane_size = crtc->getPlaneNum();
+    m_fb_caches[dpy].frame_count++;
     for (i = 0; i < num; i++)
     {
         status_t ret = NO_ERROR;
@@ -1272,8 +1426,8 @@ void DrmDevice::updateOverlayInputs(
 
         if (param->dim)
         {
-            ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_FB_ID, m_drm->getDimFbId()) < 0;
-            ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_DIM_COLOR, param->layer_color) < 0;
+            ret |= plane->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_PLANE_FB_ID, m_drm->getDimFbId(), true) < 0;
+            ret |= plane->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_PLANE_DIM_COLOR, param->layer_color) < 0;
         }
         else
         {
@@ -1285,16 +1439,14 @@ void DrmDevice::updateOverlayInputs(
 
                 if (layer_cache)
                 {
-                    for (FbCacheEntry& entry : layer_cache->fb_caches)
+                    layer_cache->used_at_frame = m_fb_caches[dpy].frame_count;
+                    FbCacheEntry* entry = layer_cache->findEntry(param->alloc_id, param->format);
+                    if (entry)
                     {
-                        if (entry.alloc_id == param->alloc_id &&
-                            entry.format == param->format)
-                        {
-                            param->fb_id = entry.fb_id;
-                            entry.used_at_count = layer_cache->count;
-                            HWC_LOGV("cache[%zu] fb_id:%d", i, param->fb_id);
-                            break;
-                        }
+                        param->fb_id = entry->fb_id;
+                        entry->used_at_count = layer_cache->count;
+                        m_fb_caches[dpy].hit_count++;
+                        HWC_LOGV("cache[%zu] fb_id:%d", i, param->fb_id);
                     }
                 }
             }
@@ -1318,12 +1470,13 @@ void DrmDevice::updateOverlayInputs(
 
                     // remove long not used fb cache
                     uint64_t remove_threshold = layer_cache->fb_caches.size() * 2;
-                    layer_cache->fb_caches.remove_if(
+                    layer_cache->removeEntriesIf(
                         [&](FbCacheEntry& entry)
                         {
                             if (layer_cache->count - entry.used_at_count > remove_threshold)
                             {
                                 trashAddFbId(entry);
+                                m_fb_caches[dpy].evict_count++;
                                 return true;
                             }
                             return false;
@@ -1333,6 +1486,7 @@ void DrmDevice::updateOverlayInputs(
 
             if (param->fb_id == 0)
             {
+                m_fb_caches[dpy].miss_count++;
                 createFbId(param, dpy, i);
                 if (param->fb_id == 0)
                 {
@@ -1353,8 +1507,7 @@ void DrmDevice::updateOverlayInputs(
                     std::lock_guard<std::mutex> l(m_layer_caches_mutex[dpy]);
                     if (!layer_cache)
                     {
-                        m_fb_caches[dpy].layer_caches.emplace_back(param);
-                        layer_cache = &m_fb_caches[dpy].layer_caches.back();
+                        layer_cache = m_fb_caches[dpy].addLayerCache(param);
                     }
 
                     if (layer_cache->fb_caches.size() > 20)
@@ -1375,35 +1528,37 @@ void DrmDevice::updateOverlayInputs(
                         param->secure))
                     {
                         m_fb_caches[dpy].moveFbCachesToRemove(layer_cache->fb_caches.back());
-                        layer_cache->fb_caches.back() = {param->alloc_id, param->fb_id,
-                                                         param->format, layer_cache->count};
+                        layer_cache->replaceLastEntry({param->alloc_id, param->fb_id,
+                                                       param->format, layer_cache->count});
                     }
                     else
                     {
-                        layer_cache->fb_caches.emplace_back(FbCacheEntry{param->alloc_id, param->fb_id,
-                                                                         param->format, layer_cache->count});
+                        layer_cache->addEntry(FbCacheEntry{param->alloc_id, param->fb_id,
+                                                           param->format, layer_cache->count});
                     }
                 }
             }
-            ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_FB_ID, param->fb_id) < 0;
-        }
-        ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_CRTC_ID, crtc->getId()) < 0;
-        ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_CRTC_X,
-                                  static_cast<uint64_t>(param->dst_crop.left)) < 0;
-        ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_CRTC_Y,
-                                  static_cast<uint64_t>(param->dst_crop.top)) < 0;
-        ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_CRTC_W,
-                                  static_cast<uint64_t>(param->dst_crop.getWidth())) < 0;
-        ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_CRTC_H,
-                                  static_cast<uint64_t>(param->dst_crop.getHeight())) < 0;
-        ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_SRC_X,
-                                  static_cast<uint64_t>(param->src_crop.left) << 16) < 0;
-        ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_SRC_Y,
-                                  static_cast<uint64_t>(param->src_crop.top) << 16) < 0;
-        ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_SRC_W,
-                                  static_cast<uint64_t>(param->src_crop.getWidth()) << 16) < 0;
-        ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_SRC_H,
-                                  static_cast<uint64_t>(param->src_crop.getHeight()) << 16) < 0;
+            ret |= plane->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_PLANE_FB_ID, param->fb_id, true) < 0;
+        }
+        ret |= plane->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_PLANE_CRTC_ID, crtc->getId(), true) < 0;
+        ret |= plane->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_PLANE_CRTC_X,
+                                           static_cast<uint64_t>(param->dst_crop.left)) < 0;
+        ret |= plane->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_PLANE_CRTC_Y,
+                                           static_cast<uint64_t>(param->dst_crop.top)) < 0;
+        ret |= plane->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_PLANE_CRTC_W,
+                                           static_cast<uint64_t>(param->dst_crop.getWidth())) < 0;
+        ret |= plane->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_PLANE_CRTC_H,
+                                           static_cast<uint64_t>(param->dst_crop.getHeight())) < 0;
+        ret |= plane->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_PLANE_SRC_X,
+                                           static_cast<uint64_t>(param->src_crop.left) << 16) < 0;
+        ret |= plane->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_PLANE_SRC_Y,
+                                           static_cast<uint64_t>(param->src_crop.top) << 16) < 0;
+        ret |= plane->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_PLANE_SRC_W,
+                                           static_cast<uint64_t>(param->src_crop.getWidth()) << 16) < 0;
+        ret |= plane->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_PLANE_SRC_H,
+                                           static_cast<uint64_t>(param->src_crop.getHeight()) << 16) < 0;
+        // the buffer index is new in every frame, and it also puts the plane
+        // into the request when the other properties are not changed
         ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_NEXT_BUFFER_IDX, param->fence_index) < 0;
 
         // for UNKNOWN dataspace, use color_range instead,
@@ -1411,14 +1566,14 @@ void DrmDevice::updateOverlayInputs(
         // that may casue mismatching with MM layer
         int plane_dataspace = (param->dataspace == HAL_DATASPACE_UNKNOWN) ?
             mapDataspaceFromColorRange(param->color_range) : param->dataspace;
-        ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_DATASPACE, static_cast<uint64_t>(plane_dataspace)) < 0;
-
-        ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_VPITCH, param->v_pitch) < 0;
-        ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_COMPRESS, param->compress) < 0;
-        ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_PLANE_ALPHA, param->alpha) < 0;
-        ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_ALPHA_CON, param->alpha_enable) < 0;
-        ret |= plane->addProperty(m_atomic_req[dpy], DRM_PROP_PLANE_IS_MML,
-                                    (param->is_mml)? 1 : 0) < 0;
+        ret |= plane->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_PLANE_DATASPACE, static_cast<uint64_t>(plane_dataspace)) < 0;
+
+        ret |= plane->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_PLANE_VPITCH, param->v_pitch) < 0;
+        ret |= plane->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_PLANE_COMPRESS, param->compress) < 0;
+        ret |= plane->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_PLANE_PLANE_ALPHA, param->alpha) < 0;
+        ret |= plane->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_PLANE_ALPHA_CON, param->alpha_enable) < 0;
+        ret |= plane->addPropertyIfChanged(m_atomic_req[dpy], DRM_PROP_PLANE_IS_MML,
+                                           (param->is_mml)? 1 : 0) < 0;
         if (param->is_mml)
         {
             void* addr = reinterpret_cast<void*>(param->mml_cfg);
@@ -1784,12 +1939,45 @@ status_t DrmDevice::disablePlane(drmModeAtomicReqPtr req_ptr, const DrmModePlane
         return BAD_VALUE;
     }
 
+    // nothing is added if the plane is already disabled
     status_t ret = NO_ERROR;
-    ret |= plane->addProperty(req_ptr, DRM_PROP_PLANE_CRTC_ID, 0) < 0;
-    ret |= plane->addProperty(req_ptr, DRM_PROP_PLANE_FB_ID, 0) < 0;
+    ret |= plane->addPropertyIfChanged(req_ptr, DRM_PROP_PLANE_CRTC_ID, 0) < 0;
+    ret |= plane->addPropertyIfChanged(req_ptr, DRM_PROP_PLANE_FB_ID, 0) < 0;
     return ret;
 }
 
+void DrmDevice::updateCommittedProperties(DrmModeCrtc* crtc, bool is_committed)
+{
+    // without delta commit, every property is added again in the next frame
+    const bool is_delta = is_committed && Platform::getInstance().m_config.drm_delta_commit;
+    for (size_t i = 0; i < crtc->getPlaneNum(); i++)
+    {
+        auto plane = crtc->getPlane(i);
+        if (CC_UNLIKELY(!plane))
+        {
+            continue;
+        }
+
+        if (is_delta)
+        {
+            plane->commitProperties();
+        }
+        else
+        {
+            plane->invalidateProperties();
+        }
+    }
+
+    if (is_delta)
+    {
+        crtc->commitProperties();
+    }
+    else
+    {
+        crtc->invalidateProperties();
+    }
+}
+
 void DrmDevice::createAtomicRequirement(uint64_t dpy)
 {
     CHECK_DPY_RET_VOID(dpy);
@@ -1995,8 +2183,14 @@ void DrmDevice::dump(const uint64_t& dpy, String8* dump_str)
                 m_last_color_config[dpy].color_matrix[i * COLOR_MATRIX_DIM + 2],
                 m_last_color_config[dpy].color_matrix[i * COLOR_MATRIX_DIM + 3]);
     }
+    dump_str->appendFormat("blob cache: %zu, committed %u, hit %" PRIu64 ", miss %" PRIu64 "\n",
+            m_color_blob_caches[dpy].entries.size(), m_color_blob_caches[dpy].committed_blob_id,
+            m_color_blob_caches[dpy].hit_count, m_color_blob_caches[dpy].miss_count);
     dump_str->appendFormat("---------------------------------------\n");
 
+    dump_str->appendFormat("trash: removed %" PRIu64 ", backlog %zu, boosted %d, boost %" PRIu64 "\n",
+                           m_trash_removed_count.load(), m_trash_depth.load(),
+                           m_trash_is_boosted.load(), m_trash_boost_count.load());
     for (unsigned int i = 0; i < DisplayManager::MAX_DISPLAYS; i++)
     {
         dump_str->appendFormat("dpy %u, fb_cache:\n", i);
@@ -2008,20 +2202,106 @@ void DrmDevice::dump(const uint64_t& dpy, String8* dump_str)
     return;
 }
 
-status_t DrmDevice::createColorTransformBlob(const uint64_t& dpy, sp<ColorTransform> color_transform, uint32_t* id)
+// hashColorConfig() is FNV-1a over the config, which is zero filled before
+// the quantized matrix is set, so equal configs have equal bytes
+static size_t hashColorConfig(const struct disp_ccorr_config& config)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&config);
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < sizeof(config); i++)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return static_cast<size_t>(hash);
+}
+
+status_t DrmDevice::getColorTransformBlob(const uint64_t& dpy, sp<ColorTransform> color_transform, uint32_t* id)
 {
     CHECK_DPY_RET_STATUS(dpy);
 
-    if (color_transform != nullptr && id != nullptr)
+    if (color_transform == nullptr || id == nullptr)
+    {
+        return BAD_VALUE;
+    }
+
+    struct disp_ccorr_config config;
+    memset(&config, 0, sizeof(config));
+    config.mode = color_transform->hint;
+    for (unsigned int i = 0; i < COLOR_MATRIX_DIM * COLOR_MATRIX_DIM ; i++)
+    {
+        config.color_matrix[i] = transFloatToIntForColorMatrix(color_transform->matrix[i / 4][i % 4]);
+    }
+    config.feature_flag = color_transform->force_disable_color;
+
+    ColorBlobCache& cache = m_color_blob_caches[dpy];
+    const size_t hash = hashColorConfig(config);
+    for (auto it = cache.entries.begin(); it != cache.entries.end(); ++it)
+    {
+        if (it->hash == hash && memcmp(&it->config, &config, sizeof(config)) == 0)
+        {
+            cache.entries.splice(cache.entries.begin(), cache.entries, it);
+            cache.hit_count++;
+            m_crtc_colortransform_res[dpy] = NO_ERROR;
+            m_last_color_config[dpy] = config;
+            *id = it->blob_id;
+            HWC_LOGV("(%" PRIu64 ") reuse blob(%u) of color transform", dpy, *id);
+            return NO_ERROR;
+        }
+    }
+
+    cache.miss_count++;
+    status_t res = createColorTransformBlob(dpy, config, id);
+    if (res >= 0)
+    {
+        cache.entries.push_front(ColorBlobEntry{hash, config, *id});
+    }
+    return res;
+}
+
+void DrmDevice::commitColorTransformBlob(const uint64_t& dpy, const uint32_t& id)
+{
+    CHECK_DPY_RET_VOID(dpy);
+
+    ColorBlobCache& cache = m_color_blob_caches[dpy];
+    cache.committed_blob_id = id;
+
+    // the committed blob is the latest used, so it is never at the back
+    const size_t max_size = Platform::getInstance().m_config.drm_color_blob_cache_size + 1;
+    while (cache.entries.size() > max_size && cache.entries.back().blob_id != id)
     {
-        struct disp_ccorr_config config;
-        memset(&config, 0, sizeof(config));
-        config.mode = color_transform->hint;
-        for (unsigned int i = 0; i < COLOR_MATRIX_DIM * COLOR_MATRIX_DIM ; i++)
+        const uint32_t blob_id = cache.entries.back().blob_id;
+        status_t res = destroyBlob(blob_id);
+        if (res < 0)
         {
-            config.color_matrix[i] = transFloatToIntForColorMatrix(color_transform->matrix[i / 4][i % 4]);
+            HWC_LOGE("(%" PRIu64 ") failed to destroy blob(%u) of color transform: %d",
+                    dpy, blob_id, res);
+        }
+        cache.entries.pop_back();
+    }
+}
+
+void DrmDevice::removeColorBlobCache(uint64_t dpy)
+{
+    ColorBlobCache& cache = m_color_blob_caches[dpy];
+    for (ColorBlobEntry& entry : cache.entries)
+    {
+        status_t res = destroyBlob(entry.blob_id);
+        if (res < 0)
+        {
+            HWC_LOGE("(%" PRIu64 ") failed to destroy blob(%u) of color transform: %d",
+                    dpy, entry.blob_id, res);
         }
-        config.feature_flag = color_transform->force_disable_color;
+    }
+    cache.entries.clear();
+    cache.committed_blob_id = 0;
+}
+
+status_t DrmDevice::createColorTransformBlob(const uint64_t& dpy, const struct disp_ccorr_config& config, uint32_t* id)
+{
+    CHECK_DPY_RET_STATUS(dpy);
+
+    if (id != nullptr)
+    {
         int res = m_drm->createPropertyBlob(&config, sizeof(config), id);
         //Keep ColorTransform result and matrix for dump
         m_crtc_colortransform_res[dpy] = res;
@@ -2062,63 +2342,180 @@ int32_t DrmDevice::getCurrentRefresh(uint64_t dpy)
 
 void DrmDevice::trashCleanerLoop()
 {
+    // removeFb() competes with the commits for the drm driver, so the cleaner
+    // runs in background. It stays in SCHED_OTHER rather than SCHED_IDLE,
+    // because removeFb() may hold the locks of the driver which a commit
+    // waits for
+    if (setpriority(PRIO_PROCESS, 0, TRASH_CLEANER_NICE) != 0)
+    {
+        HWC_LOGW("Couldn't set nice %d for TrashCleaner", TRASH_CLEANER_NICE);
+    }
+    m_trash_cleaner_tid = gettid();
+
+    std::list<uint32_t> fb_id_list;
+    uint64_t cleaned_commit_count = 0;
     while (true)
     {
-        if (m_trash_request_add_fb_id) {
-            usleep(50); // sleep some time to let trashAddFbId() get lock
-        }
+        {
+            std::unique_lock<std::mutex> lock(m_trash_mutex);
+            if (fb_id_list.empty())
+            {
+                m_condition.wait(lock, [&] {
+                    return m_trash_cleaner_thread_stop || m_trash_head.load() != nullptr;
+                });
+            }
 
-        std::unique_lock<std::mutex> lock(m_trash_mutex);
+            // fb_id is removed right after a commit, so it does not delay the
+            // next one. If no commit comes, e.g. the display is idle, it is
+            // removed after the timeout
+            m_condition.wait_for(lock, std::chrono::nanoseconds(TRASH_IDLE_TIMEOUT_NS), [&] {
+                return m_trash_cleaner_thread_stop || m_trash_is_boosted ||
+                       m_trash_commit_count != cleaned_commit_count;
+            });
+        }
+        const bool is_stop = m_trash_cleaner_thread_stop;
+        cleaned_commit_count = m_trash_commit_count;
+
+        // the stack is in LIFO order, so it is reversed to remove the oldest
+        // fb_id first
+        TrashNode* node = m_trash_head.exchange(nullptr, std::memory_order_acquire);
+        std::list<uint32_t> taken;
+        while (node)
+        {
+            TrashNode* next = node->next;
+            taken.push_front(node->fb_id);
+            delete node;
+            node = next;
+        }
+        fb_id_list.splice(fb_id_list.end(), taken);
 
-        if (m_trash_fb_id_list.empty())
+        if (fb_id_list.empty())
         {
-            if (m_trash_cleaner_thread_stop)
+            if (is_stop)
             {
                 break;
             }
-
-            m_condition.wait(lock);
             continue;
         }
 
-        while (m_trash_fb_id_list.size())
+        HWC_ATRACE_FORMAT_NAME("trash_clean %zu", fb_id_list.size());
+        const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        while (!fb_id_list.empty())
         {
-            // let trashAddFbId has higher priority
-            if (m_trash_request_add_fb_id)
+            m_drm->removeFb(fb_id_list.front());
+            fb_id_list.pop_front();
+            m_trash_removed_count++;
+            const size_t depth = --m_trash_depth;
+
+            // a long backlog holds the memory of the buffers, so a boosted
+            // cleaner does not stop until it catches up
+            if (m_trash_is_boosted)
+            {
+                if (depth > TRASH_BACKLOG_LIMIT / 2)
+                {
+                    continue;
+                }
+                trashSetBoost(false);
+            }
+
+            // the rest waits for the next commit, unless the device is closing
+            if (!is_stop && systemTime(SYSTEM_TIME_MONOTONIC) - start > TRASH_CLEAN_BUDGET_NS)
             {
                 break;
             }
-            m_drm->removeFb(m_trash_fb_id_list.front());
-            m_trash_fb_id_list.pop_front();
         }
     }
 }
 
+void DrmDevice::trashSetBoost(bool is_boost)
+{
+    // the depth is checked again with the lock, so a boost from a pusher is
+    // not undone by the cleaner which has just seen a short trash
+    std::lock_guard<std::mutex> lock(m_trash_boost_mutex);
+    const size_t depth = m_trash_depth;
+    const pid_t tid = m_trash_cleaner_tid;
+    if (m_trash_is_boosted == is_boost || tid == 0 ||
+        (is_boost && depth <= TRASH_BACKLOG_LIMIT) ||
+        (!is_boost && depth > TRASH_BACKLOG_LIMIT / 2))
+    {
+        return;
+    }
+
+    if (setpriority(PRIO_PROCESS, tid, is_boost ? 0 : TRASH_CLEANER_NICE) != 0)
+    {
+        HWC_LOGD("Couldn't %s TrashCleaner: %s", is_boost ? "boost" : "unboost", strerror(errno));
+        return;
+    }
+    m_trash_is_boosted = is_boost;
+    if (is_boost)
+    {
+        m_trash_boost_count++;
+    }
+}
+
+void DrmDevice::trashPush(TrashNode* first, TrashNode* last, size_t count)
+{
+    const size_t depth = m_trash_depth.fetch_add(count) + count;
+
+    TrashNode* head = m_trash_head.load(std::memory_order_relaxed);
+    do
+    {
+        last->next = head;
+    } while (!m_trash_head.compare_exchange_weak(head, first,
+                                                 std::memory_order_release,
+                                                 std::memory_order_relaxed));
+
+    // the cleaner is only waiting for an empty trash, and the lock makes sure
+    // the notification is not missed
+    if (head == nullptr)
+    {
+        std::lock_guard<std::mutex> lock(m_trash_mutex);
+        m_condition.notify_one();
+    }
+
+    if (depth > TRASH_BACKLOG_LIMIT && !m_trash_is_boosted)
+    {
+        trashSetBoost(true);
+        // the boosted cleaner does not wait for the next commit
+        std::lock_guard<std::mutex> lock(m_trash_mutex);
+        m_condition.notify_one();
+    }
+}
+
+void DrmDevice::trashNotifyCommit()
+{
+    std::lock_guard<std::mutex> lock(m_trash_mutex);
+    m_trash_commit_count++;
+    m_condition.notify_one();
+}
+
 void DrmDevice::trashAddFbId(const std::list<FbCacheEntry>& fb_caches)
 {
     if (fb_caches.empty())
     {
         return;
     }
-    std::lock_guard<std::mutex> l(m_add_trash_mutex);
-    m_trash_request_add_fb_id = true;
-    std::lock_guard<std::mutex> lock(m_trash_mutex);
+
+    TrashNode* first = nullptr;
+    TrashNode* last = nullptr;
+    size_t count = 0;
     for (const FbCacheEntry& entry : fb_caches)
     {
-        m_trash_fb_id_list.push_back(entry.fb_id);
+        count++;
+        TrashNode* node = new TrashNode{entry.fb_id, first};
+        if (!last)
+        {
+            last = node;
+        }
+        first = node;
     }
-    m_trash_request_add_fb_id = false;
-    m_condition.notify_all();
+    trashPush(first, last, count);
 }
 
 void DrmDevice::trashAddFbId(FbCacheEntry& entry)
 {
-    std::lock_guard<std::mutex> l(m_add_trash_mutex);
-    m_trash_request_add_fb_id = true;
-    std::lock_guard<std::mutex> lock(m_trash_mutex);
-    m_trash_fb_id_list.push_back(entry.fb_id);
-    m_trash_request_add_fb_id = false;
-    m_condition.notify_all();
+    TrashNode* node = new TrashNode{entry.fb_id, nullptr};
+    trashPush(node, node, 1);
 }
 
 void DrmDevice::removeFbCacheDisplay(uint64_t dpy)
@@ -2131,8 +2528,14 @@ void DrmDevice::removeFbCacheDisplay(uint64_t dpy)
             m_drm->removeFb(entry.fb_id);
         }
     }
+    for (FbCacheEntry& entry : m_fb_caches[dpy].fb_caches_in_flight)
+    {
+        m_drm->removeFb(entry.fb_id);
+    }
+    m_fb_caches[dpy].fb_caches_in_flight.clear();
     std::lock_guard<std::mutex> l(m_layer_caches_mutex[dpy]);
     m_fb_caches[dpy].layer_caches.clear();
+    m_fb_caches[dpy].layer_cache_index.clear();
 }
 
 void DrmDevice::removeFbCacheAllDisplay()
@@ -2,7 +2,10 @@
 #define DRM_HWDEV_H_
 
 #include <stdint.h>
+#include <atomic>
+#include <list>
 #include <thread>
+#include <unordered_map>
 
 #include <linux/mediatek_drm.h>
 
@@ -286,6 +289,30 @@ private:
         bool paramIsSame(const OverlayPortParam* param);
         void updateParam(const OverlayPortParam* param);
 
+        // findEntry() returns the entry of the buffer, or nullptr if it has no fb_id yet
+        FbCacheEntry* findEntry(uint64_t alloc_id, unsigned int format);
+        void addEntry(const FbCacheEntry& entry);
+        void replaceLastEntry(const FbCacheEntry& entry);
+        void clearEntries();
+
+        // removeEntriesIf() removes the entries which pred returns true
+        template <typename Pred>
+        void removeEntriesIf(Pred pred)
+        {
+            for (auto it = fb_caches.begin(); it != fb_caches.end();)
+            {
+                if (pred(*it))
+                {
+                    eraseEntryIndex(it);
+                    it = fb_caches.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+
         uint64_t id;
         unsigned int src_buf_width;
         unsigned int src_buf_height;
@@ -297,19 +324,96 @@ private:
         uint64_t count; // update every buf update, to check which cache is not used anymore
         uint64_t last_alloc_id;
         nsecs_t last_buf_update;
+        uint64_t used_at_frame; // set to FbCache::frame_count, every time this layer is looked up
+
+    private:
+        void eraseEntryIndex(std::list<FbCacheEntry>::iterator it);
+
+        // the index of fb_caches by alloc_id, only the latest entry of an
+        // alloc_id is indexed
+        std::unordered_map<uint64_t, std::list<FbCacheEntry>::iterator> m_entry_index;
     };
 
     struct FbCache
     {
+        FbCache()
+            : frame_count(0)
+            , hit_count(0)
+            , miss_count(0)
+            , evict_count(0)
+        { }
+
         std::list<FbCacheInfo> layer_caches;
 
         std::list<FbCacheEntry> fb_caches_pending_remove; // to be removed after atomic commit
+        std::list<FbCacheEntry> fb_caches_in_flight; // to be removed after the nonblocking commit is applied
         void moveFbCachesToRemove(FbCacheEntry& entry);
         void moveFbCachesToRemove(FbCacheInfo* cache);
         void moveFbCachesToRemoveExcept(FbCacheInfo* cache, uint32_t fb_id);
 
         FbCacheInfo* getLayerCacheForId(uint64_t id);
+
+        // addLayerCache() creates the cache of a layer, the least recently
+        // used one is evicted if the display has too many caches
+        FbCacheInfo* addLayerCache(const OverlayPortParam* param);
+
+        // removeLayerCachesIf() removes the layer caches which pred returns
+        // true, pred is responsible for their fb_id
+        template <typename Pred>
+        void removeLayerCachesIf(Pred pred)
+        {
+            for (auto it = layer_caches.begin(); it != layer_caches.end();)
+            {
+                if (pred(*it))
+                {
+                    layer_cache_index.erase(it->id);
+                    it = layer_caches.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+
         void dump(String8* str);
+
+        // the index of layer_caches by hwc_layer_id
+        std::unordered_map<uint64_t, std::list<FbCacheInfo>::iterator> layer_cache_index;
+
+        uint64_t frame_count; // update every updateOverlayInputs()
+        uint64_t hit_count;
+        uint64_t miss_count;
+        uint64_t evict_count;
+    };
+
+    // ColorBlobEntry is a property blob of a color transform, hash is taken
+    // from its config, whose matrix is already quantized
+    struct ColorBlobEntry
+    {
+        size_t hash;
+        struct disp_ccorr_config config;
+        uint32_t blob_id;
+    };
+
+    // ColorBlobCache keeps the recent blobs of color transform alive, so an
+    // animated matrix reuses the blob of a matrix it has shown instead of
+    // creating and destroying one every frame. The front is the latest used
+    struct ColorBlobCache
+    {
+        ColorBlobCache()
+            : committed_blob_id(0)
+            , hit_count(0)
+            , miss_count(0)
+        { }
+
+        std::list<ColorBlobEntry> entries;
+
+        // the blob of the last commit, it is never evicted
+        uint32_t committed_blob_id;
+
+        uint64_t hit_count;
+        uint64_t miss_count;
     };
 
     // query hw capabilities through ioctl and store in m_caps_info
@@ -319,17 +423,36 @@ private:
     unsigned int getDeviceId(uint64_t dpy);
 
     status_t disablePlane(drmModeAtomicReqPtr req_ptr, const DrmModePlane* plane);
+
+    // updateCommittedProperties() records the properties of the crtc and its
+    // planes after a commit, so the next frame only adds the changed ones
+    void updateCommittedProperties(DrmModeCrtc* crtc, bool is_committed);
     void createAtomicRequirement(uint64_t dpy);
     void releaseAtomicRequirement(uint64_t dpy);
     status_t disableCrtcOutput(drmModeAtomicReqPtr req_ptr, const DrmModeCrtc* crtc);
 
     void createFbId(OverlayPortParam* param, const uint64_t& dpy, const uint64_t& id);
-    status_t createColorTransformBlob(const uint64_t& dpy, sp<ColorTransform> color_transform, uint32_t* id);
+    // getColorTransformBlob() returns the blob of color_transform, a cached one
+    // is reused if the quantized matrix is the same
+    status_t getColorTransformBlob(const uint64_t& dpy, sp<ColorTransform> color_transform, uint32_t* id);
+    status_t createColorTransformBlob(const uint64_t& dpy, const struct disp_ccorr_config& config, uint32_t* id);
+    // commitColorTransformBlob() records the committed blob and destroys the
+    // least recently used blobs over drm_color_blob_cache_size
+    void commitColorTransformBlob(const uint64_t& dpy, const uint32_t& id);
+    void removeColorBlobCache(uint64_t dpy);
     status_t destroyBlob(uint32_t id);
 
     void trashCleanerLoop();
     void trashAddFbId(const std::list<FbCacheEntry>& fb_caches);
     void trashAddFbId(FbCacheEntry& entry);
+    // trashPush() pushes a chain of count nodes from first to last into the
+    // trash
+    void trashPush(TrashNode* first, TrashNode* last, size_t count);
+    // trashSetBoost() moves the trash cleaner between its background nice
+    // value and the default one
+    void trashSetBoost(bool is_boost);
+    // trashNotifyCommit() lets the trash cleaner run after a commit
+    void trashNotifyCommit();
 
     void removeFbCacheDisplay(uint64_t dpy);
     void removeFbCacheAllDisplay();
@@ -357,8 +480,8 @@ private:
     std::pair<uint64_t, uint32_t >* m_prev_commit_dcm_out_fb_id[DisplayManager::MAX_DISPLAYS];
     DisplayState m_display_state;
 
-    // store the last commited blob id of color transform
-    uint32_t m_prev_commit_color_transform[DisplayManager::MAX_DISPLAYS];
+    // the blobs of color transform, including the last committed one
+    ColorBlobCache m_color_blob_caches[DisplayManager::MAX_DISPLAYS];
 
     // CRTC color transform result
     int m_crtc_colortransform_res[DisplayManager::MAX_DISPLAYS];
@@ -367,13 +490,33 @@ private:
     uint32_t m_drm_max_support_width;
     uint32_t m_drm_max_support_height;
 
+    // TrashNode is a node of the trash, which is a lock free stack pushed by
+    // OverlayEngine threads and taken as a whole by the trash cleaner
+    struct TrashNode
+    {
+        uint32_t fb_id;
+        TrashNode* next;
+    };
+
     std::thread m_trash_cleaner_thread;
+    std::atomic<TrashNode*> m_trash_head{nullptr};
+    // m_trash_mutex is only used to sleep on m_condition, the trash itself
+    // does not need a lock
     mutable std::mutex m_trash_mutex;
     mutable std::condition_variable m_condition;
-    bool m_trash_cleaner_thread_stop = false;
-    std::list<uint32_t> m_trash_fb_id_list;
-    mutable std::mutex m_add_trash_mutex;
-    bool m_trash_request_add_fb_id = false;
+    std::atomic<bool> m_trash_cleaner_thread_stop{false};
+    // update after every commit, the trash is cleaned between commits
+    std::atomic<uint64_t> m_trash_commit_count{0};
+    std::atomic<uint64_t> m_trash_removed_count{0};
+    // the number of fb_id pushed but not removed yet
+    std::atomic<size_t> m_trash_depth{0};
+    // the pushers boost the cleaner when the depth is over the limit, the
+    // cleaner may be starved under the load which fills the trash, so it
+    // cannot be left to boost itself
+    std::atomic<pid_t> m_trash_cleaner_tid{0};
+    std::atomic<bool> m_trash_is_boosted{false};
+    std::mutex m_trash_boost_mutex;
+    std::atomic<uint64_t> m_trash_boost_count{0};
 
     bool m_msync2_enable[DisplayManager::MAX_DISPLAYS] = {0};
     // currently only for primary
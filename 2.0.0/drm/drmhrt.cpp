@@ -453,3 +453,27 @@ bool DrmHrt::queryValidLayer()
 {
     return HWCMediator::getInstance().getOvlDevice(HWC_DISPLAY_PRIMARY)->queryValidLayer(&m_disp_layer);
 }
+
+void DrmHrt::getQuerySegments(QuerySegments* segs)
+{
+    segs->push_back(std::make_pair(static_cast<void*>(&m_disp_layer), sizeof(m_disp_layer)));
+
+    const size_t num_input = sizeof(m_disp_layer.input_config) / sizeof(m_disp_layer.input_config[0]);
+    for (size_t i = 0; i < num_input; ++i)
+    {
+        if (m_disp_layer.layer_num[i] <= 0)
+            continue;
+
+        const size_t layer_num = static_cast<size_t>(m_disp_layer.layer_num[i]);
+        if (m_disp_layer.input_config[i] != NULL)
+        {
+            segs->push_back(std::make_pair(static_cast<void*>(m_disp_layer.input_config[i]),
+                                           layer_num * sizeof(drm_mtk_layer_config)));
+        }
+        if (m_disp_layer.mml_cfg[i] != NULL)
+        {
+            segs->push_back(std::make_pair(static_cast<void*>(m_disp_layer.mml_cfg[i]),
+                                           layer_num * sizeof(mml_frame_info)));
+        }
+    }
+}
@@ -42,6 +42,9 @@ public:
 
     bool queryValidLayer();
 
+protected:
+    void getQuerySegments(QuerySegments* segs);
+
 private:
     mml_frame_info* m_layer_mml_info[DisplayManager::MAX_DISPLAYS];
     drm_mtk_layer_config* m_layer_config_list[DisplayManager::MAX_DISPLAYS];
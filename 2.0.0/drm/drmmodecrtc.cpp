@@ -137,14 +137,25 @@ DrmModeEncoder* DrmModeCrtc::getEncoder()
 
 void DrmModeCrtc::addPlane(DrmModePlane *plane)
 {
+    plane->invalidateProperties();
     m_planes.push_back(plane);
 }
 
 void DrmModeCrtc::clearPlane()
 {
+    invalidateAllProperties();
     m_planes.clear();
 }
 
+void DrmModeCrtc::invalidateAllProperties()
+{
+    invalidateProperties();
+    for (DrmModePlane* plane : m_planes)
+    {
+        plane->invalidateProperties();
+    }
+}
+
 void DrmModeCrtc::setMode(DrmModeInfo& mode)
 {
     m_mode = mode;
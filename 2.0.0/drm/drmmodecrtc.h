@@ -78,6 +78,10 @@ public:
     uint32_t getPhyHeight();
     size_t getPlaneNum();
     const DrmModePlane* getPlane(size_t index);
+
+    // invalidateAllProperties() forgets the committed properties of the crtc
+    // and its planes, e.g. after others commit to them
+    void invalidateAllProperties();
     void setReqSize(uint32_t width, uint32_t height);
     uint32_t getReqWidth();
     uint32_t getReqHeight();
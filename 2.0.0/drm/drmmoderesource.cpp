@@ -9,7 +9,10 @@
 
 #include <cutils/log.h>
 #include <utils/Trace.h>
+#include <algorithm>
 #include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <drm/drm_fourcc.h>
 
 #include "utils/debug.h"
@@ -30,6 +33,14 @@
 #define DRM_DIM_FAKE_GEM_HANDLE 0xff44696D //0xff'Dim'
 #define DRM_DIM_BUF_LENGTH 4096
 
+// the user data of a nonblocking commit keeps dpy in the low bits and the
+// sequence of the commit in the others
+#define DRM_COMMIT_DPY_BITS 4
+#define DRM_COMMIT_DPY_MASK ((static_cast<uintptr_t>(1) << DRM_COMMIT_DPY_BITS) - 1)
+#define DRM_COMMIT_SEQ_MASK (~static_cast<uintptr_t>(0) >> DRM_COMMIT_DPY_BITS)
+static_assert(DisplayManager::MAX_DISPLAYS <= DRM_COMMIT_DPY_MASK + 1,
+              "dpy does not fit in the user data of a commit");
+
 using namespace android;
 
 DrmModeResource& DrmModeResource::getInstance()
@@ -43,13 +54,29 @@ DrmModeResource::DrmModeResource()
     , m_dim_fb_id(0)
     , m_max_support_width(0)
     , m_max_support_height(0)
+    , m_event_stop_fd(-1)
 {
     memset(m_display_list, 0, sizeof(m_display_list));
+    memset(m_commit_state, 0, sizeof(m_commit_state));
     init();
 }
 
 DrmModeResource::~DrmModeResource()
 {
+    if (m_event_thread.joinable())
+    {
+        uint64_t value = 1;
+        if (write(m_event_stop_fd, &value, sizeof(value)) != sizeof(value))
+        {
+            HWC_LOGE("%s: failed to stop the event thread: %s", __func__, strerror(errno));
+        }
+        m_event_thread.join();
+    }
+    if (m_event_stop_fd >= 0)
+    {
+        close(m_event_stop_fd);
+    }
+
     if (m_crtc_list.size() > 0)
     {
         for (size_t i = 0; i < m_crtc_list.size(); i++)
@@ -606,6 +633,7 @@ int DrmModeResource::setDisplay(uint64_t dpy, bool use_req_size)
 #endif
         res = drmModeSetCrtc(m_fd, crtc->getId(), crtc->getFbId(), 0, 0, &c_id, 1, &modeInfo);
     }
+    crtc->invalidateAllProperties();
     if (res)
     {
         HWC_LOGE("drmModeSetCrtc fail ret:%d %s", res, strerror(errno));
@@ -684,6 +712,7 @@ int DrmModeResource::blankDisplay(uint64_t dpy, int mode)
     }
 
     res = atomicCommit(atomic_req, DRM_MODE_ATOMIC_ALLOW_MODESET, this);
+    crtc->invalidateAllProperties();
     if (res)
     {
         HWC_LOGE("(%" PRIu64 ") %s: failed to do atomic commit ret=%d", dpy, __func__, res);
@@ -953,6 +982,167 @@ int DrmModeResource::atomicCommit(drmModeAtomicReqPtr req, uint32_t flags, void
     return res;
 }
 
+int DrmModeResource::atomicCommitNonblock(uint64_t dpy, drmModeAtomicReqPtr req, uint32_t flags)
+{
+    if (dpy >= DisplayManager::MAX_DISPLAYS)
+    {
+        return -EINVAL;
+    }
+
+    std::call_once(m_event_thread_once, &DrmModeResource::startEventThread, this);
+    if (!m_event_thread.joinable())
+    {
+        return atomicCommit(req, flags, nullptr);
+    }
+
+    uintptr_t seq = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_commit_mutex);
+        CommitState& state = m_commit_state[dpy];
+        state.next_seq = (state.next_seq + 1) & DRM_COMMIT_SEQ_MASK;
+        seq = state.next_seq;
+    }
+
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    int res = atomicCommit(req, flags | DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT,
+                           reinterpret_cast<void*>((seq << DRM_COMMIT_DPY_BITS) | static_cast<uintptr_t>(dpy)));
+    if (res == 0)
+    {
+        // the event may come before this, then done_seq is already seq and
+        // the commit is not in flight
+        std::lock_guard<std::mutex> lock(m_commit_mutex);
+        CommitState& state = m_commit_state[dpy];
+        state.commit_seq = seq;
+        state.commit_time = now;
+        state.commit_count++;
+    }
+    return res;
+}
+
+int DrmModeResource::waitCommitDone(uint64_t dpy, nsecs_t timeout)
+{
+    if (dpy >= DisplayManager::MAX_DISPLAYS)
+    {
+        return -EINVAL;
+    }
+
+    ATRACE_NAME("waitCommitDone");
+    std::unique_lock<std::mutex> lock(m_commit_mutex);
+    CommitState& state = m_commit_state[dpy];
+    if (!m_commit_cond.wait_for(lock, std::chrono::nanoseconds(timeout),
+                                [&state] { return !state.isInFlight(); }))
+    {
+        state.timeout_count++;
+        return -ETIMEDOUT;
+    }
+    return 0;
+}
+
+void DrmModeResource::finishCommits(uint64_t dpy)
+{
+    if (dpy >= DisplayManager::MAX_DISPLAYS)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_commit_mutex);
+    CommitState& state = m_commit_state[dpy];
+    state.done_seq = state.commit_seq;
+    m_commit_cond.notify_all();
+}
+
+void DrmModeResource::startEventThread()
+{
+    m_event_stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (m_event_stop_fd < 0)
+    {
+        HWC_LOGE("%s: failed to create eventfd: %s", __func__, strerror(errno));
+        return;
+    }
+
+    m_event_thread = std::thread(&DrmModeResource::eventLoop, this);
+    if (pthread_setname_np(m_event_thread.native_handle(), "DrmEvent"))
+    {
+        HWC_LOGW("%s: failed to set the name of the event thread", __func__);
+    }
+}
+
+void DrmModeResource::eventLoop()
+{
+    drmEventContext context;
+    memset(&context, 0, sizeof(context));
+    context.version = 2;
+    context.page_flip_handler = &DrmModeResource::handlePageFlip;
+
+    struct pollfd fds[2];
+    fds[0].fd = m_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = m_event_stop_fd;
+    fds[1].events = POLLIN;
+
+    while (true)
+    {
+        fds[0].revents = 0;
+        fds[1].revents = 0;
+        int res = poll(fds, 2, -1);
+        if (res < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            HWC_LOGE("%s: failed to poll drm events: %s", __func__, strerror(errno));
+            break;
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            break;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            drmHandleEvent(m_fd, &context);
+        }
+    }
+
+    // nobody reports the commits in flight from now on, so do not let the
+    // overlay threads wait for them
+    std::lock_guard<std::mutex> lock(m_commit_mutex);
+    for (auto& state : m_commit_state)
+    {
+        state.done_seq = state.commit_seq;
+    }
+    m_commit_cond.notify_all();
+}
+
+void DrmModeResource::handlePageFlip(int /*fd*/, unsigned int /*sequence*/, unsigned int tv_sec,
+                                     unsigned int tv_usec, void* user_data)
+{
+    const nsecs_t ts = static_cast<nsecs_t>(tv_sec) * 1000000000 + static_cast<nsecs_t>(tv_usec) * 1000;
+    const uintptr_t data = reinterpret_cast<uintptr_t>(user_data);
+    getInstance().onCommitDone(static_cast<uint64_t>(data & DRM_COMMIT_DPY_MASK),
+                               data >> DRM_COMMIT_DPY_BITS, ts);
+}
+
+void DrmModeResource::onCommitDone(uint64_t dpy, uintptr_t seq, nsecs_t ts)
+{
+    if (dpy >= DisplayManager::MAX_DISPLAYS)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_commit_mutex);
+    CommitState& state = m_commit_state[dpy];
+    if (seq == state.commit_seq && state.isInFlight())
+    {
+        state.max_latency = std::max(state.max_latency, ts - state.commit_time);
+    }
+    // the events of a crtc come in the order of the commits
+    state.done_seq = seq;
+    m_commit_cond.notify_all();
+}
+
 int32_t DrmModeResource::getWidth(uint64_t dpy, uint32_t config)
 {
     DrmModeConnector *connector = getCurrentConnector(dpy);
@@ -1207,11 +1397,26 @@ const mtk_drm_disp_caps_info& DrmModeResource::getCapsInfo()
 
 void DrmModeResource::dump(String8* str)
 {
-    if (isUserLoad())
+    if (CC_UNLIKELY(!str))
     {
         return;
     }
-    if (CC_UNLIKELY(!str))
+    {
+        std::lock_guard<std::mutex> lock(m_commit_mutex);
+        for (size_t i = 0; i < DisplayManager::MAX_DISPLAYS; i++)
+        {
+            const CommitState& state = m_commit_state[i];
+            if (state.commit_count == 0)
+            {
+                continue;
+            }
+            str->appendFormat("dpy %zu, nonblock commit: %" PRIu64 ", in flight: %d, timeout: %" PRIu64
+                              ", max latency: %" PRId64 "us\n",
+                              i, state.commit_count, state.isInFlight(), state.timeout_count,
+                              ns2us(state.max_latency));
+        }
+    }
+    if (isUserLoad())
     {
         return;
     }
@@ -12,7 +12,9 @@
 
 #include <linux/mediatek_drm.h>
 
+#include <condition_variable>
 #include <mutex>
+#include <thread>
 #include <utils/Timers.h>
 #include <unordered_set>
 
@@ -53,6 +55,19 @@ public:
     int waitNextVsync(uint64_t dpy, nsecs_t* ts);
 
     int atomicCommit(drmModeAtomicReqPtr req, uint32_t flags, void *user_data);
+
+    // atomicCommitNonblock() commits with DRM_MODE_ATOMIC_NONBLOCK and returns
+    // before the hardware applies it. The page flip event of the commit is
+    // handled by the event thread
+    int atomicCommitNonblock(uint64_t dpy, drmModeAtomicReqPtr req, uint32_t flags);
+
+    // waitCommitDone() waits until the last nonblocking commit of dpy is
+    // applied, it returns -ETIMEDOUT if the commit is still in flight
+    int waitCommitDone(uint64_t dpy, nsecs_t timeout);
+
+    // finishCommits() is called after a blocking commit of dpy succeeds, the
+    // driver applies it after the nonblocking commits before it
+    void finishCommits(uint64_t dpy);
     inline int ioctl(unsigned long request, void *arg) { return ::ioctl(m_fd, static_cast<unsigned int>(request), arg); }
     inline int drmIoctl(unsigned long request, void *arg) { return ::drmIoctl(m_fd, request, arg); }
 
@@ -94,6 +109,13 @@ private:
     void setupDisplayList();
     DrmModeConnector* getCurrentConnector(uint64_t dpy);
 
+    // eventLoop() reads the events of m_fd until m_event_stop_fd is signaled
+    void startEventThread();
+    void eventLoop();
+    static void handlePageFlip(int fd, unsigned int sequence, unsigned int tv_sec,
+                               unsigned int tv_usec, void* user_data);
+    void onCommitDone(uint64_t dpy, uintptr_t seq, nsecs_t ts);
+
 private:
     int m_fd;
 
@@ -111,6 +133,31 @@ private:
     std::mutex m_cur_fb_lock;
 
     mtk_drm_disp_caps_info m_caps_info;
+
+    // a commit is in flight until the page flip event of its sequence comes,
+    // so a late event of an older commit does not finish a newer one
+    struct CommitState
+    {
+        bool isInFlight() const { return commit_seq != done_seq; }
+
+        uintptr_t next_seq;
+        uintptr_t commit_seq;
+        uintptr_t done_seq;
+        nsecs_t commit_time;
+        uint64_t commit_count;
+        uint64_t timeout_count;
+        nsecs_t max_latency;
+    };
+
+    // protect m_commit_state, it is accessed by OverlayEngine threads and the
+    // event thread
+    std::mutex m_commit_mutex;
+    std::condition_variable m_commit_cond;
+    CommitState m_commit_state[DisplayManager::MAX_DISPLAYS];
+
+    std::once_flag m_event_thread_once;
+    std::thread m_event_thread;
+    int m_event_stop_fd;
 };
 
 #endif
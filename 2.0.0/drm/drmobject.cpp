@@ -12,6 +12,7 @@ DrmObject::DrmObject(uint32_t type, uint32_t id)
     , m_prop_size(0)
     , m_prop_list(NULL)
     , m_property(NULL)
+    , m_is_prop_state_invalid(false)
 {
 }
 
@@ -35,6 +36,65 @@ int DrmObject::addProperty(drmModeAtomicReqPtr req, int prop, uint64_t value) co
     return 0;
 }
 
+int DrmObject::addPropertyIfChanged(drmModeAtomicReqPtr req, int prop, uint64_t value,
+                                    bool is_forced) const
+{
+    resetPropertyState();
+    if (m_prop_state.size() < m_prop_size)
+    {
+        m_prop_state.resize(m_prop_size, PropertyState{false, false, 0, 0});
+    }
+
+    PropertyState& state = m_prop_state[static_cast<size_t>(prop)];
+    // the request may already have another value of this property
+    if (!is_forced && state.is_committed && state.committed == value &&
+        (!state.is_pending || state.pending == value))
+    {
+        return 0;
+    }
+
+    // an uninitialized property is never added, so it must not be treated as
+    // committed, and a failed add leaves the pending value of the request
+    int ret = addProperty(req, prop, value);
+    if (m_property[prop].hasInit() && ret >= 0)
+    {
+        state.is_pending = true;
+        state.pending = value;
+    }
+    return ret;
+}
+
+void DrmObject::commitProperties() const
+{
+    resetPropertyState();
+    for (PropertyState& state : m_prop_state)
+    {
+        if (state.is_pending)
+        {
+            state.is_committed = true;
+            state.committed = state.pending;
+            state.is_pending = false;
+        }
+    }
+}
+
+void DrmObject::invalidateProperties() const
+{
+    m_is_prop_state_invalid = true;
+}
+
+void DrmObject::resetPropertyState() const
+{
+    if (m_is_prop_state_invalid.exchange(false))
+    {
+        for (PropertyState& state : m_prop_state)
+        {
+            state.is_committed = false;
+            state.is_pending = false;
+        }
+    }
+}
+
 int DrmObject::checkProperty()
 {
     int res = 0;
@@ -2,6 +2,7 @@
 #define __MTK_HWC_DRM_OBJECT_H__
 
 #include <stdint.h>
+#include <atomic>
 #include <vector>
 
 #include "drmmodeproperty.h"
@@ -15,6 +16,20 @@ public:
     virtual const DrmModeProperty& getProperty(int prop) const;
     virtual int addProperty(drmModeAtomicReqPtr req, int prop, uint64_t value) const;
 
+    // addPropertyIfChanged() adds the property only if the value is different
+    // from the committed one, or is_forced is true. The value becomes the
+    // committed one after commitProperties()
+    int addPropertyIfChanged(drmModeAtomicReqPtr req, int prop, uint64_t value,
+                             bool is_forced = false) const;
+
+    // commitProperties() is called after the request is committed successfully
+    void commitProperties() const;
+
+    // invalidateProperties() forgets the committed values, so all of them are
+    // added again. It can be called by any thread, e.g. when others change the
+    // state of the object or the commit fails
+    void invalidateProperties() const;
+
 protected:
     virtual void initObject() = 0;
     virtual int checkProperty();
@@ -26,6 +41,22 @@ protected:
     size_t m_prop_size;
     std::pair<int, std::string> *m_prop_list;
     DrmModeProperty *m_property;
+
+private:
+    struct PropertyState
+    {
+        bool is_committed;
+        bool is_pending;
+        uint64_t committed;
+        uint64_t pending;
+    };
+
+    // resetPropertyState() applies invalidateProperties() in the thread
+    // which adds the properties
+    void resetPropertyState() const;
+
+    mutable std::vector<PropertyState> m_prop_state;
+    mutable std::atomic<bool> m_is_prop_state_invalid;
 };
 
 #endif
@@ -12,6 +12,7 @@
 #include "utils/tools.h"
 
 #include "event.h"
+#include "dispatcher.h"
 #include "display.h"
 #include "hwc2.h"
 #include "sync.h"
@@ -473,7 +474,8 @@ bool RefreshRequestThread::threadLoop()
 }
 
 IdleThread::IdleThread(uint64_t dpy)
-    : m_enabled(false)
+    : m_dpy(dpy)
+    , m_enabled(false)
     , m_wait_time(0)
 {
     m_thread_name = std::string("IdleThread_") + std::to_string(dpy);
@@ -498,26 +500,37 @@ void IdleThread::setEnabled(bool enable)
 
 bool IdleThread::threadLoop()
 {
-    Mutex::Autolock _l(m_lock);
-    if (exitPending()) {
-        return false;
-    }
-    while (!m_enabled)
+    bool is_idle = false;
     {
-        m_state = HWC_THREAD_IDLE;
-        m_condition.wait(m_lock);
+        Mutex::Autolock _l(m_lock);
         if (exitPending()) {
             return false;
         }
+        while (!m_enabled)
+        {
+            m_state = HWC_THREAD_IDLE;
+            m_condition.wait(m_lock);
+            if (exitPending()) {
+                return false;
+            }
+        }
+        m_state = HWC_THREAD_TRIGGER;
+
+        if (m_condition.waitRelative(m_lock, m_wait_time) == TIMED_OUT){
+            HWC_ATRACE_NAME("idle_refresh");
+            HWC_LOGD("idle_refresh");
+            DisplayManager::getInstance().refreshForDisplay(HWC_DISPLAY_PRIMARY,
+                    HWC_REFRESH_FOR_IDLE_THREAD);
+            m_enabled = false;
+            is_idle = true;
+        }
     }
-    m_state = HWC_THREAD_TRIGGER;
 
-    if (m_condition.waitRelative(m_lock, m_wait_time) == TIMED_OUT){
-        HWC_ATRACE_NAME("idle_refresh");
-        HWC_LOGD("idle_refresh");
-        DisplayManager::getInstance().refreshForDisplay(HWC_DISPLAY_PRIMARY,
-                HWC_REFRESH_FOR_IDLE_THREAD);
-        m_enabled = false;
+    // m_lock is released first, since the dispatcher takes plug_lock_main
+    // before setEnabled()
+    if (is_idle)
+    {
+        HWCDispatcher::getInstance().onIdle(m_dpy);
     }
 
     return true;
@@ -530,7 +543,9 @@ HWVSyncEstimator& HWVSyncEstimator::getInstance()
 }
 
 HWVSyncEstimator::HWVSyncEstimator()
-    : m_sample_count(0)
+    : m_listener(new PresentFenceListener())
+    , m_reset_count(0)
+    , m_sample_count(0)
     , m_last_signaled_prenset_fence_time(0)
 {
     resetAvgVSyncPeriod(DisplayManager::getInstance().getDisplayData(HWC_DISPLAY_PRIMARY)->refresh);
@@ -544,38 +559,40 @@ HWVSyncEstimator::~HWVSyncEstimator()
 void HWVSyncEstimator::resetAvgVSyncPeriod(nsecs_t period)
 {
     AutoMutex l(m_mutex);
-    for (int fence_fd : m_present_fence_queue)
-    {
-        ::protectedClose(fence_fd);
-    }
-    m_present_fence_queue.clear();
+    // the fences pushed before the reset are ignored when they signal
+    ++m_reset_count;
     m_avg_period = period;
     m_cur_config_period = -1;
 }
 
 void HWVSyncEstimator::pushPresentFence(const int& fd, const nsecs_t cur_period)
 {
-    AutoMutex l(m_mutex);
-    if (m_cur_config_period != -1 && m_cur_config_period != cur_period)
+    unsigned int reset_count = 0;
     {
-        HWC_LOGW("period are changed without resetAvgVSyncPeriod");
+        AutoMutex l(m_mutex);
+        if (m_cur_config_period != -1 && m_cur_config_period != cur_period)
+        {
+            HWC_LOGW("period are changed without resetAvgVSyncPeriod");
+        }
+        m_cur_config_period = cur_period;
+        reset_count = m_reset_count;
     }
-    m_cur_config_period = cur_period;
 
-    m_present_fence_queue.push_back(fd);
-    if (m_present_fence_queue.size() > m_history_size)
+    if (fd >= 0)
     {
-        std::list<int>::iterator it = m_present_fence_queue.begin();
-        ::protectedClose(*it);
-        m_present_fence_queue.erase(it);
+        FenceMonitor::getInstance().addFence(fd, m_listener, reset_count, 1000, "hw_vsync");
     }
 }
 
+void HWVSyncEstimator::PresentFenceListener::onFenceSignaled(unsigned int fence_idx, nsecs_t signal_time)
+{
+    HWVSyncEstimator::getInstance().onPresentFenceSignaled(fence_idx, signal_time);
+}
+
 nsecs_t HWVSyncEstimator::getNextHWVsync(nsecs_t cur)
 {
     AutoMutex l(m_mutex);
-    updateLocked();
-    if (m_last_signaled_prenset_fence_time <= 0)
+    if (m_last_signaled_prenset_fence_time <= 0 || m_avg_period <= 0)
     {
         return -1;
     }
@@ -584,17 +601,13 @@ nsecs_t HWVSyncEstimator::getNextHWVsync(nsecs_t cur)
             (((cur - m_last_signaled_prenset_fence_time) / m_avg_period) + 1) * m_avg_period;
 }
 
-void HWVSyncEstimator::update()
+void HWVSyncEstimator::onPresentFenceSignaled(unsigned int reset_count, nsecs_t signal_time)
 {
     AutoMutex l(m_mutex);
-    updateLocked();
-}
-
-void HWVSyncEstimator::updateLocked()
-{
-    nsecs_t cur_fence_signal_time = 0, prev_fence_signal_time = 0;
-    std::list<int>::iterator it;
-    std::list<int>::iterator last_signaled = m_present_fence_queue.begin();
+    if (reset_count != m_reset_count || signal_time == SIGNAL_TIME_INVALID)
+    {
+        return;
+    }
 
     if (CC_UNLIKELY(m_cur_config_period <= 0))
     {
@@ -602,39 +615,27 @@ void HWVSyncEstimator::updateLocked()
         m_cur_config_period = DisplayManager::getInstance().getDisplayData(HWC_DISPLAY_PRIMARY)->refresh;
     }
 
-    for (it = m_present_fence_queue.begin(); it != m_present_fence_queue.end(); ++it)
+    // the fences in one epoll batch may be reported out of order, so only
+    // the newer signal updates the estimation
+    if (signal_time <= m_last_signaled_prenset_fence_time)
     {
-        nsecs_t temp = getFenceSignalTime(*it);
-        if (temp != SIGNAL_TIME_INVALID && temp != SIGNAL_TIME_PENDING) {
-            prev_fence_signal_time = cur_fence_signal_time;
-            cur_fence_signal_time = temp;
-            last_signaled = it;
-
-            if (it != m_present_fence_queue.begin())
-            {
-                uint32_t num_of_vsync =
-                    static_cast<uint32_t>((cur_fence_signal_time - prev_fence_signal_time) /
-                                          static_cast<float>(m_cur_config_period) + 0.5f);
-
-                if (m_sample_count < 100)
-                    m_sample_count++;
-
-                if (num_of_vsync > 0 && num_of_vsync < 5)
-                    m_avg_period = (((m_sample_count - 1) * m_avg_period) +
-                                    ((cur_fence_signal_time - prev_fence_signal_time) / num_of_vsync))
-                                    / m_sample_count;
-            }
-        }
+        return;
     }
 
-    if (last_signaled != m_present_fence_queue.begin())
+    if (m_last_signaled_prenset_fence_time > 0)
     {
-        for (it = m_present_fence_queue.begin(); it != last_signaled; ++it) {
-            ::protectedClose(*it);
-        }
-        m_present_fence_queue.erase(m_present_fence_queue.begin(), last_signaled);
+        const nsecs_t diff = signal_time - m_last_signaled_prenset_fence_time;
+        uint32_t num_of_vsync =
+            static_cast<uint32_t>(diff / static_cast<float>(m_cur_config_period) + 0.5f);
+
+        if (m_sample_count < 100)
+            m_sample_count++;
+
+        if (num_of_vsync > 0 && num_of_vsync < 5)
+            m_avg_period = (((m_sample_count - 1) * m_avg_period) + (diff / num_of_vsync))
+                            / m_sample_count;
     }
-    m_last_signaled_prenset_fence_time = cur_fence_signal_time;
+    m_last_signaled_prenset_fence_time = signal_time;
 }
 
 FenceDebugger::FenceDebugger(std::string name, int mode, bool wait_log)
@@ -650,7 +651,8 @@ FenceDebugger::~FenceDebugger()
 
 void FenceDebugger::initialize()
 {
-    run(m_name.c_str(), PRIORITY_URGENT_DISPLAY);
+    // make sure the thread of FenceMonitor is running before the first fence
+    FenceMonitor::getInstance();
 }
 
 void FenceDebugger::dupAndStoreFence(const int fd, const unsigned int fence_idx)
@@ -662,65 +664,26 @@ void FenceDebugger::dupAndStoreFence(const int fd, const unsigned int fence_idx)
         return;
     }
 
+    if (m_wait_log)
     {
-        Mutex::Autolock _l(m_lock);
-
-        m_fence_queue.push_back({ .fd = ::dup(fd), .fence_idx = fence_idx});
-        m_condition.signal();
+        HWC_LOGI("%s_%u, wait+", m_name.c_str(), fence_idx);
     }
 
-    if (m_fence_queue.size() > 20)
+    const int timeout = ((m_mode & WAIT_PERIODICALLY) != 0) ? 1000 : 1500;
+    if (FenceMonitor::getInstance().addFence(fd, this, fence_idx, timeout, m_name.c_str()) != NO_ERROR)
     {
-        HWC_LOGW("%s(), fd queue size %zu > 20", __FUNCTION__, m_fence_queue.size());
-        HWC_ATRACE_NAME("warning, fence queue size > 20");
+        HWC_ATRACE_NAME("warning, cannot monitor fence");
     }
 }
 
-
-bool FenceDebugger::threadLoop()
+void FenceDebugger::onFenceSignaled(unsigned int fence_idx, nsecs_t signal_time)
 {
-    FenceInfo cur_f_info = { .fd = -1, .fence_idx = UINT_MAX };
-    {
-        Mutex::Autolock _l(m_lock);
-        if (exitPending()) {
-            return false;
-        }
-
-        if (m_fence_queue.empty())
-        {
-            m_state = HWC_THREAD_IDLE;
-            m_condition.wait(m_lock);
-            return true;
-        }
-
-        m_state = HWC_THREAD_TRIGGER;
-
-        cur_f_info = m_fence_queue.front();
-        m_fence_queue.pop_front();
-    }
-
-    if (cur_f_info.fd == -1)
-    {
-        HWC_LOGW("cur_f_info.id = -1");
-        return true;
-    }
-
-    std::string dbg_name = m_name +
-                           std::string("_") + std::to_string(cur_f_info.fd) +
-                           std::string("_") + std::to_string(cur_f_info.fence_idx);
-
-    if (m_wait_log)
-    {
-        HWC_LOGI("%s, wait+", dbg_name.c_str());
-    }
+    Mutex::Autolock _l(m_lock);
 
-    int ret = ((m_mode & WAIT_PERIODICALLY) != 0) ?
-              SyncFence::waitPeriodicallyWoCloseFd(cur_f_info.fd, 100, 1000, dbg_name.c_str()) :
-              SyncFence::waitWithoutCloseFd(cur_f_info.fd, 1500, dbg_name.c_str());
+    std::string dbg_name = m_name + std::string("_") + std::to_string(fence_idx);
 
-    if (ret == 0)
+    if (signal_time != SIGNAL_TIME_INVALID)
     {
-        uint64_t signal_time = SyncFence::getSignalTime(cur_f_info.fd);
         if (signal_time == m_prev_signal_time)
         {
             HWC_LOGI("2 same signal time %" PRId64, signal_time);
@@ -728,7 +691,7 @@ bool FenceDebugger::threadLoop()
             HWC_ATRACE_INT((m_name + "_same_ts").c_str(), m_same_count++ % 2);
         }
 
-        if ((m_mode & CHECK_DIFF_BIG) != 0)
+        if ((m_mode & CHECK_DIFF_BIG) != 0 && m_prev_signal_time != SIGNAL_TIME_INVALID)
         {
             int64_t diff = static_cast<int64_t>(signal_time - m_prev_signal_time);
             HWC_ATRACE_INT64(diff > 50 * 1000 * 1000 ?
@@ -747,11 +710,6 @@ bool FenceDebugger::threadLoop()
 
     if (m_wait_log)
     {
-        HWC_LOGI("%s, wait-, ret %d", dbg_name.c_str(), ret);
+        HWC_LOGI("%s, wait-, signal %" PRId64, dbg_name.c_str(), signal_time);
     }
-
-    ::protectedClose(cur_f_info.fd);
-
-    return true;
 }
-
@@ -3,6 +3,7 @@
 
 #include <utils/threads.h>
 #include <list>
+#include "fence_monitor.h"
 #include "worker.h"
 
 using namespace android;
@@ -124,6 +125,7 @@ private:
     mutable Mutex m_lock;
     Condition m_condition;
 
+    uint64_t m_dpy;
     bool m_enabled;
     nsecs_t m_wait_time;
 };
@@ -134,24 +136,37 @@ public:
     static HWVSyncEstimator& getInstance();
     ~HWVSyncEstimator();
     void resetAvgVSyncPeriod(nsecs_t period);
+
+    // pushPresentFence() watches fd with FenceMonitor, the average period is
+    // updated when the fence signals. fd is not taken by this function
     void pushPresentFence(const int& fd, const nsecs_t cur_period);
-    void update();
     nsecs_t getNextHWVsync(nsecs_t cur);
 private:
     HWVSyncEstimator();
-    void updateLocked();
+
+    // PresentFenceListener forwards the signal of present fences, the
+    // estimator is a static object, so it cannot be held by sp<> itself
+    struct PresentFenceListener : public FenceMonitorListener {
+        virtual void onFenceSignaled(unsigned int fence_idx, nsecs_t signal_time);
+    };
+
+    // onPresentFenceSignaled() updates the average period with the signal
+    // time of present fence pushed after the last reset
+    void onPresentFenceSignaled(unsigned int reset_count, nsecs_t signal_time);
 
     mutable Mutex m_mutex;
-    std::list<int> m_present_fence_queue;
+    sp<PresentFenceListener> m_listener;
+    unsigned int m_reset_count;
     nsecs_t m_avg_period;
     nsecs_t m_cur_config_period;
     int m_sample_count;
     nsecs_t m_last_signaled_prenset_fence_time;
-
-    size_t const m_history_size = 5;
 };
 
-class FenceDebugger : public HWCThread
+// FenceDebugger traces the signal time of fences for debugging, and checks
+// whether two fences signal with the same timestamp. The fences are watched
+// by FenceMonitor, so it does not have its own thread.
+class FenceDebugger : public FenceMonitorListener
 {
 public:
     FenceDebugger(std::string name, int mode, bool wait_log = false);
@@ -168,22 +183,13 @@ public:
     };
 
 private:
-    struct FenceInfo
-    {
-        int fd;
-        unsigned int fence_idx;
-    };
-
-    virtual void onFirstRef() {}
-    virtual bool threadLoop();
+    virtual void onFenceSignaled(unsigned int fence_idx, nsecs_t signal_time);
 
     mutable Mutex m_lock;
-    std::list<FenceInfo> m_fence_queue;
-    Condition m_condition;
 
     std::string m_name;
 
-    uint64_t m_prev_signal_time = UINT64_MAX;
+    nsecs_t m_prev_signal_time = -1;
 
     int m_same_count = 0;
 
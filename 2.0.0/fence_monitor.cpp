@@ -0,0 +1,398 @@
+#define DEBUG_LOG_TAG "FMON"
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "fence_monitor.h"
+
+#include <algorithm>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <utils/String8.h>
+
+#include "utils/debug.h"
+#include "utils/tools.h"
+
+#include "sync.h"
+
+// the epoll data of m_wake_fd, the data of a fence is its generation and slot
+#define FENCE_MONITOR_WAKE_DATA UINT64_MAX
+
+// the thread checks the timeout of fences at least once in this period
+#define FENCE_MONITOR_MAX_POLL_MS 100
+
+#define FENCE_MONITOR_MAX_EVENTS 16
+
+FenceMonitor& FenceMonitor::getInstance()
+{
+    // the thread holds a reference of itself while it is running, so keep
+    // the instance alive for the whole process
+    static sp<FenceMonitor> gInstance = new FenceMonitor();
+    return *gInstance;
+}
+
+FenceMonitor::FenceMonitor()
+    : m_epoll_fd(-1)
+    , m_wake_fd(-1)
+    , m_num_active(0)
+    , m_generation(0)
+    , m_timeline_pos(0)
+    , m_add_count(0)
+    , m_full_count(0)
+    , m_timeout_count(0)
+{
+    m_thread_name = std::string("FenceMonitor");
+
+    for (size_t i = 0; i < HWC_FENCE_MONITOR_MAX_FENCES; i++)
+    {
+        m_slots[i].fd = -1;
+        m_slots[i].generation = 0;
+    }
+
+    for (size_t i = 0; i < HWC_FENCE_MONITOR_TIMELINE_SIZE; i++)
+    {
+        m_timeline[i].seq.store(0, std::memory_order_relaxed);
+    }
+
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd < 0)
+    {
+        HWC_LOGE("failed to create epoll: %s", strerror(errno));
+        return;
+    }
+
+    m_wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_wake_fd < 0)
+    {
+        HWC_LOGE("failed to create eventfd: %s", strerror(errno));
+        return;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u64 = FENCE_MONITOR_WAKE_DATA;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wake_fd, &event) != 0)
+    {
+        HWC_LOGE("failed to add eventfd to epoll: %s", strerror(errno));
+    }
+}
+
+FenceMonitor::~FenceMonitor()
+{
+    for (size_t i = 0; i < HWC_FENCE_MONITOR_MAX_FENCES; i++)
+    {
+        if (m_slots[i].fd >= 0)
+        {
+            ::protectedClose(m_slots[i].fd);
+        }
+    }
+
+    if (m_wake_fd >= 0)
+    {
+        ::protectedClose(m_wake_fd);
+    }
+
+    if (m_epoll_fd >= 0)
+    {
+        ::protectedClose(m_epoll_fd);
+    }
+}
+
+void FenceMonitor::onFirstRef()
+{
+    run(m_thread_name.c_str(), PRIORITY_URGENT_DISPLAY);
+}
+
+status_t FenceMonitor::addFence(int fd, const sp<FenceMonitorListener>& listener,
+                                unsigned int fence_idx, int timeout_ms, const char* name)
+{
+    if (fd < 0 || listener == nullptr)
+    {
+        return BAD_VALUE;
+    }
+
+    if (m_epoll_fd < 0 || m_wake_fd < 0)
+    {
+        return NO_INIT;
+    }
+
+    const int dup_fd = ::dup(fd);
+    if (dup_fd < 0)
+    {
+        const int err = errno;
+        HWC_LOGW("[%s] failed to dup fence %d: %s", name, fd, strerror(err));
+        return -err;
+    }
+
+    bool need_wake = false;
+    {
+        Mutex::Autolock l(m_lock);
+
+        size_t idx = 0;
+        for (; idx < HWC_FENCE_MONITOR_MAX_FENCES; idx++)
+        {
+            if (m_slots[idx].fd < 0)
+            {
+                break;
+            }
+        }
+
+        if (idx == HWC_FENCE_MONITOR_MAX_FENCES)
+        {
+            m_full_count.fetch_add(1, std::memory_order_relaxed);
+            HWC_LOGW("[%s] too many fences, drop fence %u", name, fence_idx);
+            ::protectedClose(dup_fd);
+            return NO_MEMORY;
+        }
+
+        Slot& slot = m_slots[idx];
+        slot.generation = ++m_generation;
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.u64 = (static_cast<uint64_t>(slot.generation) << 32) | idx;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, dup_fd, &event) != 0)
+        {
+            const int err = errno;
+            HWC_LOGW("[%s] failed to add fence %u to epoll: %s", name, fence_idx, strerror(err));
+            ::protectedClose(dup_fd);
+            return -err;
+        }
+
+        slot.fd = dup_fd;
+        slot.fence_idx = fence_idx;
+        slot.deadline = systemTime() + ms2ns(timeout_ms);
+        snprintf(slot.name, sizeof(slot.name), "%s", name ? name : "");
+        slot.listener = listener;
+
+        need_wake = m_num_active++ == 0;
+    }
+    m_add_count.fetch_add(1, std::memory_order_relaxed);
+
+    if (need_wake)
+    {
+        const uint64_t value = 1;
+        if (::write(m_wake_fd, &value, sizeof(value)) != static_cast<ssize_t>(sizeof(value)))
+        {
+            HWC_LOGW("failed to wake up fence monitor: %s", strerror(errno));
+        }
+    }
+
+    return NO_ERROR;
+}
+
+void FenceMonitor::handleFence(size_t idx, uint32_t generation, bool is_timeout)
+{
+    int fd = -1;
+    unsigned int fence_idx = 0;
+    char name[HWC_FENCE_MONITOR_NAME_LEN];
+    sp<FenceMonitorListener> listener;
+    {
+        Mutex::Autolock l(m_lock);
+
+        Slot& slot = m_slots[idx];
+        if (slot.fd < 0 || slot.generation != generation)
+        {
+            // it has been handled by timeout or signal already
+            return;
+        }
+
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, slot.fd, nullptr);
+
+        fd = slot.fd;
+        fence_idx = slot.fence_idx;
+        memcpy(name, slot.name, sizeof(name));
+        listener = slot.listener;
+
+        slot.fd = -1;
+        slot.listener = nullptr;
+        --m_num_active;
+    }
+
+    nsecs_t signal_time = SIGNAL_TIME_INVALID;
+    if (is_timeout)
+    {
+        m_timeout_count.fetch_add(1, std::memory_order_relaxed);
+        HWC_LOGW("[%s] fence %u didn't signal in time", name, fence_idx);
+        HWC_ATRACE_FORMAT_NAME("%s_%u timeout", name, fence_idx);
+    }
+    else
+    {
+        const uint64_t time = SyncFence::getSignalTime(fd);
+        if (time != static_cast<uint64_t>(SIGNAL_TIME_INVALID) &&
+            time != static_cast<uint64_t>(SIGNAL_TIME_PENDING))
+        {
+            signal_time = static_cast<nsecs_t>(time);
+        }
+    }
+
+    addRecord(name, fence_idx, signal_time, systemTime());
+
+    listener->onFenceSignaled(fence_idx, signal_time);
+
+    ::protectedClose(fd);
+}
+
+int FenceMonitor::checkTimeout()
+{
+    size_t expired_idx[HWC_FENCE_MONITOR_MAX_FENCES];
+    uint32_t expired_generation[HWC_FENCE_MONITOR_MAX_FENCES];
+    size_t num_expired = 0;
+    nsecs_t nearest = -1;
+    {
+        Mutex::Autolock l(m_lock);
+
+        if (m_num_active == 0)
+        {
+            m_state = HWC_THREAD_IDLE;
+            return -1;
+        }
+        m_state = HWC_THREAD_TRIGGER;
+
+        const nsecs_t now = systemTime();
+        for (size_t i = 0; i < HWC_FENCE_MONITOR_MAX_FENCES; i++)
+        {
+            const Slot& slot = m_slots[i];
+            if (slot.fd < 0)
+            {
+                continue;
+            }
+
+            const nsecs_t remain = slot.deadline - now;
+            if (remain <= 0)
+            {
+                expired_idx[num_expired] = i;
+                expired_generation[num_expired] = slot.generation;
+                ++num_expired;
+            }
+            else if (nearest < 0 || remain < nearest)
+            {
+                nearest = remain;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < num_expired; i++)
+    {
+        handleFence(expired_idx[i], expired_generation[i], true);
+    }
+
+    if (nearest < 0)
+    {
+        // only expired fences were found, check the others again soon
+        return num_expired > 0 ? 0 : -1;
+    }
+
+    return static_cast<int>(std::min(ns2ms(nearest + ms2ns(1) - 1),
+                                     static_cast<nsecs_t>(FENCE_MONITOR_MAX_POLL_MS)));
+}
+
+bool FenceMonitor::threadLoop()
+{
+    if (m_epoll_fd < 0)
+    {
+        return false;
+    }
+
+    const int timeout = checkTimeout();
+
+    struct epoll_event events[FENCE_MONITOR_MAX_EVENTS];
+    const int num_events = epoll_wait(m_epoll_fd, events, FENCE_MONITOR_MAX_EVENTS, timeout);
+    if (num_events < 0)
+    {
+        if (errno != EINTR)
+        {
+            HWC_LOGW("epoll_wait failed: %s", strerror(errno));
+        }
+        return true;
+    }
+
+    for (int i = 0; i < num_events; i++)
+    {
+        const uint64_t data = events[i].data.u64;
+        if (data == FENCE_MONITOR_WAKE_DATA)
+        {
+            uint64_t value = 0;
+            if (::read(m_wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+            {
+                HWC_LOGW("failed to read eventfd: %s", strerror(errno));
+            }
+            continue;
+        }
+
+        handleFence(static_cast<size_t>(data & 0xffffffff), static_cast<uint32_t>(data >> 32), false);
+    }
+
+    return true;
+}
+
+void FenceMonitor::addRecord(const char* name, unsigned int fence_idx,
+                             nsecs_t signal_time, nsecs_t notify_time)
+{
+    const uint64_t pos = m_timeline_pos.load(std::memory_order_relaxed);
+    Record& record = m_timeline[pos & (HWC_FENCE_MONITOR_TIMELINE_SIZE - 1)];
+
+    const uint32_t seq = record.seq.load(std::memory_order_relaxed);
+    record.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    record.fence_idx = fence_idx;
+    record.signal_time = signal_time;
+    record.notify_time = notify_time;
+    memcpy(record.name, name, sizeof(record.name));
+
+    record.seq.store(seq + 2, std::memory_order_release);
+    m_timeline_pos.store(pos + 1, std::memory_order_release);
+}
+
+void FenceMonitor::dump(String8* dump_str)
+{
+    size_t num_active = 0;
+    {
+        Mutex::Autolock l(m_lock);
+        num_active = m_num_active;
+    }
+
+    dump_str->appendFormat("\n[HWC FenceMonitor]\n");
+    dump_str->appendFormat("  active:%zu/%d added:%" PRIu64 " full:%" PRIu64 " timeout:%" PRIu64 "\n",
+                           num_active, HWC_FENCE_MONITOR_MAX_FENCES,
+                           m_add_count.load(std::memory_order_relaxed),
+                           m_full_count.load(std::memory_order_relaxed),
+                           m_timeout_count.load(std::memory_order_relaxed));
+
+    const uint64_t pos = m_timeline_pos.load(std::memory_order_acquire);
+    const uint64_t count = std::min(pos, static_cast<uint64_t>(HWC_FENCE_MONITOR_TIMELINE_SIZE));
+    for (uint64_t i = 1; i <= count; i++)
+    {
+        const Record& record = m_timeline[(pos - i) & (HWC_FENCE_MONITOR_TIMELINE_SIZE - 1)];
+
+        const uint32_t seq = record.seq.load(std::memory_order_acquire);
+        if (seq & 1)
+        {
+            continue;
+        }
+
+        char name[HWC_FENCE_MONITOR_NAME_LEN];
+        memcpy(name, record.name, sizeof(name));
+        name[sizeof(name) - 1] = '\0';
+        const unsigned int fence_idx = record.fence_idx;
+        const nsecs_t signal_time = record.signal_time;
+        const nsecs_t notify_time = record.notify_time;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (record.seq.load(std::memory_order_relaxed) != seq)
+        {
+            continue;
+        }
+
+        dump_str->appendFormat("  %s idx:%u signal:%" PRId64 " notify:%" PRId64 "\n",
+                               name, fence_idx, signal_time, notify_time);
+    }
+}
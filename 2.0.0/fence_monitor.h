@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+
+#include "worker.h"
+
+namespace android {
+class String8;
+}
+
+// HWC_FENCE_MONITOR_MAX_FENCES is the number of fences watched at the same time
+#define HWC_FENCE_MONITOR_MAX_FENCES 64
+
+// HWC_FENCE_MONITOR_TIMELINE_SIZE is the number of signals kept for dumpsys,
+// it must be a power of two
+#define HWC_FENCE_MONITOR_TIMELINE_SIZE 64
+
+#define HWC_FENCE_MONITOR_NAME_LEN 16
+
+struct FenceMonitorListener : public virtual RefBase {
+    // onFenceSignaled() is called by the thread of FenceMonitor. signal_time
+    // is the timestamp of the fence, or SIGNAL_TIME_INVALID if the fence has
+    // an error or does not signal before the timeout
+    virtual void onFenceSignaled(unsigned int fence_idx, nsecs_t signal_time) = 0;
+};
+
+// FenceMonitor is the process-wide thread which watches fences for debugging
+// and statistics. All fences are registered into one epoll set, so the
+// owners do not need a thread per fence stream, and the signals of all
+// owners are kept in one timeline for diagnosis.
+class FenceMonitor : public HWCThread
+{
+public:
+    static FenceMonitor& getInstance();
+    virtual ~FenceMonitor();
+
+    // addFence() dups fd and watches it. listener is called once, when the
+    // fence signals or timeout_ms passes. name identifies the owner in the
+    // timeline and the log
+    status_t addFence(int fd, const sp<FenceMonitorListener>& listener,
+                      unsigned int fence_idx, int timeout_ms, const char* name);
+
+    void dump(android::String8* dump_str);
+
+private:
+    FenceMonitor();
+
+    struct Slot
+    {
+        int fd;
+        uint32_t generation;
+        unsigned int fence_idx;
+        nsecs_t deadline;
+        char name[HWC_FENCE_MONITOR_NAME_LEN];
+        sp<FenceMonitorListener> listener;
+    };
+
+    // Record is written only by the thread of FenceMonitor. seq is odd while
+    // the record is being written, so a reader can drop a torn record
+    struct Record
+    {
+        std::atomic<uint32_t> seq;
+        unsigned int fence_idx;
+        nsecs_t signal_time;
+        nsecs_t notify_time;
+        char name[HWC_FENCE_MONITOR_NAME_LEN];
+    };
+
+    virtual void onFirstRef();
+    virtual bool threadLoop();
+
+    // handleFence() releases the slot of idx and notifies its listener
+    void handleFence(size_t idx, uint32_t generation, bool is_timeout);
+
+    // checkTimeout() handles the fences which pass their deadline, and
+    // returns the time to the nearest deadline in ms, or -1 if it is idle
+    int checkTimeout();
+
+    void addRecord(const char* name, unsigned int fence_idx, nsecs_t signal_time, nsecs_t notify_time);
+
+    int m_epoll_fd;
+
+    // m_wake_fd wakes up the thread when the first fence is added, so the
+    // timeout of the fence is handled
+    int m_wake_fd;
+
+    // m_lock of HWCThread protects the slots
+    Slot m_slots[HWC_FENCE_MONITOR_MAX_FENCES];
+    size_t m_num_active;
+    uint32_t m_generation;
+
+    Record m_timeline[HWC_FENCE_MONITOR_TIMELINE_SIZE];
+    std::atomic<uint64_t> m_timeline_pos;
+
+    std::atomic<uint64_t> m_add_count;
+    std::atomic<uint64_t> m_full_count;
+    std::atomic<uint64_t> m_timeout_count;
+};
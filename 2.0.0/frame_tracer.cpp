@@ -0,0 +1,354 @@
+#define DEBUG_LOG_TAG "FTR"
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "frame_tracer.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
+#include <utils/String8.h>
+
+#include "utils/debug.h"
+#include "utils/tools.h"
+
+using namespace android;
+
+// FenceMonitor drops a fence which does not signal in this period
+#define HWC_FRAME_TRACER_FENCE_TIMEOUT_MS 1000
+
+HWCFrameTracer& HWCFrameTracer::getInstance()
+{
+    static HWCFrameTracer gInstance;
+    return gInstance;
+}
+
+HWCFrameTracer::HWCFrameTracer()
+    : m_mode(0)
+    , m_fence_fail_count(0)
+{
+    for (size_t dpy = 0; dpy < HWC_FRAME_TRACER_MAX_DISPLAYS; dpy++)
+    {
+        for (size_t i = 0; i < HWC_FRAME_TRACER_SIZE; i++)
+        {
+            for (size_t s = 0; s < HWC_FRAME_STAGE_NUM; s++)
+            {
+                m_records[dpy][i].stages[s].tag.store(0, std::memory_order_relaxed);
+                m_records[dpy][i].stages[s].ts.store(0, std::memory_order_relaxed);
+            }
+        }
+        m_last_watch_seq[dpy].store(0, std::memory_order_relaxed);
+        m_present_listener[dpy] = new FenceListener(dpy, HWC_FRAME_STAGE_PRESENT_FENCE);
+        m_release_listener[dpy] = new FenceListener(dpy, HWC_FRAME_STAGE_RELEASE_FENCE);
+    }
+}
+
+void HWCFrameTracer::updateConfig()
+{
+    char value[PROPERTY_VALUE_MAX] = {0};
+    property_get("vendor.debug.hwc.frame_tracer", value, "0");
+    m_mode.store(atoi(value), std::memory_order_relaxed);
+}
+
+const char* HWCFrameTracer::getStageName(int stage)
+{
+    switch (stage)
+    {
+        case HWC_FRAME_STAGE_VALIDATE_START: return "validate_start";
+        case HWC_FRAME_STAGE_VALIDATE_END: return "validate_end";
+        case HWC_FRAME_STAGE_PRESENT: return "present";
+        case HWC_FRAME_STAGE_SET_JOB: return "set_job";
+        case HWC_FRAME_STAGE_DISPATCH: return "dispatch";
+        case HWC_FRAME_STAGE_OVL_LOOP: return "ovl_loop";
+        case HWC_FRAME_STAGE_COMMIT_DONE: return "commit_done";
+        case HWC_FRAME_STAGE_PRESENT_FENCE: return "present_fence";
+        case HWC_FRAME_STAGE_RELEASE_FENCE: return "release_fence";
+        default: return "unknown";
+    }
+}
+
+void HWCFrameTracer::stamp(uint64_t dpy, uint64_t sequence, int stage, nsecs_t ts)
+{
+    if (!isEnabled() || dpy >= HWC_FRAME_TRACER_MAX_DISPLAYS ||
+        stage < 0 || stage >= HWC_FRAME_STAGE_NUM)
+    {
+        return;
+    }
+
+    Stage& st = m_records[dpy][sequence & (HWC_FRAME_TRACER_SIZE - 1)].stages[stage];
+    st.tag.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    st.ts.store(ts, std::memory_order_relaxed);
+    st.tag.store(sequence + 1, std::memory_order_release);
+}
+
+void HWCFrameTracer::watchFence(uint64_t dpy, uint64_t sequence, int stage, int fd)
+{
+    if (!isEnabled() || fd < 0 || dpy >= HWC_FRAME_TRACER_MAX_DISPLAYS)
+    {
+        return;
+    }
+
+    sp<FenceListener> listener;
+    const char* name = nullptr;
+    if (stage == HWC_FRAME_STAGE_PRESENT_FENCE)
+    {
+        listener = m_present_listener[dpy];
+        name = "ftr_present";
+    }
+    else if (stage == HWC_FRAME_STAGE_RELEASE_FENCE)
+    {
+        listener = m_release_listener[dpy];
+        name = "ftr_release";
+    }
+    else
+    {
+        return;
+    }
+
+    // fences are watched by the thread of setJob in the order of sequence
+    m_last_watch_seq[dpy].store(sequence, std::memory_order_relaxed);
+    if (FenceMonitor::getInstance().addFence(fd, listener, static_cast<unsigned int>(sequence),
+                                             HWC_FRAME_TRACER_FENCE_TIMEOUT_MS, name) != NO_ERROR)
+    {
+        m_fence_fail_count.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void HWCFrameTracer::FenceListener::onFenceSignaled(unsigned int fence_idx, nsecs_t signal_time)
+{
+    HWCFrameTracer::getInstance().onFenceSignaled(m_disp_id, m_stage, fence_idx, signal_time);
+}
+
+void HWCFrameTracer::onFenceSignaled(uint64_t dpy, int stage, unsigned int fence_idx, nsecs_t signal_time)
+{
+    if (signal_time == SIGNAL_TIME_INVALID)
+    {
+        return;
+    }
+
+    const uint64_t base = m_last_watch_seq[dpy].load(std::memory_order_relaxed);
+    const uint64_t sequence = base - static_cast<uint32_t>(static_cast<uint32_t>(base) - fence_idx);
+    stamp(dpy, sequence, stage, signal_time);
+}
+
+bool HWCFrameTracer::readFrame(const Record& record, Frame* frame) const
+{
+    uint64_t tags[HWC_FRAME_STAGE_NUM];
+    nsecs_t ts[HWC_FRAME_STAGE_NUM];
+    uint64_t max_tag = 0;
+    for (size_t s = 0; s < HWC_FRAME_STAGE_NUM; s++)
+    {
+        const Stage& st = record.stages[s];
+        const uint64_t tag = st.tag.load(std::memory_order_acquire);
+        ts[s] = st.ts.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        tags[s] = (st.tag.load(std::memory_order_relaxed) == tag) ? tag : 0;
+        max_tag = std::max(max_tag, tags[s]);
+    }
+
+    if (max_tag == 0)
+    {
+        return false;
+    }
+
+    frame->sequence = max_tag - 1;
+    for (size_t s = 0; s < HWC_FRAME_STAGE_NUM; s++)
+    {
+        frame->ts[s] = (tags[s] == max_tag) ? ts[s] : -1;
+    }
+    return true;
+}
+
+static nsecs_t getPercentile(std::vector<nsecs_t>* samples, int pct)
+{
+    if (samples->empty())
+        return 0;
+
+    const size_t idx = std::min(samples->size() - 1,
+                                samples->size() * static_cast<size_t>(pct) / 100);
+    std::nth_element(samples->begin(), samples->begin() + static_cast<long>(idx), samples->end());
+    return (*samples)[idx];
+}
+
+void HWCFrameTracer::dump(String8* dump_str)
+{
+    std::lock_guard<std::mutex> lock(m_dump_lock);
+
+    const int mode = m_mode.load(std::memory_order_relaxed);
+    dump_str->appendFormat("FrameTracer mode:%d fence_fail:%" PRIu64 " (latency from the previous stage, us)\n",
+                           mode, m_fence_fail_count.load(std::memory_order_relaxed));
+    if (mode == 0)
+    {
+        return;
+    }
+
+    for (size_t dpy = 0; dpy < HWC_FRAME_TRACER_MAX_DISPLAYS; dpy++)
+    {
+        std::vector<nsecs_t> deltas[HWC_FRAME_STAGE_NUM];
+        std::vector<nsecs_t> totals;
+        size_t frame_count = 0;
+        for (size_t i = 0; i < HWC_FRAME_TRACER_SIZE; i++)
+        {
+            Frame frame;
+            if (!readFrame(m_records[dpy][i], &frame))
+                continue;
+
+            frame_count++;
+            int first = -1;
+            int prev = -1;
+            for (int s = 0; s < HWC_FRAME_STAGE_NUM; s++)
+            {
+                if (frame.ts[s] < 0)
+                    continue;
+
+                if (prev >= 0)
+                {
+                    deltas[s].push_back(frame.ts[s] - frame.ts[prev]);
+                }
+                else
+                {
+                    first = s;
+                }
+                prev = s;
+            }
+            if (frame.ts[HWC_FRAME_STAGE_PRESENT_FENCE] >= 0 && first != HWC_FRAME_STAGE_PRESENT_FENCE)
+            {
+                totals.push_back(frame.ts[HWC_FRAME_STAGE_PRESENT_FENCE] - frame.ts[first]);
+            }
+        }
+
+        if (frame_count == 0)
+            continue;
+
+        dump_str->appendFormat("  (%zu) frames:%zu\n", dpy, frame_count);
+        for (int s = 1; s < HWC_FRAME_STAGE_NUM; s++)
+        {
+            if (deltas[s].empty())
+                continue;
+
+            const nsecs_t max = *std::max_element(deltas[s].begin(), deltas[s].end());
+            dump_str->appendFormat("    %-14s n:%-4zu p50:%-6" PRId64 " p99:%-6" PRId64 " max:%" PRId64 "\n",
+                                   getStageName(s), deltas[s].size(),
+                                   ns2us(getPercentile(&deltas[s], 50)),
+                                   ns2us(getPercentile(&deltas[s], 99)), ns2us(max));
+        }
+        if (!totals.empty())
+        {
+            const nsecs_t max = *std::max_element(totals.begin(), totals.end());
+            dump_str->appendFormat("    %-14s n:%-4zu p50:%-6" PRId64 " p99:%-6" PRId64 " max:%" PRId64 "\n",
+                                   "to_present", totals.size(), ns2us(getPercentile(&totals, 50)),
+                                   ns2us(getPercentile(&totals, 99)), ns2us(max));
+        }
+    }
+
+    if (mode == 2)
+    {
+        writeTrace();
+        dump_str->appendFormat("  trace: %s\n", HWC_FRAME_TRACER_PATH);
+    }
+}
+
+static void appendTraceTime(String8* str, nsecs_t ns)
+{
+    // the unit of Chrome trace is us
+    str->appendFormat("%" PRId64 ".%03" PRId64, ns / 1000, ns % 1000);
+}
+
+void HWCFrameTracer::writeTrace()
+{
+    String8 json;
+    json.append("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first_event = true;
+    auto beginEvent = [&json, &first_event]()
+    {
+        json.append(first_event ? "" : ",\n");
+        first_event = false;
+    };
+
+    for (size_t dpy = 0; dpy < HWC_FRAME_TRACER_MAX_DISPLAYS; dpy++)
+    {
+        // each display is a process and each stage is a thread, so the
+        // stages of one frame line up with the sequence in args
+        beginEvent();
+        json.appendFormat("{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%zu,\"args\":{\"name\":\"HWC display %zu\"}}",
+                          dpy, dpy);
+        for (int s = 1; s < HWC_FRAME_STAGE_NUM; s++)
+        {
+            beginEvent();
+            json.appendFormat("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%zu,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                              dpy, s, getStageName(s));
+        }
+
+        for (size_t i = 0; i < HWC_FRAME_TRACER_SIZE; i++)
+        {
+            Frame frame;
+            if (!readFrame(m_records[dpy][i], &frame))
+                continue;
+
+            int first = -1;
+            int prev = -1;
+            for (int s = 0; s < HWC_FRAME_STAGE_NUM; s++)
+            {
+                if (frame.ts[s] < 0)
+                    continue;
+
+                if (prev >= 0)
+                {
+                    beginEvent();
+                    json.appendFormat("{\"ph\":\"X\",\"cat\":\"hwc\",\"name\":\"%s\",\"pid\":%zu,\"tid\":%d,\"ts\":",
+                                      getStageName(s), dpy, s);
+                    appendTraceTime(&json, frame.ts[prev]);
+                    json.append(",\"dur\":");
+                    appendTraceTime(&json, std::max(frame.ts[s] - frame.ts[prev], static_cast<nsecs_t>(0)));
+                    json.appendFormat(",\"args\":{\"seq\":%" PRIu64 "}}", frame.sequence);
+                }
+                else
+                {
+                    first = s;
+                }
+                prev = s;
+            }
+
+            // an async slice of the whole frame joins its stages in the UI
+            if (first >= 0 && prev != first)
+            {
+                beginEvent();
+                json.appendFormat("{\"ph\":\"b\",\"cat\":\"hwc\",\"name\":\"frame\",\"id\":%" PRIu64 ",\"pid\":%zu,\"ts\":",
+                                  frame.sequence, dpy);
+                appendTraceTime(&json, frame.ts[first]);
+                json.appendFormat(",\"args\":{\"seq\":%" PRIu64 "}}", frame.sequence);
+                beginEvent();
+                json.appendFormat("{\"ph\":\"e\",\"cat\":\"hwc\",\"name\":\"frame\",\"id\":%" PRIu64 ",\"pid\":%zu,\"ts\":",
+                                  frame.sequence, dpy);
+                appendTraceTime(&json, frame.ts[prev]);
+                json.append("}");
+            }
+        }
+    }
+    json.append("\n]}\n");
+
+    // write a temporary file and rename it, so a reader never sees a
+    // partial trace
+    const char* tmp_path = HWC_FRAME_TRACER_PATH ".tmp";
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        HWC_LOGW("%s: failed to open %s: %s", __func__, tmp_path, strerror(errno));
+        return;
+    }
+
+    const bool ok = write(fd, json.string(), json.length()) == static_cast<ssize_t>(json.length());
+    ::protectedClose(fd);
+    if (!ok || rename(tmp_path, HWC_FRAME_TRACER_PATH) != 0)
+    {
+        HWC_LOGW("%s: failed to write %s: %s", __func__, HWC_FRAME_TRACER_PATH, strerror(errno));
+        unlink(tmp_path);
+    }
+}
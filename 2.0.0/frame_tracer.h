@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+#include <hardware/hwcomposer_defs.h>
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+
+#include "fence_monitor.h"
+
+namespace android {
+class String8;
+}
+
+// HWC_FRAME_TRACER_SIZE is the number of frames kept for each display, it
+// must be a power of two
+#define HWC_FRAME_TRACER_SIZE 256
+
+#define HWC_FRAME_TRACER_MAX_DISPLAYS HWC_NUM_DISPLAY_TYPES
+
+// the Chrome trace JSON written by dump() when vendor.debug.hwc.frame_tracer
+// is 2, it can be opened by ui.perfetto.dev or chrome://tracing
+#define HWC_FRAME_TRACER_PATH "/data/SF_dump/hwc_frame_trace.json"
+
+// the stages of a frame in the order of the pipeline
+enum HWC_FRAME_STAGE
+{
+    HWC_FRAME_STAGE_VALIDATE_START = 0,
+    HWC_FRAME_STAGE_VALIDATE_END,
+    HWC_FRAME_STAGE_PRESENT,
+    HWC_FRAME_STAGE_SET_JOB,
+    HWC_FRAME_STAGE_DISPATCH,
+    HWC_FRAME_STAGE_OVL_LOOP,
+    HWC_FRAME_STAGE_COMMIT_DONE,
+    HWC_FRAME_STAGE_PRESENT_FENCE,
+    HWC_FRAME_STAGE_RELEASE_FENCE,
+    HWC_FRAME_STAGE_NUM,
+};
+
+// HWCFrameTracer stamps each frame, identified by DispatcherJob::sequence,
+// at every stage of the pipeline, so the latency of a frame can be joined
+// across the binder, dispatcher and overlay threads. stamp() is lock-free
+// and may be called by any thread, each stage of a record is a small
+// seqlock, so dump() never blocks the pipeline.
+class HWCFrameTracer
+{
+public:
+    static HWCFrameTracer& getInstance();
+
+    bool isEnabled() const { return m_mode.load(std::memory_order_relaxed) != 0; }
+
+    // updateConfig() reads vendor.debug.hwc.frame_tracer, 0 disables the
+    // tracer, 1 enables it and 2 also writes HWC_FRAME_TRACER_PATH on dump
+    void updateConfig();
+
+    // stamp() records ts as the time when frame sequence of dpy reaches stage
+    void stamp(uint64_t dpy, uint64_t sequence, int stage, nsecs_t ts = systemTime());
+
+    // watchFence() stamps stage with the signal time of fd, fd is not taken
+    void watchFence(uint64_t dpy, uint64_t sequence, int stage, int fd);
+
+    void dump(android::String8* dump_str);
+
+    static const char* getStageName(int stage);
+
+private:
+    HWCFrameTracer();
+
+    // a stage is valid only if its tag is sequence + 1, the tag is cleared
+    // while ts is being written
+    struct Stage
+    {
+        std::atomic<uint64_t> tag;
+        std::atomic<nsecs_t> ts;
+    };
+
+    struct Record
+    {
+        Stage stages[HWC_FRAME_STAGE_NUM];
+    };
+
+    // Frame is a consistent copy of a Record
+    struct Frame
+    {
+        uint64_t sequence;
+        nsecs_t ts[HWC_FRAME_STAGE_NUM];
+    };
+
+    // FenceListener stamps the signal time of fences of one stage, the
+    // tracer is a static object, so it cannot be held by sp<> itself
+    struct FenceListener : public FenceMonitorListener {
+        FenceListener(uint64_t dpy, int stage) : m_disp_id(dpy), m_stage(stage) { }
+        virtual void onFenceSignaled(unsigned int fence_idx, nsecs_t signal_time);
+
+        uint64_t m_disp_id;
+        int m_stage;
+    };
+
+    // onFenceSignaled() restores the sequence from its low 32 bits, which is
+    // carried by the index of FenceMonitor
+    void onFenceSignaled(uint64_t dpy, int stage, unsigned int fence_idx, nsecs_t signal_time);
+
+    // readFrame() copies the newest frame in record, it returns false if no
+    // stage is stamped
+    bool readFrame(const Record& record, Frame* frame) const;
+
+    // writeTrace() writes the frames of all displays as Chrome trace JSON
+    void writeTrace();
+
+    std::atomic<int> m_mode;
+
+    Record m_records[HWC_FRAME_TRACER_MAX_DISPLAYS][HWC_FRAME_TRACER_SIZE];
+
+    // m_last_watch_seq is the sequence of the last watched fence of each
+    // display, fence signals are mapped back to the nearest older sequence
+    std::atomic<uint64_t> m_last_watch_seq[HWC_FRAME_TRACER_MAX_DISPLAYS];
+
+    sp<FenceListener> m_present_listener[HWC_FRAME_TRACER_MAX_DISPLAYS];
+    sp<FenceListener> m_release_listener[HWC_FRAME_TRACER_MAX_DISPLAYS];
+
+    std::atomic<uint64_t> m_fence_fail_count;
+
+    // m_dump_lock serializes dump(), it is never taken by stamp()
+    std::mutex m_dump_lock;
+};
@@ -2,11 +2,16 @@
 
 #include "hrt_common.h"
 
+#include <cstring>
 #include <vector>
 
+#include <inttypes.h>
+
 #include "overlay.h"
 #include "dispatcher.h"
 #include "hwc2.h"
+#include "platform_wrap.h"
+#include "sim_hrt.h"
 
 #ifndef MTK_HWC_USE_DRM_DEVICE
 #include "legacy/hrt.h"
@@ -50,6 +55,18 @@ void HrtCommon::setCompType(const std::vector<sp<HWCDisplay> >& displays)
 void HrtCommon::dump(String8* str)
 {
     str->appendFormat("%s\n", m_hrt_result.str().c_str());
+    str->appendFormat("[HRT Cache] enable:%d entries:%zu hit:%" PRIu64 " miss:%" PRIu64 "\n",
+                      isCacheEnabled(), m_cache.size(), m_cache_hit_count, m_cache_miss_count);
+    str->appendFormat("[HRT Query] memo:%d hit:%" PRIu64 " miss:%" PRIu64 "\n",
+                      Platform::getInstance().m_config.hrt_query_memo,
+                      m_query_hit_count, m_query_miss_count);
+    str->appendFormat("[HRT Model] check:%d checked:%" PRIu64 " mismatch:%" PRIu64 "\n",
+                      Platform::getInstance().m_config.hrt_model_check,
+                      m_check_count, m_check_mismatch_count);
+    str->appendFormat("[HRT Plan] joint:%d shared_bound:%u planned:%" PRIu64 " fail:%" PRIu64 " extend:%" PRIu64 "\n",
+                      Platform::getInstance().m_config.hrt_joint_plan,
+                      Platform::getInstance().m_config.hrt_model_shared_bound_layer_num,
+                      m_plan_count, m_plan_fail_count, m_plan_extend_count);
 }
 
 void HrtCommon::printQueryValidLayerResult()
@@ -256,7 +273,7 @@ void HrtCommon::fillLayerInfoOfDispatcherJob(const std::vector<sp<HWCDisplay> >&
     }
 }
 
-void HrtCommon::run(std::vector<sp<HWCDisplay> >& displays, const bool& is_skip_validate)
+bool HrtCommon::run(std::vector<sp<HWCDisplay> >& displays, const bool& is_skip_validate)
 {
     updateGlesRangeForDisplaysBeforHrt(displays);
     if (0 == isEnabled())
@@ -264,23 +281,89 @@ void HrtCommon::run(std::vector<sp<HWCDisplay> >& displays, const bool& is_skip_
         HrtCommon::simpleLayeringRule(displays);
         updateGlesRangeHwTypeForDisplays(displays);
         HrtCommon::fillLayerInfoOfDispatcherJob(displays);
-        return;
+        return true;
     }
 
     if (is_skip_validate)
     {
+        if (!m_is_result_valid)
+        {
+            HWC_LOGD("%s: no layering to restore", __func__);
+            return false;
+        }
+
         updateGlesRangeHwTypeForDisplays(displays);
+        if (m_is_cache_restored)
+        {
+            // the layering must not fall back to the older result of the
+            // backend, the caller validates again instead
+            if (!applyCacheEntry(displays, m_restored_entry, false))
+            {
+                HWC_LOGD("%s: failed to restore the cached layering", __func__);
+                return false;
+            }
+            return true;
+        }
         fillLayerInfoOfDispatcherJob(displays);
-        return;
+        return true;
+    }
+
+    // the planned range is a part of the layer stack, so it is done before
+    // the cache lookup
+    if (Platform::getInstance().m_config.hrt_joint_plan)
+    {
+        planJointLayering(displays);
+    }
+
+    std::vector<int64_t> key;
+    uint64_t hash = 0;
+    const bool is_cache_enabled = isCacheEnabled();
+    m_is_cache_restored = false;
+    if (is_cache_enabled)
+    {
+        buildCacheKey(displays, &key, &hash);
+        if (restoreFromCache(displays, key, hash))
+        {
+            m_is_cache_restored = true;
+            m_is_result_valid = true;
+            m_restored_entry = m_cache.front();
+            setCompType(displays);
+            if (isRPOEnabled())
+            {
+                modifyMdpDstRoiIfRejectedByRpo(displays);
+            }
+            updateGlesRangeHwTypeForDisplays(displays);
+            return true;
+        }
+    }
+    else if (!m_cache.empty())
+    {
+        clearCache();
+    }
+
+    const bool is_check_model = Platform::getInstance().m_config.hrt_model_check && !isSimulated();
+    if (is_check_model)
+    {
+        buildHrtModelInput(displays, isRPOEnabled(), &m_check_input);
+        m_check_model.layering(m_check_input, &m_check_result);
     }
 
     fillLayerConfigList(displays);
 
     fillDispLayer(displays);
 
-    if (queryValidLayer())
+    if (queryValidLayerWithMemo())
     {
+        m_is_result_valid = true;
         fillLayerInfoOfDispatcherJob(displays);
+        if (is_check_model)
+        {
+            checkModel(displays);
+        }
+        if (is_cache_enabled)
+        {
+            storeToCache(displays, &key, hash);
+        }
         setCompType(displays);
         if (isRPOEnabled())
         {
@@ -292,6 +375,8 @@ void HrtCommon::run(std::vector<sp<HWCDisplay> >& displays, const bool& is_skip_
     else
     {
         HWC_LOGE("%s: an error when hrt calculating!", __func__);
+        m_is_result_valid = false;
+        clearCache();
 
         for (auto& display : displays)
         {
@@ -305,6 +390,53 @@ void HrtCommon::run(std::vector<sp<HWCDisplay> >& displays, const bool& is_skip_
 
             job->layer_info.max_overlap_layer_num = -1;
         }
+        return false;
+    }
+    return true;
+}
+
+void HrtCommon::planJointLayering(const std::vector<sp<HWCDisplay> >& displays)
+{
+    buildHrtModelInput(displays, isRPOEnabled(), &m_plan_input);
+    if (m_plan_input.size() < 2)
+        return;
+
+    // by default each display keeps its own bound, so the plan only moves
+    // the bandwidth between them
+    uint32_t shared_bound = Platform::getInstance().m_config.hrt_model_shared_bound_layer_num;
+    if (0 == shared_bound)
+    {
+        shared_bound = Platform::getInstance().m_config.hrt_model_bound_layer_num *
+                       static_cast<uint32_t>(m_plan_input.size());
+    }
+
+    if (!m_plan_model.plan(m_plan_input, shared_bound, &m_plan_result))
+    {
+        ++m_plan_fail_count;
+        HWC_LOGV("%s: no plan in shared bound %u", __func__, shared_bound);
+        return;
+    }
+    ++m_plan_count;
+
+    for (auto& plan : m_plan_result)
+    {
+        for (auto& display : displays)
+        {
+            if (display->getId() != plan.disp_id)
+                continue;
+
+            int32_t gles_head = -1, gles_tail = -1;
+            display->getGlesRange(&gles_head, &gles_tail);
+            if (gles_head != plan.gles_head || gles_tail != plan.gles_tail)
+            {
+                HWC_LOGV("%s: disp:%" PRIu64 " gles(%d,%d)->(%d,%d) w:%u gpu_pixels:%" PRIu64, __func__,
+                         plan.disp_id, gles_head, gles_tail, plan.gles_head, plan.gles_tail,
+                         plan.overlap_weight, plan.gpu_pixels);
+                display->setGlesRange(plan.gles_head, plan.gles_tail);
+                ++m_plan_extend_count;
+            }
+            break;
+        }
     }
 }
 
@@ -328,9 +460,378 @@ void HrtCommon::updateGlesRangeHwTypeForDisplays(const std::vector<sp<HWCDisplay
     }
 }
 
+bool HrtCommon::isCacheEnabled() const
+{
+    return Platform::getInstance().m_config.hrt_decision_cache;
+}
+
+void HrtCommon::clearCache()
+{
+    m_cache.clear();
+}
+
+static inline void pushFloat(std::vector<int64_t>* key, const float& val)
+{
+    uint32_t bits = 0;
+    memcpy(&bits, &val, sizeof(bits));
+    key->push_back(bits);
+}
+
+static inline void pushRect(std::vector<int64_t>* key, const hwc_rect_t& rect)
+{
+    key->push_back(rect.left);
+    key->push_back(rect.top);
+    key->push_back(rect.right);
+    key->push_back(rect.bottom);
+}
+
+void HrtCommon::buildCacheKey(const std::vector<sp<HWCDisplay> >& displays,
+                              std::vector<int64_t>* key, uint64_t* hash)
+{
+    key->clear();
+    for (auto& display : displays)
+    {
+        if (!display->isConnected())
+            continue;
+
+        const std::vector<sp<HWCLayer> >& layers = display->getVisibleLayersSortedByZ();
+        int32_t gles_head = -1, gles_tail = -1;
+        display->getGlesRange(&gles_head, &gles_tail);
+
+        key->push_back(static_cast<int64_t>(display->getId()));
+        key->push_back(display->getActiveConfig());
+        key->push_back(display->getPowerMode());
+        key->push_back(display->getColorMode());
+        key->push_back(display->getMirrorSrc());
+        key->push_back(gles_head);
+        key->push_back(gles_tail);
+        key->push_back(display->getClientClearLayerNum());
+        key->push_back(static_cast<int64_t>(layers.size()));
+
+        for (auto& layer : layers)
+        {
+            const PrivateHandle& priv_hnd = layer->getPrivateHandle();
+            const hwc_frect_t& src_crop = layer->getSourceCrop();
+
+            key->push_back(layer->getHwlayerType());
+            key->push_back(priv_hnd.format);
+            key->push_back(priv_hnd.prexform);
+            key->push_back(isCompressData(&priv_hnd));
+            key->push_back(isSecure(&priv_hnd));
+            key->push_back(layer->isNeedPQ());
+            key->push_back(priv_hnd.pq_enable);
+            pushFloat(key, src_crop.left);
+            pushFloat(key, src_crop.top);
+            pushFloat(key, src_crop.right);
+            pushFloat(key, src_crop.bottom);
+            pushRect(key, layer->getDisplayFrame());
+            key->push_back(layer->getTransform());
+            key->push_back(layer->getBlend());
+            key->push_back(layer->getDataspace());
+            pushFloat(key, layer->getPlaneAlpha());
+            key->push_back(layer->getZOrder());
+            key->push_back(layer->getLayerCaps());
+
+            switch (layer->getHwlayerType())
+            {
+                case HWC_LAYER_TYPE_MM:
+                    pushRect(key, layer->getMdpDstRoi());
+                    key->push_back(layer->decideMdpOutputFormat());
+                    key->push_back(layer->decideMdpOutDataspace());
+                    key->push_back(layer->decideMdpOutputCompressedBuffers());
+                    break;
+
+                case HWC_LAYER_TYPE_GLAI:
+                    pushRect(key, layer->getGlaiDstRoi());
+                    key->push_back(layer->getGlaiOutFormat());
+                    break;
+
+                default:
+                    break;
+            }
+        }
+    }
+
+    // FNV-1a
+    uint64_t val = 14695981039346656037ULL;
+    for (auto& item : *key)
+    {
+        val ^= static_cast<uint64_t>(item);
+        val *= 1099511628211ULL;
+    }
+    *hash = val;
+}
+
+bool HrtCommon::restoreFromCache(const std::vector<sp<HWCDisplay> >& displays,
+                                 const std::vector<int64_t>& key, const uint64_t& hash)
+{
+    auto entry = m_cache.begin();
+    for (; entry != m_cache.end(); ++entry)
+    {
+        if (entry->hash == hash && entry->key == key)
+            break;
+    }
+
+    if (entry == m_cache.end() || entry->hrt_weight != m_last_hrt_weight ||
+        !applyCacheEntry(displays, *entry, true))
+    {
+        ++m_cache_miss_count;
+        return false;
+    }
+
+    // move the entry to the front
+    m_cache.splice(m_cache.begin(), m_cache, entry);
+    ++m_cache_hit_count;
+    return true;
+}
+
+bool HrtCommon::applyCacheEntry(const std::vector<sp<HWCDisplay> >& displays,
+                                const HrtCacheEntry& entry, const bool& is_all_displays)
+{
+    std::vector<std::pair<sp<HWCDisplay>, const HrtCacheDisplay*> > targets;
+    for (auto& display : displays)
+    {
+        const uint64_t disp_id = display->getId();
+        DispatcherJob* job = HWCDispatcher::getInstance().getExistJob(disp_id);
+
+        if (!display->isConnected() || NULL == job || display->getMirrorSrc() != -1)
+            continue;
+
+        const HrtCacheDisplay* cache_display = NULL;
+        for (auto& item : entry.displays)
+        {
+            if (item.disp_id == disp_id)
+            {
+                cache_display = &item;
+                break;
+            }
+        }
+
+        if (NULL == cache_display)
+            return false;
+
+        targets.push_back(std::make_pair(display, cache_display));
+    }
+
+    if (targets.empty() || (is_all_displays && targets.size() != entry.displays.size()))
+        return false;
+
+    for (auto& target : targets)
+    {
+        const sp<HWCDisplay>& display = target.first;
+        const HrtCacheDisplay& cache_display = *target.second;
+        const uint64_t disp_id = display->getId();
+        DispatcherJob* job = HWCDispatcher::getInstance().getExistJob(disp_id);
+        const std::vector<sp<HWCLayer> >& layers = display->getVisibleLayersSortedByZ();
+
+        const unsigned int layers_num = static_cast<unsigned int>(cache_display.layers.size());
+        if (layers_num > m_cache_config_len[disp_id])
+        {
+            if (NULL != m_cache_config_list[disp_id])
+                delete[] m_cache_config_list[disp_id];
+
+            m_cache_config_len[disp_id] = layers_num;
+            m_cache_config_list[disp_id] = new HrtLayerConfig[layers_num];
+        }
+
+        for (size_t i = 0; i < cache_display.layers.size() && i < layers.size(); ++i)
+        {
+            const HrtCacheLayer& cache_layer = cache_display.layers[i];
+            m_cache_config_list[disp_id][i].ovl_id = cache_layer.ovl_id;
+            m_cache_config_list[disp_id][i].ext_sel_layer = cache_layer.ext_sel_layer;
+
+            auto& layer = layers[i];
+            layer->setLayerCaps(cache_layer.layer_caps);
+            if (cache_layer.is_clear_client)
+            {
+                layer->setHWCRequests(layer->getHWCRequests() | HWC2_LAYER_REQUEST_CLEAR_CLIENT_TARGET);
+            }
+        }
+
+        job->layer_info.hrt_config_list = m_cache_config_list[disp_id];
+        job->layer_info.gles_head = cache_display.gles_head;
+        job->layer_info.gles_tail = cache_display.gles_tail;
+        job->layer_info.max_overlap_layer_num = cache_display.max_overlap_layer_num;
+        job->layer_info.hrt_weight = m_last_hrt_weight;
+        job->layer_info.hrt_idx = m_last_hrt_idx;
+        HWC_LOGV("%s(), disp:%" PRIu64 " gles_head:%d gles_tail:%d hrt:%u,%u", __FUNCTION__,
+                 disp_id, job->layer_info.gles_head, job->layer_info.gles_tail,
+                 job->layer_info.hrt_weight, job->layer_info.hrt_idx);
+    }
+
+    return true;
+}
+
+void HrtCommon::storeToCache(const std::vector<sp<HWCDisplay> >& displays,
+                             std::vector<int64_t>* key, const uint64_t& hash)
+{
+    HrtCacheEntry entry;
+    entry.hash = hash;
+    entry.hrt_weight = 0;
+
+    bool has_job = false;
+    for (auto& display : displays)
+    {
+        const uint64_t disp_id = display->getId();
+        DispatcherJob* job = HWCDispatcher::getInstance().getExistJob(disp_id);
+
+        if (!display->isConnected() || NULL == job || display->getMirrorSrc() != -1)
+            continue;
+
+        // a display without the result of driver falls back to GLES, and
+        // the config list is not filled if the backend runs out of memory
+        const std::vector<sp<HWCLayer> >& layers = display->getVisibleLayersSortedByZ();
+        if (job->layer_info.max_overlap_layer_num == -1 ||
+            (!layers.empty() && NULL == job->layer_info.hrt_config_list))
+        {
+            return;
+        }
+
+        // every display has the weight and index of the same query
+        m_last_hrt_weight = job->layer_info.hrt_weight;
+        m_last_hrt_idx = job->layer_info.hrt_idx;
+        entry.hrt_weight = job->layer_info.hrt_weight;
+        has_job = true;
+
+        HrtCacheDisplay cache_display;
+        cache_display.disp_id = disp_id;
+        cache_display.gles_head = job->layer_info.gles_head;
+        cache_display.gles_tail = job->layer_info.gles_tail;
+        cache_display.max_overlap_layer_num = job->layer_info.max_overlap_layer_num;
+        cache_display.layers.resize(layers.size());
+        for (size_t i = 0; i < layers.size(); ++i)
+        {
+            HrtCacheLayer& cache_layer = cache_display.layers[i];
+            cache_layer.ovl_id = job->layer_info.hrt_config_list[i].ovl_id;
+            cache_layer.ext_sel_layer = job->layer_info.hrt_config_list[i].ext_sel_layer;
+            cache_layer.layer_caps = layers[i]->getLayerCaps();
+            cache_layer.is_clear_client =
+                (layers[i]->getHWCRequests() & HWC2_LAYER_REQUEST_CLEAR_CLIENT_TARGET) != 0;
+        }
+        entry.displays.push_back(std::move(cache_display));
+    }
+
+    if (!has_job)
+        return;
+
+    // a stack which is queried again replaces its stale entry
+    for (auto it = m_cache.begin(); it != m_cache.end(); ++it)
+    {
+        if (it->hash == hash && it->key == *key)
+        {
+            m_cache.erase(it);
+            break;
+        }
+    }
+
+    entry.key.swap(*key);
+    m_cache.push_front(std::move(entry));
+    if (m_cache.size() > HWC_HRT_CACHE_SIZE)
+    {
+        m_cache.pop_back();
+    }
+}
+
+static void packQuerySegments(const std::vector<std::pair<void*, size_t> >& segs, std::vector<uint8_t>* buf)
+{
+    buf->clear();
+    for (auto& seg : segs)
+    {
+        const uint8_t* data = static_cast<const uint8_t*>(seg.first);
+        buf->insert(buf->end(), data, data + seg.second);
+    }
+}
+
+bool HrtCommon::queryValidLayerWithMemo()
+{
+    QuerySegments segs;
+    if (Platform::getInstance().m_config.hrt_query_memo)
+    {
+        getQuerySegments(&segs);
+    }
+
+    if (segs.empty())
+    {
+        m_is_query_memo_valid = false;
+        return queryValidLayer();
+    }
+
+    packQuerySegments(segs, &m_query_buf);
+    if (m_is_query_memo_valid && m_query_buf == m_query_request &&
+        m_query_response.size() == m_query_request.size())
+    {
+        // the request is the same, so the result is written back into the
+        // buffers at the same addresses
+        size_t offset = 0;
+        for (auto& seg : segs)
+        {
+            memcpy(seg.first, m_query_response.data() + offset, seg.second);
+            offset += seg.second;
+        }
+        ++m_query_hit_count;
+        return true;
+    }
+
+    ++m_query_miss_count;
+    m_is_query_memo_valid = false;
+    m_query_request.swap(m_query_buf);
+    if (!queryValidLayer())
+    {
+        return false;
+    }
+
+    // the driver does not change the number and the size of buffers
+    packQuerySegments(segs, &m_query_response);
+    m_is_query_memo_valid = true;
+    return true;
+}
+
+void HrtCommon::checkModel(const std::vector<sp<HWCDisplay> >& displays)
+{
+    for (size_t i = 0; i < m_check_input.size() && i < m_check_result.size(); ++i)
+    {
+        const HrtModelResult& result = m_check_result[i];
+        DispatcherJob* job = HWCDispatcher::getInstance().getExistJob(result.disp_id);
+        if (NULL == job)
+            continue;
+
+        bool is_match = job->layer_info.gles_head == result.gles_head &&
+                        job->layer_info.gles_tail == result.gles_tail;
+        for (auto& display : displays)
+        {
+            if (display->getId() != result.disp_id)
+                continue;
+
+            const std::vector<sp<HWCLayer> >& layers = display->getVisibleLayersSortedByZ();
+            for (size_t j = 0; j < layers.size() && j < result.layer_caps.size(); ++j)
+            {
+                const bool is_driver_rsz = (layers[j]->getLayerCaps() & HWC_DISP_RSZ_LAYER) != 0;
+                const bool is_model_rsz = (result.layer_caps[j] & HRT_MODEL_CAPS_DISP_RSZ) != 0;
+                if (is_driver_rsz != is_model_rsz)
+                {
+                    is_match = false;
+                }
+            }
+        }
+
+        ++m_check_count;
+        if (!is_match)
+        {
+            ++m_check_mismatch_count;
+            HWC_LOGW("HRT model mismatch: driver g(%d,%d) ovlp:%d w:%u, model %s",
+                     job->layer_info.gles_head, job->layer_info.gles_tail,
+                     job->layer_info.max_overlap_layer_num, job->layer_info.hrt_weight,
+                     HrtModel::describe(m_check_input[i], result).c_str());
+        }
+    }
+}
+
 HrtCommon* createHrt()
 {
-#ifndef MTK_HWC_USE_DRM_DEVICE
+#ifdef MTK_HWC_USE_NULL_DEVICE
+    // null device has no layering driver, so the layering is simulated
+    return new SimHrt();
+#elif !defined(MTK_HWC_USE_DRM_DEVICE)
     return new Hrt();
 #else
     return new DrmHrt();
@@ -1,7 +1,10 @@
 #ifndef HWC_HRT_INTERFACE_H
 #define HWC_HRT_INTERFACE_H
 
+#include <atomic>
+#include <list>
 #include <sstream>
+#include <utility>
 #include <vector>
 
 #include <utils/StrongPointer.h>
@@ -9,6 +12,7 @@
 #include <utils/RefBase.h>
 
 #include "display.h"
+#include "hrt_model.h"
 
 using namespace android;
 
@@ -17,6 +21,9 @@ enum
     HWC_DISP_OVERRIDE_MDP_OUTPUT_FORMAT_DEFAULT = 0,
 };
 
+// HWC_HRT_CACHE_SIZE is the number of layer stacks kept by the decision cache
+#define HWC_HRT_CACHE_SIZE 8
+
 class HWCDisplay;
 struct HrtLayerConfig;
 
@@ -24,10 +31,26 @@ class HrtCommon : public RefBase
 {
 public:
     HrtCommon()
+        : m_last_hrt_weight(0)
+        , m_last_hrt_idx(0)
+        , m_is_cache_restored(false)
+        , m_is_result_valid(false)
+        , m_cache_hit_count(0)
+        , m_cache_miss_count(0)
+        , m_is_query_memo_valid(false)
+        , m_query_hit_count(0)
+        , m_query_miss_count(0)
+        , m_check_count(0)
+        , m_check_mismatch_count(0)
+        , m_plan_count(0)
+        , m_plan_fail_count(0)
+        , m_plan_extend_count(0)
     {
         memset(m_layer_config_len, 0, sizeof(m_layer_config_len));
         memset(m_hrt_config_list, 0, sizeof(m_hrt_config_list));
         memset(m_hrt_config_len, 0, sizeof(m_hrt_config_len));
+        memset(m_cache_config_list, 0, sizeof(m_cache_config_list));
+        memset(m_cache_config_len, 0, sizeof(m_cache_config_len));
     }
 
     virtual ~HrtCommon() {}
@@ -36,13 +59,19 @@ public:
 
     virtual bool isRPOEnabled() const;
 
+    // isSimulated() is true if the layering is decided by HrtModel
+    virtual bool isSimulated() const { return false; }
+
     virtual void dump(String8* str);
 
     virtual void printQueryValidLayerResult();
 
     virtual void modifyMdpDstRoiIfRejectedByRpo(const std::vector<sp<HWCDisplay> >& displays);
 
-    virtual void run(std::vector<sp<HWCDisplay> >& displays, const bool& is_skip_validate);
+    // run() decides the layering of displays, or restores the layering of the
+    // last validate if is_skip_validate is true. It returns false if neither
+    // can be done
+    virtual bool run(std::vector<sp<HWCDisplay> >& displays, const bool& is_skip_validate);
 
     void simpleLayeringRule(const std::vector<sp<HWCDisplay> >& displays);
 
@@ -61,11 +90,138 @@ public:
 
     // this function only called after hrt for updating hwtype in gles_range
     void updateGlesRangeHwTypeForDisplays(const std::vector<sp<HWCDisplay> >& displays);
+
+    // clearCache() drops all cached layering decisions
+    void clearCache();
+
+    // invalidateQuery() forces the next validate to query the driver, it is
+    // called when the driver state which is not in the request changes
+    void invalidateQuery() { m_is_query_memo_valid = false; }
 protected:
+    typedef std::vector<std::pair<void*, size_t> > QuerySegments;
+
+    // getQuerySegments() lists the buffers passed to the driver by
+    // queryValidLayer(), the driver writes its result into the same buffers.
+    // a backend without segments is always queried
+    virtual void getQuerySegments(QuerySegments* /*segs*/) {}
+
     std::stringstream m_hrt_result;
     unsigned int m_layer_config_len[DisplayManager::MAX_DISPLAYS];
     HrtLayerConfig* m_hrt_config_list[DisplayManager::MAX_DISPLAYS];
     unsigned int m_hrt_config_len[DisplayManager::MAX_DISPLAYS];
+
+private:
+    // the layering decision of a layer
+    struct HrtCacheLayer
+    {
+        uint32_t ovl_id;
+        int ext_sel_layer;
+        int32_t layer_caps;
+        bool is_clear_client;
+    };
+
+    // the layering decision of a display
+    struct HrtCacheDisplay
+    {
+        uint64_t disp_id;
+        int32_t gles_head;
+        int32_t gles_tail;
+        int max_overlap_layer_num;
+        std::vector<HrtCacheLayer> layers;
+    };
+
+    // HrtCacheEntry is the result of queryValidLayer() of a layer stack. hash
+    // is only used to reject a mismatch quickly, key is always compared
+    struct HrtCacheEntry
+    {
+        uint64_t hash;
+        std::vector<int64_t> key;
+        uint32_t hrt_weight;
+        std::vector<HrtCacheDisplay> displays;
+    };
+
+    bool isCacheEnabled() const;
+
+    // buildCacheKey() collects the signature of the layer stacks of displays.
+    // it covers everything used by fillLayerConfigList() of the backends, so
+    // the same key is always layered in the same way
+    void buildCacheKey(const std::vector<sp<HWCDisplay> >& displays,
+                       std::vector<int64_t>* key, uint64_t* hash);
+
+    // applyCacheEntry() fills the jobs of displays with entry. if
+    // is_all_displays is true, every display of entry must own a job
+    bool applyCacheEntry(const std::vector<sp<HWCDisplay> >& displays,
+                         const HrtCacheEntry& entry, const bool& is_all_displays);
+
+    // restoreFromCache() fills the dispatcher jobs with the cached decision
+    // of key, it returns false if key is not cached
+    bool restoreFromCache(const std::vector<sp<HWCDisplay> >& displays,
+                          const std::vector<int64_t>& key, const uint64_t& hash);
+
+    // storeToCache() saves the decision which is just filled into the jobs
+    void storeToCache(const std::vector<sp<HWCDisplay> >& displays,
+                      std::vector<int64_t>* key, const uint64_t& hash);
+
+    // the most recent entry is at the front
+    std::list<HrtCacheEntry> m_cache;
+
+    // a cache hit reuses the hrt_idx of the last query, the driver keeps the
+    // bandwidth of that query, so only an entry with the same weight can hit
+    uint32_t m_last_hrt_weight;
+    uint32_t m_last_hrt_idx;
+
+    // m_is_cache_restored is true if the last validate is restored from the
+    // cache, the result kept by the backend is older than it, so skipping
+    // validate applies m_restored_entry again
+    bool m_is_cache_restored;
+    HrtCacheEntry m_restored_entry;
+
+    // m_is_result_valid is false if the last validate has no layering to
+    // restore, e.g. the query failed
+    bool m_is_result_valid;
+
+    // m_cache_config_list is the hrt_config_list of the jobs restored from
+    // the cache
+    HrtLayerConfig* m_cache_config_list[DisplayManager::MAX_DISPLAYS];
+    unsigned int m_cache_config_len[DisplayManager::MAX_DISPLAYS];
+
+    uint64_t m_cache_hit_count;
+    uint64_t m_cache_miss_count;
+
+    // queryValidLayerWithMemo() reuses the last result of queryValidLayer()
+    // if the request is byte-identical to the last one
+    bool queryValidLayerWithMemo();
+
+    // the request and the result of the last queryValidLayer()
+    std::vector<uint8_t> m_query_request;
+    std::vector<uint8_t> m_query_response;
+    std::vector<uint8_t> m_query_buf;
+    std::atomic<bool> m_is_query_memo_valid;
+
+    uint64_t m_query_hit_count;
+    uint64_t m_query_miss_count;
+
+    // checkModel() compares the result of the driver with the prediction of
+    // HrtModel, the prediction is made before the driver is queried
+    void checkModel(const std::vector<sp<HWCDisplay> >& displays);
+
+    HrtModel m_check_model;
+    std::vector<HrtModelDisplay> m_check_input;
+    std::vector<HrtModelResult> m_check_result;
+    uint64_t m_check_count;
+    uint64_t m_check_mismatch_count;
+
+    // planJointLayering() extends the GLES range of displays with HrtModel
+    // before the query, so the displays share the bandwidth by the GPU cost
+    // instead of the order the driver extends them
+    void planJointLayering(const std::vector<sp<HWCDisplay> >& displays);
+
+    HrtModel m_plan_model;
+    std::vector<HrtModelDisplay> m_plan_input;
+    std::vector<HrtModelPlan> m_plan_result;
+    uint64_t m_plan_count;
+    uint64_t m_plan_fail_count;
+    uint64_t m_plan_extend_count;
 };
 
 HrtCommon* createHrt();
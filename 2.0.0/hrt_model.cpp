@@ -0,0 +1,462 @@
+#include "hrt_model.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <inttypes.h>
+#include <stdio.h>
+
+HrtModel::HrtModel()
+    : m_idx(0)
+{
+}
+
+uint32_t HrtModel::layering(const std::vector<HrtModelDisplay>& displays,
+                            std::vector<HrtModelResult>* results)
+{
+    results->clear();
+    results->resize(displays.size());
+
+    uint32_t hrt_weight = 0;
+    for (size_t i = 0; i < displays.size(); ++i)
+    {
+        layeringDisplay(displays[i], &(*results)[i]);
+        hrt_weight += (*results)[i].overlap_weight;
+    }
+
+    ++m_idx;
+    return hrt_weight;
+}
+
+bool HrtModel::plan(const std::vector<HrtModelDisplay>& displays, const uint32_t& shared_bound_layer_num,
+                    std::vector<HrtModelPlan>* plans) const
+{
+    plans->clear();
+
+    // the weight of each display is scaled to HRT_MODEL_BASE_FPS, so the
+    // displays with different refresh rates can share the bound
+    const uint64_t shared_bound = static_cast<uint64_t>(shared_bound_layer_num) * HRT_MODEL_UNIT_WEIGHT;
+
+    std::vector<PlanOption> options(1);
+    options[0].weight = 0;
+    options[0].gpu_pixels = 0;
+    options[0].gles_pixels = 0;
+
+    std::vector<PlanOption> display_options;
+    std::vector<PlanOption> next_options;
+    for (auto& display : displays)
+    {
+        collectPlanOptions(display, &display_options);
+
+        next_options.clear();
+        for (auto& option : options)
+        {
+            for (auto& display_option : display_options)
+            {
+                const uint64_t weight = option.weight + display_option.weight;
+                if (shared_bound != 0 && weight > shared_bound)
+                    continue;
+
+                next_options.push_back(option);
+                PlanOption& next_option = next_options.back();
+                next_option.weight = weight;
+                next_option.gpu_pixels += display_option.gpu_pixels;
+                next_option.gles_pixels += display_option.gles_pixels;
+                next_option.plans.push_back(display_option.plans[0]);
+            }
+        }
+        pruneOptions(&next_options);
+
+        if (next_options.empty())
+            return false;
+
+        options.swap(next_options);
+    }
+
+    // the options are sorted by weight and each one composes fewer pixels
+    // than the previous one, so the last one is the best
+    *plans = options.back().plans;
+    return true;
+}
+
+void HrtModel::collectPlanOptions(const HrtModelDisplay& display, std::vector<PlanOption>* options) const
+{
+    options->clear();
+
+    HrtModelResult result;
+    initResult(display, &result);
+    const int32_t head = result.gles_head;
+    const int32_t tail = result.gles_tail;
+    const int32_t num_layers = static_cast<int32_t>(display.layers.size());
+
+    if (num_layers > HRT_MODEL_PLAN_MAX_LAYER_NUM)
+    {
+        addPlanOption(display, &result, options);
+        pruneOptions(options);
+        return;
+    }
+
+    auto is_ovl_only = [&](int32_t idx) {
+        return (result.layer_caps[static_cast<size_t>(idx)] & HRT_MODEL_CAPS_OVL_ONLY) != 0;
+    };
+
+    if (head == -1)
+    {
+        addPlanOption(display, &result, options);
+        for (int32_t h = 0; h < num_layers; ++h)
+        {
+            for (int32_t t = h; t < num_layers && !is_ovl_only(t); ++t)
+            {
+                result.gles_head = h;
+                result.gles_tail = t;
+                addPlanOption(display, &result, options);
+            }
+        }
+    }
+    else
+    {
+        // the range decided by HWC is kept even if it has an OVL only layer,
+        // only the layers added by the plan are checked
+        for (int32_t h = head; h >= 0 && (h == head || !is_ovl_only(h)); --h)
+        {
+            for (int32_t t = tail; t < num_layers && (t == tail || !is_ovl_only(t)); ++t)
+            {
+                result.gles_head = h;
+                result.gles_tail = t;
+                addPlanOption(display, &result, options);
+            }
+        }
+    }
+
+    pruneOptions(options);
+}
+
+void HrtModel::addPlanOption(const HrtModelDisplay& display, HrtModelResult* result,
+                             std::vector<PlanOption>* options) const
+{
+    const uint32_t num_layers = static_cast<uint32_t>(display.layers.size());
+    const uint32_t gles_num = result->gles_head == -1 ? 0 :
+                              static_cast<uint32_t>(result->gles_tail - result->gles_head + 1);
+    const uint32_t ovl_num = num_layers - gles_num + (gles_num ? 1 : 0);
+    if (display.max_layer_num != 0 && ovl_num > display.max_layer_num)
+        return;
+
+    calculateOverlap(display, result);
+    const uint64_t bound = getBound(display);
+    if (bound != 0 && result->overlap_weight > bound)
+        return;
+
+    uint64_t gles_pixels = 0;
+    bool is_dirty = false;
+    for (uint32_t i = 0; i < gles_num; ++i)
+    {
+        const HrtModelLayer& layer = display.layers[static_cast<size_t>(result->gles_head) + i];
+        gles_pixels += static_cast<uint64_t>(std::max(layer.dst_width, 0)) *
+                       static_cast<uint64_t>(std::max(layer.dst_height, 0));
+        is_dirty |= layer.is_dirty || !layer.was_in_gles;
+    }
+
+    // a layer which leaves the GLES range also needs a full re-render
+    uint32_t prev_gles_num = 0;
+    for (auto& layer : display.layers)
+    {
+        prev_gles_num += layer.was_in_gles ? 1 : 0;
+    }
+    is_dirty |= prev_gles_num != gles_num;
+
+    options->push_back(PlanOption());
+    PlanOption& option = options->back();
+    option.weight = static_cast<uint64_t>(result->overlap_weight) *
+                    static_cast<uint64_t>(std::max(display.fps, 1)) / HRT_MODEL_BASE_FPS;
+    option.gpu_pixels = is_dirty ? gles_pixels : 0;
+    option.gles_pixels = gles_pixels;
+    option.plans.resize(1);
+    option.plans[0].disp_id = display.disp_id;
+    option.plans[0].gles_head = result->gles_head;
+    option.plans[0].gles_tail = result->gles_tail;
+    option.plans[0].overlap_weight = result->overlap_weight;
+    option.plans[0].gpu_pixels = option.gpu_pixels;
+}
+
+void HrtModel::pruneOptions(std::vector<PlanOption>* options)
+{
+    auto is_better = [](const PlanOption& a, const PlanOption& b) {
+        return a.gpu_pixels != b.gpu_pixels ? a.gpu_pixels < b.gpu_pixels : a.gles_pixels < b.gles_pixels;
+    };
+
+    std::stable_sort(options->begin(), options->end(), [&](const PlanOption& a, const PlanOption& b) {
+        return a.weight != b.weight ? a.weight < b.weight : is_better(a, b);
+    });
+
+    size_t num = 0;
+    for (size_t i = 0; i < options->size(); ++i)
+    {
+        if (num == 0 || is_better((*options)[i], (*options)[num - 1]))
+        {
+            if (num != i)
+            {
+                (*options)[num] = std::move((*options)[i]);
+            }
+            ++num;
+        }
+    }
+    options->resize(num);
+}
+
+void HrtModel::initResult(const HrtModelDisplay& display, HrtModelResult* result) const
+{
+    const bool has_layer = !display.layers.empty();
+
+    result->disp_id = display.disp_id;
+    result->gles_head = has_layer ? display.gles_head : -1;
+    result->gles_tail = has_layer ? display.gles_tail : -1;
+    result->max_overlap_layer_num = 0;
+    result->overlap_weight = 0;
+    result->is_over_bound = false;
+    result->layer_caps.resize(display.layers.size());
+    for (size_t i = 0; i < display.layers.size(); ++i)
+    {
+        result->layer_caps[i] = display.layers[i].caps & ~HRT_MODEL_CAPS_DISP_RSZ;
+    }
+
+    decideRpo(display, result);
+}
+
+uint64_t HrtModel::getBound(const HrtModelDisplay& display)
+{
+    // the bound is scaled with the refresh rate, a faster display reads the
+    // same lines in less time
+    const int32_t fps = std::max(display.fps, 1);
+    return static_cast<uint64_t>(display.bound_layer_num) *
+           HRT_MODEL_UNIT_WEIGHT * HRT_MODEL_BASE_FPS / static_cast<uint64_t>(fps);
+}
+
+void HrtModel::layeringDisplay(const HrtModelDisplay& display, HrtModelResult* result) const
+{
+    const int32_t num_layers = static_cast<int32_t>(display.layers.size());
+
+    initResult(display, result);
+
+    if (!limitLayerNum(display, result))
+    {
+        result->is_over_bound = true;
+    }
+
+    calculateOverlap(display, result);
+
+    const uint64_t bound = getBound(display);
+    while (bound != 0 && result->overlap_weight > bound)
+    {
+        if (!extendGles(display, result))
+        {
+            result->is_over_bound = true;
+            break;
+        }
+        calculateOverlap(display, result);
+    }
+
+    for (int32_t i = 0; i < num_layers; ++i)
+    {
+        if (isInGles(*result, i))
+        {
+            result->layer_caps[static_cast<size_t>(i)] &= ~HRT_MODEL_CAPS_DISP_RSZ;
+        }
+    }
+
+    fillOvlId(display, result);
+}
+
+void HrtModel::decideRpo(const HrtModelDisplay& display, HrtModelResult* result) const
+{
+    for (size_t i = 0; i < display.layers.size(); ++i)
+    {
+        const int32_t idx = static_cast<int32_t>(i);
+        const HrtModelLayer& layer = display.layers[i];
+        if (isInGles(*result, idx) || layer.bits_per_pixel == 0)
+            continue;
+
+        if (layer.src_width == layer.dst_width && layer.src_height == layer.dst_height)
+            continue;
+
+        const bool is_rpo = display.is_rpo_enabled && idx == 0 &&
+                            layer.dst_width >= layer.src_width &&
+                            layer.dst_height >= layer.src_height &&
+                            layer.dst_width <= layer.src_width * HRT_MODEL_RPO_MAX_RATIO &&
+                            layer.dst_height <= layer.src_height * HRT_MODEL_RPO_MAX_RATIO &&
+                            (display.rpo_max_src_width == 0 || layer.src_width <= display.rpo_max_src_width);
+        if (is_rpo)
+        {
+            result->layer_caps[i] |= HRT_MODEL_CAPS_DISP_RSZ;
+            continue;
+        }
+
+        // MDP scales to the display frame when RPO is rejected, and an OVL
+        // only layer has nowhere else to go
+        if (layer.caps & (HRT_MODEL_CAPS_MDP | HRT_MODEL_CAPS_OVL_ONLY))
+            continue;
+
+        if (result->gles_head == -1)
+        {
+            result->gles_head = idx;
+            result->gles_tail = idx;
+        }
+        else
+        {
+            result->gles_head = std::min(result->gles_head, idx);
+            result->gles_tail = std::max(result->gles_tail, idx);
+        }
+    }
+}
+
+void HrtModel::calculateOverlap(const HrtModelDisplay& display, HrtModelResult* result) const
+{
+    // each event is the top or the bottom of a layer, the bottom is exclusive
+    struct Event
+    {
+        int32_t y;
+        int32_t count;
+        int64_t weight;
+    };
+    std::vector<Event> events;
+    events.reserve(display.layers.size() * 2 + 2);
+
+    for (size_t i = 0; i < display.layers.size(); ++i)
+    {
+        const HrtModelLayer& layer = display.layers[i];
+        if (isInGles(*result, static_cast<int32_t>(i)) || layer.dst_height <= 0)
+            continue;
+
+        int64_t weight = static_cast<int64_t>(HRT_MODEL_UNIT_WEIGHT) * layer.bits_per_pixel / 32;
+        if ((result->layer_caps[i] & HRT_MODEL_CAPS_DISP_RSZ) == 0 &&
+            layer.src_height > layer.dst_height)
+        {
+            weight = weight * layer.src_height / layer.dst_height;
+        }
+        events.push_back({layer.dst_top, 1, weight});
+        events.push_back({layer.dst_top + layer.dst_height, -1, -weight});
+    }
+
+    if (result->gles_head != -1)
+    {
+        events.push_back({0, 1, HRT_MODEL_UNIT_WEIGHT});
+        events.push_back({std::max(display.height, 1), -1, -HRT_MODEL_UNIT_WEIGHT});
+    }
+
+    std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+        return a.y != b.y ? a.y < b.y : a.count < b.count;
+    });
+
+    int32_t count = 0;
+    int64_t weight = 0;
+    int32_t max_count = 0;
+    int64_t max_weight = 0;
+    for (auto& event : events)
+    {
+        count += event.count;
+        weight += event.weight;
+        max_count = std::max(max_count, count);
+        max_weight = std::max(max_weight, weight);
+    }
+
+    result->max_overlap_layer_num = max_count;
+    result->overlap_weight = static_cast<uint32_t>(max_weight);
+}
+
+bool HrtModel::limitLayerNum(const HrtModelDisplay& display, HrtModelResult* result) const
+{
+    if (display.max_layer_num == 0)
+        return true;
+
+    while (true)
+    {
+        uint32_t num = result->gles_head == -1 ? 0 : 1;
+        for (size_t i = 0; i < display.layers.size(); ++i)
+        {
+            if (!isInGles(*result, static_cast<int32_t>(i)))
+                ++num;
+        }
+
+        if (num <= display.max_layer_num)
+            return true;
+
+        if (!extendGles(display, result))
+            return false;
+    }
+}
+
+bool HrtModel::extendGles(const HrtModelDisplay& display, HrtModelResult* result) const
+{
+    const int32_t num_layers = static_cast<int32_t>(display.layers.size());
+    auto can_move = [&](int32_t idx) {
+        return idx >= 0 && idx < num_layers &&
+               (result->layer_caps[static_cast<size_t>(idx)] & HRT_MODEL_CAPS_OVL_ONLY) == 0;
+    };
+
+    if (result->gles_head == -1)
+    {
+        for (int32_t idx = num_layers - 1; idx >= 0; --idx)
+        {
+            if (can_move(idx))
+            {
+                result->gles_head = idx;
+                result->gles_tail = idx;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    if (can_move(result->gles_tail + 1))
+    {
+        ++result->gles_tail;
+        return true;
+    }
+
+    if (can_move(result->gles_head - 1))
+    {
+        --result->gles_head;
+        return true;
+    }
+
+    return false;
+}
+
+void HrtModel::fillOvlId(const HrtModelDisplay& display, HrtModelResult* result) const
+{
+    result->ovl_id.resize(display.layers.size());
+
+    uint32_t ovl_index = 0;
+    for (size_t i = 0; i < display.layers.size(); ++i)
+    {
+        const int32_t idx = static_cast<int32_t>(i);
+        result->ovl_id[i] = ovl_index;
+        if (!isInGles(*result, idx) || idx == result->gles_tail)
+        {
+            ++ovl_index;
+        }
+    }
+}
+
+std::string HrtModel::describe(const HrtModelDisplay& display, const HrtModelResult& result)
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf), "disp:%" PRIu64 " %dx%d@%d max:%u bound:%u g(%d,%d)->(%d,%d) ovlp:%d w:%u over:%d",
+             display.disp_id, display.width, display.height, display.fps,
+             display.max_layer_num, display.bound_layer_num,
+             display.gles_head, display.gles_tail, result.gles_head, result.gles_tail,
+             result.max_overlap_layer_num, result.overlap_weight, result.is_over_bound);
+    std::string str(buf);
+
+    for (size_t i = 0; i < display.layers.size(); ++i)
+    {
+        const HrtModelLayer& layer = display.layers[i];
+        snprintf(buf, sizeof(buf), " [%zu s:%dx%d d:%d,%d,%dx%d bits:%u dirty:%d caps:%x->%x ovl:%u]",
+                 i, layer.src_width, layer.src_height,
+                 layer.dst_left, layer.dst_top, layer.dst_width, layer.dst_height,
+                 layer.bits_per_pixel, layer.is_dirty, layer.caps,
+                 i < result.layer_caps.size() ? result.layer_caps[i] : 0,
+                 i < result.ovl_id.size() ? result.ovl_id[i] : 0);
+        str += buf;
+    }
+    return str;
+}
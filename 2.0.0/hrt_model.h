@@ -0,0 +1,259 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// HrtModel only depends on the standard library, so it can be built on a
+// host and run against recorded layer stacks without the display driver
+
+// HRT_MODEL_UNIT_WEIGHT is the weight of a line of a 32 bits per pixel layer,
+// it is the same unit as hrt_weight of the display driver
+#define HRT_MODEL_UNIT_WEIGHT 400
+
+// HRT_MODEL_BASE_FPS is the refresh rate of bound_layer_num
+#define HRT_MODEL_BASE_FPS 60
+
+// HRT_MODEL_RPO_MAX_RATIO is the max upscale ratio of the display resizer
+#define HRT_MODEL_RPO_MAX_RATIO 2
+
+// HRT_MODEL_PLAN_MAX_LAYER_NUM is the max number of layers whose GLES range
+// is searched by plan(), a larger display keeps the range decided by HWC
+#define HRT_MODEL_PLAN_MAX_LAYER_NUM 32
+
+enum HRT_MODEL_CAPS
+{
+    // the layer cannot be composed by GPU, e.g. a secure layer
+    HRT_MODEL_CAPS_OVL_ONLY = 0x1,
+
+    // the layer is scaled by MDP before OVL, so OVL reads its MDP output
+    HRT_MODEL_CAPS_MDP = 0x2,
+
+    // the layer is scaled by the display resizer
+    HRT_MODEL_CAPS_DISP_RSZ = 0x4,
+};
+
+struct HrtModelLayer
+{
+    HrtModelLayer()
+        : src_width(0)
+        , src_height(0)
+        , dst_left(0)
+        , dst_top(0)
+        , dst_width(0)
+        , dst_height(0)
+        , bits_per_pixel(32)
+        , caps(0)
+        , is_dirty(true)
+        , was_in_gles(false)
+    { }
+
+    // the size read by OVL, it is the MDP output for an MDP layer
+    int32_t src_width;
+    int32_t src_height;
+
+    int32_t dst_left;
+    int32_t dst_top;
+    int32_t dst_width;
+    int32_t dst_height;
+
+    // bits per pixel read by OVL, 0 for a dim layer which reads no memory
+    uint32_t bits_per_pixel;
+
+    int32_t caps;
+
+    // the content of the layer is changed in this frame
+    bool is_dirty;
+
+    // the layer was composed by GPU in the last frame
+    bool was_in_gles;
+};
+
+struct HrtModelDisplay
+{
+    HrtModelDisplay()
+        : disp_id(0)
+        , width(0)
+        , height(0)
+        , fps(HRT_MODEL_BASE_FPS)
+        , max_layer_num(0)
+        , bound_layer_num(0)
+        , is_rpo_enabled(false)
+        , rpo_max_src_width(0)
+        , gles_head(-1)
+        , gles_tail(-1)
+    { }
+
+    uint64_t disp_id;
+    int32_t width;
+    int32_t height;
+    int32_t fps;
+
+    // the number of OVL inputs, the client target takes one of them
+    uint32_t max_layer_num;
+
+    // the bandwidth bound in full screen 32 bits per pixel layers at
+    // HRT_MODEL_BASE_FPS, 0 means unlimited
+    uint32_t bound_layer_num;
+
+    bool is_rpo_enabled;
+
+    // the max source width of the display resizer, 0 means unlimited
+    int32_t rpo_max_src_width;
+
+    // the GLES range decided by HWC before HRT
+    int32_t gles_head;
+    int32_t gles_tail;
+
+    std::vector<HrtModelLayer> layers;
+};
+
+struct HrtModelResult
+{
+    HrtModelResult()
+        : disp_id(0)
+        , gles_head(-1)
+        , gles_tail(-1)
+        , max_overlap_layer_num(0)
+        , overlap_weight(0)
+        , is_over_bound(false)
+    { }
+
+    uint64_t disp_id;
+    int32_t gles_head;
+    int32_t gles_tail;
+
+    // the max number of OVL inputs on the same line, including the client
+    // target
+    int32_t max_overlap_layer_num;
+
+    // the max weight on the same line
+    uint32_t overlap_weight;
+
+    // the bound cannot be met, e.g. all layers are OVL only
+    bool is_over_bound;
+
+    // HRT_MODEL_CAPS of each layer after layering
+    std::vector<int32_t> layer_caps;
+
+    // the OVL input of each layer, the layers in the GLES range share the
+    // input of the client target
+    std::vector<uint32_t> ovl_id;
+};
+
+// HrtModelPlan is the GLES range chosen by plan() for a display
+struct HrtModelPlan
+{
+    HrtModelPlan()
+        : disp_id(0)
+        , gles_head(-1)
+        , gles_tail(-1)
+        , overlap_weight(0)
+        , gpu_pixels(0)
+    { }
+
+    uint64_t disp_id;
+    int32_t gles_head;
+    int32_t gles_tail;
+    uint32_t overlap_weight;
+
+    // the pixels composed by GPU in this frame, it is 0 if the GLES range has
+    // the same layers as the last frame and none of them is dirty, because
+    // the last client target can be reused
+    uint64_t gpu_pixels;
+};
+
+// HrtModel predicts the layering decision of the display driver. It follows
+// the rules of the driver:
+// 1. each layer has a weight of HRT_MODEL_UNIT_WEIGHT * bits_per_pixel / 32
+//    on every line it covers, and a vertical downscale multiplies the lines
+//    it reads
+// 2. the client target is a full screen 32 bits per pixel layer
+// 3. the max weight on a line must not exceed the bound of the display,
+//    otherwise the GLES range is extended from the top until it does
+// 4. only the bottom layer may be scaled by the display resizer (RPO), a UI
+//    layer which needs scaling otherwise goes to GLES
+class HrtModel
+{
+public:
+    HrtModel();
+
+    // layering() decides the GLES range and the caps of each display and
+    // returns the total weight of all displays as hrt_weight
+    uint32_t layering(const std::vector<HrtModelDisplay>& displays,
+                      std::vector<HrtModelResult>* results);
+
+    // plan() chooses the GLES range of all displays together, so the total
+    // weight stays in the bound shared by them and the pixels composed by GPU
+    // are the fewest. The ranges only grow from the ones decided by HWC. It
+    // returns false if the displays cannot meet the bound, and the decision
+    // is left to layering()
+    bool plan(const std::vector<HrtModelDisplay>& displays, const uint32_t& shared_bound_layer_num,
+              std::vector<HrtModelPlan>* plans) const;
+
+    // getLastIdx() is the index of the last layering(), it increases like
+    // the hrt_idx of the driver
+    uint32_t getLastIdx() const { return m_idx; }
+
+    // describe() prints a display and its result for logs and offline tools
+    static std::string describe(const HrtModelDisplay& display, const HrtModelResult& result);
+
+private:
+    // PlanOption is a choice of the GLES ranges of the displays planned so
+    // far, gles_pixels breaks the tie of gpu_pixels
+    struct PlanOption
+    {
+        uint64_t weight;
+        uint64_t gpu_pixels;
+        uint64_t gles_pixels;
+        std::vector<HrtModelPlan> plans;
+    };
+
+    // initResult() fills the result before any layer is moved
+    void initResult(const HrtModelDisplay& display, HrtModelResult* result) const;
+
+    // getBound() is the bound of the display at its refresh rate, 0 means
+    // unlimited
+    static uint64_t getBound(const HrtModelDisplay& display);
+
+    // collectPlanOptions() lists the GLES ranges of a display which meet its
+    // own limits
+    void collectPlanOptions(const HrtModelDisplay& display, std::vector<PlanOption>* options) const;
+
+    // addPlanOption() appends the range of result if it meets the limits of
+    // the display
+    void addPlanOption(const HrtModelDisplay& display, HrtModelResult* result,
+                       std::vector<PlanOption>* options) const;
+
+    // pruneOptions() drops the options which are not better than another one
+    // with less weight
+    static void pruneOptions(std::vector<PlanOption>* options);
+
+    // layeringDisplay() handles one display
+    void layeringDisplay(const HrtModelDisplay& display, HrtModelResult* result) const;
+
+    // decideRpo() marks the layers scaled by the display resizer, and pulls
+    // the other scaled UI layers into the GLES range
+    void decideRpo(const HrtModelDisplay& display, HrtModelResult* result) const;
+
+    // calculateOverlap() fills max_overlap_layer_num and overlap_weight
+    void calculateOverlap(const HrtModelDisplay& display, HrtModelResult* result) const;
+
+    // limitLayerNum() extends the GLES range until the OVL inputs are enough
+    bool limitLayerNum(const HrtModelDisplay& display, HrtModelResult* result) const;
+
+    // extendGles() moves one more layer into the GLES range. It returns false
+    // if no layer can be moved
+    bool extendGles(const HrtModelDisplay& display, HrtModelResult* result) const;
+
+    // fillOvlId() assigns the OVL inputs
+    void fillOvlId(const HrtModelDisplay& display, HrtModelResult* result) const;
+
+    static bool isInGles(const HrtModelResult& result, int32_t idx)
+    {
+        return result.gles_head != -1 && idx >= result.gles_head && idx <= result.gles_tail;
+    }
+
+    uint32_t m_idx;
+};
@@ -0,0 +1,462 @@
+// hrt_model_replay is a host tool which feeds the layer stacks of a file
+// written by HWCRecorder into HrtModel. It rebuilds the layers of each display
+// from the recorded calls and runs the model at every validate, then checks
+// the result against the rules of the driver. It returns non-zero if the file
+// cannot be read or a result breaks a rule, so it can be run as a host test.
+//
+// usage: hrt_model_replay <recording> <width> <height> [max_layer_num]
+//                         [bound_layer_num] [fps] [-v]
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hardware/gralloc.h>
+
+#include "hrt_model.h"
+#include "hwc2_recorder.h"
+
+// HRT_REPLAY_DEFAULT_LAYER_NUM is the OVL inputs used when the argument is
+// not given
+#define HRT_REPLAY_DEFAULT_LAYER_NUM 4
+
+struct ReplayLayer
+{
+    ReplayLayer()
+        : z(0)
+        , composition(HWC2_COMPOSITION_DEVICE)
+        , transform(0)
+        , format(HAL_PIXEL_FORMAT_RGBA_8888)
+        , usage(0)
+        , is_dirty(true)
+    {
+        memset(&frame, 0, sizeof(frame));
+        memset(&crop, 0, sizeof(crop));
+    }
+
+    uint32_t z;
+    int32_t composition;
+    int32_t transform;
+    uint32_t format;
+    uint32_t usage;
+    hwc_rect_t frame;
+    hwc_frect_t crop;
+    bool is_dirty;
+};
+
+struct ReplayDisplay
+{
+    ReplayDisplay()
+        : width(0)
+        , height(0)
+    { }
+
+    int32_t width;
+    int32_t height;
+    std::map<uint64_t, ReplayLayer> layers;
+};
+
+struct ReplayStats
+{
+    ReplayStats()
+        : record_count(0)
+        , validate_count(0)
+        , extended_count(0)
+        , over_bound_count(0)
+        , error_count(0)
+        , max_weight(0)
+    { }
+
+    uint64_t record_count;
+    uint64_t validate_count;
+
+    // the validates whose GLES range is extended by the model
+    uint64_t extended_count;
+    uint64_t over_bound_count;
+
+    // the results which break a rule of the driver
+    uint64_t error_count;
+    uint32_t max_weight;
+};
+
+static uint32_t getFormatBitsPerPixel(uint32_t format)
+{
+    switch (format)
+    {
+        case HAL_PIXEL_FORMAT_RGBA_FP16:
+            return 64;
+
+        case HAL_PIXEL_FORMAT_RGB_888:
+            return 24;
+
+        case HAL_PIXEL_FORMAT_RGB_565:
+            return 16;
+
+        case HAL_PIXEL_FORMAT_YV12:
+        case HAL_PIXEL_FORMAT_YCbCr_420_888:
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+            return 12;
+
+        case HAL_PIXEL_FORMAT_YCbCr_422_I:
+        case HAL_PIXEL_FORMAT_YCbCr_422_SP:
+            return 16;
+
+        default:
+            return 32;
+    }
+}
+
+static bool isYuvFormat(uint32_t format)
+{
+    return getFormatBitsPerPixel(format) == 12 ||
+           format == HAL_PIXEL_FORMAT_YCbCr_422_I ||
+           format == HAL_PIXEL_FORMAT_YCbCr_422_SP;
+}
+
+// buildModelDisplay() converts the recorded layers into the model input, it
+// follows buildHrtModelInput() as far as the recording can tell: a YUV or
+// rotated layer is handled by MDP, so OVL reads the MDP output with the size
+// of its display frame
+static void buildModelDisplay(uint64_t dpy, const ReplayDisplay& display, uint32_t max_layer_num,
+                              uint32_t bound_layer_num, int32_t fps, HrtModelDisplay* model_display)
+{
+    std::vector<const ReplayLayer*> layers;
+    for (auto& item : display.layers)
+    {
+        const ReplayLayer& layer = item.second;
+        if (layer.frame.right <= layer.frame.left || layer.frame.bottom <= layer.frame.top)
+            continue;
+        layers.push_back(&layer);
+    }
+    std::stable_sort(layers.begin(), layers.end(),
+                     [](const ReplayLayer* a, const ReplayLayer* b) { return a->z < b->z; });
+
+    *model_display = HrtModelDisplay();
+    model_display->disp_id = dpy;
+    model_display->width = display.width;
+    model_display->height = display.height;
+    model_display->fps = fps;
+    model_display->max_layer_num = max_layer_num;
+    model_display->bound_layer_num = bound_layer_num;
+    model_display->layers.resize(layers.size());
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        const ReplayLayer& layer = *layers[i];
+        HrtModelLayer& model_layer = model_display->layers[i];
+        const int32_t idx = static_cast<int32_t>(i);
+
+        if (layer.composition == HWC2_COMPOSITION_CLIENT)
+        {
+            if (model_display->gles_head == -1)
+            {
+                model_display->gles_head = idx;
+            }
+            model_display->gles_tail = idx;
+        }
+
+        model_layer.dst_left = layer.frame.left;
+        model_layer.dst_top = layer.frame.top;
+        model_layer.dst_width = layer.frame.right - layer.frame.left;
+        model_layer.dst_height = layer.frame.bottom - layer.frame.top;
+        model_layer.is_dirty = layer.is_dirty;
+        if (layer.usage & GRALLOC_USAGE_PROTECTED)
+        {
+            model_layer.caps |= HRT_MODEL_CAPS_OVL_ONLY;
+        }
+
+        if (layer.composition == HWC2_COMPOSITION_SOLID_COLOR)
+        {
+            model_layer.bits_per_pixel = 0;
+            model_layer.src_width = model_layer.dst_width;
+            model_layer.src_height = model_layer.dst_height;
+        }
+        else if (isYuvFormat(layer.format) || (layer.transform & HWC_TRANSFORM_ROT_90))
+        {
+            model_layer.bits_per_pixel = 32;
+            model_layer.src_width = model_layer.dst_width;
+            model_layer.src_height = model_layer.dst_height;
+            model_layer.caps |= HRT_MODEL_CAPS_MDP;
+        }
+        else
+        {
+            model_layer.bits_per_pixel = getFormatBitsPerPixel(layer.format);
+            model_layer.src_width = static_cast<int32_t>(layer.crop.right - layer.crop.left + 0.5f);
+            model_layer.src_height = static_cast<int32_t>(layer.crop.bottom - layer.crop.top + 0.5f);
+        }
+    }
+}
+
+// checkResult() returns the number of broken rules
+static int checkResult(const HrtModelDisplay& display, const HrtModelResult& result)
+{
+    int error = 0;
+    if (result.layer_caps.size() != display.layers.size() ||
+        result.ovl_id.size() != display.layers.size())
+    {
+        fprintf(stderr, "disp:%" PRIu64 " result size %zu/%zu does not match %zu layers\n",
+                display.disp_id, result.layer_caps.size(), result.ovl_id.size(), display.layers.size());
+        return 1;
+    }
+
+    // the range decided by HWC only grows
+    if (display.gles_head != -1 &&
+        (result.gles_head == -1 || result.gles_head > display.gles_head || result.gles_tail < display.gles_tail))
+    {
+        fprintf(stderr, "disp:%" PRIu64 " GLES range g(%d,%d) shrinks to (%d,%d)\n",
+                display.disp_id, display.gles_head, display.gles_tail, result.gles_head, result.gles_tail);
+        ++error;
+    }
+
+    if (result.is_over_bound)
+        return error;
+
+    if (display.max_layer_num > 0 &&
+        result.max_overlap_layer_num > static_cast<int32_t>(display.max_layer_num))
+    {
+        fprintf(stderr, "disp:%" PRIu64 " uses %d OVL inputs of %u\n",
+                display.disp_id, result.max_overlap_layer_num, display.max_layer_num);
+        ++error;
+    }
+
+    for (size_t i = 0; i < display.layers.size(); ++i)
+    {
+        const bool is_in_gles = result.gles_head != -1 &&
+                                static_cast<int32_t>(i) >= result.gles_head &&
+                                static_cast<int32_t>(i) <= result.gles_tail;
+        if (is_in_gles && (display.layers[i].caps & HRT_MODEL_CAPS_OVL_ONLY))
+        {
+            fprintf(stderr, "disp:%" PRIu64 " moves OVL only layer %zu into GLES\n", display.disp_id, i);
+            ++error;
+        }
+    }
+    return error;
+}
+
+static bool readRecording(const char* path, const std::vector<int32_t>& args, bool verbose,
+                          ReplayStats* stats)
+{
+    FILE* file = fopen(path, "rbe");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    HwcRecFileHeader file_header;
+    if (fread(&file_header, sizeof(file_header), 1, file) != 1 ||
+        file_header.magic != HWC_REC_MAGIC || file_header.version != HWC_REC_VERSION)
+    {
+        fprintf(stderr, "%s is not a recording of version %d\n", path, HWC_REC_VERSION);
+        fclose(file);
+        return false;
+    }
+
+    const uint32_t max_layer_num = static_cast<uint32_t>(args[2]);
+    const uint32_t bound_layer_num = static_cast<uint32_t>(args[3]);
+    const int32_t fps = args[4];
+
+    HrtModel model;
+    std::map<uint64_t, ReplayDisplay> displays;
+    std::vector<uint8_t> payload;
+    HwcRecHeader header;
+    while (fread(&header, sizeof(header), 1, file) == 1)
+    {
+        if (header.size > HWC_REC_MAX_PAYLOAD_SIZE)
+        {
+            fprintf(stderr, "corrupted record type:%u size:%u\n", header.type, header.size);
+            ++stats->error_count;
+            break;
+        }
+
+        payload.resize(header.size);
+        if (header.size > 0 && fread(payload.data(), header.size, 1, file) != 1)
+        {
+            fprintf(stderr, "truncated record type:%u size:%u\n", header.type, header.size);
+            break;
+        }
+        ++stats->record_count;
+
+        auto has = [&](size_t size) { return payload.size() >= size; };
+        int32_t val[3] = { 0, 0, 0 };
+        ReplayDisplay& display = displays[header.display];
+        if (display.width == 0)
+        {
+            display.width = args[0];
+            display.height = args[1];
+        }
+
+        switch (header.type)
+        {
+            case HWC_REC_CREATE_VIRTUAL_DISPLAY:
+                // the record is written with the id of the created display
+                if (has(sizeof(int32_t) * 3))
+                {
+                    memcpy(val, payload.data(), sizeof(int32_t) * 3);
+                    display.width = val[0];
+                    display.height = val[1];
+                }
+                break;
+
+            case HWC_REC_DESTROY_VIRTUAL_DISPLAY:
+                displays.erase(header.display);
+                break;
+
+            case HWC_REC_CREATE_LAYER:
+                display.layers[header.layer] = ReplayLayer();
+                break;
+
+            case HWC_REC_DESTROY_LAYER:
+                display.layers.erase(header.layer);
+                break;
+
+            case HWC_REC_LAYER_BUFFER:
+            {
+                auto iter = display.layers.find(header.layer);
+                if (iter == display.layers.end() || !has(sizeof(HwcRecBuffer)))
+                    break;
+
+                HwcRecBuffer buf;
+                memcpy(&buf, payload.data(), sizeof(buf));
+                iter->second.format = buf.format;
+                iter->second.usage = buf.usage;
+                iter->second.is_dirty = true;
+                break;
+            }
+
+            case HWC_REC_LAYER_COMPOSITION_TYPE:
+            case HWC_REC_LAYER_TRANSFORM:
+            case HWC_REC_LAYER_Z_ORDER:
+            {
+                auto iter = display.layers.find(header.layer);
+                if (iter == display.layers.end() || !has(sizeof(int32_t)))
+                    break;
+
+                memcpy(val, payload.data(), sizeof(int32_t));
+                if (header.type == HWC_REC_LAYER_COMPOSITION_TYPE)
+                {
+                    iter->second.composition = val[0];
+                }
+                else if (header.type == HWC_REC_LAYER_TRANSFORM)
+                {
+                    iter->second.transform = val[0];
+                }
+                else
+                {
+                    iter->second.z = static_cast<uint32_t>(val[0]);
+                }
+                iter->second.is_dirty = true;
+                break;
+            }
+
+            case HWC_REC_LAYER_DISPLAY_FRAME:
+            {
+                auto iter = display.layers.find(header.layer);
+                if (iter != display.layers.end() && has(sizeof(hwc_rect_t)))
+                {
+                    memcpy(&iter->second.frame, payload.data(), sizeof(hwc_rect_t));
+                    iter->second.is_dirty = true;
+                }
+                break;
+            }
+
+            case HWC_REC_LAYER_SOURCE_CROP:
+            {
+                auto iter = display.layers.find(header.layer);
+                if (iter != display.layers.end() && has(sizeof(hwc_frect_t)))
+                {
+                    memcpy(&iter->second.crop, payload.data(), sizeof(hwc_frect_t));
+                    iter->second.is_dirty = true;
+                }
+                break;
+            }
+
+            case HWC_REC_VALIDATE:
+            {
+                std::vector<HrtModelDisplay> input(1);
+                std::vector<HrtModelResult> results;
+                buildModelDisplay(header.display, display, max_layer_num, bound_layer_num, fps, &input[0]);
+                const uint32_t weight = model.layering(input, &results);
+                ++stats->validate_count;
+                stats->max_weight = std::max(stats->max_weight, weight);
+                if (results[0].is_over_bound)
+                {
+                    ++stats->over_bound_count;
+                }
+                if (results[0].gles_head != input[0].gles_head || results[0].gles_tail != input[0].gles_tail)
+                {
+                    ++stats->extended_count;
+                }
+
+                const int error = checkResult(input[0], results[0]);
+                stats->error_count += static_cast<uint64_t>(error);
+                if (verbose || error > 0)
+                {
+                    printf("%s\n", HrtModel::describe(input[0], results[0]).c_str());
+                }
+
+                for (auto& item : display.layers)
+                {
+                    item.second.is_dirty = false;
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    bool verbose = false;
+    std::vector<const char*> params;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-v") == 0)
+        {
+            verbose = true;
+        }
+        else
+        {
+            params.push_back(argv[i]);
+        }
+    }
+
+    if (params.size() < 3)
+    {
+        fprintf(stderr, "usage: %s <recording> <width> <height> [max_layer_num] "
+                "[bound_layer_num] [fps] [-v]\n", argv[0]);
+        return 2;
+    }
+
+    // width, height, max_layer_num, bound_layer_num, fps
+    std::vector<int32_t> args = { 0, 0, HRT_REPLAY_DEFAULT_LAYER_NUM, 0, HRT_MODEL_BASE_FPS };
+    for (size_t i = 1; i < params.size() && i <= args.size(); ++i)
+    {
+        args[i - 1] = atoi(params[i]);
+    }
+    if (args[0] <= 0 || args[1] <= 0 || args[4] <= 0)
+    {
+        fprintf(stderr, "invalid display %dx%d@%d\n", args[0], args[1], args[4]);
+        return 2;
+    }
+
+    ReplayStats stats;
+    if (!readRecording(params[0], args, verbose, &stats))
+        return 1;
+
+    printf("records:%" PRIu64 " validates:%" PRIu64 " extended:%" PRIu64 " over_bound:%" PRIu64
+           " max_weight:%u errors:%" PRIu64 "\n",
+           stats.record_count, stats.validate_count, stats.extended_count,
+           stats.over_bound_count, stats.max_weight, stats.error_count);
+    return stats.error_count > 0 ? 1 : 0;
+}
@@ -27,6 +27,11 @@
 #include "asyncblitdev.h"
 #include "sync.h"
 #include "pq_interface.h"
+#include "fence_monitor.h"
+#include "frame_tracer.h"
+#include "hwc2_bench.h"
+#include "hwc2_recorder.h"
+#include "mcycle_model.h"
 
 #include "ai_blulight_defender.h"
 #include "glai_controller.h"
@@ -45,6 +50,19 @@ bool isDispConnected(const uint64_t& display)
     return DisplayManager::getInstance().getDisplayData(display)->connected;
 }
 
+// stampFrame() stamps the current job of display into HWCFrameTracer
+static void stampFrame(const sp<HWCDisplay>& display, int stage)
+{
+    if (!HWCFrameTracer::getInstance().isEnabled())
+        return;
+
+    DispatcherJob* job = HWCDispatcher::getInstance().getExistJob(display->getId());
+    if (job != nullptr)
+    {
+        HWCFrameTracer::getInstance().stamp(display->getId(), job->sequence, stage);
+    }
+}
+
 // -----------------------------------------------------------------------------
 
 DisplayListener::DisplayListener(
@@ -252,8 +270,7 @@ HWCMediator& HWCMediator::getInstance()
 }
 
 HWCMediator::HWCMediator()
-    : m_need_validate(HWC_SKIP_VALIDATE_NOT_SKIP)
-    , m_validate_seq(0)
+    : m_validate_seq(0)
     , m_present_seq(0)
     , m_vsync_offset_state(true)
     , m_set_buf_from_sf_log(DbgLogger::TYPE_HWC_LOG, 'D', "%s", g_set_buf_from_sf_log_prefix)
@@ -275,6 +292,8 @@ HWCMediator::HWCMediator()
     , m_callback_refresh_data(nullptr)
     , m_prev_hwbinder_tid(0)
 {
+    setNeedValidateOfAllDisplay(HWC_SKIP_VALIDATE_NOT_SKIP);
+
     sp<IOverlayDevice> primary_disp_dev = getHwDevice();
     sp<IOverlayDevice> virtual_disp_dev = nullptr;
     m_hrt = createHrt();
@@ -471,6 +490,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::deviceCreateVirtualDisplay(
         return HWC2_ERROR_BAD_PARAMETER;
     }
 
+    HWCRecorder::getInstance().recordVirtualDisplay(HWC_DISPLAY_VIRTUAL, width, height, *format);
     *outDisplay = HWC_DISPLAY_VIRTUAL;
 
     if (*outDisplay >= m_displays.size())
@@ -567,6 +587,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::deviceDestroyVirtualDisplay(
     hwc2_device_t* /*device*/,
     hwc2_display_t display)
 {
+    HWCRecorder::getInstance().recordCall(HWC_REC_DESTROY_VIRTUAL_DISPLAY, display);
     CHECK_DISP_CONNECT(display);
 
     HWC_LOGI("(%" PRIu64 ") %s", display, __func__);
@@ -714,6 +735,16 @@ void HWCMediator::deviceDump(hwc2_device_t* /*device*/, uint32_t* outSize, char*
 
         dump_str.appendFormat("  is_support_mdp_pmqos(vendor.debug.hwc.is_support_mdp_pmqos):%d\n", Platform::getInstance().m_config.is_support_mdp_pmqos);
         dump_str.appendFormat("  is_support_mdp_pmqos_debug(vendor.debug.hwc.is_support_mdp_pmqos_debug):%d\n", Platform::getInstance().m_config.is_support_mdp_pmqos_debug);
+        dump_str.appendFormat("  perf_slack_control(vendor.debug.hwc.perf_slack_control):%d\n", Platform::getInstance().m_config.perf_slack_control);
+        dump_str.appendFormat("  hrt_decision_cache(vendor.debug.hwc.hrt_decision_cache):%d\n", Platform::getInstance().m_config.hrt_decision_cache);
+        dump_str.appendFormat("  hrt_query_memo(vendor.debug.hwc.hrt_query_memo):%d\n", Platform::getInstance().m_config.hrt_query_memo);
+        dump_str.appendFormat("  hrt_model_check(vendor.debug.hwc.hrt_model_check):%d\n", Platform::getInstance().m_config.hrt_model_check);
+        dump_str.appendFormat("  hrt_model_bound_layer_num(vendor.debug.hwc.hrt_model_bound):%u\n", Platform::getInstance().m_config.hrt_model_bound_layer_num);
+        dump_str.appendFormat("  hrt_joint_plan(vendor.debug.hwc.hrt_joint_plan):%d\n", Platform::getInstance().m_config.hrt_joint_plan);
+        dump_str.appendFormat("  hrt_model_shared_bound_layer_num(vendor.debug.hwc.hrt_shared_bound):%u\n", Platform::getInstance().m_config.hrt_model_shared_bound_layer_num);
+        dump_str.appendFormat("  drm_delta_commit(vendor.debug.hwc.drm_delta_commit):%d\n", Platform::getInstance().m_config.drm_delta_commit);
+        dump_str.appendFormat("  drm_nonblock_commit(vendor.debug.hwc.drm_nonblock_commit):%d\n", Platform::getInstance().m_config.drm_nonblock_commit);
+        dump_str.appendFormat("  drm_color_blob_cache_size(vendor.debug.hwc.drm_color_blob_cache):%u\n", Platform::getInstance().m_config.drm_color_blob_cache_size);
         dump_str.appendFormat("  force_pq_index(vendor.debug.hwc.force_pq_index):%d\n", Platform::getInstance().m_config.force_pq_index);
         dump_str.appendFormat("  is_support_game_pq(vendor.debug.hwc.is_support_game_pq):%d\n", HwcFeatureList::getInstance().getFeature().game_pq);
 
@@ -858,6 +889,13 @@ void HWCMediator::deviceDump(hwc2_device_t* /*device*/, uint32_t* outSize, char*
 #endif
 
         DataExpress::getInstance().dump(&dump_str);
+        HWCRecorder::getInstance().dump(&dump_str);
+#ifdef MTK_HWC_USE_NULL_DEVICE
+        HWCBench::dump(&dump_str);
+#endif
+        HWCMCycleModel::getInstance().dump(&dump_str);
+        FenceMonitor::getInstance().dump(&dump_str);
+        HWCFrameTracer::getInstance().dump(&dump_str);
 
         if (HwcFeatureList::getInstance().getFeature().has_glai)
         {
@@ -1312,6 +1350,76 @@ void HWCMediator::updatePlatformConfig(bool is_init)
         {
             Platform::getInstance().m_config.hint_hwlayer_type = getHintHWLayerType(getHWLayerType(value));
         }
+
+        property_get("vendor.debug.hwc.perf_slack_control", value, "-1");
+        if (-1 != atoi(value))
+        {
+            Platform::getInstance().m_config.perf_slack_control = atoi(value);
+        }
+
+        property_get("vendor.debug.hwc.hrt_decision_cache", value, "-1");
+        if (-1 != atoi(value))
+        {
+            Platform::getInstance().m_config.hrt_decision_cache = atoi(value);
+        }
+
+        property_get("vendor.debug.hwc.hrt_query_memo", value, "-1");
+        if (-1 != atoi(value))
+        {
+            Platform::getInstance().m_config.hrt_query_memo = atoi(value);
+        }
+
+        property_get("vendor.debug.hwc.hrt_model_check", value, "-1");
+        if (-1 != atoi(value))
+        {
+            Platform::getInstance().m_config.hrt_model_check = atoi(value);
+        }
+
+        property_get("vendor.debug.hwc.hrt_model_bound", value, "-1");
+        if (-1 != atoi(value))
+        {
+            Platform::getInstance().m_config.hrt_model_bound_layer_num = static_cast<uint32_t>(atoi(value));
+        }
+
+        property_get("vendor.debug.hwc.hrt_joint_plan", value, "-1");
+        if (-1 != atoi(value))
+        {
+            Platform::getInstance().m_config.hrt_joint_plan = atoi(value);
+        }
+
+        property_get("vendor.debug.hwc.hrt_shared_bound", value, "-1");
+        if (-1 != atoi(value))
+        {
+            Platform::getInstance().m_config.hrt_model_shared_bound_layer_num = static_cast<uint32_t>(atoi(value));
+        }
+
+        property_get("vendor.debug.hwc.drm_delta_commit", value, "-1");
+        if (-1 != atoi(value))
+        {
+            Platform::getInstance().m_config.drm_delta_commit = atoi(value);
+        }
+
+        property_get("vendor.debug.hwc.drm_nonblock_commit", value, "-1");
+        if (-1 != atoi(value))
+        {
+            Platform::getInstance().m_config.drm_nonblock_commit = atoi(value);
+        }
+
+        property_get("vendor.debug.hwc.drm_color_blob_cache", value, "-1");
+        if (-1 != atoi(value))
+        {
+            Platform::getInstance().m_config.drm_color_blob_cache_size = static_cast<uint32_t>(atoi(value));
+        }
+
+        HWCRecorder::getInstance().updateConfig();
+        HWCMCycleModel::getInstance().updateConfig();
+        HWCFrameTracer::getInstance().updateConfig();
+#ifdef MTK_HWC_USE_NULL_DEVICE
+        // replaying is only allowed with null device, otherwise it would fight
+        // with SurfaceFlinger for the real display
+        HWCReplayer::updateConfig();
+        HWCBench::updateConfig();
+#endif
     }
 }
 
@@ -1406,6 +1514,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::displayAcceptChanges(
     hwc2_device_t* /*device*/,
     hwc2_display_t display)
 {
+    HWCRecorder::getInstance().recordCall(HWC_REC_ACCEPT_CHANGES, display);
     CHECK_DISP_CONNECT(display);
 
     getHWCDisplay(display)->acceptChanges();
@@ -1420,7 +1529,12 @@ int32_t /*hwc2_error_t*/ HWCMediator::displayCreateLayer(
 {
     CHECK_DISP_CONNECT(display);
 
-    return getHWCDisplay(display)->createLayer(out_layer, false);
+    const int32_t err = getHWCDisplay(display)->createLayer(out_layer, false);
+    if (err == HWC2_ERROR_NONE)
+    {
+        HWCRecorder::getInstance().recordCall(HWC_REC_CREATE_LAYER, display, *out_layer);
+    }
+    return err;
 }
 
 int32_t /*hwc2_error_t*/ HWCMediator::displayDestroyLayer(
@@ -1428,6 +1542,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::displayDestroyLayer(
     hwc2_display_t display,
     hwc2_layer_t layer)
 {
+    HWCRecorder::getInstance().recordCall(HWC_REC_DESTROY_LAYER, display, layer);
     CHECK_DISP_CONNECT(display);
 
     sp<HWCDisplay> hwc_display = getHWCDisplay(display);
@@ -1823,7 +1938,9 @@ int32_t /*hwc2_error_t*/ HWCMediator::displayPresent(
     hwc2_display_t display,
     int32_t* out_retire_fence)
 {
+    HWCRecorder::getInstance().recordCall(HWC_REC_PRESENT, display);
     CHECK_DISP(display);
+    FrameAllocScope alloc_scope;
 
     sp<HWCDisplay> hwc_display = getHWCDisplay(display);
 
@@ -1856,21 +1973,23 @@ int32_t /*hwc2_error_t*/ HWCMediator::displayPresent(
             HWCDispatcher::getInstance().setSessionMode(HWC_DISPLAY_PRIMARY, use_decouple_mode);
 
             prepareForValidation();
-            setNeedValidate(HWC_SKIP_VALIDATE_NOT_SKIP);
             setValiPresentStateOfAllDisplay(HWC_VALI_PRESENT_STATE_CHECK_SKIP_VALI, __LINE__);
-            if (checkSkipValidate(false) == true)
-                setNeedValidate(HWC_SKIP_VALIDATE_SKIP);
-            else
-                setNeedValidate(HWC_SKIP_VALIDATE_NOT_SKIP);
+            checkSkipValidate(false);
         }
 
-        if (getNeedValidate() == HWC_SKIP_VALIDATE_NOT_SKIP)
+        if (getNeedValidate(display) == HWC_SKIP_VALIDATE_NOT_SKIP)
         {
             return HWC2_ERROR_NOT_VALIDATED;
         }
         else
         {
-            m_hrt->run(m_displays, true);
+            // the displays skip together, so the layering of all displays
+            // is restored by the first present of this frame
+            if (!skipValidate())
+            {
+                setNeedValidateOfAllDisplay(HWC_SKIP_VALIDATE_NOT_SKIP);
+                return HWC2_ERROR_NOT_VALIDATED;
+            }
             setValiPresentStateOfAllDisplay(HWC_VALI_PRESENT_STATE_VALIDATE_DONE, __LINE__);
         }
     }
@@ -1883,6 +2002,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::displayPresent(
             HWC_LOGV("(%" PRIu64 ") %s getCommittedLayers() size:%zu",
                      hwc_display->getId(), __func__, hwc_display->getCommittedLayers().size());
             hwc_display->beforePresent(DisplayManager::getInstance().getNumberPluginDisplay());
+            stampFrame(hwc_display, HWC_FRAME_STAGE_PRESENT);
             hwc_display->present();
             HWCDispatcher::getInstance().trigger(display);
         }
@@ -1926,6 +2046,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::displaySetActiveConfig(
     hwc2_display_t display,
     hwc2_config_t config_id)
 {
+    HWCRecorder::getInstance().recordInt(HWC_REC_SET_ACTIVE_CONFIG, display, 0, static_cast<int32_t>(config_id));
     CHECK_DISP_CONNECT(display);
 
     sp<HWCDisplay> hwc_display = getHWCDisplay(display);
@@ -1941,6 +2062,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::displaySetActiveConfig(
     if (display == HWC_DISPLAY_PRIMARY)
     {
         hwc_display->setActiveConfig(config_id);
+        m_hrt->invalidateQuery();
     }
     HWC_LOGI("(%" PRIu64 ") %s config:%d", display, __func__, config_id);
 
@@ -1949,9 +2071,10 @@ int32_t /*hwc2_error_t*/ HWCMediator::displaySetActiveConfig(
 
 int32_t /*hwc2_error_t*/ HWCMediator::displaySetBrightness(
         hwc2_device_t* /*device*/,
-        hwc2_display_t /*display*/,
-        float /*brightness*/)
+        hwc2_display_t display,
+        float brightness)
 {
+    HWCRecorder::getInstance().recordFloat(HWC_REC_SET_BRIGHTNESS, display, 0, brightness);
     return HWC2_ERROR_UNSUPPORTED;
 }
 
@@ -1960,9 +2083,10 @@ int32_t /*hwc2_error_t*/ HWCMediator::displaySetClientTarget(
     hwc2_display_t display,
     buffer_handle_t handle,
     int32_t acquire_fence,
-    int32_t /*dataspace*/,
+    int32_t dataspace,
     hwc_region_t damage)
 {
+    HWCRecorder::getInstance().recordClientTarget(display, handle, acquire_fence, dataspace, damage);
     CHECK_DISP_CONNECT(display);
 
     sp<HWCDisplay> hwc_display = getHWCDisplay(display);
@@ -1994,6 +2118,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::displaySetColorMode(
     hwc2_display_t display,
     int32_t mode)
 {
+    HWCRecorder::getInstance().recordInt(HWC_REC_SET_COLOR_MODE, display, 0, mode);
     CHECK_DISP_CONNECT(display);
 
     HWC_LOGI("(%" PRIu64 ") %s mode:%d", display, __func__, mode);
@@ -2007,6 +2132,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::displaySetColorTransform(
     const float* matrix,
     int32_t /*android_color_transform_t*/ hint)
 {
+    HWCRecorder::getInstance().recordColorTransform(display, matrix, hint);
     CHECK_DISP_CONNECT(display);
 
     if (display == HWC_DISPLAY_PRIMARY ||
@@ -2027,6 +2153,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::displaySetOutputBuffer(
     buffer_handle_t buffer,
     int32_t release_fence)
 {
+    HWCRecorder::getInstance().recordBuffer(HWC_REC_SET_OUTPUT_BUFFER, display, 0, buffer, release_fence);
     if (display != HWC_DISPLAY_VIRTUAL)
     {
         HWC_LOGE("%s: invalid display(%" PRIu64 ")", __func__, display);
@@ -2046,6 +2173,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::displaySetPowerMode(
     hwc2_display_t display,
     int32_t /*hwc2_power_mode_t*/ mode)
 {
+    HWCRecorder::getInstance().recordInt(HWC_REC_SET_POWER_MODE, display, 0, mode);
     CHECK_DISP_CONNECT(display);
 
     HWC_LOGD("%s display:%" PRIu64 " mode:%d", __func__, display, mode);
@@ -2062,6 +2190,11 @@ int32_t /*hwc2_error_t*/ HWCMediator::displaySetPowerMode(
         case HWC2_POWER_MODE_DOZE:
         case HWC2_POWER_MODE_DOZE_SUSPEND:
             getHWCDisplay(display)->setPowerMode(mode);
+            m_hrt->invalidateQuery();
+            if (display == HWC_DISPLAY_PRIMARY && mode == HWC2_POWER_MODE_OFF)
+            {
+                HWCMCycleModel::getInstance().save();
+            }
             break;
 
         default:
@@ -2077,6 +2210,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::displaySetVsyncEnabled(
     hwc2_display_t display,
     int32_t /*hwc2_vsync_t*/ enabled)
 {
+    HWCRecorder::getInstance().recordInt(HWC_REC_SET_VSYNC_ENABLED, display, 0, enabled);
     if (getHWCDisplay(display)->getId() != HWC_DISPLAY_EXTERNAL)
         CHECK_DISP_CONNECT(display);
 
@@ -2282,7 +2416,9 @@ int32_t /*hwc2_error_t*/ HWCMediator::displayValidateDisplay(
     uint32_t* out_num_types,
     uint32_t* out_num_requests)
 {
+    HWCRecorder::getInstance().recordCall(HWC_REC_VALIDATE, display);
     CHECK_DISP(display);
+    FrameAllocScope alloc_scope;
 
     sp<HWCDisplay> hwc_display = getHWCDisplay(display);
 
@@ -2314,14 +2450,11 @@ int32_t /*hwc2_error_t*/ HWCMediator::displayValidateDisplay(
 
             if (Platform::getInstance().m_config.is_skip_hrt)
             {
-                if (checkSkipValidate(true) == true)
-                    setNeedValidate(HWC_SKIP_VALIDATE_SKIP);
-                else
-                    setNeedValidate(HWC_SKIP_VALIDATE_NOT_SKIP);
+                checkSkipValidate(true);
             }
             else
             {
-                setNeedValidate(HWC_SKIP_VALIDATE_NOT_SKIP);
+                setNeedValidateOfAllDisplay(HWC_SKIP_VALIDATE_NOT_SKIP);
             }
         }
         else
@@ -2344,7 +2477,12 @@ int32_t /*hwc2_error_t*/ HWCMediator::displayValidateDisplay(
     if (hwc_display->getValiPresentState() == HWC_VALI_PRESENT_STATE_PRESENT_DONE ||
         hwc_display->getValiPresentState() == HWC_VALI_PRESENT_STATE_CHECK_SKIP_VALI)
     {
-        if (getNeedValidate() == HWC_SKIP_VALIDATE_NOT_SKIP)
+        if (getNeedValidate(display) == HWC_SKIP_VALIDATE_SKIP && !skipValidate())
+        {
+            setNeedValidateOfAllDisplay(HWC_SKIP_VALIDATE_NOT_SKIP);
+        }
+
+        if (getNeedValidate(display) == HWC_SKIP_VALIDATE_NOT_SKIP)
         {
             if (is_validate_only_one_display)
             {
@@ -2358,7 +2496,6 @@ int32_t /*hwc2_error_t*/ HWCMediator::displayValidateDisplay(
         }
         else
         {
-            m_hrt->run(m_displays, true);
             setValiPresentStateOfAllDisplay(HWC_VALI_PRESENT_STATE_VALIDATE, __LINE__);
         }
     }
@@ -2428,6 +2565,7 @@ int32_t HWCMediator::displaySetDisplayedContentSamplingEnabled(
     uint8_t /* mask of android_component_t */ component_mask,
     uint64_t max_frames)
 {
+    HWCRecorder::getInstance().recordContentSampling(display, enabled, component_mask, max_frames);
     CHECK_DISP_CONNECT(display);
 
     sp<HWCDisplay> hwc_display = getHWCDisplay(display);
@@ -2468,6 +2606,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::displaySetColorModeWithRenderIntent(
     int32_t /*android_color_mode_t*/ mode,
     int32_t /*android_render_intent_v1_1_t */ intent)
 {
+    HWCRecorder::getInstance().recordInt2(HWC_REC_SET_COLOR_MODE_WITH_INTENT, display, 0, mode, intent);
     CHECK_DISP_CONNECT(display);
 
     HWC_LOGI("(%" PRIu64 ") %s mode:%d intent:%d", display, __func__, mode, intent);
@@ -2483,6 +2622,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerSetCursorPosition(
     int32_t x,
     int32_t y)
 {
+    HWCRecorder::getInstance().recordInt2(HWC_REC_LAYER_CURSOR_POSITION, display, layer, x, y);
     CHECK_DISP_CONNECT(display);
 
     sp<HWCDisplay> hwc_display = getHWCDisplay(display);
@@ -2508,6 +2648,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerSetBuffer(
     buffer_handle_t buffer,
     int32_t acquire_fence)
 {
+    HWCRecorder::getInstance().recordBuffer(HWC_REC_LAYER_BUFFER, display, layer, buffer, acquire_fence);
     CHECK_DISP_CONNECT(display);
 
     sp<HWCLayer> hwc_layer = getHWCDisplay(display)->getLayer(layer);
@@ -2537,6 +2678,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerSetSurfaceDamage(
     hwc2_layer_t layer_id,
     hwc_region_t damage)
 {
+    HWCRecorder::getInstance().recordRegion(HWC_REC_LAYER_SURFACE_DAMAGE, display, layer_id, damage);
     CHECK_DISP_CONNECT(display);
 
     sp<HWCLayer> layer = getHWCDisplay(display)->getLayer(layer_id);
@@ -2554,6 +2696,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetBlendMode(
     hwc2_layer_t layer_id,
     int32_t /*hwc2_blend_mode_t*/ mode)
 {
+    HWCRecorder::getInstance().recordInt(HWC_REC_LAYER_BLEND_MODE, display, layer_id, mode);
     CHECK_DISP_CONNECT(display);
 
     sp<HWCLayer> layer = getHWCDisplay(display)->getLayer(layer_id);
@@ -2579,6 +2722,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetColor(
     hwc2_layer_t layer_id,
     hwc_color_t color)
 {
+    HWCRecorder::getInstance().recordColor(display, layer_id, color);
     CHECK_DISP_CONNECT(display);
 
     sp<HWCLayer> layer = getHWCDisplay(display)->getLayer(layer_id);
@@ -2595,6 +2739,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetCompositionType(
     hwc2_layer_t layer_id,
     int32_t /*hwc2_composition_t*/ type)
 {
+    HWCRecorder::getInstance().recordInt(HWC_REC_LAYER_COMPOSITION_TYPE, display, layer_id, type);
     CHECK_DISP_CONNECT(display);
 
     HWC_LOGV("(%" PRIu64 ") layerStateSetCompositionType() layer id:%" PRIu64 " type:%s", display, layer_id, getCompString(type));
@@ -2644,6 +2789,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetDataSpace(
     hwc2_layer_t layer,
     int32_t /*android_dataspace_t*/ dataspace)
 {
+    HWCRecorder::getInstance().recordInt(HWC_REC_LAYER_DATASPACE, display, layer, dataspace);
     CHECK_DISP_CONNECT(display);
 
     sp<HWCLayer> hwc_layer = getHWCDisplay(display)->getLayer(layer);
@@ -2662,6 +2808,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetDisplayFrame(
     hwc2_layer_t layer_id,
     hwc_rect_t frame)
 {
+    HWCRecorder::getInstance().recordRect(HWC_REC_LAYER_DISPLAY_FRAME, display, layer_id, frame);
     CHECK_DISP_CONNECT(display);
 
     sp<HWCDisplay> hwc_display = getHWCDisplay(display);
@@ -2697,6 +2844,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetPlaneAlpha(
     hwc2_layer_t layer_id,
     float alpha)
 {
+    HWCRecorder::getInstance().recordFloat(HWC_REC_LAYER_PLANE_ALPHA, display, layer_id, alpha);
     CHECK_DISP_CONNECT(display);
 
     sp<HWCLayer> layer = getHWCDisplay(display)->getLayer(layer_id);
@@ -2709,10 +2857,11 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetPlaneAlpha(
 
 int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetSidebandStream(
     hwc2_device_t* /*device*/,
-    hwc2_display_t /*display*/,
-    hwc2_layer_t /*layer*/,
+    hwc2_display_t display,
+    hwc2_layer_t layer,
     const native_handle_t* /*stream*/)
 {
+    HWCRecorder::getInstance().recordCall(HWC_REC_LAYER_SIDEBAND_STREAM, display, layer);
     return HWC2_ERROR_NONE;
 }
 
@@ -2722,6 +2871,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetSourceCrop(
     hwc2_layer_t layer_id,
     hwc_frect_t crop)
 {
+    HWCRecorder::getInstance().recordFRect(HWC_REC_LAYER_SOURCE_CROP, display, layer_id, crop);
     CHECK_DISP_CONNECT(display);
 
     sp<HWCLayer> layer = getHWCDisplay(display)->getLayer(layer_id);
@@ -2741,6 +2891,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetTransform(
     hwc2_layer_t layer_id,
     int32_t /*hwc_transform_t*/ transform)
 {
+    HWCRecorder::getInstance().recordInt(HWC_REC_LAYER_TRANSFORM, display, layer_id, transform);
     CHECK_DISP_CONNECT(display);
 
     sp<HWCLayer> layer = getHWCDisplay(display)->getLayer(layer_id);
@@ -2773,6 +2924,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetVisibleRegion(
     hwc2_layer_t layer_id,
     hwc_region_t visible)
 {
+    HWCRecorder::getInstance().recordRegion(HWC_REC_LAYER_VISIBLE_REGION, display, layer_id, visible);
     CHECK_DISP_CONNECT(display);
 
     sp<HWCLayer> layer = getHWCDisplay(display)->getLayer(layer_id);
@@ -2791,6 +2943,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetZOrder(
     hwc2_layer_t layer_id,
     uint32_t z)
 {
+    HWCRecorder::getInstance().recordInt(HWC_REC_LAYER_Z_ORDER, display, layer_id, static_cast<int32_t>(z));
     CHECK_DISP_CONNECT(display);
 
     sp<HWCLayer> layer = getHWCDisplay(display)->getLayer(layer_id);
@@ -2808,6 +2961,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetPerFrameMetadata(
     const int32_t* /*hw2_per_frame_metadata_key_t*/ keys,
     const float* metadata)
 {
+    HWCRecorder::getInstance().recordPerFrameMetadata(display, layer_id, numElements, keys, metadata);
     CHECK_DISP_CONNECT(display);
 
     sp<HWCLayer> layer = getHWCDisplay(display)->getLayer(layer_id);
@@ -2837,6 +2991,7 @@ int32_t /*hwc2_error_t*/ HWCMediator::layerStateSetPerFrameMetadataBlobs(
     const uint32_t* sizes,
     const uint8_t* metadata)
 {
+    HWCRecorder::getInstance().recordPerFrameMetadataBlobs(display, layer_id, numElements, keys, sizes, metadata);
     CHECK_DISP_CONNECT(display);
 
     sp<HWCLayer> layer = getHWCDisplay(display)->getLayer(layer_id);
@@ -2936,6 +3091,8 @@ bool HWCMediator::sameDisplayContent(uint64_t dpy)
 
 bool HWCMediator::checkSkipValidate(const bool& is_validate_call)
 {
+    setNeedValidateOfAllDisplay(HWC_SKIP_VALIDATE_NOT_SKIP);
+
     // If we use layer hint, ignore skip validate even it indeed can skip.
     if (Platform::getInstance().m_config.hint_id > 0)
     {
@@ -2943,8 +3100,6 @@ bool HWCMediator::checkSkipValidate(const bool& is_validate_call)
         return false;
     }
 
-    bool has_valid_display = false;
-
     if (HWCMediator::getInstance().getDriverRefreshCount() > 0)
     {
         HWC_LOGD("no skip vali(L%d) validate(%d)", __LINE__, is_validate_call);
@@ -2971,6 +3126,8 @@ bool HWCMediator::checkSkipValidate(const bool& is_validate_call)
         return false;
     }
 
+    bool has_valid_display = false;
+    bool is_all_skip = true;
     for (size_t i = 0; i < m_displays.size(); ++i)
     {
         sp<HWCDisplay> hwc_display = getHWCDisplay(i);
@@ -2979,108 +3136,159 @@ bool HWCMediator::checkSkipValidate(const bool& is_validate_call)
             continue;
         }
 
-        const uint64_t disp_id = hwc_display->getId();
         has_valid_display = true;
-
-        if (disp_id > HWC_DISPLAY_PRIMARY)
+        if (checkSkipValidateOfDisplay(hwc_display, is_validate_call))
         {
-            HWC_LOGD("no skip vali(%zu:L%d) validate(%d)", i, __LINE__, is_validate_call);
-            return false;
+            setNeedValidate(hwc_display->getId(), HWC_SKIP_VALIDATE_SKIP);
+        }
+        else
+        {
+            is_all_skip = false;
         }
+    }
+
+    // the source and the sink of mirror path are composed together, so they
+    // skip validate only together
+    for (size_t i = 0; i < m_displays.size(); ++i)
+    {
+        sp<HWCDisplay> hwc_display = getHWCDisplay(i);
+        if (!hwc_display->isValid())
+            continue;
 
-        if (hwc_display->isForceGpuCompose())
+        DispatcherJob* job = HWCDispatcher::getInstance().getExistJob(hwc_display->getId());
+        if (job == NULL || job->disp_mir_id < 0 ||
+            static_cast<uint64_t>(job->disp_mir_id) >= DisplayManager::MAX_DISPLAYS)
         {
-            HWC_LOGD("no skip vali(%zu:L%d) validate(%d)", i, __LINE__, is_validate_call);
-            return false;
+            continue;
         }
 
-        if (hwc_display->isConfigChanged())
+        const uint64_t src_id = static_cast<uint64_t>(job->disp_mir_id);
+        if (getNeedValidate(src_id) == HWC_SKIP_VALIDATE_NOT_SKIP ||
+            getNeedValidate(hwc_display->getId()) == HWC_SKIP_VALIDATE_NOT_SKIP)
         {
-            HWC_LOGD("no skip vali(%zu:L%d) validate(%d)", i, __LINE__, is_validate_call);
-            return false;
+            setNeedValidate(src_id, HWC_SKIP_VALIDATE_NOT_SKIP);
+            setNeedValidate(hwc_display->getId(), HWC_SKIP_VALIDATE_NOT_SKIP);
+            is_all_skip = false;
         }
+    }
 
-        auto&& layers = hwc_display->getVisibleLayersSortedByZ();
+    // HRT checks the bandwidth of all displays together, a display which
+    // presents with its last layering would be left out of the HRT input of
+    // the others, so the displays skip validate only together
+    if (!has_valid_display || !is_all_skip)
+    {
+        setNeedValidateOfAllDisplay(HWC_SKIP_VALIDATE_NOT_SKIP);
+        return false;
+    }
 
-        for (size_t j = 0; j < layers.size(); ++j)
-        {
-            if (layers[j]->isStateChanged())
-            {
-                HWC_LOGD("no skip vali(%zu:L%d) validate(%d), reason 0x%x",
-                         i, __LINE__, is_validate_call, layers[j]->getStateChangedReason());
-                return false;
-            }
+    HWC_LOGD("do skip vali validate(%d)", is_validate_call);
+    return true;
+}
 
-            if (!is_validate_call &&
-                layers[j]->getHwlayerType() == HWC_LAYER_TYPE_INVALID)
-            {
-                HWC_LOGD("no skip vali(%zu:L%d) validate(%d)", i, __LINE__, is_validate_call);
-                return false;
-            }
+bool HWCMediator::checkSkipValidateOfDisplay(const sp<HWCDisplay>& hwc_display, const bool& is_validate_call)
+{
+    const uint64_t disp_id = hwc_display->getId();
 
-            if (layers[j]->getPrevIsPQEnhance() != layers[j]->getPrivateHandle().pq_enable)
-            {
-                HWC_LOGD("no skip vali(%zu:L%d) validate(%d)", i, __LINE__, is_validate_call);
-                return false;
-            }
+    if (hwc_display->isForceGpuCompose())
+    {
+        HWC_LOGD("no skip vali(%" PRIu64 ":L%d) validate(%d)", disp_id, __LINE__, is_validate_call);
+        return false;
+    }
 
-            if (layers[j]->isNeedPQ(1) ||
-                layers[j]->isNeedPQ(1) != layers[j]->getLastAppGamePQ())
-            {
-                HWC_LOGD("no skip vali(%zu:L%d) validate(%d)", i, __LINE__, is_validate_call);
-                return false;
-            }
+    if (hwc_display->isConfigChanged())
+    {
+        HWC_LOGD("no skip vali(%" PRIu64 ":L%d) validate(%d)", disp_id, __LINE__, is_validate_call);
+        return false;
+    }
 
-            if (layers[j]->isAIPQ() != layers[j]->getLastAIPQ())
-            {
-                HWC_LOGD("no skip vali(%zu:L%d) validate(%d)", i, __LINE__, is_validate_call);
-                return false;
-            }
+    // the output buffer of virtual display may be missing while it is
+    // disconnecting, and low latency WFD has its own repaint flow
+    if (disp_id >= HWC_DISPLAY_VIRTUAL &&
+        (getLowLatencyWFD() ||
+         hwc_display->getOutbuf() == nullptr ||
+         hwc_display->getOutbuf()->getHandle() == nullptr))
+    {
+        HWC_LOGD("no skip vali(%" PRIu64 ":L%d) validate(%d)", disp_id, __LINE__, is_validate_call);
+        return false;
+    }
 
-            if (layers[j]->isCameraPreviewHDR() != layers[j]->getLastCameraPreviewHDR())
-            {
-                HWC_LOGD("no skip vali(%zu:L%d) validate(%d)", i, __LINE__, is_validate_call);
-                return false;
-            }
+    auto&& layers = hwc_display->getVisibleLayersSortedByZ();
 
-            if (layers[j]->getPrivateHandle().glai_inference != layers[j]->getGlaiLastInference())
-            {
-                HWC_LOGD("no skip vali(%zu:L%d) validate(%d)", i, __LINE__, is_validate_call);
-                return false;
-            }
+    for (size_t j = 0; j < layers.size(); ++j)
+    {
+        if (layers[j]->isStateChanged())
+        {
+            HWC_LOGD("no skip vali(%" PRIu64 ":L%d) validate(%d), reason 0x%x",
+                     disp_id, __LINE__, is_validate_call, layers[j]->getStateChangedReason());
+            return false;
         }
 
-        DispatcherJob* job = HWCDispatcher::getInstance().getExistJob(disp_id);
-        if (job == NULL || hwc_display->getPrevAvailableInputLayerNum() != job->num_layers)
+        if (!is_validate_call &&
+            layers[j]->getHwlayerType() == HWC_LAYER_TYPE_INVALID)
         {
-            HWC_LOGD("no skip vali(%zu:L%d) validate(%d)", i, __LINE__, is_validate_call);
+            HWC_LOGD("no skip vali(%" PRIu64 ":L%d) validate(%d)", disp_id, __LINE__, is_validate_call);
             return false;
         }
 
-        if (hwc_display->isVisibleLayerChanged())
+        if (layers[j]->getPrevIsPQEnhance() != layers[j]->getPrivateHandle().pq_enable)
         {
-            HWC_LOGD("no skip vali(%zu:L%d) validate(%d)", i, __LINE__, is_validate_call);
+            HWC_LOGD("no skip vali(%" PRIu64 ":L%d) validate(%d)", disp_id, __LINE__, is_validate_call);
             return false;
         }
 
-        if (HWCDispatcher::getInstance().getOvlEnginePowerModeChanged(disp_id) > 0)
+        if (layers[j]->isNeedPQ(1) ||
+            layers[j]->isNeedPQ(1) != layers[j]->getLastAppGamePQ())
         {
-            HWC_LOGD("no skip vali(%zu:L%d) validate(%d)", i, __LINE__, is_validate_call);
+            HWC_LOGD("no skip vali(%" PRIu64 ":L%d) validate(%d)", disp_id, __LINE__, is_validate_call);
             return false;
         }
 
-        // if there exists secure layers, we do not skip validate.
-        if (listSecure(layers))
+        if (layers[j]->isAIPQ() != layers[j]->getLastAIPQ())
         {
-            HWC_LOGD("no skip vali(%zu:L%d) validate(%d)", i, __LINE__, is_validate_call);
+            HWC_LOGD("no skip vali(%" PRIu64 ":L%d) validate(%d)", disp_id, __LINE__, is_validate_call);
             return false;
         }
+
+        if (layers[j]->isCameraPreviewHDR() != layers[j]->getLastCameraPreviewHDR())
+        {
+            HWC_LOGD("no skip vali(%" PRIu64 ":L%d) validate(%d)", disp_id, __LINE__, is_validate_call);
+            return false;
+        }
+
+        if (layers[j]->getPrivateHandle().glai_inference != layers[j]->getGlaiLastInference())
+        {
+            HWC_LOGD("no skip vali(%" PRIu64 ":L%d) validate(%d)", disp_id, __LINE__, is_validate_call);
+            return false;
+        }
+    }
+
+    DispatcherJob* job = HWCDispatcher::getInstance().getExistJob(disp_id);
+    if (job == NULL || hwc_display->getPrevAvailableInputLayerNum() != job->num_layers)
+    {
+        HWC_LOGD("no skip vali(%" PRIu64 ":L%d) validate(%d)", disp_id, __LINE__, is_validate_call);
+        return false;
     }
 
-    if (has_valid_display)
-        HWC_LOGD("do skip vali validate(%d)", is_validate_call);
+    if (hwc_display->isVisibleLayerChanged())
+    {
+        HWC_LOGD("no skip vali(%" PRIu64 ":L%d) validate(%d)", disp_id, __LINE__, is_validate_call);
+        return false;
+    }
+
+    if (HWCDispatcher::getInstance().getOvlEnginePowerModeChanged(disp_id) > 0)
+    {
+        HWC_LOGD("no skip vali(%" PRIu64 ":L%d) validate(%d)", disp_id, __LINE__, is_validate_call);
+        return false;
+    }
+
+    // if there exists secure layers, we do not skip validate.
+    if (listSecure(layers))
+    {
+        HWC_LOGD("no skip vali(%" PRIu64 ":L%d) validate(%d)", disp_id, __LINE__, is_validate_call);
+        return false;
+    }
 
-    return (has_valid_display)? true : false;
+    return true;
 }
 
 int HWCMediator::getValidDisplayNum()
@@ -3137,7 +3345,8 @@ void HWCMediator::buildVisibleAndInvisibleLayerForAllDisplay()
 
 void HWCMediator::createJob(const sp<HWCDisplay>& hwc_display)
 {
-    int dispather_job_status = HWCDispatcher::getInstance().getJob(hwc_display->getId());
+    int dispather_job_status = HWCDispatcher::getInstance().getJob(hwc_display->getId(),
+                                                                     hwc_display->getSfTargetTs());
     hwc_display->setJobStatus(dispather_job_status);
     hwc_display->setJobDisplayOrientation();
     hwc_display->setJobDisplayData();
@@ -3214,6 +3423,19 @@ void HWCMediator::setJobVideoTimeStamp()
     }
 }
 
+void HWCMediator::setNeedValidateOfAllDisplay(SKIP_VALI_STATE val)
+{
+    for (size_t i = 0; i < DisplayManager::MAX_DISPLAYS; ++i)
+    {
+        m_need_validate[i] = val;
+    }
+}
+
+bool HWCMediator::skipValidate()
+{
+    return m_hrt->run(m_displays, true);
+}
+
 void HWCMediator::setValiPresentStateOfAllDisplay(const HWC_VALI_PRESENT_STATE& val, const int32_t& line)
 {
     for (size_t i = 0; i < m_displays.size(); ++i)
@@ -3337,6 +3559,8 @@ void calculateMdpDstRoi(sp<HWCLayer> layer, const uint64_t& disp_id, const doubl
 
 void HWCMediator::validate(const sp<HWCDisplay>& target_disp)
 {
+    HWC_BENCH_STAGE(HWC_BENCH_STAGE_VALIDATE);
+
     // check if mirror mode exists
     {
         for (auto& hwc_display : m_displays)
@@ -3347,6 +3571,7 @@ void HWCMediator::validate(const sp<HWCDisplay>& target_disp)
             if ((target_disp != nullptr) && target_disp != hwc_display)
                 continue;
 
+            stampFrame(hwc_display, HWC_FRAME_STAGE_VALIDATE_START);
             hwc_display->validate();
             hwc_display->setOverrideMDPOutputFormatOfLayers();
         }
@@ -3366,8 +3591,26 @@ void HWCMediator::validate(const sp<HWCDisplay>& target_disp)
                                    Platform::getInstance().m_config.mdp_scale_percentage);
             }
         }
+
+        // the session mode of the driver may change without a change of
+        // the layering request
+        if (HWCDispatcher::getInstance().getSessionModeChanged() > 0)
+        {
+            m_hrt->invalidateQuery();
+        }
         m_hrt->run(m_displays, false);
     }
+
+    for (auto& hwc_display : m_displays)
+    {
+        if (!hwc_display->isValid())
+            continue;
+
+        if ((target_disp != nullptr) && target_disp != hwc_display)
+            continue;
+
+        stampFrame(hwc_display, HWC_FRAME_STAGE_VALIDATE_END);
+    }
 }
 
 void HWCMediator::notifyHwbinderTid()
@@ -137,8 +137,15 @@ private:
     void updatePlatformConfig(bool is_init);
 /*-------------------------------------------------------------------------*/
 /* Skip Validate */
+    // checkSkipValidate() checks each valid display, the displays skip
+    // validate only if all of them can skip. The result is kept in
+    // setNeedValidate() and returned
     bool checkSkipValidate(const bool& is_validate_call);
 
+    // checkSkipValidateOfDisplay() checks the layer state, composition types
+    // and overlay availability of one display
+    bool checkSkipValidateOfDisplay(const sp<HWCDisplay>& hwc_display, const bool& is_validate_call);
+
     int getValidDisplayNum();
 
     void buildVisibleAndInvisibleLayerForAllDisplay();
@@ -152,15 +159,21 @@ private:
 
     void setValiPresentStateOfAllDisplay(const HWC_VALI_PRESENT_STATE& val, const int32_t& line);
 
-    SKIP_VALI_STATE getNeedValidate() const { return m_need_validate; }
-    void setNeedValidate(SKIP_VALI_STATE val) { m_need_validate = val; }
+    SKIP_VALI_STATE getNeedValidate(const uint64_t& dpy) const { return m_need_validate[dpy]; }
+    void setNeedValidate(const uint64_t& dpy, SKIP_VALI_STATE val) { m_need_validate[dpy] = val; }
+    void setNeedValidateOfAllDisplay(SKIP_VALI_STATE val);
+
+    // skipValidate() reuses the last validate result of all displays, it
+    // returns false if the result cannot be restored and validate is needed
+    bool skipValidate();
 /*-------------------------------------------------------------------------*/
 
     std::vector<sp<HWCDisplay> > m_displays;
 
     sp<HrtCommon> m_hrt;
 
-    SKIP_VALI_STATE m_need_validate;
+    // the skip validate decision of each display in the current frame
+    SKIP_VALI_STATE m_need_validate[DisplayManager::MAX_DISPLAYS];
 
     int32_t m_validate_seq;
     int32_t m_present_seq;
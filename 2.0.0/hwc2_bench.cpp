@@ -0,0 +1,510 @@
+#define DEBUG_LOG_TAG "BENCH"
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "hwc2_bench.h"
+
+#include <algorithm>
+#include <thread>
+
+#include <inttypes.h>
+
+#include <cutils/properties.h>
+#include <utils/String8.h>
+
+#include "utils/debug.h"
+#include "utils/tools.h"
+
+#include "display.h"
+#include "grallocdev.h"
+#include "hwc2.h"
+
+using namespace android;
+
+#define BENCH_DEFAULT_FRAMES 600
+
+HWCStageProfiler& HWCStageProfiler::getInstance()
+{
+    static HWCStageProfiler gInstance;
+    return gInstance;
+}
+
+HWCStageProfiler::HWCStageProfiler()
+    : m_enabled(false)
+{
+    for (int i = 0; i < HWC_BENCH_STAGE_NUM; i++)
+    {
+        m_samples[i].reserve(HWC_BENCH_MAX_SAMPLES);
+        m_sample_pos[i] = 0;
+    }
+}
+
+void HWCStageProfiler::start()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    for (int i = 0; i < HWC_BENCH_STAGE_NUM; i++)
+    {
+        m_samples[i].clear();
+        m_sample_pos[i] = 0;
+    }
+    m_enabled.store(true, std::memory_order_relaxed);
+}
+
+void HWCStageProfiler::stop()
+{
+    m_enabled.store(false, std::memory_order_relaxed);
+}
+
+void HWCStageProfiler::addSample(int stage, nsecs_t cpu_time)
+{
+    if (stage < 0 || stage >= HWC_BENCH_STAGE_NUM)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    std::vector<nsecs_t>& samples = m_samples[stage];
+    if (samples.size() < HWC_BENCH_MAX_SAMPLES)
+    {
+        samples.push_back(cpu_time);
+    }
+    else
+    {
+        // keep the latest samples when the run is longer than the buffer
+        samples[m_sample_pos[stage]] = cpu_time;
+        m_sample_pos[stage] = (m_sample_pos[stage] + 1) % HWC_BENCH_MAX_SAMPLES;
+    }
+}
+
+nsecs_t HWCStageProfiler::getPercentile(int stage, int pct)
+{
+    if (stage < 0 || stage >= HWC_BENCH_STAGE_NUM)
+        return 0;
+
+    std::vector<nsecs_t> sorted;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        sorted = m_samples[stage];
+    }
+    if (sorted.empty())
+        return 0;
+
+    const size_t idx = std::min(sorted.size() - 1,
+                                sorted.size() * static_cast<size_t>(std::max(pct, 0)) / 100);
+    std::nth_element(sorted.begin(), sorted.begin() + static_cast<long>(idx), sorted.end());
+    return sorted[idx];
+}
+
+size_t HWCStageProfiler::getSampleCount(int stage)
+{
+    if (stage < 0 || stage >= HWC_BENCH_STAGE_NUM)
+        return 0;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_samples[stage].size();
+}
+
+const char* HWCStageProfiler::getStageName(int stage)
+{
+    switch (stage)
+    {
+        case HWC_BENCH_STAGE_VALIDATE:
+            return "validate";
+        case HWC_BENCH_STAGE_SET_JOB:
+            return "setJob";
+        case HWC_BENCH_STAGE_DISPATCH:
+            return "dispatch";
+        case HWC_BENCH_STAGE_OVL_LOOP:
+            return "ovl_loop";
+        default:
+            return "unknown";
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+std::mutex HWCBench::s_result_lock;
+HWCBench::Result HWCBench::s_last_result;
+
+HWCBench::HWCBench()
+    : m_dpy(HWC_DISPLAY_PRIMARY)
+    , m_is_virtual(false)
+    , m_output_buffer(nullptr)
+{
+}
+
+HWCBench::~HWCBench()
+{
+    teardown();
+}
+
+void HWCBench::updateConfig()
+{
+    static std::mutex s_lock;
+    static std::string s_name;
+    char value[PROPERTY_VALUE_MAX] = {0};
+
+    property_get("vendor.debug.hwc.bench", value, "");
+    std::lock_guard<std::mutex> lock(s_lock);
+    if (s_name == value)
+        return;
+
+    s_name = value;
+    if (s_name.empty())
+        return;
+
+    property_get("vendor.debug.hwc.bench_frames", value, "0");
+    uint32_t frames = static_cast<uint32_t>(strtoul(value, nullptr, 0));
+    if (frames == 0)
+    {
+        frames = BENCH_DEFAULT_FRAMES;
+    }
+
+    std::thread([name = s_name, frames]()
+    {
+        pthread_setname_np(pthread_self(), "HWCBench");
+        HWCBench bench;
+        Result result;
+        if (bench.run(name, frames, &result) == NO_ERROR)
+        {
+            std::lock_guard<std::mutex> lock(s_result_lock);
+            s_last_result = result;
+        }
+    }).detach();
+}
+
+void HWCBench::dump(String8* dump_str)
+{
+    std::lock_guard<std::mutex> lock(s_result_lock);
+    if (s_last_result.frame_count == 0)
+        return;
+
+    const Result& r = s_last_result;
+    dump_str->appendFormat("[HWC Bench] %s frames:%" PRIu64 " errors:%" PRIu64 " duration:%" PRId64 "ms"
+                           " alloc/frame avg:%.2f max:%" PRIu64 "\n",
+                           r.scenario.c_str(), r.frame_count, r.error_count, ns2ms(r.duration),
+                           static_cast<double>(r.alloc_total) / static_cast<double>(r.frame_count),
+                           r.alloc_max);
+    for (int i = 0; i < HWC_BENCH_STAGE_NUM; i++)
+    {
+        dump_str->appendFormat("  %-8s cpu p50:%" PRId64 "us p99:%" PRId64 "us\n",
+                               HWCStageProfiler::getStageName(i), ns2us(r.p50[i]), ns2us(r.p99[i]));
+    }
+}
+
+bool HWCBench::getScenario(const std::string& name, Scenario* scenario)
+{
+    const DisplayData* disp_data = DisplayManager::getInstance().getDisplayData(HWC_DISPLAY_PRIMARY);
+    const int32_t w = disp_data->width > 0 ? disp_data->width : 1080;
+    const int32_t h = disp_data->height > 0 ? disp_data->height : 2400;
+    const int32_t bar = h / 20;
+
+    const uint64_t ui_usage = GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER |
+                              GRALLOC_USAGE_HW_RENDER;
+    const uint64_t video_usage = GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER;
+    const uint64_t camera_usage = GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER |
+                                  GRALLOC_USAGE_HW_CAMERA_WRITE;
+
+    const LayerDesc status_bar = { static_cast<uint32_t>(w), static_cast<uint32_t>(bar),
+                                   HAL_PIXEL_FORMAT_RGBA_8888, ui_usage, HAL_DATASPACE_V0_SRGB,
+                                   { 0, 0, w, bar }, false };
+    const LayerDesc nav_bar = { static_cast<uint32_t>(w), static_cast<uint32_t>(bar),
+                                HAL_PIXEL_FORMAT_RGBA_8888, ui_usage, HAL_DATASPACE_V0_SRGB,
+                                { 0, h - bar, w, h }, false };
+    const LayerDesc app = { static_cast<uint32_t>(w), static_cast<uint32_t>(h),
+                            HAL_PIXEL_FORMAT_RGBA_8888, ui_usage, HAL_DATASPACE_V0_SRGB,
+                            { 0, 0, w, h }, true };
+    const LayerDesc wallpaper = { static_cast<uint32_t>(w), static_cast<uint32_t>(h),
+                                  HAL_PIXEL_FORMAT_RGBX_8888, ui_usage, HAL_DATASPACE_V0_SRGB,
+                                  { 0, 0, w, h }, false };
+
+    scenario->virtual_width = 0;
+    scenario->virtual_height = 0;
+    scenario->layers.clear();
+
+    if (name == "ui")
+    {
+        scenario->layers = { wallpaper, app, status_bar, nav_bar };
+    }
+    else if (name == "video")
+    {
+        const LayerDesc video = { 1920, 1080, HAL_PIXEL_FORMAT_YV12, video_usage,
+                                  HAL_DATASPACE_V0_BT709, { 0, h / 3, w, h / 3 + w * 9 / 16 }, true };
+        scenario->layers = { video, status_bar, nav_bar };
+    }
+    else if (name == "camera")
+    {
+        const LayerDesc preview = { 1920, 1440, HAL_PIXEL_FORMAT_YCrCb_420_SP, camera_usage,
+                                    HAL_DATASPACE_V0_JFIF, { 0, 0, w, w * 4 / 3 }, true };
+        const LayerDesc control = { static_cast<uint32_t>(w), static_cast<uint32_t>(h),
+                                    HAL_PIXEL_FORMAT_RGBA_8888, ui_usage, HAL_DATASPACE_V0_SRGB,
+                                    { 0, 0, w, h }, false };
+        scenario->layers = { preview, control };
+    }
+    else if (name == "mirror4k")
+    {
+        // there is no external display without the display driver, so the 4K
+        // output is provided by a virtual display
+        scenario->virtual_width = 3840;
+        scenario->virtual_height = 2160;
+        const LayerDesc video = { 3840, 2160, HAL_PIXEL_FORMAT_YV12, video_usage,
+                                  HAL_DATASPACE_V0_BT709, { 0, 0, 3840, 2160 }, true };
+        const LayerDesc osd = { 3840, 216, HAL_PIXEL_FORMAT_RGBA_8888, ui_usage,
+                                HAL_DATASPACE_V0_SRGB, { 0, 1944, 3840, 2160 }, false };
+        scenario->layers = { video, osd };
+    }
+    else if (name == "virtual")
+    {
+        scenario->virtual_width = 1920;
+        scenario->virtual_height = 1080;
+        const LayerDesc vds_app = { 1920, 1080, HAL_PIXEL_FORMAT_RGBA_8888, ui_usage,
+                                    HAL_DATASPACE_V0_SRGB, { 0, 0, 1920, 1080 }, true };
+        const LayerDesc vds_bar = { 1920, 54, HAL_PIXEL_FORMAT_RGBA_8888, ui_usage,
+                                    HAL_DATASPACE_V0_SRGB, { 0, 0, 1920, 54 }, false };
+        scenario->layers = { vds_app, vds_bar };
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+status_t HWCBench::setupLayers(const Scenario& scenario)
+{
+    HWCMediator& mediator = HWCMediator::getInstance();
+
+    if (scenario.virtual_width > 0)
+    {
+        int32_t format = HAL_PIXEL_FORMAT_RGBA_8888;
+        if (mediator.deviceCreateVirtualDisplay(nullptr, scenario.virtual_width,
+                scenario.virtual_height, &format, &m_dpy) != HWC2_ERROR_NONE)
+        {
+            HWC_LOGE("%s: failed to create virtual display %ux%u", __func__,
+                     scenario.virtual_width, scenario.virtual_height);
+            return NO_INIT;
+        }
+        m_is_virtual = true;
+
+        GrallocDevice::AllocParam param;
+        param.width = scenario.virtual_width;
+        param.height = scenario.virtual_height;
+        param.format = static_cast<unsigned int>(format);
+        param.usage = GRALLOC_USAGE_HW_COMPOSER | GRALLOC_USAGE_HW_VIDEO_ENCODER;
+        if (GrallocDevice::getInstance().alloc(param) != NO_ERROR)
+        {
+            HWC_LOGE("%s: failed to alloc output buffer", __func__);
+            return NO_MEMORY;
+        }
+        m_output_buffer = param.handle;
+    }
+    else
+    {
+        m_dpy = HWC_DISPLAY_PRIMARY;
+    }
+    mediator.displaySetPowerMode(nullptr, m_dpy, HWC2_POWER_MODE_ON);
+
+    uint32_t z = 0;
+    for (const LayerDesc& desc : scenario.layers)
+    {
+        hwc2_layer_t layer = 0;
+        if (mediator.displayCreateLayer(nullptr, m_dpy, &layer) != HWC2_ERROR_NONE)
+        {
+            HWC_LOGE("%s: failed to create layer", __func__);
+            return NO_INIT;
+        }
+        m_layers.push_back(layer);
+
+        // two buffers for each layer, so the layers updated per frame flip
+        // between them like a buffer queue
+        for (int i = 0; i < 2; i++)
+        {
+            GrallocDevice::AllocParam param;
+            param.width = desc.width;
+            param.height = desc.height;
+            param.format = desc.format;
+            param.usage = desc.usage;
+            if (GrallocDevice::getInstance().alloc(param) != NO_ERROR)
+            {
+                HWC_LOGE("%s: failed to alloc %ux%u fmt:0x%x", __func__,
+                         desc.width, desc.height, desc.format);
+                return NO_MEMORY;
+            }
+            m_buffers.push_back(param.handle);
+        }
+
+        hwc_region_t visible = { 1, &desc.frame };
+        const hwc_frect_t crop = { 0.0f, 0.0f, static_cast<float>(desc.width),
+                                   static_cast<float>(desc.height) };
+        mediator.layerStateSetCompositionType(nullptr, m_dpy, layer, HWC2_COMPOSITION_DEVICE);
+        mediator.layerStateSetBlendMode(nullptr, m_dpy, layer,
+                                        z == 0 ? HWC2_BLEND_MODE_NONE : HWC2_BLEND_MODE_PREMULTIPLIED);
+        mediator.layerStateSetDataSpace(nullptr, m_dpy, layer, desc.dataspace);
+        mediator.layerStateSetDisplayFrame(nullptr, m_dpy, layer, desc.frame);
+        mediator.layerStateSetSourceCrop(nullptr, m_dpy, layer, crop);
+        mediator.layerStateSetPlaneAlpha(nullptr, m_dpy, layer, 1.0f);
+        mediator.layerStateSetTransform(nullptr, m_dpy, layer, 0);
+        mediator.layerStateSetVisibleRegion(nullptr, m_dpy, layer, visible);
+        mediator.layerStateSetZOrder(nullptr, m_dpy, layer, z++);
+        mediator.layerSetBuffer(nullptr, m_dpy, layer, m_buffers[m_buffers.size() - 2], -1);
+    }
+    return NO_ERROR;
+}
+
+void HWCBench::releaseFences()
+{
+    HWCMediator& mediator = HWCMediator::getInstance();
+    uint32_t num = 0;
+    if (mediator.displayGetReleaseFence(nullptr, m_dpy, &num, nullptr, nullptr) != HWC2_ERROR_NONE)
+        return;
+
+    // the second call is always needed, see HWCReplayer::releaseFences()
+    std::vector<hwc2_layer_t> layers(num + 1);
+    std::vector<int32_t> fences(num + 1, -1);
+    mediator.displayGetReleaseFence(nullptr, m_dpy, &num, layers.data(), fences.data());
+    for (uint32_t i = 0; i < num; i++)
+    {
+        if (fences[i] >= 0)
+        {
+            ::protectedClose(fences[i]);
+        }
+    }
+}
+
+void HWCBench::teardown()
+{
+    HWCMediator& mediator = HWCMediator::getInstance();
+    for (hwc2_layer_t layer : m_layers)
+    {
+        mediator.displayDestroyLayer(nullptr, m_dpy, layer);
+    }
+    m_layers.clear();
+
+    if (m_is_virtual)
+    {
+        mediator.deviceDestroyVirtualDisplay(nullptr, m_dpy);
+        m_is_virtual = false;
+    }
+
+    for (buffer_handle_t buf : m_buffers)
+    {
+        GrallocDevice::getInstance().free(buf);
+    }
+    m_buffers.clear();
+
+    if (m_output_buffer != nullptr)
+    {
+        GrallocDevice::getInstance().free(m_output_buffer);
+        m_output_buffer = nullptr;
+    }
+}
+
+status_t HWCBench::run(const std::string& name, uint32_t frames, Result* result)
+{
+    if (result == nullptr)
+        return BAD_VALUE;
+
+    Scenario scenario;
+    if (!getScenario(name, &scenario))
+    {
+        HWC_LOGE("%s: unknown scenario %s", __func__, name.c_str());
+        return BAD_VALUE;
+    }
+
+    status_t err = setupLayers(scenario);
+    if (err != NO_ERROR)
+    {
+        teardown();
+        return err;
+    }
+
+    HWC_LOGI("%s: run %s with %zu layers on display %" PRIu64 " for %u frames",
+             __func__, name.c_str(), scenario.layers.size(), m_dpy, frames);
+
+    HWCMediator& mediator = HWCMediator::getInstance();
+    *result = Result();
+    result->scenario = name;
+
+    // a few frames to warm up the pools and caches before measuring
+    const uint32_t warm_up = std::min<uint32_t>(frames, 30);
+    const nsecs_t period = DisplayManager::getInstance().getDisplayData(HWC_DISPLAY_PRIMARY)->refresh;
+    nsecs_t start = systemTime();
+    for (uint32_t frame = 0; frame < frames + warm_up; frame++)
+    {
+        if (frame == warm_up)
+        {
+            HWCStageProfiler::getInstance().start();
+            start = systemTime();
+        }
+        const nsecs_t frame_start = systemTime();
+        const uint64_t alloc_count = getFrameAllocCount();
+
+        for (size_t i = 0; i < m_layers.size(); i++)
+        {
+            if (!scenario.layers[i].update_per_frame)
+                continue;
+            mediator.layerSetBuffer(nullptr, m_dpy, m_layers[i], m_buffers[i * 2 + (frame & 1)], -1);
+            hwc_region_t damage = { 1, &scenario.layers[i].frame };
+            mediator.layerSetSurfaceDamage(nullptr, m_dpy, m_layers[i], damage);
+        }
+        if (m_output_buffer != nullptr)
+        {
+            mediator.displaySetOutputBuffer(nullptr, m_dpy, m_output_buffer, -1);
+        }
+
+        uint32_t num_types = 0, num_requests = 0;
+        int32_t ret = mediator.displayValidateDisplay(nullptr, m_dpy, &num_types, &num_requests);
+        if (ret == HWC2_ERROR_HAS_CHANGES)
+        {
+            ret = mediator.displayAcceptChanges(nullptr, m_dpy);
+        }
+
+        int32_t retire_fence = -1;
+        if (ret == HWC2_ERROR_NONE)
+        {
+            ret = mediator.displayPresent(nullptr, m_dpy, &retire_fence);
+        }
+        if (retire_fence >= 0)
+        {
+            ::protectedClose(retire_fence);
+        }
+        releaseFences();
+
+        if (frame >= warm_up)
+        {
+            const uint64_t alloc = getFrameAllocCount() - alloc_count;
+            result->alloc_total += alloc;
+            result->alloc_max = std::max(result->alloc_max, alloc);
+            ++result->frame_count;
+            if (ret != HWC2_ERROR_NONE)
+            {
+                ++result->error_count;
+            }
+        }
+
+        // pace the frames with vsync period, so the dispatcher is not fed
+        // faster than the display would be
+        const nsecs_t elapsed = systemTime() - frame_start;
+        if (period > elapsed)
+        {
+            usleep(static_cast<useconds_t>(ns2us(period - elapsed)));
+        }
+    }
+    result->duration = systemTime() - start;
+
+    // wait for the last jobs, since the dispatcher and overlay stages are async
+    usleep(static_cast<useconds_t>(ns2us(period * 3)));
+    HWCStageProfiler& profiler = HWCStageProfiler::getInstance();
+    profiler.stop();
+    for (int i = 0; i < HWC_BENCH_STAGE_NUM; i++)
+    {
+        result->p50[i] = profiler.getPercentile(i, 50);
+        result->p99[i] = profiler.getPercentile(i, 99);
+        HWC_LOGI("%s: %s %s samples:%zu cpu p50:%" PRId64 "us p99:%" PRId64 "us", __func__,
+                 name.c_str(), HWCStageProfiler::getStageName(i), profiler.getSampleCount(i),
+                 ns2us(result->p50[i]), ns2us(result->p99[i]));
+    }
+    HWC_LOGI("%s: %s frames:%" PRIu64 " errors:%" PRIu64 " alloc total:%" PRIu64 " max:%" PRIu64,
+             __func__, name.c_str(), result->frame_count, result->error_count,
+             result->alloc_total, result->alloc_max);
+
+    teardown();
+    return NO_ERROR;
+}
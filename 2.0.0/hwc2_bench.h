@@ -0,0 +1,184 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <time.h>
+
+#include <hardware/hwcomposer2.h>
+#include <utils/Errors.h>
+#include <utils/Timers.h>
+
+namespace android {
+class String8;
+}
+
+// HWC_BENCH_MAX_SAMPLES is the number of samples kept for each stage
+#define HWC_BENCH_MAX_SAMPLES 4096
+
+enum HWC_BENCH_STAGE
+{
+    HWC_BENCH_STAGE_VALIDATE = 0,
+    HWC_BENCH_STAGE_SET_JOB,
+    HWC_BENCH_STAGE_DISPATCH,
+    HWC_BENCH_STAGE_OVL_LOOP,
+    HWC_BENCH_STAGE_NUM,
+};
+
+// HWCStageProfiler collects the CPU time of each stage of the frame pipeline.
+// It is only enabled while HWCBench is running, otherwise HWC_BENCH_STAGE()
+// costs one relaxed load.
+class HWCStageProfiler
+{
+public:
+    static HWCStageProfiler& getInstance();
+
+    bool isEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    // start() drops all samples and starts collecting
+    void start();
+    void stop();
+
+    void addSample(int stage, nsecs_t cpu_time);
+
+    // getPercentile() returns the percentile of CPU time of stage, pct is
+    // from 0 to 100
+    nsecs_t getPercentile(int stage, int pct);
+    size_t getSampleCount(int stage);
+
+    static const char* getStageName(int stage);
+
+    // getThreadCpuTime() returns the CPU time consumed by the calling thread
+    static nsecs_t getThreadCpuTime()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return static_cast<nsecs_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+    }
+
+private:
+    HWCStageProfiler();
+
+    std::atomic<bool> m_enabled;
+
+    std::mutex m_lock;
+    std::vector<nsecs_t> m_samples[HWC_BENCH_STAGE_NUM];
+    size_t m_sample_pos[HWC_BENCH_STAGE_NUM];
+};
+
+// HWCStageTimer adds the CPU time of its scope to HWCStageProfiler
+class HWCStageTimer
+{
+public:
+    explicit HWCStageTimer(int stage)
+        : m_stage(stage)
+        , m_start(HWCStageProfiler::getInstance().isEnabled() ?
+                  HWCStageProfiler::getThreadCpuTime() : -1)
+    { }
+
+    ~HWCStageTimer()
+    {
+        if (m_start >= 0)
+        {
+            HWCStageProfiler::getInstance().addSample(m_stage,
+                HWCStageProfiler::getThreadCpuTime() - m_start);
+        }
+    }
+
+private:
+    int m_stage;
+    nsecs_t m_start;
+};
+
+// HWCBench only runs with null device, so the stages are not timed otherwise
+#ifdef MTK_HWC_USE_NULL_DEVICE
+#define HWC_BENCH_STAGE(stage) HWCStageTimer hwc_bench_stage_timer(stage)
+#else
+#define HWC_BENCH_STAGE(stage)
+#endif
+
+// HWCBench drives HWCMediator with synthetic layer stacks and reports the
+// p50/p99 CPU time of each stage and the allocations per frame. It is
+// started by setting vendor.debug.hwc.bench to a scenario name, and
+// vendor.debug.hwc.bench_frames selects the number of frames.
+// Scenarios:
+//   ui        four RGBA layers of status bar, app, navigation bar and wallpaper
+//   video     1080p YUV video with two UI layers
+//   camera    camera preview with a UI layer on top
+//   mirror4k  a 3840x2160 virtual display showing a 4K video
+//   virtual   a 1080p virtual display with UI layers
+class HWCBench
+{
+public:
+    struct LayerDesc
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t format;
+        uint64_t usage;
+        int32_t dataspace;
+        hwc_rect_t frame;
+        bool update_per_frame;
+    };
+
+    struct Scenario
+    {
+        // 0 means the primary display, otherwise the size of virtual display
+        uint32_t virtual_width;
+        uint32_t virtual_height;
+        std::vector<LayerDesc> layers;
+    };
+
+    struct Result
+    {
+        Result()
+            : frame_count(0)
+            , error_count(0)
+            , alloc_total(0)
+            , alloc_max(0)
+            , duration(0)
+        { }
+
+        std::string scenario;
+        uint64_t frame_count;
+        uint64_t error_count;
+        uint64_t alloc_total;
+        uint64_t alloc_max;
+        nsecs_t duration;
+        nsecs_t p50[HWC_BENCH_STAGE_NUM] = {};
+        nsecs_t p99[HWC_BENCH_STAGE_NUM] = {};
+    };
+
+    HWCBench();
+    ~HWCBench();
+
+    // updateConfig() starts a bench thread when vendor.debug.hwc.bench is
+    // changed to a scenario name
+    static void updateConfig();
+
+    // dump() shows the result of the last run
+    static void dump(android::String8* dump_str);
+
+    // run() runs the scenario for frames and fills result
+    android::status_t run(const std::string& name, uint32_t frames, Result* result);
+
+private:
+    // getScenario() builds the layer stack of scenario, it returns false if
+    // the name is unknown
+    static bool getScenario(const std::string& name, Scenario* scenario);
+
+    android::status_t setupLayers(const Scenario& scenario);
+    void releaseFences();
+    void teardown();
+
+    hwc2_display_t m_dpy;
+    bool m_is_virtual;
+    std::vector<hwc2_layer_t> m_layers;
+    std::vector<buffer_handle_t> m_buffers;
+    buffer_handle_t m_output_buffer;
+
+    static std::mutex s_result_lock;
+    static Result s_last_result;
+};
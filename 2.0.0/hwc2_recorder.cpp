@@ -0,0 +1,998 @@
+#define DEBUG_LOG_TAG "REC"
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "hwc2_recorder.h"
+
+#include <algorithm>
+#include <thread>
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
+#include <utils/String8.h>
+
+#include "ui/gralloc_extra.h"
+
+#include "utils/debug.h"
+#include "utils/tools.h"
+
+#include "grallocdev.h"
+#include "hwc2.h"
+
+using namespace android;
+
+HWCRecorder& HWCRecorder::getInstance()
+{
+    static HWCRecorder gInstance;
+    return gInstance;
+}
+
+HWCRecorder::HWCRecorder()
+    : m_enabled(false)
+    , m_fd(-1)
+    , m_record_count(0)
+    , m_frame_count(0)
+    , m_write_bytes(0)
+{
+    m_buffer.reserve(HWC_REC_FLUSH_SIZE * 2);
+}
+
+HWCRecorder::~HWCRecorder()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    stopLocked();
+}
+
+void HWCRecorder::updateConfig()
+{
+    char value[PROPERTY_VALUE_MAX] = {0};
+    property_get("vendor.debug.hwc.record", value, "");
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_path == value)
+        return;
+
+    stopLocked();
+    if (strlen(value) > 0)
+    {
+        startLocked(value);
+    }
+}
+
+bool HWCRecorder::startLocked(const std::string& path)
+{
+    m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0660);
+    if (m_fd < 0)
+    {
+        HWC_LOGE("%s: failed to open %s: %s", __func__, path.c_str(), strerror(errno));
+        m_fd = -1;
+        return false;
+    }
+
+    m_path = path;
+    m_buffer.clear();
+    m_record_count = 0;
+    m_frame_count = 0;
+    m_write_bytes = 0;
+
+    HwcRecFileHeader header;
+    header.magic = HWC_REC_MAGIC;
+    header.version = HWC_REC_VERSION;
+    header.start_ts = systemTime();
+    const uint8_t* ptr = reinterpret_cast<const uint8_t*>(&header);
+    m_buffer.insert(m_buffer.end(), ptr, ptr + sizeof(header));
+    flushLocked();
+
+    m_enabled.store(true, std::memory_order_relaxed);
+    HWC_LOGI("%s: record HWC2 calls to %s", __func__, path.c_str());
+    return true;
+}
+
+void HWCRecorder::stopLocked()
+{
+    m_enabled.store(false, std::memory_order_relaxed);
+    if (m_fd < 0)
+    {
+        m_path.clear();
+        return;
+    }
+
+    flushLocked();
+    close(m_fd);
+    m_fd = -1;
+    HWC_LOGI("%s: stop recording %s, records:%" PRIu64 " frames:%" PRIu64 " bytes:%" PRIu64,
+             __func__, m_path.c_str(), m_record_count, m_frame_count, m_write_bytes);
+    m_path.clear();
+}
+
+void HWCRecorder::flushLocked()
+{
+    size_t offset = 0;
+    while (m_fd >= 0 && offset < m_buffer.size())
+    {
+        ssize_t ret = write(m_fd, m_buffer.data() + offset, m_buffer.size() - offset);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            HWC_LOGE("%s: failed to write %s: %s", __func__, m_path.c_str(), strerror(errno));
+            m_enabled.store(false, std::memory_order_relaxed);
+            close(m_fd);
+            m_fd = -1;
+            break;
+        }
+        offset += static_cast<size_t>(ret);
+    }
+    m_write_bytes += offset;
+    m_buffer.clear();
+}
+
+void HWCRecorder::appendLocked(uint16_t type, uint64_t dpy, uint64_t layer,
+                               const void* payload0, size_t size0,
+                               const void* payload1, size_t size1)
+{
+    if (m_fd < 0)
+        return;
+
+    if (size0 + size1 > HWC_REC_MAX_PAYLOAD_SIZE)
+    {
+        HWC_LOGW("%s: drop record type:%u size:%zu", __func__, type, size0 + size1);
+        return;
+    }
+
+    HwcRecHeader header;
+    header.type = type;
+    header.reserved = 0;
+    header.size = static_cast<uint32_t>(size0 + size1);
+    header.ts = systemTime();
+    header.display = dpy;
+    header.layer = layer;
+
+    const uint8_t* ptr = reinterpret_cast<const uint8_t*>(&header);
+    m_buffer.insert(m_buffer.end(), ptr, ptr + sizeof(header));
+    if (size0 > 0)
+    {
+        ptr = static_cast<const uint8_t*>(payload0);
+        m_buffer.insert(m_buffer.end(), ptr, ptr + size0);
+    }
+    if (size1 > 0)
+    {
+        ptr = static_cast<const uint8_t*>(payload1);
+        m_buffer.insert(m_buffer.end(), ptr, ptr + size1);
+    }
+    ++m_record_count;
+
+    // keep the file consistent at frame boundary, so a recording interrupted
+    // by a crash can still be replayed until the last present
+    if (type == HWC_REC_PRESENT)
+    {
+        ++m_frame_count;
+        flushLocked();
+    }
+    else if (m_buffer.size() > HWC_REC_FLUSH_SIZE)
+    {
+        flushLocked();
+    }
+}
+
+void HWCRecorder::recordCall(uint16_t type, uint64_t dpy, uint64_t layer)
+{
+    if (!isEnabled())
+        return;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    appendLocked(type, dpy, layer, nullptr, 0);
+}
+
+void HWCRecorder::recordInt(uint16_t type, uint64_t dpy, uint64_t layer, int32_t val)
+{
+    if (!isEnabled())
+        return;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    appendLocked(type, dpy, layer, &val, sizeof(val));
+}
+
+void HWCRecorder::recordInt2(uint16_t type, uint64_t dpy, uint64_t layer, int32_t val0, int32_t val1)
+{
+    if (!isEnabled())
+        return;
+
+    const int32_t val[2] = { val0, val1 };
+    std::lock_guard<std::mutex> lock(m_lock);
+    appendLocked(type, dpy, layer, val, sizeof(val));
+}
+
+void HWCRecorder::recordFloat(uint16_t type, uint64_t dpy, uint64_t layer, float val)
+{
+    if (!isEnabled())
+        return;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    appendLocked(type, dpy, layer, &val, sizeof(val));
+}
+
+void HWCRecorder::recordRect(uint16_t type, uint64_t dpy, uint64_t layer, const hwc_rect_t& rect)
+{
+    if (!isEnabled())
+        return;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    appendLocked(type, dpy, layer, &rect, sizeof(rect));
+}
+
+void HWCRecorder::recordFRect(uint16_t type, uint64_t dpy, uint64_t layer, const hwc_frect_t& rect)
+{
+    if (!isEnabled())
+        return;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    appendLocked(type, dpy, layer, &rect, sizeof(rect));
+}
+
+void HWCRecorder::recordRegion(uint16_t type, uint64_t dpy, uint64_t layer, const hwc_region_t& region)
+{
+    if (!isEnabled())
+        return;
+
+    uint32_t num = static_cast<uint32_t>(region.numRects);
+    if (region.rects == nullptr)
+    {
+        num = 0;
+    }
+    else if (num > HWC_REC_MAX_REGION_RECTS)
+    {
+        num = HWC_REC_MAX_REGION_RECTS;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    appendLocked(type, dpy, layer, &num, sizeof(num), region.rects, num * sizeof(hwc_rect_t));
+}
+
+void HWCRecorder::recordColor(uint64_t dpy, uint64_t layer, const hwc_color_t& color)
+{
+    if (!isEnabled())
+        return;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    appendLocked(HWC_REC_LAYER_COLOR, dpy, layer, &color, sizeof(color));
+}
+
+static void fillRecBuffer(buffer_handle_t handle, int32_t fence, HwcRecBuffer* buf)
+{
+    memset(buf, 0, sizeof(*buf));
+    buf->alloc_id = UINT64_MAX;
+    buf->has_fence = fence >= 0;
+    if (handle == nullptr)
+        return;
+
+    int usage = 0;
+    int err = gralloc_extra_query(handle, GRALLOC_EXTRA_GET_ID, &buf->alloc_id);
+    err |= gralloc_extra_query(handle, GRALLOC_EXTRA_GET_WIDTH, &buf->width);
+    err |= gralloc_extra_query(handle, GRALLOC_EXTRA_GET_HEIGHT, &buf->height);
+    err |= gralloc_extra_query(handle, GRALLOC_EXTRA_GET_FORMAT, &buf->format);
+    err |= gralloc_extra_query(handle, GRALLOC_EXTRA_GET_STRIDE, &buf->stride);
+    err |= gralloc_extra_query(handle, GRALLOC_EXTRA_GET_USAGE, &usage);
+    buf->usage = static_cast<uint32_t>(usage);
+    if (err)
+    {
+        HWC_LOGW("%s: failed to query buffer info (handle=%p)", __func__, handle);
+    }
+}
+
+void HWCRecorder::recordBuffer(uint16_t type, uint64_t dpy, uint64_t layer,
+                               buffer_handle_t handle, int32_t fence)
+{
+    if (!isEnabled())
+        return;
+
+    // query gralloc before taking the lock
+    HwcRecBuffer buf;
+    fillRecBuffer(handle, fence, &buf);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    appendLocked(type, dpy, layer, &buf, sizeof(buf));
+}
+
+void HWCRecorder::recordClientTarget(uint64_t dpy, buffer_handle_t handle, int32_t fence,
+                                     int32_t dataspace, const hwc_region_t& damage)
+{
+    if (!isEnabled())
+        return;
+
+    // payload: HwcRecBuffer, dataspace, number of rects, rects
+    std::vector<uint8_t> payload(sizeof(HwcRecBuffer) + sizeof(int32_t) + sizeof(uint32_t));
+    HwcRecBuffer buf;
+    fillRecBuffer(handle, fence, &buf);
+    uint32_t num = damage.rects == nullptr ? 0 : static_cast<uint32_t>(damage.numRects);
+    if (num > HWC_REC_MAX_REGION_RECTS)
+    {
+        num = HWC_REC_MAX_REGION_RECTS;
+    }
+    memcpy(payload.data(), &buf, sizeof(buf));
+    memcpy(payload.data() + sizeof(buf), &dataspace, sizeof(dataspace));
+    memcpy(payload.data() + sizeof(buf) + sizeof(dataspace), &num, sizeof(num));
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    appendLocked(HWC_REC_SET_CLIENT_TARGET, dpy, 0, payload.data(), payload.size(),
+                 damage.rects, num * sizeof(hwc_rect_t));
+}
+
+void HWCRecorder::recordColorTransform(uint64_t dpy, const float* matrix, int32_t hint)
+{
+    if (!isEnabled())
+        return;
+
+    // payload: hint, 4x4 matrix, a null matrix is recorded as identity
+    float mat[16] = { 1.0f, 0.0f, 0.0f, 0.0f,
+                      0.0f, 1.0f, 0.0f, 0.0f,
+                      0.0f, 0.0f, 1.0f, 0.0f,
+                      0.0f, 0.0f, 0.0f, 1.0f };
+    if (matrix != nullptr)
+    {
+        memcpy(mat, matrix, sizeof(mat));
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    appendLocked(HWC_REC_SET_COLOR_TRANSFORM, dpy, 0, &hint, sizeof(hint), mat, sizeof(mat));
+}
+
+void HWCRecorder::recordVirtualDisplay(uint64_t dpy, uint32_t width, uint32_t height, int32_t format)
+{
+    if (!isEnabled())
+        return;
+
+    const int32_t val[3] = { static_cast<int32_t>(width), static_cast<int32_t>(height), format };
+    std::lock_guard<std::mutex> lock(m_lock);
+    appendLocked(HWC_REC_CREATE_VIRTUAL_DISPLAY, dpy, 0, val, sizeof(val));
+}
+
+void HWCRecorder::recordContentSampling(uint64_t dpy, int32_t enabled, uint8_t component_mask,
+                                        uint64_t max_frames)
+{
+    if (!isEnabled())
+        return;
+
+    // payload: enabled, component mask, max frames
+    const int32_t val[2] = { enabled, component_mask };
+    std::lock_guard<std::mutex> lock(m_lock);
+    appendLocked(HWC_REC_SET_CONTENT_SAMPLING_ENABLED, dpy, 0, val, sizeof(val),
+                 &max_frames, sizeof(max_frames));
+}
+
+void HWCRecorder::recordPerFrameMetadata(uint64_t dpy, uint64_t layer, uint32_t num,
+                                         const int32_t* keys, const float* metadata)
+{
+    if (!isEnabled())
+        return;
+
+    if (keys == nullptr || metadata == nullptr)
+    {
+        num = 0;
+    }
+
+    // payload: number of elements, keys, values
+    std::vector<uint8_t> payload(sizeof(num) + num * (sizeof(int32_t) + sizeof(float)));
+    memcpy(payload.data(), &num, sizeof(num));
+    if (num > 0)
+    {
+        memcpy(payload.data() + sizeof(num), keys, num * sizeof(int32_t));
+        memcpy(payload.data() + sizeof(num) + num * sizeof(int32_t), metadata, num * sizeof(float));
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    appendLocked(HWC_REC_LAYER_PER_FRAME_METADATA, dpy, layer, payload.data(), payload.size());
+}
+
+void HWCRecorder::recordPerFrameMetadataBlobs(uint64_t dpy, uint64_t layer, uint32_t num,
+                                              const int32_t* keys, const uint32_t* sizes,
+                                              const uint8_t* metadata)
+{
+    if (!isEnabled())
+        return;
+
+    if (keys == nullptr || sizes == nullptr || metadata == nullptr)
+    {
+        num = 0;
+    }
+
+    size_t blob_size = 0;
+    for (uint32_t i = 0; i < num; i++)
+    {
+        blob_size += sizes[i];
+    }
+
+    // payload: number of elements, keys, sizes, concatenated blobs
+    const size_t head_size = sizeof(num) + num * (sizeof(int32_t) + sizeof(uint32_t));
+    std::vector<uint8_t> payload(head_size);
+    memcpy(payload.data(), &num, sizeof(num));
+    if (num > 0)
+    {
+        memcpy(payload.data() + sizeof(num), keys, num * sizeof(int32_t));
+        memcpy(payload.data() + sizeof(num) + num * sizeof(int32_t), sizes, num * sizeof(uint32_t));
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    appendLocked(HWC_REC_LAYER_PER_FRAME_METADATA_BLOBS, dpy, layer,
+                 payload.data(), payload.size(), metadata, blob_size);
+}
+
+void HWCRecorder::dump(String8* dump_str)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    dump_str->appendFormat("[HWC Recorder] (vendor.debug.hwc.record)\n");
+    if (m_fd < 0)
+    {
+        dump_str->appendFormat("  disabled\n");
+        return;
+    }
+    dump_str->appendFormat("  path:%s records:%" PRIu64 " frames:%" PRIu64 " bytes:%" PRIu64 "\n",
+                           m_path.c_str(), m_record_count, m_frame_count,
+                           m_write_bytes + m_buffer.size());
+}
+
+HWCReplayer::HWCReplayer()
+{
+}
+
+void HWCReplayer::updateConfig()
+{
+    static std::mutex s_lock;
+    static std::string s_path;
+    char value[PROPERTY_VALUE_MAX] = {0};
+
+    property_get("vendor.debug.hwc.replay", value, "");
+    std::lock_guard<std::mutex> lock(s_lock);
+    if (s_path == value)
+        return;
+
+    s_path = value;
+    if (s_path.empty())
+        return;
+
+    property_get("vendor.debug.hwc.replay_real_time", value, "0");
+    const bool real_time = atoi(value) != 0;
+    std::thread([path = s_path, real_time]()
+    {
+        pthread_setname_np(pthread_self(), "HWCReplay");
+        HWCReplayer replayer;
+        Stats stats;
+        replayer.replay(path.c_str(), real_time, &stats);
+    }).detach();
+}
+
+HWCReplayer::~HWCReplayer()
+{
+    freeBuffers();
+}
+
+void HWCReplayer::freeBuffers()
+{
+    for (auto& buf : m_buffers)
+    {
+        GrallocDevice::getInstance().free(buf.second);
+    }
+    m_buffers.clear();
+}
+
+// getThreadCpuTime() returns the CPU time consumed by the replay thread, so
+// the time blocked on locks or fences is not counted as the cost of a call
+static nsecs_t getThreadCpuTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<nsecs_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+hwc2_layer_t HWCReplayer::mapLayer(uint64_t dpy, uint64_t layer)
+{
+    auto& layers = m_layer_map[dpy];
+    auto iter = layers.find(layer);
+    if (iter != layers.end())
+        return iter->second;
+
+    // layers not created in the recording are client targets, they are
+    // created with the display, e.g. layerSetCursorPosition() for the
+    // present timestamp of client target
+    sp<HWCDisplay> display = HWCMediator::getInstance().getHWCDisplay(dpy);
+    if (display != nullptr && display->getClientTarget() != nullptr)
+        return display->getClientTarget()->getId();
+
+    return layer;
+}
+
+buffer_handle_t HWCReplayer::getBuffer(const HwcRecBuffer& buf)
+{
+    if (buf.alloc_id == UINT64_MAX)
+        return nullptr;
+
+    auto iter = m_buffers.find(buf.alloc_id);
+    if (iter != m_buffers.end())
+        return iter->second;
+
+    // protected content can not be allocated without the secure world, and
+    // the composition path does not care about it
+    GrallocDevice::AllocParam param;
+    param.width = buf.width;
+    param.height = buf.height;
+    param.format = buf.format;
+    param.usage = buf.usage & ~static_cast<uint64_t>(GRALLOC_USAGE_PROTECTED);
+    if (GrallocDevice::getInstance().alloc(param) != NO_ERROR)
+    {
+        HWC_LOGW("%s: failed to alloc stand-in buffer for %" PRIu64 " (%ux%u fmt:0x%x)",
+                 __func__, buf.alloc_id, buf.width, buf.height, buf.format);
+        return nullptr;
+    }
+    m_buffers[buf.alloc_id] = param.handle;
+    return param.handle;
+}
+
+hwc_region_t HWCReplayer::getRegion(const std::vector<uint8_t>& payload, size_t offset)
+{
+    hwc_region_t region = { 0, nullptr };
+    uint32_t num = 0;
+    if (payload.size() < offset + sizeof(num))
+        return region;
+
+    memcpy(&num, payload.data() + offset, sizeof(num));
+    if (num > HWC_REC_MAX_REGION_RECTS ||
+        payload.size() < offset + sizeof(num) + num * sizeof(hwc_rect_t))
+        return region;
+
+    m_rects.resize(num);
+    if (num > 0)
+    {
+        memcpy(m_rects.data(), payload.data() + offset + sizeof(num), num * sizeof(hwc_rect_t));
+    }
+    region.numRects = num;
+    region.rects = m_rects.data();
+    return region;
+}
+
+void HWCReplayer::releaseFences(uint64_t dpy)
+{
+    HWCMediator& mediator = HWCMediator::getInstance();
+    uint32_t num = 0;
+    if (mediator.displayGetReleaseFence(nullptr, dpy, &num, nullptr, nullptr) != HWC2_ERROR_NONE)
+        return;
+
+    // the second call is always needed like SurfaceFlinger does, since it
+    // also moves the release fences of this frame to the previous ones
+    std::vector<hwc2_layer_t> layers(num + 1);
+    std::vector<int32_t> fences(num + 1, -1);
+    mediator.displayGetReleaseFence(nullptr, dpy, &num, layers.data(), fences.data());
+    for (uint32_t i = 0; i < num; i++)
+    {
+        if (fences[i] >= 0)
+        {
+            ::protectedClose(fences[i]);
+        }
+    }
+}
+
+void HWCReplayer::playRecord(const HwcRecHeader& header, const std::vector<uint8_t>& payload,
+                             Stats* stats)
+{
+    HWCMediator& mediator = HWCMediator::getInstance();
+    const uint64_t dpy = header.display;
+    const uint8_t* data = payload.data();
+    int32_t val[3] = { 0, 0, 0 };
+    int32_t err = HWC2_ERROR_NONE;
+
+    // payloads are validated by size before use, a short payload means the
+    // file is truncated or written by another version
+    auto has = [&](size_t size) { return payload.size() >= size; };
+
+    switch (header.type)
+    {
+        case HWC_REC_CREATE_VIRTUAL_DISPLAY:
+        {
+            if (!has(sizeof(int32_t) * 3))
+                break;
+            memcpy(val, data, sizeof(int32_t) * 3);
+            hwc2_display_t out_dpy = 0;
+            err = mediator.deviceCreateVirtualDisplay(nullptr, static_cast<uint32_t>(val[0]),
+                                                      static_cast<uint32_t>(val[1]), &val[2], &out_dpy);
+            break;
+        }
+
+        case HWC_REC_DESTROY_VIRTUAL_DISPLAY:
+            err = mediator.deviceDestroyVirtualDisplay(nullptr, dpy);
+            m_layer_map.erase(dpy);
+            break;
+
+        case HWC_REC_CREATE_LAYER:
+        {
+            hwc2_layer_t layer = 0;
+            err = mediator.displayCreateLayer(nullptr, dpy, &layer);
+            if (err == HWC2_ERROR_NONE)
+            {
+                m_layer_map[dpy][header.layer] = layer;
+            }
+            break;
+        }
+
+        case HWC_REC_DESTROY_LAYER:
+            err = mediator.displayDestroyLayer(nullptr, dpy, mapLayer(dpy, header.layer));
+            m_layer_map[dpy].erase(header.layer);
+            break;
+
+        case HWC_REC_ACCEPT_CHANGES:
+            err = mediator.displayAcceptChanges(nullptr, dpy);
+            break;
+
+        case HWC_REC_VALIDATE:
+        {
+            uint32_t num_types = 0, num_requests = 0;
+            const nsecs_t start = getThreadCpuTime();
+            err = mediator.displayValidateDisplay(nullptr, dpy, &num_types, &num_requests);
+            const nsecs_t duration = getThreadCpuTime() - start;
+            stats->validate_total += duration;
+            stats->validate_max = std::max(stats->validate_max, duration);
+
+            // composition changes are applied by the recorded acceptChanges()
+            if (err == HWC2_ERROR_HAS_CHANGES)
+            {
+                err = HWC2_ERROR_NONE;
+            }
+            break;
+        }
+
+        case HWC_REC_PRESENT:
+        {
+            int32_t retire_fence = -1;
+            const nsecs_t start = getThreadCpuTime();
+            err = mediator.displayPresent(nullptr, dpy, &retire_fence);
+            const nsecs_t duration = getThreadCpuTime() - start;
+            stats->present_total += duration;
+            stats->present_max = std::max(stats->present_max, duration);
+            ++stats->frame_count;
+
+            if (retire_fence >= 0)
+            {
+                ::protectedClose(retire_fence);
+            }
+            // SurfaceFlinger validates again after a failed present, and the
+            // calls are recorded as well
+            if (err == HWC2_ERROR_NOT_VALIDATED)
+            {
+                err = HWC2_ERROR_NONE;
+            }
+            else
+            {
+                releaseFences(dpy);
+            }
+            break;
+        }
+
+        case HWC_REC_SET_ACTIVE_CONFIG:
+            if (!has(sizeof(int32_t)))
+                break;
+            memcpy(val, data, sizeof(int32_t));
+            err = mediator.displaySetActiveConfig(nullptr, dpy, static_cast<hwc2_config_t>(val[0]));
+            break;
+
+        case HWC_REC_SET_CLIENT_TARGET:
+        {
+            if (!has(sizeof(HwcRecBuffer) + sizeof(int32_t)))
+                break;
+            HwcRecBuffer buf;
+            memcpy(&buf, data, sizeof(buf));
+            memcpy(val, data + sizeof(buf), sizeof(int32_t));
+            hwc_region_t damage = getRegion(payload, sizeof(buf) + sizeof(int32_t));
+            err = mediator.displaySetClientTarget(nullptr, dpy, getBuffer(buf), -1, val[0], damage);
+            break;
+        }
+
+        case HWC_REC_SET_COLOR_MODE:
+            if (!has(sizeof(int32_t)))
+                break;
+            memcpy(val, data, sizeof(int32_t));
+            err = mediator.displaySetColorMode(nullptr, dpy, val[0]);
+            break;
+
+        case HWC_REC_SET_COLOR_MODE_WITH_INTENT:
+            if (!has(sizeof(int32_t) * 2))
+                break;
+            memcpy(val, data, sizeof(int32_t) * 2);
+            err = mediator.displaySetColorModeWithRenderIntent(nullptr, dpy, val[0], val[1]);
+            break;
+
+        case HWC_REC_SET_COLOR_TRANSFORM:
+        {
+            float mat[16];
+            if (!has(sizeof(int32_t) + sizeof(mat)))
+                break;
+            memcpy(val, data, sizeof(int32_t));
+            memcpy(mat, data + sizeof(int32_t), sizeof(mat));
+            err = mediator.displaySetColorTransform(nullptr, dpy, mat, val[0]);
+            break;
+        }
+
+        case HWC_REC_SET_OUTPUT_BUFFER:
+        {
+            if (!has(sizeof(HwcRecBuffer)))
+                break;
+            HwcRecBuffer buf;
+            memcpy(&buf, data, sizeof(buf));
+            err = mediator.displaySetOutputBuffer(nullptr, dpy, getBuffer(buf), -1);
+            break;
+        }
+
+        case HWC_REC_SET_POWER_MODE:
+            if (!has(sizeof(int32_t)))
+                break;
+            memcpy(val, data, sizeof(int32_t));
+            err = mediator.displaySetPowerMode(nullptr, dpy, val[0]);
+            break;
+
+        case HWC_REC_SET_VSYNC_ENABLED:
+            if (!has(sizeof(int32_t)))
+                break;
+            memcpy(val, data, sizeof(int32_t));
+            err = mediator.displaySetVsyncEnabled(nullptr, dpy, val[0]);
+            break;
+
+        case HWC_REC_LAYER_CURSOR_POSITION:
+            if (!has(sizeof(int32_t) * 2))
+                break;
+            memcpy(val, data, sizeof(int32_t) * 2);
+            err = mediator.layerSetCursorPosition(nullptr, dpy, mapLayer(dpy, header.layer), val[0], val[1]);
+            break;
+
+        case HWC_REC_LAYER_BUFFER:
+        {
+            if (!has(sizeof(HwcRecBuffer)))
+                break;
+            HwcRecBuffer buf;
+            memcpy(&buf, data, sizeof(buf));
+            err = mediator.layerSetBuffer(nullptr, dpy, mapLayer(dpy, header.layer), getBuffer(buf), -1);
+            break;
+        }
+
+        case HWC_REC_LAYER_SURFACE_DAMAGE:
+            err = mediator.layerSetSurfaceDamage(nullptr, dpy, mapLayer(dpy, header.layer),
+                                                 getRegion(payload, 0));
+            break;
+
+        case HWC_REC_LAYER_BLEND_MODE:
+            if (!has(sizeof(int32_t)))
+                break;
+            memcpy(val, data, sizeof(int32_t));
+            err = mediator.layerStateSetBlendMode(nullptr, dpy, mapLayer(dpy, header.layer), val[0]);
+            break;
+
+        case HWC_REC_LAYER_COLOR:
+        {
+            hwc_color_t color;
+            if (!has(sizeof(color)))
+                break;
+            memcpy(&color, data, sizeof(color));
+            err = mediator.layerStateSetColor(nullptr, dpy, mapLayer(dpy, header.layer), color);
+            break;
+        }
+
+        case HWC_REC_LAYER_COMPOSITION_TYPE:
+            if (!has(sizeof(int32_t)))
+                break;
+            memcpy(val, data, sizeof(int32_t));
+            err = mediator.layerStateSetCompositionType(nullptr, dpy, mapLayer(dpy, header.layer), val[0]);
+            break;
+
+        case HWC_REC_LAYER_DATASPACE:
+            if (!has(sizeof(int32_t)))
+                break;
+            memcpy(val, data, sizeof(int32_t));
+            err = mediator.layerStateSetDataSpace(nullptr, dpy, mapLayer(dpy, header.layer), val[0]);
+            break;
+
+        case HWC_REC_LAYER_DISPLAY_FRAME:
+        {
+            hwc_rect_t rect;
+            if (!has(sizeof(rect)))
+                break;
+            memcpy(&rect, data, sizeof(rect));
+            err = mediator.layerStateSetDisplayFrame(nullptr, dpy, mapLayer(dpy, header.layer), rect);
+            break;
+        }
+
+        case HWC_REC_LAYER_PLANE_ALPHA:
+        {
+            float alpha = 1.0f;
+            if (!has(sizeof(alpha)))
+                break;
+            memcpy(&alpha, data, sizeof(alpha));
+            err = mediator.layerStateSetPlaneAlpha(nullptr, dpy, mapLayer(dpy, header.layer), alpha);
+            break;
+        }
+
+        case HWC_REC_LAYER_SOURCE_CROP:
+        {
+            hwc_frect_t crop;
+            if (!has(sizeof(crop)))
+                break;
+            memcpy(&crop, data, sizeof(crop));
+            err = mediator.layerStateSetSourceCrop(nullptr, dpy, mapLayer(dpy, header.layer), crop);
+            break;
+        }
+
+        case HWC_REC_LAYER_TRANSFORM:
+            if (!has(sizeof(int32_t)))
+                break;
+            memcpy(val, data, sizeof(int32_t));
+            err = mediator.layerStateSetTransform(nullptr, dpy, mapLayer(dpy, header.layer), val[0]);
+            break;
+
+        case HWC_REC_LAYER_VISIBLE_REGION:
+            err = mediator.layerStateSetVisibleRegion(nullptr, dpy, mapLayer(dpy, header.layer),
+                                                      getRegion(payload, 0));
+            break;
+
+        case HWC_REC_LAYER_Z_ORDER:
+            if (!has(sizeof(int32_t)))
+                break;
+            memcpy(val, data, sizeof(int32_t));
+            err = mediator.layerStateSetZOrder(nullptr, dpy, mapLayer(dpy, header.layer),
+                                               static_cast<uint32_t>(val[0]));
+            break;
+
+        case HWC_REC_LAYER_PER_FRAME_METADATA:
+        {
+            uint32_t num = 0;
+            if (!has(sizeof(num)))
+                break;
+            memcpy(&num, data, sizeof(num));
+            if (!has(sizeof(num) + num * (sizeof(int32_t) + sizeof(float))))
+                break;
+            std::vector<int32_t> keys(num);
+            std::vector<float> values(num);
+            memcpy(keys.data(), data + sizeof(num), num * sizeof(int32_t));
+            memcpy(values.data(), data + sizeof(num) + num * sizeof(int32_t), num * sizeof(float));
+            err = mediator.layerStateSetPerFrameMetadata(nullptr, dpy, mapLayer(dpy, header.layer),
+                                                         num, keys.data(), values.data());
+            break;
+        }
+
+        case HWC_REC_LAYER_PER_FRAME_METADATA_BLOBS:
+        {
+            uint32_t num = 0;
+            if (!has(sizeof(num)))
+                break;
+            memcpy(&num, data, sizeof(num));
+            const size_t head_size = sizeof(num) + num * (sizeof(int32_t) + sizeof(uint32_t));
+            if (!has(head_size))
+                break;
+            std::vector<int32_t> keys(num);
+            std::vector<uint32_t> sizes(num);
+            memcpy(keys.data(), data + sizeof(num), num * sizeof(int32_t));
+            memcpy(sizes.data(), data + sizeof(num) + num * sizeof(int32_t), num * sizeof(uint32_t));
+            err = mediator.layerStateSetPerFrameMetadataBlobs(nullptr, dpy, mapLayer(dpy, header.layer),
+                                                              num, keys.data(), sizes.data(),
+                                                              data + head_size);
+            break;
+        }
+
+        case HWC_REC_SET_BRIGHTNESS:
+        {
+            float brightness = 0.0f;
+            if (!has(sizeof(brightness)))
+                break;
+            memcpy(&brightness, data, sizeof(brightness));
+            err = mediator.displaySetBrightness(nullptr, dpy, brightness);
+            // the brightness is not supported by all devices, and it does not
+            // change the composition path
+            if (err == HWC2_ERROR_UNSUPPORTED)
+            {
+                err = HWC2_ERROR_NONE;
+            }
+            break;
+        }
+
+        case HWC_REC_SET_CONTENT_SAMPLING_ENABLED:
+        {
+            uint64_t max_frames = 0;
+            if (!has(sizeof(int32_t) * 2 + sizeof(max_frames)))
+                break;
+            memcpy(val, data, sizeof(int32_t) * 2);
+            memcpy(&max_frames, data + sizeof(int32_t) * 2, sizeof(max_frames));
+            err = mediator.displaySetDisplayedContentSamplingEnabled(nullptr, dpy, val[0],
+                                                                     static_cast<uint8_t>(val[1]),
+                                                                     max_frames);
+            break;
+        }
+
+        case HWC_REC_LAYER_SIDEBAND_STREAM:
+            // the stream handle belongs to SurfaceFlinger and cannot be
+            // rebuilt, so only the call itself is replayed
+            err = mediator.layerStateSetSidebandStream(nullptr, dpy, mapLayer(dpy, header.layer), nullptr);
+            break;
+
+        default:
+            HWC_LOGW("%s: unknown record type %u", __func__, header.type);
+            break;
+    }
+
+    ++stats->record_count;
+    if (err != HWC2_ERROR_NONE)
+    {
+        ++stats->error_count;
+        HWC_LOGD("%s: (%" PRIu64 ") type:%u layer:%" PRIu64 " err:%d",
+                 __func__, dpy, header.type, header.layer, err);
+    }
+}
+
+status_t HWCReplayer::replay(const char* path, bool real_time, Stats* stats)
+{
+    if (path == nullptr || stats == nullptr)
+        return BAD_VALUE;
+
+    FILE* file = fopen(path, "rbe");
+    if (file == nullptr)
+    {
+        HWC_LOGE("%s: failed to open %s: %s", __func__, path, strerror(errno));
+        return NAME_NOT_FOUND;
+    }
+
+    HwcRecFileHeader file_header;
+    if (fread(&file_header, sizeof(file_header), 1, file) != 1 ||
+        file_header.magic != HWC_REC_MAGIC || file_header.version != HWC_REC_VERSION)
+    {
+        HWC_LOGE("%s: %s is not a recording of version %d", __func__, path, HWC_REC_VERSION);
+        fclose(file);
+        return BAD_TYPE;
+    }
+
+    HWC_LOGI("%s: replay %s real_time:%d", __func__, path, real_time);
+
+    *stats = Stats();
+    m_layer_map.clear();
+    const nsecs_t replay_start = systemTime();
+    std::vector<uint8_t> payload;
+    HwcRecHeader header;
+    while (fread(&header, sizeof(header), 1, file) == 1)
+    {
+        if (header.size > HWC_REC_MAX_PAYLOAD_SIZE)
+        {
+            HWC_LOGE("%s: corrupted record type:%u size:%u", __func__, header.type, header.size);
+            ++stats->error_count;
+            break;
+        }
+
+        payload.resize(header.size);
+        if (header.size > 0 && fread(payload.data(), header.size, 1, file) != 1)
+        {
+            HWC_LOGW("%s: truncated record type:%u size:%u", __func__, header.type, header.size);
+            break;
+        }
+
+        if (real_time)
+        {
+            const nsecs_t target = replay_start + (header.ts - file_header.start_ts);
+            const nsecs_t now = systemTime();
+            if (target > now)
+            {
+                usleep(static_cast<useconds_t>(ns2us(target - now)));
+            }
+        }
+
+        playRecord(header, payload, stats);
+    }
+    fclose(file);
+
+    stats->duration = systemTime() - replay_start;
+    freeBuffers();
+
+    const uint64_t frames = stats->frame_count > 0 ? stats->frame_count : 1;
+    HWC_LOGI("%s: done records:%" PRIu64 " frames:%" PRIu64 " errors:%" PRIu64
+             " validate cpu avg:%" PRId64 "us max:%" PRId64 "us present cpu avg:%" PRId64 "us max:%" PRId64
+             "us duration:%" PRId64 "ms",
+             __func__, stats->record_count, stats->frame_count, stats->error_count,
+             ns2us(stats->validate_total / static_cast<nsecs_t>(frames)), ns2us(stats->validate_max),
+             ns2us(stats->present_total / static_cast<nsecs_t>(frames)), ns2us(stats->present_max),
+             ns2ms(stats->duration));
+    return NO_ERROR;
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <hardware/hwcomposer2.h>
+#include <utils/Errors.h>
+#include <utils/Timers.h>
+
+namespace android {
+class String8;
+}
+
+// HWC_REC_MAGIC is "HWCR" in little endian
+#define HWC_REC_MAGIC 0x52435748
+#define HWC_REC_VERSION 1
+
+// HWC_REC_MAX_REGION_RECTS limits the rects of a recorded region
+#define HWC_REC_MAX_REGION_RECTS 64
+
+// HWC_REC_MAX_PAYLOAD_SIZE is the largest payload of a record, the recorder
+// drops a larger record and the replayer rejects it as a corrupted file
+#define HWC_REC_MAX_PAYLOAD_SIZE (64 * 1024)
+
+// HWC_REC_FLUSH_SIZE is the size of buffered records which triggers a flush
+#define HWC_REC_FLUSH_SIZE (64 * 1024)
+
+enum HWC_REC_TYPE
+{
+    HWC_REC_CREATE_VIRTUAL_DISPLAY = 1,
+    HWC_REC_DESTROY_VIRTUAL_DISPLAY,
+    HWC_REC_CREATE_LAYER,
+    HWC_REC_DESTROY_LAYER,
+    HWC_REC_ACCEPT_CHANGES,
+    HWC_REC_VALIDATE,
+    HWC_REC_PRESENT,
+    HWC_REC_SET_ACTIVE_CONFIG,
+    HWC_REC_SET_CLIENT_TARGET,
+    HWC_REC_SET_COLOR_MODE,
+    HWC_REC_SET_COLOR_MODE_WITH_INTENT,
+    HWC_REC_SET_COLOR_TRANSFORM,
+    HWC_REC_SET_OUTPUT_BUFFER,
+    HWC_REC_SET_POWER_MODE,
+    HWC_REC_SET_VSYNC_ENABLED,
+    HWC_REC_LAYER_CURSOR_POSITION,
+    HWC_REC_LAYER_BUFFER,
+    HWC_REC_LAYER_SURFACE_DAMAGE,
+    HWC_REC_LAYER_BLEND_MODE,
+    HWC_REC_LAYER_COLOR,
+    HWC_REC_LAYER_COMPOSITION_TYPE,
+    HWC_REC_LAYER_DATASPACE,
+    HWC_REC_LAYER_DISPLAY_FRAME,
+    HWC_REC_LAYER_PLANE_ALPHA,
+    HWC_REC_LAYER_SOURCE_CROP,
+    HWC_REC_LAYER_TRANSFORM,
+    HWC_REC_LAYER_VISIBLE_REGION,
+    HWC_REC_LAYER_Z_ORDER,
+    HWC_REC_LAYER_PER_FRAME_METADATA,
+    HWC_REC_LAYER_PER_FRAME_METADATA_BLOBS,
+    HWC_REC_SET_BRIGHTNESS,
+    HWC_REC_SET_CONTENT_SAMPLING_ENABLED,
+    HWC_REC_LAYER_SIDEBAND_STREAM,
+    HWC_REC_TYPE_NUM,
+};
+
+// all structures below are written to the file as they are, so only fixed
+// size fields are used and the layout must not be changed without bumping
+// HWC_REC_VERSION
+struct HwcRecFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    int64_t start_ts;
+};
+
+// HwcRecHeader is followed by size bytes of payload
+struct HwcRecHeader
+{
+    uint16_t type;
+    uint16_t reserved;
+    uint32_t size;
+    int64_t ts;
+    uint64_t display;
+    uint64_t layer;
+};
+
+// HwcRecBuffer describes a buffer without its content, the replayer
+// allocates a stand-in buffer with the same geometry for each alloc_id
+struct HwcRecBuffer
+{
+    uint64_t alloc_id;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    uint32_t usage;
+    int32_t stride;
+    int32_t has_fence;
+};
+
+// HWCRecorder writes the HWC2 calls of SurfaceFlinger into a binary file.
+// It is enabled by setting vendor.debug.hwc.record to the path of output file
+// and disabled by clearing the property, both are applied at next dumpsys.
+// The record() functions are called at the entry of HWCMediator and return
+// immediately when the recorder is disabled.
+class HWCRecorder
+{
+public:
+    static HWCRecorder& getInstance();
+    ~HWCRecorder();
+
+    // updateConfig() starts or stops the recording according to the property
+    void updateConfig();
+
+    bool isEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    void dump(android::String8* dump_str);
+
+    void recordCall(uint16_t type, uint64_t dpy, uint64_t layer = 0);
+    void recordInt(uint16_t type, uint64_t dpy, uint64_t layer, int32_t val);
+    void recordInt2(uint16_t type, uint64_t dpy, uint64_t layer, int32_t val0, int32_t val1);
+    void recordFloat(uint16_t type, uint64_t dpy, uint64_t layer, float val);
+    void recordRect(uint16_t type, uint64_t dpy, uint64_t layer, const hwc_rect_t& rect);
+    void recordFRect(uint16_t type, uint64_t dpy, uint64_t layer, const hwc_frect_t& rect);
+    void recordRegion(uint16_t type, uint64_t dpy, uint64_t layer, const hwc_region_t& region);
+    void recordColor(uint64_t dpy, uint64_t layer, const hwc_color_t& color);
+    void recordBuffer(uint16_t type, uint64_t dpy, uint64_t layer,
+                      buffer_handle_t handle, int32_t fence);
+    void recordClientTarget(uint64_t dpy, buffer_handle_t handle, int32_t fence,
+                            int32_t dataspace, const hwc_region_t& damage);
+    void recordColorTransform(uint64_t dpy, const float* matrix, int32_t hint);
+    void recordVirtualDisplay(uint64_t dpy, uint32_t width, uint32_t height, int32_t format);
+    void recordContentSampling(uint64_t dpy, int32_t enabled, uint8_t component_mask,
+                               uint64_t max_frames);
+    void recordPerFrameMetadata(uint64_t dpy, uint64_t layer, uint32_t num,
+                                const int32_t* keys, const float* metadata);
+    void recordPerFrameMetadataBlobs(uint64_t dpy, uint64_t layer, uint32_t num,
+                                     const int32_t* keys, const uint32_t* sizes,
+                                     const uint8_t* metadata);
+
+private:
+    HWCRecorder();
+
+    // startLocked() opens the file and writes the file header
+    bool startLocked(const std::string& path);
+
+    // stopLocked() flushes buffered records and closes the file
+    void stopLocked();
+
+    // appendLocked() appends a record to the buffer, the buffer is flushed
+    // at the end of each present or when it is bigger than HWC_REC_FLUSH_SIZE
+    void appendLocked(uint16_t type, uint64_t dpy, uint64_t layer,
+                      const void* payload0, size_t size0,
+                      const void* payload1 = nullptr, size_t size1 = 0);
+
+    void flushLocked();
+
+    std::atomic<bool> m_enabled;
+
+    std::mutex m_lock;
+    std::string m_path;
+    int m_fd;
+    std::vector<uint8_t> m_buffer;
+    uint64_t m_record_count;
+    uint64_t m_frame_count;
+    uint64_t m_write_bytes;
+};
+
+// HWCReplayer reads a file written by HWCRecorder and drives HWCMediator with
+// the same call stream, so the composition path can be measured against any
+// overlay device, e.g. the null device. Buffers are replaced by stand-in
+// buffers from gralloc and all acquire fences are treated as signaled.
+class HWCReplayer
+{
+public:
+    struct Stats
+    {
+        Stats()
+            : record_count(0)
+            , frame_count(0)
+            , error_count(0)
+            , validate_total(0)
+            , validate_max(0)
+            , present_total(0)
+            , present_max(0)
+            , duration(0)
+        { }
+
+        uint64_t record_count;
+        uint64_t frame_count;
+        uint64_t error_count;
+
+        // the CPU time of the replay thread spent in validate and present
+        nsecs_t validate_total;
+        nsecs_t validate_max;
+        nsecs_t present_total;
+        nsecs_t present_max;
+        nsecs_t duration;
+    };
+
+    HWCReplayer();
+    ~HWCReplayer();
+
+    // updateConfig() starts a replay thread when vendor.debug.hwc.replay is
+    // changed to a recording path. vendor.debug.hwc.replay_real_time selects
+    // the speed of replaying
+    static void updateConfig();
+
+    // replay() plays the whole file. If real_time is true, the calls are
+    // issued with the recorded interval, otherwise they are issued as fast
+    // as possible
+    android::status_t replay(const char* path, bool real_time, Stats* stats);
+
+private:
+    // playRecord() issues one recorded call
+    void playRecord(const HwcRecHeader& header, const std::vector<uint8_t>& payload, Stats* stats);
+
+    // mapLayer() translates a recorded layer id to the replayed one
+    hwc2_layer_t mapLayer(uint64_t dpy, uint64_t layer);
+
+    // getBuffer() returns the stand-in buffer of recorded buffer
+    buffer_handle_t getBuffer(const HwcRecBuffer& buf);
+
+    // getRegion() rebuilds a region from the payload at offset
+    hwc_region_t getRegion(const std::vector<uint8_t>& payload, size_t offset);
+
+    // releaseFences() closes the release fences returned after present
+    void releaseFences(uint64_t dpy);
+
+    void freeBuffers();
+
+    std::map<uint64_t, std::map<uint64_t, hwc2_layer_t> > m_layer_map;
+    std::map<uint64_t, buffer_handle_t> m_buffers;
+    std::vector<hwc_rect_t> m_rects;
+};
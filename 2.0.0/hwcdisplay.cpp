@@ -5,6 +5,8 @@
 #include <algorithm>
 #include <thread>
 
+#include <cutils/properties.h>
+
 #include <hwc_feature_list.h>
 
 #include "hwc2_defs.h"
@@ -557,6 +559,14 @@ void HWCDisplay::offloadMMtoClient()
     }
 }
 
+// copyHdrMetadata() copies metadata into the reserved buffer of HWLayer,
+// it only allocates memory when the metadata is bigger than the capacity
+template <typename T>
+inline static void copyHdrMetadata(const std::vector<T>& src, std::vector<T>* dst)
+{
+    dst->assign(src.begin(), src.end());
+}
+
 inline static void fillHwLayer(
     const uint64_t& dpy, DispatcherJob* job, const sp<HWCLayer>& layer,
     const unsigned int& ovl_idx, const unsigned int& layer_idx, const int& ext_sel_layer)
@@ -624,9 +634,9 @@ inline static void fillHwLayer(
     hw_layer->camera_preview_hdr = layer->isCameraPreviewHDR();
     hw_layer->glai_agent_id = layer->getGlaiAgentId();
 
-    hw_layer->hdr_static_metadata_keys = layer->getHdrStaticMetadataKeys();
-    hw_layer->hdr_static_metadata_values = layer->getHdrStaticMetadataValues();
-    hw_layer->hdr_dynamic_metadata = layer->getHdrDynamicMetadata();
+    copyHdrMetadata(layer->getHdrStaticMetadataKeys(), &hw_layer->hdr_static_metadata_keys);
+    copyHdrMetadata(layer->getHdrStaticMetadataValues(), &hw_layer->hdr_static_metadata_values);
+    copyHdrMetadata(layer->getHdrDynamicMetadata(), &hw_layer->hdr_dynamic_metadata);
 
     memcpy(&hw_layer->priv_handle, priv_handle, sizeof(PrivateHandle));
 
@@ -710,8 +720,8 @@ inline void setupHwcLayers(const sp<HWCDisplay>& display, DispatcherJob* job)
 
 void HWCDisplay::calculatePerf(DispatcherJob* job)
 {
-    const HwcMCycleInfo& info = getScenarioMCInfo(job);
-    job->mc_info = &info;
+    job->mc_info = getScenarioMCInfo(job);
+    const HwcMCycleInfo& info = job->mc_info;
 
     if (Platform::getInstance().m_config.perf_prefer_below_cpu_mhz <= 0)
     {
@@ -1445,7 +1455,9 @@ void HWCDisplay::checkVisibleLayerChange(const std::vector<sp<HWCLayer> > &prev_
 void HWCDisplay::buildVisibleAndInvisibleLayersSortedByZ()
 {
     AutoMutex lock(m_dump_lock);
-    const std::vector<sp<HWCLayer> > prev_visible_layers(m_visible_layers);
+    // the two vectors are swapped instead of copied, so their storage is
+    // reused by every frame
+    m_prev_visible_layers.swap(m_visible_layers);
     m_visible_layers.clear();
     {
         AutoMutex l(m_pending_removed_layers_mutex);
@@ -1503,7 +1515,9 @@ void HWCDisplay::buildVisibleAndInvisibleLayersSortedByZ()
         }
     }
 
-    checkVisibleLayerChange(prev_visible_layers);
+    checkVisibleLayerChange(m_prev_visible_layers);
+    // do not keep the removed layers alive until the next frame
+    m_prev_visible_layers.clear();
 
     if (isVisibleLayerChanged())
     {
@@ -2043,6 +2057,15 @@ void HWCDisplay::dump(String8* dump_str)
     m_color_transform->dump(dump_str);
     HWCMediator::getInstance().getOvlDevice(m_disp_id)->dump(m_disp_id, dump_str);
     mFpsCounter.dump(dump_str, "    ");
+
+    // dump and reset, so the next dump covers only the frames after this one.
+    // The reset is done by the present thread at its next frame
+    char value[PROPERTY_VALUE_MAX] = {0};
+    property_get("vendor.debug.hwc.fps_hist_reset", value, "0");
+    if (atoi(value) == 1)
+    {
+        mFpsCounter.requestHistogramReset();
+    }
 }
 
 bool HWCDisplay::needDoAvGrouping(const unsigned int num_plugin_display)
@@ -2217,7 +2240,19 @@ void HWCDisplay::setValiPresentState(HWC_VALI_PRESENT_STATE val, const int32_t&
 
 void HWCDisplay::updateFps()
 {
-    if (mFpsCounter.update())
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    uint32_t hist_mask = 0;
+    DispatcherJob* job = HWCDispatcher::getInstance().getExistJob(getId());
+    if (job != nullptr)
+    {
+        hist_mask |= (job->num_ui_layers || job->fbt_exist) ? (1 << FpsCounter::HIST_UI) : 0;
+        hist_mask |= job->num_mm_layers ? (1 << FpsCounter::HIST_MM) : 0;
+        hist_mask |= job->num_glai_layers ? (1 << FpsCounter::HIST_GLAI) : 0;
+    }
+    mFpsCounter.updateHistogram(now, getVsyncPeriod(getActiveConfig()), hist_mask);
+
+    if (mFpsCounter.update(now))
     {
         int32_t type = 0;
         getType(&type);
@@ -257,6 +257,7 @@ public:
     int32_t setColorModeWithRenderIntent(const int32_t mode, const int32_t intent);
 
     void setSfTargetTs(nsecs_t ts) { m_sf_target_ts = ts; }
+    nsecs_t getSfTargetTs() const { return m_sf_target_ts; }
 
     void calculatePerf(DispatcherJob* job);
 
@@ -295,6 +296,8 @@ private:
     mutable Mutex m_dump_lock;
     std::set<uint64_t> m_pending_removed_layers_id;
     std::vector<sp<HWCLayer> > m_visible_layers;
+    // m_prev_visible_layers is only used in buildVisibleAndInvisibleLayersSortedByZ()
+    std::vector<sp<HWCLayer> > m_prev_visible_layers;
     std::vector<sp<HWCLayer> > m_invisible_layers;
     std::vector<sp<HWCLayer> > m_committed_layers;
 
@@ -387,3 +387,18 @@ bool Hrt::queryValidLayer()
 {
     return HWCMediator::getInstance().getOvlDevice(HWC_DISPLAY_PRIMARY)->queryValidLayer(&m_disp_layer);
 }
+
+void Hrt::getQuerySegments(QuerySegments* segs)
+{
+    segs->push_back(std::make_pair(static_cast<void*>(&m_disp_layer), sizeof(m_disp_layer)));
+
+    const size_t num_input = sizeof(m_disp_layer.input_config) / sizeof(m_disp_layer.input_config[0]);
+    for (size_t i = 0; i < num_input; ++i)
+    {
+        if (m_disp_layer.input_config[i] == NULL || m_disp_layer.layer_num[i] <= 0)
+            continue;
+
+        segs->push_back(std::make_pair(static_cast<void*>(m_disp_layer.input_config[i]),
+                                       static_cast<size_t>(m_disp_layer.layer_num[i]) * sizeof(layer_config)));
+    }
+}
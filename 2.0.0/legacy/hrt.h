@@ -37,6 +37,10 @@ public:
     void fillLayerInfoOfDispatcherJob(const std::vector<sp<HWCDisplay> >& displays);
 
     bool queryValidLayer();
+
+protected:
+    void getQuerySegments(QuerySegments* segs);
+
 private:
     layer_config* m_layer_config_list[DisplayManager::MAX_DISPLAYS];
     disp_layer_info m_disp_layer;
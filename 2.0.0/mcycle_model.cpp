@@ -0,0 +1,392 @@
+#define DEBUG_LOG_TAG "MCM"
+
+#include "mcycle_model.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
+#include <utils/String8.h>
+
+#include "utils/debug.h"
+#include "utils/tools.h"
+
+#include "platform_wrap.h"
+
+using namespace android;
+
+// HWC_MC_MODEL_MAGIC is "HWMC" in little endian
+#define HWC_MC_MODEL_MAGIC 0x434d5748
+#define HWC_MC_MODEL_VERSION 1
+// the stored model is only for debugging and tuning, see HWCMCycleModel
+#define HWC_MC_MODEL_PATH "/data/SF_dump/hwc_mc_model"
+
+// samples needed before the learned value replaces the static one, the
+// average becomes a moving average of this window after that
+#define HWC_MC_MODEL_MIN_SAMPLES 32
+
+// the learned value is mean + HWC_MC_MODEL_DEV_MARGIN * deviation, so a
+// scenario with unstable workload gets more headroom
+#define HWC_MC_MODEL_DEV_MARGIN 2.0f
+
+struct HwcMCModelFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seed_hash;
+    uint32_t entry_count;
+};
+
+HWCCycleCounter::HWCCycleCounter()
+    : m_tid(-1)
+    , m_perf_fd(-1)
+    , m_last_cpu_time(0)
+    , m_cycles(0)
+{
+}
+
+HWCCycleCounter::~HWCCycleCounter()
+{
+    deinit();
+}
+
+void HWCCycleCounter::init()
+{
+    deinit();
+    m_tid = gettid();
+
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_hv = 1;
+    m_perf_fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+    if (m_perf_fd < 0)
+    {
+        HWC_LOGI("%s: perf event is not available(%s), use cpu time and frequency",
+                 __func__, strerror(errno));
+        long cpu_num = sysconf(_SC_NPROCESSORS_CONF);
+        m_freq_fds.assign(static_cast<size_t>(std::max(cpu_num, 1L)), -1);
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    m_last_cpu_time = static_cast<nsecs_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+void HWCCycleCounter::deinit()
+{
+    if (m_perf_fd >= 0)
+    {
+        ::protectedClose(m_perf_fd);
+        m_perf_fd = -1;
+    }
+    for (int& fd : m_freq_fds)
+    {
+        if (fd >= 0)
+        {
+            ::protectedClose(fd);
+            fd = -1;
+        }
+    }
+    m_freq_fds.clear();
+}
+
+uint64_t HWCCycleCounter::readCpuFreqKHz(int cpu)
+{
+    if (cpu < 0 || static_cast<size_t>(cpu) >= m_freq_fds.size())
+        return 0;
+
+    int& fd = m_freq_fds[static_cast<size_t>(cpu)];
+    if (fd < 0)
+    {
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", cpu);
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return 0;
+    }
+
+    char buf[32] = {0};
+    ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (len <= 0)
+        return 0;
+
+    return strtoull(buf, nullptr, 10);
+}
+
+uint64_t HWCCycleCounter::read()
+{
+    if (m_tid != gettid())
+    {
+        init();
+    }
+
+    if (m_perf_fd >= 0)
+    {
+        uint64_t count = 0;
+        if (::read(m_perf_fd, &count, sizeof(count)) == static_cast<ssize_t>(sizeof(count)))
+        {
+            return count;
+        }
+        return m_cycles;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    const nsecs_t cpu_time = static_cast<nsecs_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+
+    // the frequency is sampled at the end of the interval, it is close
+    // enough since the intervals are as short as one frame
+    const uint64_t freq_khz = readCpuFreqKHz(sched_getcpu());
+    if (cpu_time > m_last_cpu_time)
+    {
+        m_cycles += static_cast<uint64_t>(cpu_time - m_last_cpu_time) * freq_khz / 1000000;
+    }
+    m_last_cpu_time = cpu_time;
+    return m_cycles;
+}
+
+// ---------------------------------------------------------------------------
+
+HWCMCycleModel& HWCMCycleModel::getInstance()
+{
+    static HWCMCycleModel gInstance;
+    return gInstance;
+}
+
+HWCMCycleModel::HWCMCycleModel()
+    : m_enabled(true)
+    , m_dirty(false)
+    , m_saving(false)
+{
+    resetLocked();
+    load();
+}
+
+void HWCMCycleModel::resetLocked()
+{
+    memset(m_entries, 0, sizeof(m_entries));
+}
+
+void HWCMCycleModel::updateConfig()
+{
+    char value[PROPERTY_VALUE_MAX] = {0};
+    property_get("vendor.debug.hwc.mc_model", value, "1");
+    const int mode = atoi(value);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_enabled = mode == 1;
+    if (mode == 2)
+    {
+        resetLocked();
+        m_dirty = true;
+    }
+}
+
+uint32_t HWCMCycleModel::getSeedHash()
+{
+    // FNV-1a over the static cycles of all scenarios
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash](const void* data, size_t size)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= p[i];
+            hash *= 16777619u;
+        }
+    };
+
+    for (const HwcMCycleInfo& info : Platform::getInstance().m_config.hwc_mcycle_table)
+    {
+        mix(&info.id, sizeof(info.id));
+        mix(&info.dispatcher_mc, sizeof(info.dispatcher_mc));
+        mix(&info.ovl_mc, sizeof(info.ovl_mc));
+    }
+    return hash;
+}
+
+void HWCMCycleModel::load()
+{
+#ifdef MTK_USER_BUILD
+    return;
+#endif
+    int fd = open(HWC_MC_MODEL_PATH, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    HwcMCModelFileHeader header;
+    Entry entries[HWC_MC_MODEL_MAX_ID];
+    const bool valid =
+        ::read(fd, &header, sizeof(header)) == static_cast<ssize_t>(sizeof(header)) &&
+        header.magic == HWC_MC_MODEL_MAGIC && header.version == HWC_MC_MODEL_VERSION &&
+        header.entry_count == HWC_MC_MODEL_MAX_ID && header.seed_hash == getSeedHash() &&
+        ::read(fd, entries, sizeof(entries)) == static_cast<ssize_t>(sizeof(entries));
+    ::protectedClose(fd);
+
+    if (!valid)
+    {
+        HWC_LOGI("%s: drop the stored model since it does not match", __func__);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    memcpy(m_entries, entries, sizeof(m_entries));
+    HWC_LOGI("%s: loaded %s", __func__, HWC_MC_MODEL_PATH);
+}
+
+void HWCMCycleModel::save()
+{
+#ifdef MTK_USER_BUILD
+    return;
+#endif
+    // a previous save is still writing, the next power off saves again
+    bool expected = false;
+    if (!m_saving.compare_exchange_strong(expected, true))
+        return;
+
+    HwcMCModelFileHeader header;
+    std::vector<Entry> entries(HWC_MC_MODEL_MAX_ID);
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!m_dirty)
+        {
+            m_saving = false;
+            return;
+        }
+        m_dirty = false;
+        memcpy(entries.data(), m_entries, sizeof(m_entries));
+    }
+    header.magic = HWC_MC_MODEL_MAGIC;
+    header.version = HWC_MC_MODEL_VERSION;
+    header.seed_hash = getSeedHash();
+    header.entry_count = HWC_MC_MODEL_MAX_ID;
+
+    std::thread([this, header, entries = std::move(entries)]()
+    {
+        pthread_setname_np(pthread_self(), "HWCMCSave");
+        writeModel(&header, sizeof(header), entries.data(), entries.size() * sizeof(Entry));
+        m_saving = false;
+    }).detach();
+}
+
+void HWCMCycleModel::writeModel(const void* header, size_t header_size,
+                                const void* entries, size_t entries_size)
+{
+    // write a temporary file and rename it, so a crash never leaves a
+    // partial model behind
+    const char* tmp_path = HWC_MC_MODEL_PATH ".tmp";
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        HWC_LOGW("%s: failed to open %s: %s", __func__, tmp_path, strerror(errno));
+        return;
+    }
+
+    const bool ok = write(fd, header, header_size) == static_cast<ssize_t>(header_size) &&
+                    write(fd, entries, entries_size) == static_cast<ssize_t>(entries_size) &&
+                    fsync(fd) == 0;
+    ::protectedClose(fd);
+    if (!ok || rename(tmp_path, HWC_MC_MODEL_PATH) != 0)
+    {
+        HWC_LOGW("%s: failed to write %s: %s", __func__, HWC_MC_MODEL_PATH, strerror(errno));
+        unlink(tmp_path);
+    }
+}
+
+void HWCMCycleModel::addSampleLocked(float sample, uint32_t* count, float* mean, float* dev)
+{
+    if (*count < HWC_MC_MODEL_MIN_SAMPLES)
+    {
+        (*count)++;
+    }
+
+    // cumulative average while warming up, then a moving average
+    const float alpha = 1.0f / static_cast<float>(*count);
+    const float diff = sample - *mean;
+    *mean += alpha * diff;
+    *dev += alpha * (fabsf(diff) - *dev);
+}
+
+void HWCMCycleModel::addDispatcherSample(int id, uint64_t cycles)
+{
+    if (id < 0 || id >= HWC_MC_MODEL_MAX_ID || cycles == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    Entry& entry = m_entries[id];
+    addSampleLocked(static_cast<float>(cycles) / 1e6f, &entry.dispatcher_count,
+                    &entry.dispatcher_mc, &entry.dispatcher_dev);
+    m_dirty = true;
+}
+
+void HWCMCycleModel::addOvlSample(int id, uint64_t cycles)
+{
+    if (id < 0 || id >= HWC_MC_MODEL_MAX_ID || cycles == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    Entry& entry = m_entries[id];
+    addSampleLocked(static_cast<float>(cycles) / 1e6f, &entry.ovl_count,
+                    &entry.ovl_mc, &entry.ovl_dev);
+    m_dirty = true;
+}
+
+HwcMCycleInfo HWCMCycleModel::apply(const HwcMCycleInfo& info)
+{
+    HwcMCycleInfo result = info;
+    if (info.id < 0 || info.id >= HWC_MC_MODEL_MAX_ID)
+        return result;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_enabled)
+        return result;
+
+    const Entry& entry = m_entries[info.id];
+    if (entry.dispatcher_count >= HWC_MC_MODEL_MIN_SAMPLES)
+    {
+        result.dispatcher_mc = entry.dispatcher_mc + HWC_MC_MODEL_DEV_MARGIN * entry.dispatcher_dev;
+    }
+    if (entry.ovl_count >= HWC_MC_MODEL_MIN_SAMPLES)
+    {
+        result.ovl_mc = entry.ovl_mc + HWC_MC_MODEL_DEV_MARGIN * entry.ovl_dev;
+    }
+    return result;
+}
+
+void HWCMCycleModel::dump(String8* dump_str)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    dump_str->appendFormat("[HWC MCycle Model] enabled:%d dirty:%d\n", m_enabled, m_dirty);
+    for (const HwcMCycleInfo& info : Platform::getInstance().m_config.hwc_mcycle_table)
+    {
+        if (info.id < 0 || info.id >= HWC_MC_MODEL_MAX_ID)
+            continue;
+
+        const Entry& entry = m_entries[info.id];
+        if (entry.dispatcher_count == 0 && entry.ovl_count == 0)
+            continue;
+
+        dump_str->appendFormat("  id:%2d dispatcher static:%.3f learned:%.3f+-%.3f(%u)"
+                               " ovl static:%.3f learned:%.3f+-%.3f(%u)\n",
+                               info.id, info.dispatcher_mc, entry.dispatcher_mc,
+                               entry.dispatcher_dev, entry.dispatcher_count,
+                               info.ovl_mc, entry.ovl_mc, entry.ovl_dev, entry.ovl_count);
+    }
+}
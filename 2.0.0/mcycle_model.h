@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <utils/Timers.h>
+
+#include "hwc2_defs.h"
+
+namespace android {
+class String8;
+}
+
+// HWC_MC_MODEL_MAX_ID must be larger than the ids of HWC_MC_TYPE
+#define HWC_MC_MODEL_MAX_ID 16
+
+// HWCCycleCounter counts the CPU cycles consumed by the calling thread. It
+// uses the cycle counter of perf events if the kernel allows it, otherwise it
+// integrates the thread CPU time with the frequency of current CPU.
+// An instance must only be read by one thread.
+class HWCCycleCounter
+{
+public:
+    HWCCycleCounter();
+    ~HWCCycleCounter();
+
+    // read() returns the accumulated cycles of the calling thread
+    uint64_t read();
+
+private:
+    void init();
+    void deinit();
+
+    // readCpuFreqKHz() returns the current frequency of cpu in kHz
+    uint64_t readCpuFreqKHz(int cpu);
+
+    pid_t m_tid;
+    int m_perf_fd;
+    std::vector<int> m_freq_fds;
+    nsecs_t m_last_cpu_time;
+    uint64_t m_cycles;
+};
+
+// HWCMCycleModel learns the million cycles of DispatchThread and OverlayEngine
+// for each scenario of hwc_mcycle_table. The static table of platform is the
+// initial value, and the learned value replaces it after enough samples, so
+// the uclamp follows the real workload after kernel or driver updates.
+// Persisting the model is a debug-only feature: HWC_MC_MODEL_PATH is in the
+// SF dump directory, which is wiped and may not exist on user builds, so user
+// builds never load or save it and always start from the static table.
+class HWCMCycleModel
+{
+public:
+    static HWCMCycleModel& getInstance();
+
+    // updateConfig() reads vendor.debug.hwc.mc_model, 0 disables the learned
+    // values and 2 also drops them
+    void updateConfig();
+
+    // apply() returns info with the learned cycles of info.id
+    HwcMCycleInfo apply(const HwcMCycleInfo& info);
+
+    void addDispatcherSample(int id, uint64_t cycles);
+    void addOvlSample(int id, uint64_t cycles);
+
+    // save() posts the model to a background thread which writes it to
+    // storage, so the caller, i.e. setPowerMode(OFF), never waits for file I/O
+    void save();
+
+    void dump(android::String8* dump_str);
+
+private:
+    HWCMCycleModel();
+
+    struct Entry
+    {
+        uint32_t dispatcher_count;
+        uint32_t ovl_count;
+        float dispatcher_mc;
+        float dispatcher_dev;
+        float ovl_mc;
+        float ovl_dev;
+    };
+
+    // addSampleLocked() updates the moving average and deviation of a value
+    static void addSampleLocked(float sample, uint32_t* count, float* mean, float* dev);
+
+    // getSeedHash() identifies the static table, the stored model is dropped
+    // when the platform table is changed
+    static uint32_t getSeedHash();
+
+    void load();
+    void resetLocked();
+
+    // writeModel() writes header and entries to HWC_MC_MODEL_PATH
+    static void writeModel(const void* header, size_t header_size,
+                           const void* entries, size_t entries_size);
+
+    std::mutex m_lock;
+    bool m_enabled;
+    bool m_dirty;
+    std::atomic<bool> m_saving;
+    Entry m_entries[HWC_MC_MODEL_MAX_ID];
+};
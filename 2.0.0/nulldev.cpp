@@ -0,0 +1,742 @@
+#define DEBUG_LOG_TAG "NULLDEV"
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "nulldev.h"
+
+#include <chrono>
+#include <cstring>
+
+#include <cutils/properties.h>
+#include <sw_sync.h>
+
+#include "utils/debug.h"
+#include "utils/tools.h"
+
+#include "overlay.h"
+#include "platform_wrap.h"
+
+#define NLOGD(dpy, x, ...) HWC_LOGD("(%" PRIu64 ") " x, dpy, ##__VA_ARGS__)
+#define NLOGW(dpy, x, ...) HWC_LOGW("(%" PRIu64 ") " x, dpy, ##__VA_ARGS__)
+
+#define NULL_DEV_DEFAULT_WIDTH 1080
+#define NULL_DEV_DEFAULT_HEIGHT 2400
+#define NULL_DEV_DEFAULT_REFRESH 60
+#define NULL_DEV_MAX_SIZE 4096
+
+static int32_t getNullDevProperty(const char* name, int32_t default_value)
+{
+    char value[PROPERTY_VALUE_MAX] = {0};
+    property_get(name, value, "0");
+    int32_t res = static_cast<int32_t>(strtol(value, nullptr, 0));
+    return (res > 0) ? res : default_value;
+}
+
+// ---------------------------------------------------------------------------
+
+NullDevice& NullDevice::getInstance()
+{
+    static NullDevice gInstance;
+    return gInstance;
+}
+
+NullDevice::NullDevice()
+    : m_vsync_ts(0)
+    , m_vsync_count(0)
+    , m_stop(false)
+{
+    m_default_width = static_cast<uint32_t>(getNullDevProperty("vendor.debug.hwc.null_dev.width",
+                                                               NULL_DEV_DEFAULT_WIDTH));
+    m_default_height = static_cast<uint32_t>(getNullDevProperty("vendor.debug.hwc.null_dev.height",
+                                                                NULL_DEV_DEFAULT_HEIGHT));
+    m_default_refresh = getNullDevProperty("vendor.debug.hwc.null_dev.fps", NULL_DEV_DEFAULT_REFRESH);
+    m_vsync_period = static_cast<nsecs_t>(1e9 / m_default_refresh);
+
+    HWC_LOGI("create NullDevice %ux%u@%d", m_default_width, m_default_height, m_default_refresh);
+
+    m_vsync_thread = std::thread(&NullDevice::vsyncLoop, this);
+    if (pthread_setname_np(m_vsync_thread.native_handle(), "NullVsync"))
+    {
+        HWC_LOGI("pthread_setname_np NullVsync fail");
+    }
+}
+
+NullDevice::~NullDevice()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stop = true;
+        m_vsync_cond.notify_all();
+    }
+    m_vsync_thread.join();
+
+    for (uint64_t dpy = 0; dpy < DisplayManager::MAX_DISPLAYS; dpy++)
+    {
+        destroyOverlaySession(dpy);
+    }
+}
+
+void NullDevice::createTimeline(NullTimeline* timeline)
+{
+    timeline->fd = sw_sync_timeline_create();
+    if (timeline->fd < 0)
+    {
+        HWC_LOGW("failed to create sw_sync timeline: %s", strerror(errno));
+        timeline->fd = -1;
+    }
+    timeline->next_idx = 0;
+    timeline->committed_idx = 0;
+    timeline->signaled_idx = 0;
+}
+
+void NullDevice::destroyTimeline(NullTimeline* timeline)
+{
+    signalTimeline(timeline, timeline->next_idx);
+    if (timeline->fd != -1)
+    {
+        protectedClose(timeline->fd);
+        timeline->fd = -1;
+    }
+}
+
+void NullDevice::createFence(NullTimeline* timeline, const char* name, unsigned int* idx, int* fd)
+{
+    *idx = ++timeline->next_idx;
+    *fd = -1;
+
+    if (timeline->fd != -1)
+    {
+        *fd = sw_sync_fence_create(timeline->fd, name, *idx);
+        if (*fd < 0)
+        {
+            HWC_LOGW("failed to create fence %s(%u): %s", name, *idx, strerror(errno));
+            *fd = -1;
+        }
+    }
+}
+
+void NullDevice::signalTimeline(NullTimeline* timeline, unsigned int idx)
+{
+    if (idx <= timeline->signaled_idx)
+        return;
+
+    if (timeline->fd != -1)
+    {
+        int err = sw_sync_timeline_inc(timeline->fd, idx - timeline->signaled_idx);
+        if (err < 0)
+        {
+            HWC_LOGW("failed to inc timeline to %u: %s", idx, strerror(errno));
+        }
+    }
+    timeline->signaled_idx = idx;
+}
+
+void NullDevice::latchFrameLocked(NullSession* session)
+{
+    NullFrame& frame = session->pending;
+    if (!frame.valid)
+        return;
+
+    // the buffer of previous frame is released once a new buffer
+    // of the same input is latched, or the input is disabled
+    for (unsigned int i = 0; i < NULL_DEV_MAX_INPUT_NUM; i++)
+    {
+        NullTimeline* timeline = &session->input[i];
+        if (frame.input_en[i] && frame.input_idx[i] > 0)
+        {
+            signalTimeline(timeline, frame.input_idx[i] - 1);
+        }
+        else
+        {
+            signalTimeline(timeline, timeline->committed_idx);
+        }
+    }
+
+    if (frame.output_en)
+    {
+        signalTimeline(&session->output, frame.output_idx);
+    }
+
+    signalTimeline(&session->present, frame.present_idx);
+
+    frame.valid = false;
+    ++session->latch_count;
+}
+
+void NullDevice::vsyncLoop()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    nsecs_t next_vsync = systemTime() + m_vsync_period;
+    while (!m_stop)
+    {
+        const nsecs_t cur_time = systemTime();
+        if (cur_time < next_vsync)
+        {
+            m_vsync_cond.wait_for(lock, std::chrono::nanoseconds(next_vsync - cur_time));
+            continue;
+        }
+
+        HWC_ATRACE_NAME("null_vsync");
+        for (uint64_t dpy = 0; dpy < HWC_DISPLAY_VIRTUAL; dpy++)
+        {
+            NullSession* session = &m_sessions[dpy];
+            if (session->valid && session->power_mode != HWC2_POWER_MODE_OFF)
+            {
+                latchFrameLocked(session);
+            }
+        }
+
+        m_vsync_ts = next_vsync;
+        ++m_vsync_count;
+        m_vsync_cond.notify_all();
+
+        // keep the phase of vsync even if this thread is late
+        next_vsync += m_vsync_period;
+        if (next_vsync <= cur_time)
+        {
+            next_vsync += ((cur_time - next_vsync) / m_vsync_period + 1) * m_vsync_period;
+        }
+    }
+}
+
+void NullDevice::initOverlay()
+{
+}
+
+unsigned int NullDevice::getHwVersion()
+{
+    return static_cast<unsigned int>(getNullDevProperty("vendor.debug.hwc.null_dev.hw_ver",
+                                                        PLATFORM_MT6983));
+}
+
+uint32_t NullDevice::getDisplayRotation(uint64_t /*dpy*/)
+{
+    return 0;
+}
+
+bool NullDevice::isDispRszSupported()
+{
+    return false;
+}
+
+bool NullDevice::isDispRpoSupported()
+{
+    return false;
+}
+
+bool NullDevice::isDisp3X4DisplayColorTransformSupported()
+{
+    return false;
+}
+
+bool NullDevice::isDispAodForceDisable()
+{
+    return true;
+}
+
+bool NullDevice::isPartialUpdateSupported()
+{
+    return false;
+}
+
+bool NullDevice::isFenceWaitSupported()
+{
+    // OverlayEngine waits the acquire fences by itself
+    return false;
+}
+
+bool NullDevice::isConstantAlphaForRGBASupported()
+{
+    return true;
+}
+
+bool NullDevice::isDispSelfRefreshSupported()
+{
+    return false;
+}
+
+bool NullDevice::isDisplayHrtSupport()
+{
+    return false;
+}
+
+bool NullDevice::isDisplaySupportedWidthAndHeight(unsigned int width, unsigned int height)
+{
+    return width <= NULL_DEV_MAX_SIZE && height <= NULL_DEV_MAX_SIZE;
+}
+
+int32_t NullDevice::getSupportedColorMode()
+{
+    return HAL_COLOR_MODE_NATIVE;
+}
+
+unsigned int NullDevice::getMaxOverlayInputNum()
+{
+    return NULL_DEV_MAX_INPUT_NUM;
+}
+
+uint32_t NullDevice::getMaxOverlayHeight()
+{
+    return NULL_DEV_MAX_SIZE;
+}
+
+uint32_t NullDevice::getMaxOverlayWidth()
+{
+    return NULL_DEV_MAX_SIZE;
+}
+
+int32_t NullDevice::getDisplayOutputRotated()
+{
+    return 0;
+}
+
+uint32_t NullDevice::getRszMaxWidthInput()
+{
+    return 0;
+}
+
+uint32_t NullDevice::getRszMaxHeightInput()
+{
+    return 0;
+}
+
+void NullDevice::enableDisplayFeature(uint32_t /*flag*/)
+{
+}
+
+void NullDevice::disableDisplayFeature(uint32_t /*flag*/)
+{
+}
+
+status_t NullDevice::createOverlaySession(uint64_t dpy, uint32_t width, uint32_t height,
+                                          HWC_DISP_MODE mode)
+{
+    CHECK_DPY_RET_STATUS(dpy);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    NullSession* session = &m_sessions[dpy];
+    if (session->valid)
+    {
+        NLOGW(dpy, "Failed to create existed NullSession");
+        return INVALID_OPERATION;
+    }
+
+    session->valid = true;
+    session->width = (width != 0) ? width : m_default_width;
+    session->height = (height != 0) ? height : m_default_height;
+    session->mode = mode;
+    session->power_mode = (dpy < HWC_DISPLAY_VIRTUAL) ? HWC2_POWER_MODE_OFF : HWC2_POWER_MODE_ON;
+    session->config = NullFrame();
+    session->pending = NullFrame();
+    session->commit_count = 0;
+    session->latch_count = 0;
+
+    for (unsigned int i = 0; i < NULL_DEV_MAX_INPUT_NUM; i++)
+    {
+        createTimeline(&session->input[i]);
+    }
+    createTimeline(&session->output);
+    createTimeline(&session->present);
+
+    NLOGD(dpy, "Create NullSession %ux%u mode:%d", session->width, session->height, mode);
+
+    return NO_ERROR;
+}
+
+void NullDevice::destroyOverlaySession(uint64_t dpy)
+{
+    CHECK_DPY_RET_VOID(dpy);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    NullSession* session = &m_sessions[dpy];
+    if (!session->valid)
+        return;
+
+    latchFrameLocked(session);
+    for (unsigned int i = 0; i < NULL_DEV_MAX_INPUT_NUM; i++)
+    {
+        destroyTimeline(&session->input[i]);
+    }
+    destroyTimeline(&session->output);
+    destroyTimeline(&session->present);
+
+    session->valid = false;
+    session->mode = HWC_DISP_INVALID_SESSION_MODE;
+
+    NLOGD(dpy, "Destroy NullSession");
+}
+
+status_t NullDevice::triggerOverlaySession(uint64_t dpy, int present_fence_idx, int /*sf_present_fence_idx*/,
+                                           int /*ovlp_layer_num*/, int /*prev_present_fence_fd*/,
+                                           hwc2_config_t /*config*/, const uint32_t& /*hrt_weight*/,
+                                           const uint32_t& /*hrt_idx*/, unsigned int /*num*/,
+                                           OverlayPortParam* const* /*params*/,
+                                           sp<ColorTransform> /*color_transform*/,
+                                           TriggerOverlayParam trigger_param)
+{
+    CHECK_DPY_RET_STATUS(dpy);
+
+    HWC_ATRACE_FORMAT_NAME("null_commit(%" PRIu64 ")", trigger_param.ovl_seq);
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    NullSession* session = &m_sessions[dpy];
+    if (!session->valid)
+    {
+        NLOGW(dpy, "Failed to trigger invalid NullSession");
+        return INVALID_OPERATION;
+    }
+
+    // like the atomic commit, a new frame can not be committed
+    // before the previous one has been latched by vsync
+    if (session->pending.valid && dpy < HWC_DISPLAY_VIRTUAL)
+    {
+        m_vsync_cond.wait_for(lock, std::chrono::nanoseconds(m_vsync_period * 2),
+            [session, this]() { return !session->pending.valid || m_stop; });
+    }
+    latchFrameLocked(session);
+
+    session->pending = session->config;
+    session->pending.valid = true;
+    session->pending.present_idx = (present_fence_idx > 0) ? static_cast<unsigned int>(present_fence_idx) : 0;
+    for (unsigned int i = 0; i < NULL_DEV_MAX_INPUT_NUM; i++)
+    {
+        if (session->pending.input_en[i])
+        {
+            session->input[i].committed_idx = session->pending.input_idx[i];
+        }
+    }
+    if (session->pending.output_en)
+    {
+        session->output.committed_idx = session->pending.output_idx;
+    }
+    session->present.committed_idx = session->pending.present_idx;
+    ++session->commit_count;
+
+    // virtual display has no vsync, so the frame is done right away
+    if (dpy >= HWC_DISPLAY_VIRTUAL || session->power_mode == HWC2_POWER_MODE_OFF)
+    {
+        latchFrameLocked(session);
+    }
+
+    return NO_ERROR;
+}
+
+void NullDevice::disableOverlaySession(uint64_t dpy, OverlayPortParam* const* /*params*/, unsigned int /*num*/)
+{
+    CHECK_DPY_RET_VOID(dpy);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    NullSession* session = &m_sessions[dpy];
+    if (!session->valid)
+        return;
+
+    latchFrameLocked(session);
+    for (unsigned int i = 0; i < NULL_DEV_MAX_INPUT_NUM; i++)
+    {
+        session->config.input_en[i] = false;
+        signalTimeline(&session->input[i], session->input[i].committed_idx);
+    }
+}
+
+status_t NullDevice::setOverlaySessionMode(uint64_t dpy, HWC_DISP_MODE mode)
+{
+    CHECK_DPY_RET_STATUS(dpy);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_sessions[dpy].valid)
+    {
+        return INVALID_OPERATION;
+    }
+    m_sessions[dpy].mode = mode;
+    return NO_ERROR;
+}
+
+HWC_DISP_MODE NullDevice::getOverlaySessionMode(uint64_t dpy)
+{
+    if (!CHECK_DPY_VALID(dpy))
+    {
+        HWC_LOGE("%s(), invalid dpy %" PRIu64 "", __FUNCTION__, dpy);
+        return HWC_DISP_INVALID_SESSION_MODE;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_sessions[dpy].mode;
+}
+
+status_t NullDevice::getOverlaySessionInfo(uint64_t dpy, SessionInfo* info)
+{
+    CHECK_DPY_RET_STATUS(dpy);
+
+    // only the primary display is connected
+    if (dpy == HWC_DISPLAY_EXTERNAL)
+    {
+        return INVALID_OPERATION;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    const NullSession* session = &m_sessions[dpy];
+    const uint32_t width = session->valid ? session->width : m_default_width;
+    const uint32_t height = session->valid ? session->height : m_default_height;
+
+    info->maxLayerNum = NULL_DEV_MAX_INPUT_NUM;
+    info->isHwVsyncAvailable = 1;
+    info->displayType = HWC_DISP_IF_TYPE_DSI0;
+    info->displayWidth = width;
+    info->displayHeight = height;
+    info->displayFormat = 2;
+    info->displayMode = HWC_DISP_IF_MODE_VIDEO;
+    info->vsyncFPS = static_cast<unsigned int>(m_default_refresh * 100);
+    info->physicalWidth = width;
+    info->physicalHeight = height;
+    info->physicalWidthUm = 0;
+    info->physicalHeightUm = 0;
+    info->density = 0;
+    info->isConnected = 1;
+    info->isHDCPSupported = 0;
+
+    return NO_ERROR;
+}
+
+unsigned int NullDevice::getAvailableOverlayInput(uint64_t /*dpy*/)
+{
+    return NULL_DEV_MAX_INPUT_NUM;
+}
+
+void NullDevice::prepareOverlayInput(uint64_t dpy, OverlayPrepareParam* param)
+{
+    CHECK_DPY_RET_VOID(dpy);
+
+    param->fence_index = 0;
+    param->fence_fd = -1;
+
+    if (param->id >= NULL_DEV_MAX_INPUT_NUM)
+    {
+        NLOGW(dpy, "Failed to prepare invalid input(%u)", param->id);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_sessions[dpy].valid)
+        return;
+
+    char name[32];
+    if (snprintf(name, sizeof(name), "null_in_%" PRIu64 "_%u", dpy, param->id) < 0)
+    {
+        name[0] = '\0';
+    }
+    createFence(&m_sessions[dpy].input[param->id], name, &param->fence_index, &param->fence_fd);
+}
+
+void NullDevice::updateOverlayInputs(uint64_t dpy, OverlayPortParam* const* params, unsigned int num,
+                                     sp<ColorTransform> /*color_transform*/)
+{
+    CHECK_DPY_RET_VOID(dpy);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    NullFrame& config = m_sessions[dpy].config;
+    for (unsigned int i = 0; i < NULL_DEV_MAX_INPUT_NUM; i++)
+    {
+        if (i < num && params[i]->state == OVL_IN_PARAM_ENABLE)
+        {
+            config.input_en[i] = true;
+            config.input_idx[i] = params[i]->fence_index;
+        }
+        else
+        {
+            config.input_en[i] = false;
+        }
+    }
+}
+
+void NullDevice::prepareOverlayOutput(uint64_t dpy, OverlayPrepareParam* param)
+{
+    CHECK_DPY_RET_VOID(dpy);
+
+    param->fence_index = 0;
+    param->fence_fd = -1;
+    param->if_fence_index = 0;
+    param->if_fence_fd = -1;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_sessions[dpy].valid)
+        return;
+
+    char name[32];
+    if (snprintf(name, sizeof(name), "null_out_%" PRIu64, dpy) < 0)
+    {
+        name[0] = '\0';
+    }
+    createFence(&m_sessions[dpy].output, name, &param->fence_index, &param->fence_fd);
+}
+
+void NullDevice::disableOverlayOutput(uint64_t dpy)
+{
+    CHECK_DPY_RET_VOID(dpy);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_sessions[dpy].config.output_en = false;
+}
+
+void NullDevice::enableOverlayOutput(uint64_t dpy, OverlayPortParam* param)
+{
+    CHECK_DPY_RET_VOID(dpy);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_sessions[dpy].config.output_en = true;
+    m_sessions[dpy].config.output_idx = param->fence_index;
+}
+
+void NullDevice::prepareOverlayPresentFence(uint64_t dpy, OverlayPrepareParam* param)
+{
+    CHECK_DPY_RET_VOID(dpy);
+
+    param->fence_index = 0;
+    param->fence_fd = -1;
+    param->is_sf_fence_support = false;
+    param->sf_fence_index = 0;
+    param->sf_fence_fd = -1;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_sessions[dpy].valid)
+        return;
+
+    char name[32];
+    if (snprintf(name, sizeof(name), "null_present_%" PRIu64, dpy) < 0)
+    {
+        name[0] = '\0';
+    }
+    createFence(&m_sessions[dpy].present, name, &param->fence_index, &param->fence_fd);
+}
+
+status_t NullDevice::waitVSync(uint64_t dpy, nsecs_t* ts)
+{
+    CHECK_DPY_RET_STATUS(dpy);
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    const uint64_t count = m_vsync_count;
+    const bool res = m_vsync_cond.wait_for(lock, std::chrono::nanoseconds(m_vsync_period * 2),
+        [count, this]() { return m_vsync_count != count || m_stop; });
+    if (!res || m_stop)
+    {
+        NLOGW(dpy, "failed to wait fake vsync");
+        return BAD_VALUE;
+    }
+
+    *ts = m_vsync_ts;
+    return NO_ERROR;
+}
+
+void NullDevice::setPowerMode(uint64_t dpy, int mode)
+{
+    CHECK_DPY_RET_VOID(dpy);
+
+    NLOGD(dpy, "NullDevice::setPowerMode() mode:%d", mode);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    NullSession* session = &m_sessions[dpy];
+    session->power_mode = mode;
+    if (mode == HWC2_POWER_MODE_OFF)
+    {
+        latchFrameLocked(session);
+    }
+}
+
+bool NullDevice::queryValidLayer(void* /*ptr*/)
+{
+    // the layering of the null device is simulated by SimHrt
+    return false;
+}
+
+status_t NullDevice::waitAllJobDone(const uint64_t dpy)
+{
+    CHECK_DPY_RET_STATUS(dpy);
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    NullSession* session = &m_sessions[dpy];
+    m_vsync_cond.wait_for(lock, std::chrono::nanoseconds(m_vsync_period * 2),
+        [session, this]() { return !session->pending.valid || m_stop; });
+    latchFrameLocked(session);
+
+    return NO_ERROR;
+}
+
+status_t NullDevice::waitRefreshRequest(unsigned int* /*type*/)
+{
+    // there is no driver to request refresh, just block the caller for a while
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_vsync_cond.wait_for(lock, std::chrono::seconds(1), [this]() { return m_stop; });
+    return TIMED_OUT;
+}
+
+int32_t NullDevice::getWidth(uint64_t dpy, hwc2_config_t /*config*/)
+{
+    if (!CHECK_DPY_VALID(dpy))
+        return 0;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    return static_cast<int32_t>(m_sessions[dpy].valid ? m_sessions[dpy].width : m_default_width);
+}
+
+int32_t NullDevice::getHeight(uint64_t dpy, hwc2_config_t /*config*/)
+{
+    if (!CHECK_DPY_VALID(dpy))
+        return 0;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    return static_cast<int32_t>(m_sessions[dpy].valid ? m_sessions[dpy].height : m_default_height);
+}
+
+int32_t NullDevice::getRefresh(uint64_t /*dpy*/, hwc2_config_t /*config*/)
+{
+    return m_default_refresh;
+}
+
+uint32_t NullDevice::getNumConfigs(uint64_t /*dpy*/)
+{
+    return 1;
+}
+
+void NullDevice::dump(const uint64_t& /*dpy*/, String8* dump_str)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    dump_str->appendFormat("----------NULLDEV----------\n");
+    dump_str->appendFormat("vsync: period=%" PRId64 " count=%" PRIu64 " ts=%" PRId64 "\n",
+                           m_vsync_period, m_vsync_count, m_vsync_ts);
+    for (unsigned int i = 0; i < DisplayManager::MAX_DISPLAYS; i++)
+    {
+        const NullSession* session = &m_sessions[i];
+        if (!session->valid)
+            continue;
+
+        dump_str->appendFormat("dpy %u: %ux%u mode=%d power=%d commit=%" PRIu64 " latch=%" PRIu64
+                               " present=%u/%u output=%u/%u\n",
+                               i, session->width, session->height, session->mode, session->power_mode,
+                               session->commit_count, session->latch_count,
+                               session->present.signaled_idx, session->present.next_idx,
+                               session->output.signaled_idx, session->output.next_idx);
+        for (unsigned int j = 0; j < NULL_DEV_MAX_INPUT_NUM; j++)
+        {
+            dump_str->appendFormat("  in%u: %u/%u/%u", j, session->input[j].signaled_idx,
+                                   session->input[j].committed_idx, session->input[j].next_idx);
+        }
+        dump_str->appendFormat("\n");
+    }
+}
+
+int32_t NullDevice::updateDisplayResolution(uint64_t /*dpy*/)
+{
+    return NO_ERROR;
+}
+
+int32_t NullDevice::getCurrentRefresh(uint64_t /*dpy*/)
+{
+    return m_default_refresh;
+}
+
+void NullDevice::submitMML(uint64_t /*dpy*/, struct mml_submit& /*params*/)
+{
+}
+
+void NullDevice::enableDisplayDriverLog(uint32_t /*param*/)
+{
+}
@@ -0,0 +1,310 @@
+#ifndef HWC_NULL_DEV_H_
+#define HWC_NULL_DEV_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <utils/Timers.h>
+
+#include "dev_interface.h"
+
+using namespace android;
+
+// NULL_DEV_MAX_INPUT_NUM is the amount of fake overlay inputs of each session
+#define NULL_DEV_MAX_INPUT_NUM 8
+
+// NullDevice is a display device without any display hardware behind it.
+// It keeps fake overlay sessions and input slots, emulates vsync with a
+// software timer and signals present, output and input release fences with
+// sw_sync timelines. It lets the whole HWC pipeline run on a host or on an
+// emulator, e.g. for replaying a recorded call stream or for benchmarking.
+class NullDevice : public IOverlayDevice
+{
+public:
+    static NullDevice& getInstance();
+    ~NullDevice();
+
+    int32_t getType() { return OVL_DEVICE_TYPE_OVL; }
+
+    // initOverlay() initializes overlay related hw setting
+    void initOverlay();
+
+    // getHwVersion() is used to get the HW version for check platform family
+    static unsigned int getHwVersion();
+
+    // getDisplayRotation gets LCM's degree
+    uint32_t getDisplayRotation(uint64_t dpy);
+
+    // isDispRszSupported() is used to query if display rsz is supported
+    bool isDispRszSupported();
+
+    // isDispRpoSupported() is used to query if rpo is supported
+    bool isDispRpoSupported();
+
+    // isDisp3X4DisplayColorTransformSupported() returns whether DISP_PQ supports
+    // 3X4 color matrix or not
+    bool isDisp3X4DisplayColorTransformSupported();
+
+    // isDispAodForceDisable return display forces disable aod on hwcomposer.
+    bool isDispAodForceDisable();
+
+    // isPartialUpdateSupported() is used to query if PartialUpdate is supported
+    bool isPartialUpdateSupported();
+
+    // isFenceWaitSupported() is used to query if FenceWait is supported
+    bool isFenceWaitSupported();
+
+    // isConstantAlphaForRGBASupported() is used to query if PRGBA is supported
+    bool isConstantAlphaForRGBASupported();
+
+    // isDispSelfRefreshSupported is used to query if hardware support ioctl of self-refresh
+    bool isDispSelfRefreshSupported();
+
+    // isDisplayHrtSupport() is used to query HRT suuported or not
+    bool isDisplayHrtSupport();
+
+    // isDisplaySupportedWidthAndHeight() is used to query Width and Height is supported or not
+    bool isDisplaySupportedWidthAndHeight(unsigned int width, unsigned int height);
+
+    // getSupportedColorMode is used to check what colormode device support
+    int32_t getSupportedColorMode();
+
+    // getMaxOverlayInputNum() gets overlay supported input amount
+    unsigned int getMaxOverlayInputNum();
+
+    // getMaxOverlayHeight() gets overlay supported height amount
+    uint32_t getMaxOverlayHeight();
+
+    // getMaxOverlayWidth() gets overlay supported width amount
+    uint32_t getMaxOverlayWidth();
+
+    // getDisplayOutputRotated() get the decouple buffer is rotated or not
+    int32_t getDisplayOutputRotated();
+
+    // getRszMaxWidthInput() get the max width of rsz input
+    uint32_t getRszMaxWidthInput();
+
+    // getRszMaxHeightInput() get the max height of rsz input
+    uint32_t getRszMaxHeightInput();
+
+    // enableDisplayFeature() is used to force hwc to enable feature
+    void enableDisplayFeature(uint32_t flag);
+
+    // disableDisplayFeature() is used to force hwc to disable feature
+    void disableDisplayFeature(uint32_t flag);
+
+    // createOverlaySession() creates overlay composition session
+    status_t createOverlaySession(
+        uint64_t dpy, uint32_t width, uint32_t height,
+        HWC_DISP_MODE mode = HWC_DISP_SESSION_DIRECT_LINK_MODE);
+
+    // destroyOverlaySession() destroys overlay composition session
+    void destroyOverlaySession(uint64_t dpy);
+
+    // triggerOverlaySession() used to trigger overlay engine to do composition
+    status_t triggerOverlaySession(
+        uint64_t dpy, int present_fence_idx, int sf_present_fence_idx, int ovlp_layer_num,
+        int prev_present_fence_fd, hwc2_config_t config,
+        const uint32_t& hrt_weight, const uint32_t& hrt_idx,
+        unsigned int num, OverlayPortParam* const* params,
+        sp<ColorTransform> color_transform,
+        TriggerOverlayParam trigger_param
+        );
+
+    // disableOverlaySession() usd to disable overlay session to do composition
+    void disableOverlaySession(uint64_t dpy,  OverlayPortParam* const* params, unsigned int num);
+
+    // setOverlaySessionMode() sets the overlay session mode
+    status_t setOverlaySessionMode(uint64_t dpy, HWC_DISP_MODE mode);
+
+    // getOverlaySessionMode() gets the overlay session mode
+    HWC_DISP_MODE getOverlaySessionMode(uint64_t dpy);
+
+    // getOverlaySessionInfo() gets specific display device information
+    status_t getOverlaySessionInfo(uint64_t dpy, SessionInfo* info);
+
+    // getAvailableOverlayInput gets available amount of overlay input
+    // for different session
+    unsigned int getAvailableOverlayInput(uint64_t dpy);
+
+    // prepareOverlayInput() gets timeline index and fence fd of overlay input layer
+    void prepareOverlayInput(uint64_t dpy, OverlayPrepareParam* param);
+
+    // updateOverlayInputs() updates multiple overlay input layers
+    void updateOverlayInputs(uint64_t dpy, OverlayPortParam* const* params, unsigned int num,
+                             sp<ColorTransform> color_transform);
+
+    // prepareOverlayOutput() gets timeline index and fence fd for overlay output buffer
+    void prepareOverlayOutput(uint64_t dpy, OverlayPrepareParam* param);
+
+    // disableOverlayOutput() disables overlay output buffer
+    void disableOverlayOutput(uint64_t dpy);
+
+    // enableOverlayOutput() enables overlay output buffer
+    void enableOverlayOutput(uint64_t dpy, OverlayPortParam* param);
+
+    // prepareOverlayPresentFence() gets present timeline index and fence
+    void prepareOverlayPresentFence(uint64_t dpy, OverlayPrepareParam* param);
+
+    // waitVSync() is used to wait vsync signal for specific display device
+    status_t waitVSync(uint64_t dpy, nsecs_t *ts);
+
+    // setPowerMode() is used to switch power setting for display
+    void setPowerMode(uint64_t dpy, int mode);
+
+    // to query valid layers which can handled by OVL
+    bool queryValidLayer(void* ptr);
+
+    // waitAllJobDone() use to wait driver for processing all job
+    status_t waitAllJobDone(const uint64_t dpy);
+
+    // waitRefreshRequest() is used to wait for refresh request from driver
+    status_t waitRefreshRequest(unsigned int* type);
+
+    // getWidth() gets the width from the config
+    int32_t getWidth(uint64_t dpy, hwc2_config_t config);
+
+    // getHeight() gets the height from the config
+    int32_t getHeight(uint64_t dpy, hwc2_config_t config);
+
+    // getRefresh() gets the fps from the config
+    int32_t getRefresh(uint64_t dpy, hwc2_config_t config);
+
+    // getNumConfigs gets the number of configs
+    uint32_t getNumConfigs(uint64_t dpy);
+
+    // dump dev info
+    void dump(const uint64_t& dpy, String8* dump_str);
+
+    // updateDisplayResolution use to update display resolution
+    int32_t updateDisplayResolution(uint64_t dpy);
+
+    // getCurrentRefresh() gets the current mode fps
+    // this is only used for external display
+    int32_t getCurrentRefresh(uint64_t dpy);
+
+    // submitMML() does nothing since there is no MML hardware
+    void submitMML(uint64_t dpy, struct mml_submit& params);
+
+    // Display Driver debug log IOCtrl
+    void enableDisplayDriverLog(uint32_t param);
+
+private:
+    NullDevice();
+
+    // NullTimeline wraps a sw_sync timeline.
+    // next_idx is the index of the last created fence,
+    // committed_idx is the index of the last committed buffer and
+    // signaled_idx is the current value of the timeline
+    struct NullTimeline
+    {
+        NullTimeline()
+            : fd(-1)
+            , next_idx(0)
+            , committed_idx(0)
+            , signaled_idx(0)
+        { }
+
+        int fd;
+        unsigned int next_idx;
+        unsigned int committed_idx;
+        unsigned int signaled_idx;
+    };
+
+    // NullFrame keeps the fence indices of a committed frame which
+    // would be signaled when the frame is latched by the next vsync
+    struct NullFrame
+    {
+        NullFrame()
+            : valid(false)
+            , present_idx(0)
+            , output_en(false)
+            , output_idx(0)
+        {
+            for (unsigned int i = 0; i < NULL_DEV_MAX_INPUT_NUM; i++)
+            {
+                input_en[i] = false;
+                input_idx[i] = 0;
+            }
+        }
+
+        bool valid;
+        unsigned int present_idx;
+        bool output_en;
+        unsigned int output_idx;
+        bool input_en[NULL_DEV_MAX_INPUT_NUM];
+        unsigned int input_idx[NULL_DEV_MAX_INPUT_NUM];
+    };
+
+    struct NullSession
+    {
+        NullSession()
+            : valid(false)
+            , width(0)
+            , height(0)
+            , mode(HWC_DISP_INVALID_SESSION_MODE)
+            , power_mode(HWC2_POWER_MODE_OFF)
+            , commit_count(0)
+            , latch_count(0)
+        { }
+
+        bool valid;
+        uint32_t width;
+        uint32_t height;
+        HWC_DISP_MODE mode;
+        int power_mode;
+
+        NullTimeline input[NULL_DEV_MAX_INPUT_NUM];
+        NullTimeline output;
+        NullTimeline present;
+
+        // config prepared by updateOverlayInputs() and enableOverlayOutput()
+        NullFrame config;
+
+        // frame committed by triggerOverlaySession() and waiting for vsync
+        NullFrame pending;
+
+        uint64_t commit_count;
+        uint64_t latch_count;
+    };
+
+    // createTimeline() creates the sw_sync timeline
+    // it is fine to fail, all fences would be -1 in that case
+    void createTimeline(NullTimeline* timeline);
+
+    // destroyTimeline() signals all created fences and close the timeline
+    void destroyTimeline(NullTimeline* timeline);
+
+    // createFence() creates the fence of next index on the timeline
+    void createFence(NullTimeline* timeline, const char* name, unsigned int* idx, int* fd);
+
+    // signalTimeline() moves the timeline forward to idx
+    void signalTimeline(NullTimeline* timeline, unsigned int idx);
+
+    // latchFrameLocked() emulates the display hardware reading the pending frame
+    void latchFrameLocked(NullSession* session);
+
+    // vsyncLoop() is the body of the fake vsync thread
+    void vsyncLoop();
+
+    std::mutex m_lock;
+
+    // m_vsync_cond is used to wake up the clients of waitVSync()
+    std::condition_variable m_vsync_cond;
+
+    NullSession m_sessions[DisplayManager::MAX_DISPLAYS];
+
+    uint32_t m_default_width;
+    uint32_t m_default_height;
+    int32_t m_default_refresh;
+
+    nsecs_t m_vsync_period;
+    nsecs_t m_vsync_ts;
+    uint64_t m_vsync_count;
+
+    std::thread m_vsync_thread;
+    bool m_stop;
+};
+
+#endif // HWC_NULL_DEV_H_
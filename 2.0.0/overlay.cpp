@@ -9,9 +9,11 @@
 #include "utils/mm_buf_dump.h"
 
 #include "hwc2_api.h"
+#include "hwc2_bench.h"
 #include "hwc2_defs.h"
 #include "overlay.h"
 #include "dispatcher.h"
+#include "frame_tracer.h"
 #include "display.h"
 #include "queue.h"
 #include "composer.h"
@@ -42,6 +44,7 @@ OverlayEngine::OverlayEngine(const uint64_t& dpy, uint32_t width, uint32_t heigh
     , m_need_wakeup(false)
     , m_prev_power_mode(0)
     , m_power_mode_changed(0)
+    , m_slack_controller("po_", dpy)
 {
     // create overlay session
     status_t err = HWCMediator::getInstance().getOvlDevice(m_disp_id)->createOverlaySession(m_disp_id, width, height);
@@ -83,7 +86,7 @@ OverlayEngine::OverlayEngine(const uint64_t& dpy, uint32_t width, uint32_t heigh
 
     std::string pool_name(m_thread_name);
     pool_name += "_FrameInfo";
-    m_pool = new ObjectPool<FrameInfo>(pool_name, 5);
+    m_pool = new ObjectPool<FrameInfo>(pool_name, HWC_OVL_FRAME_POOL_SIZE);
 
     m_trace_delay_name = std::string("present_after_ts_") + std::to_string(dpy);
     m_trace_delay_counter = 0;
@@ -94,22 +97,23 @@ OverlayEngine::OverlayEngine(const uint64_t& dpy, uint32_t width, uint32_t heigh
     m_perf_target_cpu_mhz_str = std::string("po_target_cpu_mhz_") + std::to_string(dpy);
     m_perf_uclamp_str = std::string("po_uclamp_") + std::to_string(dpy);
     m_perf_extension_time_str = std::string("po_extension_time_") + std::to_string(dpy);
+    m_fence_gate_str = std::string("fence_gate_") + std::to_string(dpy);
 }
 
 OverlayEngine::~OverlayEngine()
 {
-    size_t size = m_frame_queue.size();
-    for (size_t i = 0; i < size; i++)
+    sp<FrameInfo> frame_info;
+    while (m_frame_queue.pop(&frame_info))
     {
-        closeAllFenceFd(m_frame_queue[i]);
-        closeAllIonFd(m_frame_queue[i]);
+        closeAllFenceFd(frame_info);
+        closeAllIonFd(frame_info);
     }
+    frame_info = nullptr;
     if (m_last_frame_info != nullptr)
     {
         closeAllIonFd(m_last_frame_info);
     }
     m_last_frame_info = nullptr;
-    m_frame_queue.clear();
     delete m_pool;
 
     for (unsigned int id = 0; id < m_max_inputs; id++)
@@ -498,7 +502,10 @@ void OverlayEngine::trigger(const unsigned int& present_fence_idx,
             packageFrameInfo(frame_info, present_fence_idx, sf_present_fence_idx,
                              prev_present_fence, pq_fence_fd);
 
-            m_frame_queue.add(frame_info);
+            if (!m_frame_queue.push(std::move(frame_info)))
+            {
+                LOG_FATAL("%s(), frame queue is full", __FUNCTION__);
+            }
             HWC_ATRACE_INT(m_queue_name.c_str(), static_cast<int32_t>(m_frame_queue.size()));
         }
         else
@@ -528,6 +535,8 @@ void OverlayEngine::stop()
 
 status_t OverlayEngine::loopHandler(sp<FrameInfo>& info)
 {
+    HWC_BENCH_STAGE(HWC_BENCH_STAGE_OVL_LOOP);
+
     if (HWC_DISPLAY_VIRTUAL <= m_disp_id)
     {
         if (info->overlay_info.enable_output == false)
@@ -601,6 +610,8 @@ void OverlayEngine::setPowerMode(int mode)
 {
     AutoMutex l(m_lock);
 
+    m_slack_controller.reset();
+
     switch (mode)
     {
         case HWC2_POWER_MODE_OFF:
@@ -727,6 +738,12 @@ void OverlayEngine::dump(String8* dump_str)
     }
 
     dump_str->appendFormat("  Total size: %d bytes\n", total_size);
+    m_pool->dump(dump_str);
+    dump_str->appendFormat("  %s size:%zu/%zu max:%zu pushed:%" PRIu64 " full:%" PRIu64 "\n",
+                           m_queue_name.c_str(), m_frame_queue.size(), m_frame_queue.capacity(),
+                           m_frame_queue.getMaxDepth(), m_frame_queue.getPushCount(),
+                           m_frame_queue.getFullCount());
+    m_slack_controller.dump(dump_str);
 }
 
 bool OverlayEngine::threadLoop()
@@ -748,26 +765,17 @@ bool OverlayEngine::threadLoop()
                 break;
             }
 
-            if (m_frame_queue.empty())
+            if (!m_frame_queue.pop(&frame_info))
             {
                 //OLOGD("job is empty");
                 break;
             }
-            Vector< sp<FrameInfo> >::iterator front(m_frame_queue.begin());
-            if (front)
-            {
-                frame_info = *front;
-            }
-            else
-            {
-                LOG_FATAL("%s(), front invalid", __FUNCTION__);
-                continue;
-            }
-            m_frame_queue.erase(front);
             HWC_ATRACE_INT(m_queue_name.c_str(), static_cast<int32_t>(m_frame_queue.size()));
         }
+        FrameAllocScope alloc_scope;
 
         const nsecs_t config_period = DisplayManager::getInstance().getDisplayData(m_disp_id, frame_info->active_config)->refresh;
+        const uint64_t start_cycles = m_cycle_counter.read();
 
         calculatePerf(frame_info, config_period, tid, false);
         // change the cpu set after set the uclamp. it can avoid that use little core with
@@ -851,9 +859,17 @@ bool OverlayEngine::threadLoop()
         waitPresentAfterTs(frame_info);
 
         calculatePerf(frame_info, config_period, tid, true);
+        HWCFrameTracer::getInstance().stamp(m_disp_id, frame_info->frame_seq, HWC_FRAME_STAGE_OVL_LOOP);
         loopHandler(frame_info);
+        HWCFrameTracer::getInstance().stamp(m_disp_id, frame_info->frame_seq, HWC_FRAME_STAGE_COMMIT_DONE);
+        if (m_perf_work_time > 0)
+        {
+            const nsecs_t cpu_time = systemTime(SYSTEM_TIME_THREAD) - m_perf_cpu_start;
+            m_slack_controller.update(m_perf_work_time - cpu_time, config_period);
+        }
 
         checkPresentAfterTs(frame_info, config_period);
+        HWCMCycleModel::getInstance().addOvlSample(frame_info->mc_id, m_cycle_counter.read() - start_cycles);
 
         if (HWCMediator::getInstance().getOvlDevice(m_disp_id)->isFenceWaitSupported())
         {
@@ -1029,90 +1045,94 @@ void OverlayEngine::closeMMLCfgFd(const sp<FrameInfo>& info)
 
 void OverlayEngine::waitAllFence(sp<FrameInfo>& info)
 {
-    char tag[128];
     DbgLogger logger(DbgLogger::TYPE_HWC_LOG, 'D', nullptr);
     logger.printf("(%" PRIu64 ") Wait present fence for idx: %d", m_disp_id, info->present_fence_idx);
 
-    waitOverlayFence(info);
+    // collect all fences of the frame, and wait them with one poll set
+    m_fence_wait_items.clear();
+    int dbq_item = -1;
+    FrameOverlayInfo* overlay_info = &info->overlay_info;
+    for (unsigned int i = 0; i < overlay_info->num_layers; i++)
+    {
+        OverlayPortParam* layer = overlay_info->input.editItemAt(i);
+        if (layer->identity == HWLAYER_ID_DBQ && layer->fence != -1)
+        {
+            dbq_item = static_cast<int>(m_fence_wait_items.size());
+        }
+        addFenceWaitItem(&layer->fence, SYNC_FENCE_OVL_IN, i);
+    }
 
-    if (info->prev_present_fence != -1)
+    if (overlay_info->enable_output)
+    {
+        addFenceWaitItem(&overlay_info->output.fence, SYNC_FENCE_OVL_OUT, SYNC_DBG_ID2_MAX);
+    }
+    const size_t num_overlay_items = m_fence_wait_items.size();
+    const bool has_present_fence = info->prev_present_fence != -1;
+    addFenceWaitItem(&info->prev_present_fence, SYNC_FENCE_PF, SYNC_DBG_ID2_MAX);
+    addFenceWaitItem(&info->pq_fence_fd, SYNC_FENCE_PQ, SYNC_DBG_ID2_MAX);
+
+    if (!m_fence_wait_items.empty())
     {
+        const nsecs_t wait_start_time = systemTime();
+        m_sync_fence->waitMany(m_fence_wait_items.data(), m_fence_wait_items.size(), 1000);
+        const nsecs_t wait_end_time = systemTime();
 
-        if (HWCMediator::getInstance().getLowLatencyWFD() == true)
+        // the fence which signals last gates the commit
+        const SyncFenceWaitItem* gate = &m_fence_wait_items[0];
+        for (const SyncFenceWaitItem& item : m_fence_wait_items)
         {
-            // status: active(0) signaled(1) error(<0)
-            if (m_sync_fence->queryFenceStatus(info->prev_present_fence) == 0)
+            if (item.signal_time < 0 ||
+                (gate->signal_time >= 0 && item.signal_time > gate->signal_time))
             {
-               HWCMediator::getInstance().setRepaintAfterNextVsync();
-            }
-            else
-            {
-               HWCMediator::getInstance().setRepaintInNextVsync();
+                gate = &item;
+                if (item.signal_time < 0)
+                {
+                    break;
+                }
             }
         }
-#ifdef FENCE_DEBUG
-        HWC_LOGD("+ OverlayEngine::waitPresentFence prev_present_fence:%d", info->prev_present_fence);
-#endif
-        HWC_ATRACE_NAME("PF");
-        if (!isUserLoad() && snprintf(tag, sizeof(tag), "%s-PF", DEBUG_LOG_TAG) > 0)
-        {
-            m_sync_fence->wait(info->prev_present_fence, 1000, tag);
-        }
-        else
-        {
-            m_sync_fence->wait(info->prev_present_fence, 1000, nullptr, SYNC_FENCE_PF, m_disp_id);
-        }
-#ifdef FENCE_DEBUG
-        HWC_LOGD("- OverlayEngine::waitPresentFence");
-#endif
-        info->prev_present_fence = -1;
+
+        const int32_t gate_id = gate->fence_type == SYNC_FENCE_OVL_IN ?
+                                static_cast<int32_t>(gate->id_2) : -static_cast<int32_t>(gate->fence_type);
+        HWC_ATRACE_INT(m_fence_gate_str.c_str(), gate_id);
+        logger.printf(" fences:%zu gate:%d wait:%" PRId64 "us", m_fence_wait_items.size(), gate_id,
+                      ns2us(std::max<nsecs_t>(0, (gate->signal_time < 0 ? wait_end_time : gate->signal_time) -
+                                                 wait_start_time)));
     }
 
-    if (info->pq_fence_fd != -1)
+    if (has_present_fence && HWCMediator::getInstance().getLowLatencyWFD() == true)
     {
-        HWC_ATRACE_NAME("PQF");
-        if (!isUserLoad() && snprintf(tag, sizeof(tag), "%s-PQF", DEBUG_LOG_TAG) > 0)
+        // check whether the previous present fence is still active when the
+        // fences of overlay are signaled
+        nsecs_t overlay_ready_time = -1;
+        for (size_t i = 0; i < num_overlay_items; i++)
         {
-            m_sync_fence->wait(info->pq_fence_fd, 1000, tag);
+            overlay_ready_time = std::max(overlay_ready_time, m_fence_wait_items[i].signal_time);
         }
-        else
-        {
-            m_sync_fence->wait(info->pq_fence_fd, 1000, nullptr, SYNC_FENCE_PQ, m_disp_id);
-        }
-    }
-}
-
-void OverlayEngine::waitOverlayFence(sp<FrameInfo>& frame_info)
-{
-    char tag[128];
-    FrameOverlayInfo* info = &frame_info->overlay_info;
 
-    for (unsigned int i = 0; i < info->num_layers; i++)
-    {
-        OverlayPortParam* layer = info->input.editItemAt(i);
-        if (layer->fence != -1)
-        {
-#ifdef FENCE_DEBUG
-            HWC_LOGD("+ OverlayEngine::waitOverlayFence() layer->fence:%d", layer->fence);
-#endif
-        if (!isUserLoad() && snprintf(tag, sizeof(tag), "%s-IN-%u", DEBUG_LOG_TAG, i) > 0)
+        const nsecs_t present_time = m_fence_wait_items[num_overlay_items].signal_time;
+        if (present_time < 0 || present_time > overlay_ready_time)
         {
-            m_sync_fence->wait(layer->fence, 1000, tag);
+           HWCMediator::getInstance().setRepaintAfterNextVsync();
         }
         else
         {
-            m_sync_fence->wait(layer->fence, 1000, nullptr, SYNC_FENCE_OVL_IN, m_disp_id, i);
-        }
-#ifdef FENCE_DEBUG
-            HWC_LOGD("- OverlayEngine::waitOverlayFence()");
-#endif
-            layer->fence = -1;
+           HWCMediator::getInstance().setRepaintInNextVsync();
         }
+    }
 
-        if (layer->identity == HWLAYER_ID_DBQ && frame_info->decouple_target_ts > 0)
+    for (unsigned int i = 0; i < overlay_info->num_layers; i++)
+    {
+        OverlayPortParam* layer = overlay_info->input.editItemAt(i);
+        if (layer->identity == HWLAYER_ID_DBQ && info->decouple_target_ts > 0)
         {
-            const nsecs_t cur_time = systemTime();
-            nsecs_t diff = cur_time - frame_info->decouple_target_ts;
+            // the decouple buffer is ready when its own fence signals
+            nsecs_t ready_time = systemTime();
+            if (dbq_item >= 0 && m_fence_wait_items[static_cast<size_t>(dbq_item)].signal_time > 0)
+            {
+                ready_time = m_fence_wait_items[static_cast<size_t>(dbq_item)].signal_time;
+            }
+            const nsecs_t diff = ready_time - info->decouple_target_ts;
 
             if (diff > 0)
             {
@@ -1122,25 +1142,26 @@ void OverlayEngine::waitOverlayFence(sp<FrameInfo>& frame_info)
             }
         }
     }
+}
 
-    if (info->enable_output && info->output.fence != -1)
+void OverlayEngine::addFenceWaitItem(int* fd, unsigned int fence_type, unsigned int id)
+{
+    if (*fd == -1)
     {
-#ifdef FENCE_DEBUG
-        HWC_LOGD("+ OverlayEngine::waitOverlayFence() output.fence:%d", info->output.fence);
-#endif
-        if (!isUserLoad() && snprintf(tag, sizeof(tag), "%s-OUT", DEBUG_LOG_TAG) > 0)
-        {
-            m_sync_fence->wait(info->output.fence, 1000, tag);
-        }
-        else
-        {
-            m_sync_fence->wait(info->output.fence, 1000, nullptr, SYNC_FENCE_OVL_OUT, m_disp_id);
-        }
-#ifdef FENCE_DEBUG
-        HWC_LOGD("- OverlayEngine::waitOverlayFence()");
-#endif
-        info->output.fence = -1;
+        return;
     }
+
+    SyncFenceWaitItem item;
+    item.fd = *fd;
+    item.fence_type = fence_type;
+    item.id_1 = m_disp_id;
+    item.id_2 = id;
+    item.signal_time = -1;
+    item.err = NO_ERROR;
+    m_fence_wait_items.push_back(item);
+
+    // waitMany() closes the fd
+    *fd = -1;
 }
 
 void OverlayEngine::onFirstRef()
@@ -1170,6 +1191,7 @@ void OverlayEngine::packageFrameInfo(sp<FrameInfo>& info, const unsigned int& pr
     info->ovl_mc = m_handling_job->ovl_mc;
     info->ovl_mc_atomic_ratio = m_handling_job->ovl_mc_atomic_ratio;
     info->ovl_wo_atomic_work_time = m_handling_job->ovl_wo_atomic_work_time;
+    info->mc_id = m_handling_job->mc_info.id;
     info->cpu_set = m_handling_job->cpu_set;
     logger.printf("/ PF: %d", info->prev_present_fence);
 
@@ -1352,6 +1374,11 @@ void OverlayEngine::checkPresentAfterTs(sp<FrameInfo>& info, nsecs_t period)
 
 void OverlayEngine::calculatePerf(sp<FrameInfo>& info, nsecs_t period, pid_t tid, bool is_atomic)
 {
+    if (is_atomic)
+    {
+        m_perf_work_time = -1;
+    }
+
     if (info->ovl_mc == FLT_MAX)
     {
         return;
@@ -1406,9 +1433,17 @@ void OverlayEngine::calculatePerf(sp<FrameInfo>& info, nsecs_t period, pid_t tid
     }
     else
     {
-        target_cpu_mhz = calculateCpuMHz(work_mc, work_time);
+        target_cpu_mhz = m_slack_controller.adjust(calculateCpuMHz(work_mc, work_time));
         ovl_uclamp = cpuMHzToUClamp(target_cpu_mhz);
     }
+
+    // a frame which is already late before the commit extends its deadline
+    // by whole periods, it tells nothing about the uclamp of the commit
+    if (is_atomic && extension_time == 0 && work_time > 0)
+    {
+        m_perf_work_time = work_time;
+        m_perf_cpu_start = systemTime(SYSTEM_TIME_THREAD);
+    }
     HWC_ATRACE_INT(m_perf_target_cpu_mhz_str.c_str(), static_cast<int32_t>(target_cpu_mhz));
 
     // set uclamp for overlay
@@ -1514,6 +1549,49 @@ void FrameOverlayInfo::resetOverlayPortParam(OverlayPortParam* param)
     }
 }
 
+// MMLCfgStorage is the block allocated by OverlayPortParam::allocMMLCfg(),
+// mml_cfg points to submit which is at the beginning of block
+struct MMLCfgStorage
+{
+    mml_submit submit;
+    mml_job job;
+    mml_pq_param pq_param[MML_MAX_OUTPUTS];
+};
+
+void OverlayPortParam::allocMMLCfg()
+{
+    if (NULL != mml_cfg)
+    {
+        HWC_LOGE("MMLCfg is not NULL, please free it first !");
+        return;
+    }
+
+    MMLCfgStorage* storage = new MMLCfgStorage;
+    if (NULL == storage)
+    {
+        HWC_LOGE("MMLCfg allocate fail");
+        return;
+    }
+    memset(storage, 0, sizeof(MMLCfgStorage));
+
+    mml_cfg = &storage->submit;
+    mml_cfg->job = &storage->job;
+    for (int i = 0; i < MML_MAX_OUTPUTS; ++i)
+    {
+        mml_cfg->pq_param[i] = &storage->pq_param[i];
+    }
+    resetMMLCfg();
+}
+
+void OverlayPortParam::removeMMLCfg()
+{
+    if (NULL != mml_cfg)
+    {
+        delete reinterpret_cast<MMLCfgStorage*>(mml_cfg);
+        mml_cfg = NULL;
+    }
+}
+
 void FrameInfo::initData()
 {
     present_fence_idx = -1;
@@ -1536,5 +1614,6 @@ void FrameInfo::initData()
     ovl_mc = FLT_MAX;
     ovl_mc_atomic_ratio = 1.f;
     ovl_wo_atomic_work_time = -1;
+    mc_id = -1;
     cpu_set = HWC_CPUSET_NONE;
 }
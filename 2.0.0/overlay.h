@@ -1,15 +1,21 @@
 #ifndef HWC_OVERLAY_H_
 #define HWC_OVERLAY_H_
 
+#include <vector>
+
 #include <utils/Vector.h>
 #include <utils/RefBase.h>
 
 #include <hwc_common/pool.h>
+#include <hwc_common/ring.h>
 
 #include "data_express.h"
 #include "dev_interface.h"
 #include "hwc_ui/Rect.h"
 #include "hwc2_defs.h"
+#include "mcycle_model.h"
+#include "slack_controller.h"
+#include "sync.h"
 #include "vsync_listener.h"
 #include "worker.h"
 #include "mtk-mml.h"
@@ -19,6 +25,11 @@
 
 #define POWER_MODE_CHANGED_DO_VALIDATE_NUM 1
 
+// the number of FrameInfo kept by OverlayEngine, HWC_OVL_FRAME_QUEUE_SIZE
+// must be a power of two and not less than it, so the queue is never full
+#define HWC_OVL_FRAME_POOL_SIZE 5
+#define HWC_OVL_FRAME_QUEUE_SIZE 8
+
 using namespace android;
 using hwc::Rect;
 
@@ -183,65 +194,12 @@ struct OverlayPortParam
         return;
     }
 
-    void allocMMLCfg()
-    {
-        if (NULL != mml_cfg)
-        {
-            HWC_LOGE("MMLCfg is not NULL, please free it first !");
-            return;
-        }
-
-        mml_cfg = new mml_submit;
-        if (NULL == mml_cfg)
-        {
-            HWC_LOGE("MMLCfg allocate fail");
-            return;
-        }
-        memset(mml_cfg, 0, sizeof(mml_submit));
-
-        mml_cfg->job = new mml_job;
-        if (NULL == mml_cfg->job)
-        {
-            HWC_LOGE("MMLCfg job allocate fail");
-            delete mml_cfg;
-            mml_cfg = NULL;
-            return;
-        }
-        memset(mml_cfg->job, 0, sizeof(mml_job));
-
-        for (int i = 0; i < MML_MAX_OUTPUTS; ++i)
-        {
-            mml_cfg->pq_param[i] = new mml_pq_param;
-            if (NULL == mml_cfg->pq_param[i])
-            {
-                HWC_LOGE("MMLCfg pq_param allocate fail");
-                delete mml_cfg->job;
-                delete mml_cfg;
-                mml_cfg = NULL;
-                return;
-            }
-            memset(mml_cfg->pq_param[i], 0, sizeof(mml_pq_param));
-        }
-        resetMMLCfg();
-    };
-
-    void removeMMLCfg()
-    {
-        if (NULL != mml_cfg)
-        {
-            if (NULL != mml_cfg->job)
-                delete mml_cfg->job;
-
-            for (int i = 0; i < MML_MAX_OUTPUTS; ++i)
-            {
-                if (NULL != mml_cfg->pq_param[i])
-                    delete mml_cfg->pq_param[i];
-            }
+    // allocMMLCfg() allocates mml_submit together with its job and pq params
+    // in one block. It is kept for the life of this param and recycled by
+    // resetMMLCfg(), so the frame path does not allocate after first use.
+    void allocMMLCfg();
 
-            delete mml_cfg;
-            mml_cfg = NULL;
-        }
-    };
+    void removeMMLCfg();
 
     int state;
     void* va;
@@ -353,6 +311,7 @@ public:
     float ovl_mc;
     float ovl_mc_atomic_ratio;
     nsecs_t ovl_wo_atomic_work_time;
+    int mc_id;
     unsigned int cpu_set;
 };
 
@@ -420,6 +379,9 @@ public:
 
     void setPowerMode(int mode);
 
+    // resetSlackControl() drops the correction of m_slack_controller
+    void resetSlackControl() { m_slack_controller.reset(); }
+
     // getMaxInputNum() is used for getting max amount of overlay inputs
     unsigned int getMaxInputNum() { return m_max_inputs; }
 
@@ -517,8 +479,8 @@ private:
     // waitAllFence() is used to wait layer fence, present fence and output buffer fence
     void waitAllFence(sp<FrameInfo>& info);
 
-    // waitOverlayFence is used to wait layer fence and output buffer fence
-    void waitOverlayFence(sp<FrameInfo>& frame_info);
+    // addFenceWaitItem() moves fd into m_fence_wait_items for waitAllFence()
+    void addFenceWaitItem(int* fd, unsigned int fence_type, unsigned int id);
 
     // closeOverlayFenceFd is used to close input and output fence
     void closeOverlayFenceFd(FrameOverlayInfo* info);
@@ -594,8 +556,10 @@ private:
     // m_stop is used to stop OverlayEngine thread
     bool m_stop;
 
-    // m_frame_queue is an array which store the parameters of queued frame
-    Vector< sp<FrameInfo> > m_frame_queue;
+    // m_frame_queue is a ring which store the parameters of queued frame,
+    // the frames are pre-allocated by m_pool, so queuing a frame does not
+    // allocate. it is pushed by trigger() and popped by threadLoop()
+    SpscRing<sp<FrameInfo>, HWC_OVL_FRAME_QUEUE_SIZE> m_frame_queue;
 
     // m_pool keep all pointer of FrameInfo and maintain their life cycle
     ObjectPool<FrameInfo>* m_pool;
@@ -632,6 +596,23 @@ private:
 
     // store the last cpu set from FrameInfo
     unsigned int m_cpu_set = HWC_CPUSET_NONE;
+
+    // m_cycle_counter measures the cycles of each frame for HWCMCycleModel
+    HWCCycleCounter m_cycle_counter;
+
+    // m_slack_controller corrects the uclamp with the slack of each commit.
+    // The slack is m_perf_work_time, the work time planned by calculatePerf(),
+    // minus the thread CPU time from calculatePerf() to the return of
+    // loopHandler(), so the time blocked in the commit ioctl is not counted
+    HWCSlackController m_slack_controller;
+    nsecs_t m_perf_work_time = -1;
+    nsecs_t m_perf_cpu_start = 0;
+
+    // m_fence_wait_items keeps its capacity, so waitAllFence() does not
+    // allocate in the steady state. fence_gate_<dpy> traces the fence which
+    // signals last: the index of input layer, or -fence_type of the others
+    std::vector<SyncFenceWaitItem> m_fence_wait_items;
+    std::string m_fence_gate_str;
 };
 
 #endif // HWC_OVERLAY_H_
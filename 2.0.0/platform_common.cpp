@@ -824,6 +824,16 @@ PlatformCommon::PlatformConfig::PlatformConfig()
     , perf_prefer_below_cpu_mhz(400)
     , perf_reserve_time_for_wait_fence(us2ns(100))
     , perf_switch_threshold_cpu_mhz(200)
+    , perf_slack_control(true)
+    , hrt_decision_cache(true)
+    , hrt_query_memo(true)
+    , hrt_model_check(false)
+    , hrt_model_bound_layer_num(4)
+    , hrt_joint_plan(false)
+    , hrt_model_shared_bound_layer_num(0)
+    , drm_delta_commit(true)
+    , drm_nonblock_commit(false)
+    , drm_color_blob_cache_size(4)
 {
     char value[PROPERTY_VALUE_MAX] = {0};
     property_get("vendor.debug.hwc.blitdev_for_virtual", value, "-1");
@@ -326,6 +326,39 @@ public:
         nsecs_t perf_reserve_time_for_wait_fence;
         uint32_t perf_switch_threshold_cpu_mhz;
 
+        // scale the open-loop uclamp with the measured deadline slack
+        bool perf_slack_control;
+
+        // reuse the layering result of a layer stack which is seen recently
+        bool hrt_decision_cache;
+
+        // reuse the result of the layering query if the request is the same
+        bool hrt_query_memo;
+
+        // compare the layering of driver with HrtModel
+        bool hrt_model_check;
+
+        // the bandwidth bound of HrtModel in full screen layers at 60fps
+        uint32_t hrt_model_bound_layer_num;
+
+        // choose the GLES range of all displays together with HrtModel
+        bool hrt_joint_plan;
+
+        // the bandwidth bound shared by all displays in full screen layers at
+        // 60fps, 0 means hrt_model_bound_layer_num of each display added up
+        uint32_t hrt_model_shared_bound_layer_num;
+
+        // only add the changed plane and crtc properties to the atomic commit
+        bool drm_delta_commit;
+
+        // commit with DRM_MODE_ATOMIC_NONBLOCK, the next commit waits for the
+        // page flip event of the previous one
+        bool drm_nonblock_commit;
+
+        // the number of color transform blobs kept alive for reuse besides the
+        // committed one, 0 destroys a blob once it is replaced
+        uint32_t drm_color_blob_cache_size;
+
         struct CpuSetIndex
         {
             uint32_t little;
@@ -0,0 +1,234 @@
+#define DEBUG_LOG_TAG "HRT"
+
+#include "sim_hrt.h"
+
+#include <vector>
+
+#include <inttypes.h>
+
+#include "overlay.h"
+#include "dispatcher.h"
+#include "hwc2.h"
+#include "dev_interface.h"
+#include "platform_wrap.h"
+
+static uint32_t getModelBitsPerPixel(const sp<HWCLayer>& layer)
+{
+    switch (layer->getHwlayerType())
+    {
+        case HWC_LAYER_TYPE_DIM:
+            return 0;
+
+        case HWC_LAYER_TYPE_MM:
+        {
+            const uint32_t mdp_output_format = layer->decideMdpOutputFormat();
+            if (mdp_output_format != 0)
+            {
+                return getBitsPerPixel(mdp_output_format);
+            }
+            break;
+        }
+
+        case HWC_LAYER_TYPE_GLAI:
+            return getBitsPerPixel(layer->getGlaiOutFormat());
+
+        default:
+            break;
+    }
+    return getBitsPerPixel(layer->getPrivateHandle().format);
+}
+
+void buildHrtModelInput(const std::vector<sp<HWCDisplay> >& displays, const bool& is_rpo_enabled,
+                        std::vector<HrtModelDisplay>* input)
+{
+    input->clear();
+    for (auto& display : displays)
+    {
+        if (!display->isValid() ||
+            display->getMirrorSrc() != -1 ||
+            HWCMediator::getInstance().getOvlDevice(display->getId())->getType() != OVL_DEVICE_TYPE_OVL)
+        {
+            continue;
+        }
+
+        DispatcherJob* job = HWCDispatcher::getInstance().getExistJob(display->getId());
+        if (NULL == job)
+            continue;
+
+        const hwc2_config_t config = display->getActiveConfig();
+        const nsecs_t period = display->getVsyncPeriod(config);
+
+        input->push_back(HrtModelDisplay());
+        HrtModelDisplay& model_display = input->back();
+        model_display.disp_id = display->getId();
+        model_display.width = display->getWidth(config);
+        model_display.height = display->getHeight(config);
+        model_display.fps = period > 0 ? static_cast<int32_t>((s2ns(1) + period / 2) / period) : HRT_MODEL_BASE_FPS;
+        model_display.max_layer_num = job->num_layers;
+        model_display.bound_layer_num = Platform::getInstance().m_config.hrt_model_bound_layer_num;
+        model_display.is_rpo_enabled = is_rpo_enabled;
+        model_display.rpo_max_src_width = Platform::getInstance().m_config.rpo_ui_max_src_width;
+        display->getGlesRange(&model_display.gles_head, &model_display.gles_tail);
+
+        const std::vector<sp<HWCLayer> >& layers = display->getVisibleLayersSortedByZ();
+        const std::vector<int32_t>& prev_comp_types = display->getPrevCompTypes();
+        model_display.layers.resize(layers.size());
+        for (size_t i = 0; i < layers.size(); ++i)
+        {
+            const sp<HWCLayer>& layer = layers[i];
+            HrtModelLayer& model_layer = model_display.layers[i];
+
+            model_layer.dst_left = getDstLeft(layer);
+            model_layer.dst_top = getDstTop(layer);
+            model_layer.dst_width = getDstWidth(layer);
+            model_layer.dst_height = getDstHeight(layer);
+            model_layer.bits_per_pixel = getModelBitsPerPixel(layer);
+            model_layer.is_dirty = layer->isBufferChanged() || layer->isStateContentDirty();
+            model_layer.was_in_gles = prev_comp_types.size() == layers.size() &&
+                                      prev_comp_types[i] == HWC2_COMPOSITION_CLIENT;
+            if (layer->getLayerCaps() & HWC_LAYERING_OVL_ONLY)
+            {
+                model_layer.caps |= HRT_MODEL_CAPS_OVL_ONLY;
+            }
+
+            switch (layer->getHwlayerType())
+            {
+                case HWC_LAYER_TYPE_DIM:
+                    model_layer.src_width = model_layer.dst_width;
+                    model_layer.src_height = model_layer.dst_height;
+                    break;
+
+                case HWC_LAYER_TYPE_MM:
+                    model_layer.src_width = WIDTH(layer->getMdpDstRoi());
+                    model_layer.src_height = HEIGHT(layer->getMdpDstRoi());
+                    model_layer.caps |= HRT_MODEL_CAPS_MDP;
+                    break;
+
+                case HWC_LAYER_TYPE_GLAI:
+                    model_layer.src_width = WIDTH(layer->getGlaiDstRoi());
+                    model_layer.src_height = HEIGHT(layer->getGlaiDstRoi());
+                    break;
+
+                default:
+                    if (layer->getHwlayerType() == HWC_LAYER_TYPE_UI &&
+                        (layer->getPrivateHandle().prexform & HAL_TRANSFORM_ROT_90))
+                    {
+                        model_layer.src_width = getSrcHeight(layer);
+                        model_layer.src_height = getSrcWidth(layer);
+                    }
+                    else
+                    {
+                        model_layer.src_width = getSrcWidth(layer);
+                        model_layer.src_height = getSrcHeight(layer);
+                    }
+                    break;
+            }
+        }
+    }
+}
+
+bool SimHrt::isEnabled() const
+{
+    return true;
+}
+
+bool SimHrt::isRPOEnabled() const
+{
+    return HWCMediator::getInstance().getOvlDevice(HWC_DISPLAY_PRIMARY)->isDispRpoSupported();
+}
+
+void SimHrt::printQueryValidLayerResult()
+{
+    m_hrt_result.str("");
+    m_hrt_result << "[HRT Model] idx:" << m_model.getLastIdx() << " w:" << m_hrt_weight;
+    for (size_t i = 0; i < m_model_input.size() && i < m_model_result.size(); ++i)
+    {
+        m_hrt_result << " " << HrtModel::describe(m_model_input[i], m_model_result[i]);
+    }
+    HWC_LOGD("%s", m_hrt_result.str().c_str());
+}
+
+void SimHrt::fillLayerConfigList(const std::vector<sp<HWCDisplay> >& displays)
+{
+    buildHrtModelInput(displays, isRPOEnabled(), &m_model_input);
+}
+
+bool SimHrt::queryValidLayer()
+{
+    m_hrt_weight = m_model.layering(m_model_input, &m_model_result);
+    return true;
+}
+
+void SimHrt::fillLayerInfoOfDispatcherJob(const std::vector<sp<HWCDisplay> >& displays)
+{
+    for (auto& display : displays)
+    {
+        const uint64_t disp_id = display->getId();
+        DispatcherJob* job = HWCDispatcher::getInstance().getExistJob(disp_id);
+
+        if (!display->isConnected() || NULL == job || display->getMirrorSrc() != -1)
+            continue;
+
+        const std::vector<sp<HWCLayer> >& layers = display->getVisibleLayersSortedByZ();
+        const unsigned int layers_num = static_cast<unsigned int>(layers.size());
+        if (layers_num > m_hrt_config_len[disp_id])
+        {
+            if (NULL != m_hrt_config_list[disp_id])
+                delete[] m_hrt_config_list[disp_id];
+
+            m_hrt_config_len[disp_id] = layers_num;
+            m_hrt_config_list[disp_id] = new HrtLayerConfig[layers_num];
+        }
+        job->layer_info.hrt_config_list = m_hrt_config_list[disp_id];
+
+        const HrtModelResult* result = NULL;
+        for (auto& item : m_model_result)
+        {
+            if (item.disp_id == disp_id)
+            {
+                result = &item;
+                break;
+            }
+        }
+
+        // the driver composes all layers by GPU if the display is not
+        // layered, e.g. it is not handled by OVL
+        if (NULL == result || result->layer_caps.size() != layers.size())
+        {
+            for (unsigned int i = 0; i < layers_num; ++i)
+            {
+                m_hrt_config_list[disp_id][i].ovl_id = 0;
+                m_hrt_config_list[disp_id][i].ext_sel_layer = -1;
+            }
+            job->layer_info.max_overlap_layer_num = -1;
+            job->layer_info.hrt_weight = 0;
+            job->layer_info.hrt_idx = 0;
+            job->layer_info.gles_head = layers_num ? 0 : -1;
+            job->layer_info.gles_tail = static_cast<int>(layers_num) - 1;
+            continue;
+        }
+
+        for (size_t i = 0; i < layers.size(); ++i)
+        {
+            m_hrt_config_list[disp_id][i].ovl_id = result->ovl_id[i];
+            m_hrt_config_list[disp_id][i].ext_sel_layer = -1;
+
+            auto& layer = layers[i];
+            int32_t layer_caps = layer->getLayerCaps() & ~HWC_DISP_RSZ_LAYER;
+            if (result->layer_caps[i] & HRT_MODEL_CAPS_DISP_RSZ)
+            {
+                layer_caps |= HWC_DISP_RSZ_LAYER;
+            }
+            layer->setLayerCaps(layer_caps);
+        }
+
+        job->layer_info.max_overlap_layer_num = result->max_overlap_layer_num;
+        job->layer_info.hrt_weight = m_hrt_weight;
+        job->layer_info.hrt_idx = m_model.getLastIdx();
+        job->layer_info.gles_head = result->gles_head;
+        job->layer_info.gles_tail = result->gles_tail;
+        HWC_LOGV("%s(), disp:%" PRIu64 " gles_head:%d gles_tail:%d hrt:%u,%u", __FUNCTION__,
+                 disp_id, job->layer_info.gles_head, job->layer_info.gles_tail,
+                 job->layer_info.hrt_weight, job->layer_info.hrt_idx);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef HWC_SIM_HRT_H
+#define HWC_SIM_HRT_H
+
+#include <vector>
+
+#include "hrt_common.h"
+#include "hrt_model.h"
+
+class HWCDisplay;
+
+// buildHrtModelInput() converts the layer stacks of displays into the input
+// of HrtModel. Only the displays handled by OVL are converted, as the driver
+// does in fillDispLayer()
+void buildHrtModelInput(const std::vector<sp<HWCDisplay> >& displays, const bool& is_rpo_enabled,
+                        std::vector<HrtModelDisplay>* input);
+
+// SimHrt makes the layering decision with HrtModel instead of the display
+// driver. It is used by the null device, so the layering of a recorded call
+// stream can be replayed without display hardware
+class SimHrt : public HrtCommon
+{
+public:
+    SimHrt()
+        : m_hrt_weight(0)
+    { }
+
+    bool isEnabled() const;
+
+    bool isRPOEnabled() const;
+
+    bool isSimulated() const { return true; }
+
+    void printQueryValidLayerResult();
+
+    void fillLayerConfigList(const std::vector<sp<HWCDisplay> >& displays);
+
+    void fillLayerInfoOfDispatcherJob(const std::vector<sp<HWCDisplay> >& displays);
+
+    bool queryValidLayer();
+
+private:
+    HrtModel m_model;
+    std::vector<HrtModelDisplay> m_model_input;
+    std::vector<HrtModelResult> m_model_result;
+    uint32_t m_hrt_weight;
+};
+
+#endif
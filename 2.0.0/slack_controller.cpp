@@ -0,0 +1,105 @@
+#define DEBUG_LOG_TAG "SLK"
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "slack_controller.h"
+
+#include <algorithm>
+
+#include <inttypes.h>
+
+#include <utils/String8.h>
+
+#include "utils/debug.h"
+
+#include "platform_wrap.h"
+
+using namespace android;
+
+HWCSlackController::HWCSlackController(const std::string& name, uint64_t dpy)
+    : m_name(name + std::to_string(dpy))
+    , m_slack_str(name + "slack_" + std::to_string(dpy))
+    , m_correction_str(name + "slack_correction_" + std::to_string(dpy))
+    , m_integral(0.0f)
+    , m_is_reset_requested(false)
+    , m_correction(0.0f)
+    , m_last_slack(0)
+    , m_sample_count(0)
+    , m_miss_count(0)
+{
+}
+
+uint32_t HWCSlackController::adjust(uint32_t cpu_mhz) const
+{
+    if (!Platform::getInstance().m_config.perf_slack_control || cpu_mhz == UINT32_MAX)
+    {
+        return cpu_mhz;
+    }
+
+    const float correction = m_correction.load(std::memory_order_relaxed);
+    const float adjusted = static_cast<float>(cpu_mhz) * (1.0f + correction);
+    if (adjusted >= static_cast<float>(UINT32_MAX - 1))
+    {
+        return UINT32_MAX - 1;
+    }
+    return static_cast<uint32_t>(adjusted);
+}
+
+void HWCSlackController::update(nsecs_t slack, nsecs_t period)
+{
+    if (!Platform::getInstance().m_config.perf_slack_control || period <= 0)
+    {
+        return;
+    }
+
+    m_last_slack.store(slack, std::memory_order_relaxed);
+    m_sample_count.fetch_add(1, std::memory_order_relaxed);
+    if (slack < 0)
+    {
+        m_miss_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (m_is_reset_requested.exchange(false, std::memory_order_relaxed))
+    {
+        m_integral = 0.0f;
+    }
+
+    // the error is positive when the slack is less than the target. it is
+    // limited, so a long stall, e.g. waiting a fence, does not saturate the
+    // controller by itself
+    const nsecs_t target_slack = period * HWC_SLACK_TARGET_PERCENT / 100;
+    float error = static_cast<float>(target_slack - slack) / static_cast<float>(period);
+    error = std::max(-1.0f, std::min(error, 2.0f));
+
+    // stop integrating when the output is saturated to avoid windup
+    const float integral = std::max(HWC_SLACK_CORRECTION_MIN,
+                                    std::min(m_integral + HWC_SLACK_KI * error, HWC_SLACK_CORRECTION_MAX));
+    const float output = HWC_SLACK_KP * error + integral;
+    const float correction = std::max(HWC_SLACK_CORRECTION_MIN,
+                                      std::min(output, HWC_SLACK_CORRECTION_MAX));
+    if (output == correction)
+    {
+        m_integral = integral;
+    }
+    m_correction.store(correction, std::memory_order_relaxed);
+
+    HWC_ATRACE_INT64(m_slack_str.c_str(), static_cast<int64_t>(slack));
+    HWC_ATRACE_INT(m_correction_str.c_str(), static_cast<int32_t>(correction * 100));
+}
+
+void HWCSlackController::reset()
+{
+    m_is_reset_requested.store(true, std::memory_order_relaxed);
+    m_correction.store(0.0f, std::memory_order_relaxed);
+    HWC_ATRACE_INT(m_correction_str.c_str(), 0);
+}
+
+void HWCSlackController::dump(String8* dump_str) const
+{
+    dump_str->appendFormat("  slack_control_%s enable:%d correction:%d%% last_slack:%" PRId64
+                           " samples:%" PRIu64 " missed:%" PRIu64 "\n",
+                           m_name.c_str(), Platform::getInstance().m_config.perf_slack_control,
+                           static_cast<int32_t>(m_correction.load(std::memory_order_relaxed) * 100),
+                           static_cast<int64_t>(m_last_slack.load(std::memory_order_relaxed)),
+                           m_sample_count.load(std::memory_order_relaxed),
+                           m_miss_count.load(std::memory_order_relaxed));
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include <utils/Timers.h>
+
+namespace android {
+class String8;
+}
+
+// the slack kept before the deadline, in percentage of vsync period
+#define HWC_SLACK_TARGET_PERCENT 10
+
+// gains of the PI controller, the error is the slack shortfall normalized by
+// vsync period
+#define HWC_SLACK_KP 0.5f
+#define HWC_SLACK_KI 0.1f
+
+// range of the correction, -0.5 halves the open-loop frequency and 1.0
+// doubles it
+#define HWC_SLACK_CORRECTION_MIN -0.5f
+#define HWC_SLACK_CORRECTION_MAX 1.0f
+
+// HWCSlackController closes the loop of calculateCpuMHz(). The open-loop
+// frequency comes from the million cycles of scenario, and this controller
+// scales it with the slack between the end of the work and its deadline:
+// a missed or tight deadline raises the frequency, and a large slack lowers
+// it, so a wrong cycle estimation does not keep missing frames or boosting
+// the CPU needlessly.
+// update() and adjust() must be called by the same thread, reset() and dump()
+// may be called by any thread.
+class HWCSlackController
+{
+public:
+    // name is the prefix of systrace counters, e.g. "pd_" or "po_"
+    HWCSlackController(const std::string& name, uint64_t dpy);
+
+    // adjust() returns cpu_mhz scaled by the current correction
+    uint32_t adjust(uint32_t cpu_mhz) const;
+
+    // update() feeds the slack of a finished work, a negative slack means
+    // the deadline is missed
+    void update(nsecs_t slack, nsecs_t period);
+
+    // reset() drops the state, e.g. after the display is idle or its power
+    // mode is changed. The integral is cleared by the next update()
+    void reset();
+
+    void dump(android::String8* dump_str) const;
+
+private:
+    std::string m_name;
+    std::string m_slack_str;
+    std::string m_correction_str;
+
+    float m_integral;
+    std::atomic<bool> m_is_reset_requested;
+    std::atomic<float> m_correction;
+    std::atomic<nsecs_t> m_last_slack;
+    std::atomic<uint64_t> m_sample_count;
+    std::atomic<uint64_t> m_miss_count;
+};
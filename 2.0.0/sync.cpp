@@ -5,6 +5,8 @@
 #include <algorithm>
 #include <string>
 
+#include <poll.h>
+
 #include <sync/sync.h>
 #include <sw_sync.h>
 
@@ -88,6 +90,127 @@ status_t SyncFence::wait(int fd, int timeout, const char* log_name,
     return err < 0 ? -errno : status_t(NO_ERROR);
 }
 
+status_t SyncFence::waitMany(SyncFenceWaitItem* items, size_t count, int timeout)
+{
+    HWC_ATRACE_FORMAT_NAME("wait_fence_many(%zu)", count);
+
+    const nsecs_t start_time = systemTime();
+    const nsecs_t deadline = timeout < 0 ? -1 : start_time + ms2ns(timeout);
+    status_t ret = NO_ERROR;
+
+    for (size_t base = 0; base < count; base += SYNC_WAIT_MANY_MAX)
+    {
+        const size_t batch = std::min(count - base, static_cast<size_t>(SYNC_WAIT_MANY_MAX));
+        struct pollfd fds[SYNC_WAIT_MANY_MAX];
+        size_t num_pending = 0;
+
+        for (size_t i = 0; i < batch; i++)
+        {
+            SyncFenceWaitItem& item = items[base + i];
+            item.err = NO_ERROR;
+            // poll() ignores a negative fd, so the slot of a missing fence stays idle
+            fds[i].fd = item.fd;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+            if (item.fd < 0)
+            {
+                item.signal_time = 0;
+            }
+            else
+            {
+                item.signal_time = -1;
+                ++num_pending;
+            }
+        }
+
+        while (num_pending > 0)
+        {
+            int poll_timeout = -1;
+            if (deadline >= 0)
+            {
+                const nsecs_t remain_time = deadline - systemTime();
+                poll_timeout = remain_time <= 0 ? 0 :
+                               static_cast<int>(ns2ms(remain_time + ms2ns(1) - 1));
+            }
+
+            const int num_ready = poll(fds, static_cast<nfds_t>(batch), poll_timeout);
+            if (num_ready < 0)
+            {
+                if (errno == EINTR || errno == EAGAIN)
+                {
+                    continue;
+                }
+                SYNC_LOGW("(%" PRIu64 ") poll %zu fences failed: %s", m_client, num_pending, strerror(errno));
+                break;
+            }
+            else if (num_ready == 0)
+            {
+                break;
+            }
+
+            const nsecs_t now = systemTime();
+            for (size_t i = 0; i < batch; i++)
+            {
+                if (fds[i].fd < 0 || fds[i].revents == 0)
+                {
+                    continue;
+                }
+
+                SyncFenceWaitItem& item = items[base + i];
+                item.signal_time = now;
+                if (fds[i].revents & (POLLERR | POLLNVAL))
+                {
+                    item.err = -EINVAL;
+                }
+                fds[i].fd = -1;
+                --num_pending;
+            }
+        }
+
+        for (size_t i = 0; i < batch; i++)
+        {
+            SyncFenceWaitItem& item = items[base + i];
+            if (item.fd < 0)
+            {
+                continue;
+            }
+
+            if (item.signal_time < 0)
+            {
+                HWC_ATRACE_NAME("timeout");
+                SYNC_LOGE("[0x%x] (%" PRIu64 ") fence %d didn't signal in %d ms",
+                          getSyncDbgInt(item.fence_type, item.id_1, item.id_2), m_client,
+                          item.fd, timeout);
+                dump(item.fd);
+                item.err = -ETIME;
+            }
+            else if (item.err == NO_ERROR)
+            {
+                // poll() only tells when this thread wakes up, the kernel
+                // keeps the real signal time in the sync_file
+                const uint64_t time = getSignalTime(item.fd);
+                if (time != static_cast<uint64_t>(SIGNAL_TIME_INVALID) &&
+                    time != static_cast<uint64_t>(SIGNAL_TIME_PENDING))
+                {
+                    item.signal_time = static_cast<nsecs_t>(time);
+                }
+            }
+
+            if (ret == NO_ERROR && item.err != NO_ERROR)
+            {
+                ret = item.err;
+            }
+
+            protectedClose(item.fd);
+            item.fd = -1;
+        }
+    }
+
+    SYNC_LOGV("(%" PRIu64 ") wait and close %zu fences within %d", m_client, count, timeout);
+
+    return ret;
+}
+
 status_t SyncFence::waitForever(int fd, int warning_timeout, const char* log_name)
 {
     if (fd == -1) return NO_ERROR;
@@ -20,6 +20,26 @@ enum
     SYNC_FENCE_PQ,
 };
 
+// SYNC_WAIT_MANY_MAX is the number of fences polled by one poll() in waitMany()
+#define SYNC_WAIT_MANY_MAX 32
+
+// SyncFenceWaitItem describes one fence of SyncFence::waitMany()
+struct SyncFenceWaitItem
+{
+    // fd is closed and set to -1 by waitMany()
+    int fd;
+    unsigned int fence_type;
+    uint64_t id_1;
+    uint64_t id_2;
+
+    // signal_time is the kernel timestamp of the fence signal, it falls back
+    // to the time when waitMany() sees the fence signaled if the sync_file
+    // has no timestamp. it is 0 if there is no fence, and -1 if the fence is
+    // not signaled before the deadline
+    nsecs_t signal_time;
+    status_t err;
+};
+
 class SyncFence : public LightRefBase<SyncFence>
 {
 public:
@@ -45,6 +65,15 @@ public:
                   uint64_t id_1 = SYNC_DBG_ID1_MAX,
                   uint64_t id_2 = SYNC_DBG_ID2_MAX);
 
+    // waitMany() waits for all fences of items with one poll set, so the
+    // total time is bounded by timeout instead of the sum of each fence.
+    // the signal_time and err of each item are filled, and the fence which
+    // signals last can be found by the largest signal_time.
+    // return NO_ERROR if all fences are signaled, otherwise, the first error
+    //
+    // all fds of items will be closed implicitly before exiting waitMany()
+    status_t waitMany(SyncFenceWaitItem* items, size_t count, int timeout);
+
     // waitForever() is a convenience function for waiting forever for a fence
     // to signal (just like wait(TIMEOUT_NEVER)), but issuing an error to the
     // system log and fence state to the kernel log if the wait lasts longer
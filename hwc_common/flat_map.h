@@ -0,0 +1,114 @@
+#ifndef HWC_COMMON_FLAT_MAP_H
+#define HWC_COMMON_FLAT_MAP_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// GenerationMap is a fixed size open addressing hash map keyed by uint64_t.
+// It is used for tables which are rebuilt once per frame: nextGeneration()
+// expires all entries in O(1), and only the entries inserted after it are
+// visible to find(). Capacity must be a power of two and should be at least
+// twice of the number of keys in one generation.
+//
+// Within a generation, slots are only taken and never released, so a probe
+// can stop at the first slot which is not in the current generation. This
+// keeps the map free of tombstones.
+template <class T, size_t Capacity>
+class GenerationMap
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                  "capacity of GenerationMap must be a power of two");
+
+public:
+    GenerationMap()
+        : m_generation(1)
+        , m_size(0)
+    {
+        clearSlots();
+    }
+
+    // nextGeneration() expires all entries of the current generation
+    void nextGeneration()
+    {
+        m_size = 0;
+        if (++m_generation == 0)
+        {
+            // generation 0 marks unused slots, so wipe the table on wrap around
+            clearSlots();
+            m_generation = 1;
+        }
+    }
+
+    // find() returns the value of key in the current generation, or NULL
+    T* find(uint64_t key)
+    {
+        for (size_t i = 0, pos = hash(key); i < Capacity; ++i, pos = (pos + 1) & (Capacity - 1))
+        {
+            Slot& slot = m_slots[pos];
+            if (slot.generation != m_generation)
+                return NULL;
+            if (slot.key == key)
+                return &slot.value;
+        }
+        return NULL;
+    }
+
+    const T* find(uint64_t key) const
+    {
+        return const_cast<GenerationMap*>(this)->find(key);
+    }
+
+    // insert() returns the value of key in the current generation. If key is
+    // not in the map, it is added with the value of init. It returns NULL if
+    // the map is full
+    T* insert(uint64_t key, const T& init)
+    {
+        for (size_t i = 0, pos = hash(key); i < Capacity; ++i, pos = (pos + 1) & (Capacity - 1))
+        {
+            Slot& slot = m_slots[pos];
+            if (slot.generation != m_generation)
+            {
+                slot.generation = m_generation;
+                slot.key = key;
+                slot.value = init;
+                ++m_size;
+                return &slot.value;
+            }
+            if (slot.key == key)
+                return &slot.value;
+        }
+        return NULL;
+    }
+
+    size_t size() const { return m_size; }
+
+    size_t capacity() const { return Capacity; }
+
+private:
+    struct Slot
+    {
+        uint32_t generation;
+        uint64_t key;
+        T value;
+    };
+
+    static size_t hash(uint64_t key)
+    {
+        // Fibonacci hashing spreads sequential ids over the whole table
+        return static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> 32) & (Capacity - 1);
+    }
+
+    void clearSlots()
+    {
+        for (size_t i = 0; i < Capacity; ++i)
+        {
+            m_slots[i].generation = 0;
+        }
+    }
+
+    uint32_t m_generation;
+    size_t m_size;
+    Slot m_slots[Capacity];
+};
+
+#endif // HWC_COMMON_FLAT_MAP_H
@@ -7,11 +7,18 @@
 #include <utils/Mutex.h>
 #include <utils/Condition.h>
 #include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
 
+#include <atomic>
+#include <functional>
+#include <inttypes.h>
+#include <memory>
 #include <stdint.h>
 #include <sys/types.h>
 #include <stdlib.h>
 #include <string>
+#include <vector>
 
 #include "utils/debug.h"
 
@@ -25,6 +32,14 @@ inline uint64_t getUniquePoolId()
     return id;
 }
 
+// ObjectPool keeps a fixed amount of objects. The free objects are kept in a
+// Treiber stack of object indices, and the head of stack carries a tag which
+// is increased by every operation, so a stale head can not be swapped in
+// after the same object has been popped and pushed again (ABA). The objects
+// are never freed before the pool is destroyed, so reading the next index of
+// a popped object is always safe. Only an empty pool takes m_lock to wait.
+// The pool must outlive its objects: the destructor waits until every object
+// is returned and every returnObject() in progress has left the pool.
 template <class T>
 class ObjectPool
 {
@@ -38,13 +53,51 @@ public:
     T* getFreeObject(void);
     bool returnObject(const T* item);
 
+    // dump() shows the usage counters of pool
+    void dump(String8* dump_str) const;
+
 private:
+    void addObject(T* item);
+
+    // pop() and push() are the lock-free operations of free list
+    T* pop();
+    void push(uint32_t index);
+
+    // POOL_INDEX_NONE is the index of empty stack, object indices start from 1
+    static const uint32_t POOL_INDEX_NONE = 0;
+
+    static uint32_t getIndex(uint64_t head) { return static_cast<uint32_t>(head); }
+    static uint64_t makeHead(uint64_t old_head, uint32_t index)
+    {
+        return (((old_head >> 32) + 1) << 32) | index;
+    }
+
     Mutex m_lock;
     Condition m_cond;
     std::string m_name;
     size_t m_size;
     uint64_t m_pool_id;
-    Vector<T*> m_available_pool;
+
+    // m_objects and m_next are indexed by (object index - 1)
+    std::vector<T*> m_objects;
+    std::unique_ptr<std::atomic<uint32_t>[]> m_next;
+
+    // m_head is (tag << 32) | object index
+    std::atomic<uint64_t> m_head;
+
+    // m_waiters is the amount of threads which wait for a free object
+    std::atomic<int32_t> m_waiters;
+
+    // m_returning is the amount of returnObject() which still access the pool
+    std::atomic<int32_t> m_returning;
+
+    // statistics
+    std::atomic<uint32_t> m_in_use;
+    std::atomic<uint32_t> m_max_in_use;
+    std::atomic<uint64_t> m_get_count;
+    std::atomic<uint64_t> m_exhausted_count;
+    std::atomic<int64_t> m_wait_time_total;
+    std::atomic<int64_t> m_wait_time_max;
 };
 
 template <class T>
@@ -53,7 +106,7 @@ class LightPoolBase : public LightRefBase<T>
 public:
     typedef LightPoolBase<T> basetype;
 
-    inline LightPoolBase() : m_pool_id(0), m_count(0), m_pool(NULL) { }
+    inline LightPoolBase() : m_pool_id(0), m_pool_index(0), m_count(0), m_pool(NULL) { }
     inline void incStrong(__attribute__((unused)) const void* id) const {
         android_atomic_inc(&m_count);
     }
@@ -75,6 +128,9 @@ protected:
     inline virtual ~LightPoolBase() { }
     uint64_t m_pool_id;
 
+    // m_pool_index is the index of object in its ObjectPool
+    uint32_t m_pool_index;
+
 private:
     mutable volatile int32_t m_count;
     ObjectPool<T> *m_pool;
@@ -82,119 +138,172 @@ private:
 
 template <class T>
 ObjectPool<T>::ObjectPool(std::string name, size_t size)
-    : m_name(name)
-    , m_size(size)
+    : ObjectPool(name, size, []() { return new T(); })
 {
-    m_pool_id = getUniquePoolId();
-    for (size_t i = 0; i < m_size; i++)
-    {
-        T* tmp = new T();
-        if (tmp == NULL)
-        {
-            HWC_LOGE("ObjectPool[%s]: failed to allocate object %zu/%zu", m_name.c_str(), i, m_size);
-        }
-        else
-        {
-            tmp->m_pool_id = m_pool_id;
-            tmp->setPool(this);
-            m_available_pool.add(tmp);
-        }
-    }
 }
 
 template <class T>
 ObjectPool<T>::ObjectPool(std::string name, size_t size, create_function func)
     : m_name(name)
-    , m_size(size)
+    , m_size(0)
+    , m_next(new std::atomic<uint32_t>[size])
+    , m_head(POOL_INDEX_NONE)
+    , m_waiters(0)
+    , m_returning(0)
+    , m_in_use(0)
+    , m_max_in_use(0)
+    , m_get_count(0)
+    , m_exhausted_count(0)
+    , m_wait_time_total(0)
+    , m_wait_time_max(0)
 {
     m_pool_id = getUniquePoolId();
-    for (size_t i = 0; i < m_size; i++)
+    m_objects.reserve(size);
+    for (size_t i = 0; i < size; i++)
     {
         T* tmp = func();
         if (tmp == NULL)
         {
-            HWC_LOGE("ObjectPool[%s]: failed to allocate object %zu/%zu", m_name.c_str(), i, m_size);
+            HWC_LOGE("ObjectPool[%s]: failed to allocate object %zu/%zu", m_name.c_str(), i, size);
         }
         else
         {
-            tmp->m_pool_id = m_pool_id;
-            tmp->setPool(this);
-            m_available_pool.add(tmp);
+            addObject(tmp);
         }
     }
 }
 
+template <class T>
+void ObjectPool<T>::addObject(T* item)
+{
+    m_objects.push_back(item);
+    m_size = m_objects.size();
+
+    item->m_pool_id = m_pool_id;
+    item->m_pool_index = static_cast<uint32_t>(m_size);
+    item->setPool(this);
+    push(item->m_pool_index);
+}
+
 template <class T>
 ObjectPool<T>::~ObjectPool()
 {
     Mutex::Autolock l(m_lock);
 
     int timeout_count = 0;
+    m_waiters.fetch_add(1);
     while (1)
     {
-        if (m_size == m_available_pool.size())
+        // m_in_use drops before returnObject() stops touching the pool, so
+        // the pool is freed only after the last returnObject() leaves
+        if (m_in_use.load() == 0 && m_returning.load() == 0)
         {
             break;
         }
 
         if (timeout_count == 1)
         {
-            HWC_LOGE("ObjectPool[%s]: resource is still held, wait... (%zu/%zu,cnt:%d)",
-                     m_name.c_str(), m_available_pool.size(), m_size, timeout_count);
+            HWC_LOGE("ObjectPool[%s]: resource is still held, wait... (%u/%zu,cnt:%d)",
+                     m_name.c_str(), m_in_use.load(), m_size, timeout_count);
         }
         if (timeout_count & 0x01)
         {
-            HWC_LOGW("ObjectPool[%s]: resource is still held, wait... (%zu/%zu,cnt:%d)",
-                     m_name.c_str(), m_available_pool.size(), m_size, timeout_count);
+            HWC_LOGW("ObjectPool[%s]: resource is still held, wait... (%u/%zu,cnt:%d)",
+                     m_name.c_str(), m_in_use.load(), m_size, timeout_count);
         }
         m_cond.waitRelative(m_lock, 1000000000);
         timeout_count++;
     }
+    m_waiters.fetch_sub(1);
 
-    for (size_t i = 0; i < m_available_pool.size(); i++)
+    for (size_t i = 0; i < m_objects.size(); i++)
     {
-        delete m_available_pool[i];
+        delete m_objects[i];
     }
-    m_available_pool.clear();
+    m_objects.clear();
 }
 
 template <class T>
-T* ObjectPool<T>::getFreeObject(void)
+T* ObjectPool<T>::pop()
 {
-    Mutex::Autolock l(m_lock);
-
-    int timeout_count = 0;
-    while (1)
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    while (getIndex(head) != POOL_INDEX_NONE)
     {
-        if (!m_available_pool.isEmpty())
+        const uint32_t index = getIndex(head);
+        const uint32_t next = m_next[index - 1].load(std::memory_order_relaxed);
+        if (m_head.compare_exchange_weak(head, makeHead(head, next),
+                                         std::memory_order_acq_rel, std::memory_order_acquire))
         {
-            break;
+            return m_objects[index - 1];
         }
+    }
+    return NULL;
+}
 
-        if (timeout_count == 1)
+template <class T>
+void ObjectPool<T>::push(uint32_t index)
+{
+    uint64_t head = m_head.load(std::memory_order_relaxed);
+    do
+    {
+        m_next[index - 1].store(getIndex(head), std::memory_order_relaxed);
+    } while (!m_head.compare_exchange_weak(head, makeHead(head, index),
+                                           std::memory_order_release, std::memory_order_relaxed));
+}
+
+template <class T>
+T* ObjectPool<T>::getFreeObject(void)
+{
+    T* tmp = pop();
+    if (tmp == NULL)
+    {
+        m_exhausted_count.fetch_add(1, std::memory_order_relaxed);
+        const nsecs_t start = systemTime();
+
+        Mutex::Autolock l(m_lock);
+        // m_waiters must be visible before trying again, returnObject()
+        // checks it after pushing the object back
+        m_waiters.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        int timeout_count = 0;
+        while (1)
         {
-            HWC_LOGE("ObjectPool[%s]: pool is empty, wait... (cnt:%d)",
-                     m_name.c_str(), timeout_count);
+            tmp = pop();
+            if (tmp != NULL)
+            {
+                break;
+            }
+
+            if (timeout_count == 1)
+            {
+                HWC_LOGE("ObjectPool[%s]: pool is empty, wait... (cnt:%d)",
+                         m_name.c_str(), timeout_count);
+            }
+            if (timeout_count & 0x01)
+            {
+                HWC_LOGW("ObjectPool[%s]: pool is empty, wait... (cnt:%d)",
+                         m_name.c_str(), timeout_count);
+            }
+            m_cond.waitRelative(m_lock, 1000000000);
+            timeout_count++;
         }
-        if (timeout_count & 0x01)
+        m_waiters.fetch_sub(1);
+
+        const int64_t wait_time = systemTime() - start;
+        m_wait_time_total.fetch_add(wait_time, std::memory_order_relaxed);
+        if (wait_time > m_wait_time_max.load(std::memory_order_relaxed))
         {
-            HWC_LOGW("ObjectPool[%s]: pool is empty, wait... (cnt:%d)",
-                     m_name.c_str(), timeout_count);
+            m_wait_time_max.store(wait_time, std::memory_order_relaxed);
         }
-        m_cond.waitRelative(m_lock, 1000000000);
-        timeout_count++;
     }
 
-    T* tmp = NULL;
-    typename Vector<T*>::iterator first = m_available_pool.begin();
-    if (first)
+    m_get_count.fetch_add(1, std::memory_order_relaxed);
+    const uint32_t in_use = m_in_use.fetch_add(1) + 1;
+    uint32_t max_in_use = m_max_in_use.load(std::memory_order_relaxed);
+    while (in_use > max_in_use &&
+           !m_max_in_use.compare_exchange_weak(max_in_use, in_use, std::memory_order_relaxed))
     {
-        tmp = *first;
-        m_available_pool.erase(first);
-    }
-    else
-    {
-        LOG_FATAL("%s(), first invalid", __FUNCTION__);
     }
 
     return tmp;
@@ -203,20 +312,47 @@ T* ObjectPool<T>::getFreeObject(void)
 template <class T>
 bool ObjectPool<T>::returnObject(const T* ptr)
 {
-    bool res = false;
-    Mutex::Autolock l(m_lock);
-    if (ptr->m_pool_id == m_pool_id)
+    if (ptr->m_pool_id != m_pool_id || ptr->m_pool_index == POOL_INDEX_NONE ||
+        ptr->m_pool_index > m_size)
     {
-        res = true;
-        m_available_pool.add((T*)ptr);
-        m_cond.signal();
+        HWC_LOGE("ObjectPool[%s]: failed to recycle item[%p]", m_name.c_str(), ptr);
+        return false;
     }
 
-    if (!res)
+    // m_returning keeps the destructor waiting until this function stops
+    // touching the pool, it must be raised before m_in_use drops
+    m_returning.fetch_add(1);
+    push(ptr->m_pool_index);
+    m_in_use.fetch_sub(1);
+
+    // pairs with the fence in getFreeObject(), either the waiter sees the
+    // pushed object or this thread sees the waiter
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_waiters.load() > 0)
     {
-        HWC_LOGE("ObjectPool[%s]: failed to recycle item[%p]", m_name.c_str(), ptr);
+        Mutex::Autolock l(m_lock);
+        m_returning.fetch_sub(1);
+        m_cond.signal();
+    }
+    else
+    {
+        m_returning.fetch_sub(1);
     }
 
-    return res;
+    return true;
+}
+
+template <class T>
+void ObjectPool<T>::dump(String8* dump_str) const
+{
+    const uint64_t exhausted = m_exhausted_count.load(std::memory_order_relaxed);
+    dump_str->appendFormat("  ObjectPool[%s] size:%zu in_use:%u max:%u get:%" PRIu64
+                           " exhausted:%" PRIu64 " wait(avg:%" PRId64 "us max:%" PRId64 "us)\n",
+                           m_name.c_str(), m_size, m_in_use.load(std::memory_order_relaxed),
+                           m_max_in_use.load(std::memory_order_relaxed),
+                           m_get_count.load(std::memory_order_relaxed), exhausted,
+                           exhausted ? ns2us(m_wait_time_total.load(std::memory_order_relaxed) /
+                                             static_cast<int64_t>(exhausted)) : 0,
+                           ns2us(m_wait_time_max.load(std::memory_order_relaxed)));
 }
 #endif
@@ -0,0 +1,97 @@
+#ifndef HWC_COMMON_RING_H
+#define HWC_COMMON_RING_H
+
+#include <atomic>
+#include <stdint.h>
+#include <sys/types.h>
+#include <utility>
+
+// SpscRing is a bounded lock-free FIFO for exactly one producer thread and
+// one consumer thread. If there are more producers, they must be serialized
+// by the caller. Capacity must be a power of two.
+//
+// m_tail is only written by the producer and m_head only by the consumer.
+// A slot is published by the release store of m_tail and recycled by the
+// release store of m_head, so neither side ever waits for the other.
+template <class T, size_t Capacity>
+class SpscRing
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                  "capacity of SpscRing must be a power of two");
+
+public:
+    SpscRing()
+        : m_head(0)
+        , m_tail(0)
+        , m_max_depth(0)
+        , m_push_count(0)
+        , m_full_count(0)
+    { }
+
+    // push() is called by the producer, it returns false if the ring is full
+    bool push(T&& item)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) >= Capacity)
+        {
+            m_full_count.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        m_slots[tail & (Capacity - 1)] = std::move(item);
+        m_tail.store(tail + 1, std::memory_order_release);
+
+        const size_t depth = tail + 1 - m_head.load(std::memory_order_relaxed);
+        if (depth > m_max_depth.load(std::memory_order_relaxed))
+        {
+            m_max_depth.store(depth, std::memory_order_relaxed);
+        }
+        m_push_count.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // pop() is called by the consumer, it returns false if the ring is empty
+    bool pop(T* item)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+            return false;
+
+        T& slot = m_slots[head & (Capacity - 1)];
+        *item = std::move(slot);
+        slot = T();
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // size() can be called by any thread, the result may be stale
+    size_t size() const
+    {
+        const size_t head = m_head.load(std::memory_order_acquire);
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+        return tail - head;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    size_t capacity() const { return Capacity; }
+
+    // counters for dumpsys
+    size_t getMaxDepth() const { return m_max_depth.load(std::memory_order_relaxed); }
+    uint64_t getPushCount() const { return m_push_count.load(std::memory_order_relaxed); }
+    uint64_t getFullCount() const { return m_full_count.load(std::memory_order_relaxed); }
+
+private:
+    // keep the indices on their own cache lines, the producer and the consumer
+    // would bounce the line on every operation otherwise
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+
+    alignas(64) std::atomic<size_t> m_max_depth;
+    std::atomic<uint64_t> m_push_count;
+    std::atomic<uint64_t> m_full_count;
+
+    T m_slots[Capacity];
+};
+
+#endif // HWC_COMMON_RING_H
@@ -1,5 +1,8 @@
 #define DEBUG_LOG_TAG "FPSCOUNTER"
 
+#include <algorithm>
+
+#include <inttypes.h>
 #include <stdint.h>
 #include <errno.h>
 #include <sys/types.h>
@@ -19,6 +22,93 @@
 
 namespace android {
 
+//--------------------------------------------------------------------------------------------------
+size_t FrameTimeHistogram::getBucket(uint64_t us) {
+    if (us < SUB_BUCKET_NUM) {
+        return static_cast<size_t>(us);
+    }
+
+    // the exponent selects the bucket, and the bits below the leading one
+    // select the sub-bucket
+    const size_t exp = 63 - static_cast<size_t>(__builtin_clzll(us));
+    const size_t sub = static_cast<size_t>(us >> (exp - SUB_BUCKET_BITS)) & (SUB_BUCKET_NUM - 1);
+    const size_t idx = (exp - SUB_BUCKET_BITS + 1) * SUB_BUCKET_NUM + sub;
+    return (idx < BUCKET_NUM) ? idx : BUCKET_NUM - 1;
+}
+
+uint64_t FrameTimeHistogram::getBucketValue(size_t idx) {
+    if (idx < SUB_BUCKET_NUM) {
+        return idx;
+    }
+
+    // the middle of the sub-bucket
+    const size_t exp = idx / SUB_BUCKET_NUM + SUB_BUCKET_BITS - 1;
+    const uint64_t lower = static_cast<uint64_t>(SUB_BUCKET_NUM + idx % SUB_BUCKET_NUM) << (exp - SUB_BUCKET_BITS);
+    return lower + ((1ULL << (exp - SUB_BUCKET_BITS)) >> 1);
+}
+
+void FrameTimeHistogram::record(const nsecs_t& interval, const nsecs_t& vsync_period) {
+    if (interval <= 0) {
+        return;
+    }
+
+    if (interval > IDLE_INTERVAL) {
+        mIdleCount.fetch_add(1, std::memory_order_relaxed);
+        mPrevVsyncs.store(0, std::memory_order_relaxed);
+        return;
+    }
+
+    mBuckets[getBucket(static_cast<uint64_t>(ns2us(interval)))].fetch_add(1, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+    if (interval > mMax.load(std::memory_order_relaxed)) {
+        mMax.store(interval, std::memory_order_relaxed);
+    }
+
+    if (vsync_period > 0) {
+        const int64_t vsyncs = (interval + vsync_period / 2) / vsync_period;
+        const int64_t prev_vsyncs = mPrevVsyncs.load(std::memory_order_relaxed);
+        if (prev_vsyncs > 0 && vsyncs > prev_vsyncs) {
+            mJankCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        mPrevVsyncs.store(vsyncs, std::memory_order_relaxed);
+    }
+}
+
+void FrameTimeHistogram::reset() {
+    for (size_t i = 0; i < BUCKET_NUM; i++) {
+        mBuckets[i].store(0, std::memory_order_relaxed);
+    }
+    mCount.store(0, std::memory_order_relaxed);
+    mJankCount.store(0, std::memory_order_relaxed);
+    mIdleCount.store(0, std::memory_order_relaxed);
+    mMax.store(0, std::memory_order_relaxed);
+    mPrevVsyncs.store(0, std::memory_order_relaxed);
+}
+
+nsecs_t FrameTimeHistogram::getPercentile(uint32_t permille) const {
+    uint32_t counts[BUCKET_NUM];
+    uint64_t total = 0;
+    for (size_t i = 0; i < BUCKET_NUM; i++) {
+        counts[i] = mBuckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    // the rank of the percentile, rounded up and counted from 1
+    uint64_t rank = (total * std::min(permille, 1000u) + 999) / 1000;
+    rank = (rank == 0) ? 1 : rank;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < BUCKET_NUM; i++) {
+        sum += counts[i];
+        if (sum >= rank) {
+            return std::min(us2ns(static_cast<nsecs_t>(getBucketValue(i))), getMax());
+        }
+    }
+    return getMax();
+}
+
 //--------------------------------------------------------------------------------------------------
 bool FpsCounter::reset() {
     mFps = 0.0;
@@ -90,6 +180,33 @@ bool FpsCounter::update(const nsecs_t& timestamp) {
     return false;
 }
 
+void FpsCounter::updateHistogram(const nsecs_t& timestamp, const nsecs_t& vsync_period, uint32_t hist_mask) {
+    if (mHistResetRequested.exchange(false, std::memory_order_relaxed)) {
+        resetHistogram();
+    }
+
+    hist_mask |= 1 << HIST_ALL;
+    for (size_t i = 0; i < HIST_NUM; i++) {
+        // an interval is only meaningful between two frames with the type
+        if ((hist_mask & (1 << i)) == 0) {
+            mHistLastTime[i] = -1;
+            continue;
+        }
+
+        if (mHistLastTime[i] != -1 && timestamp > mHistLastTime[i]) {
+            mHist[i].record(timestamp - mHistLastTime[i], vsync_period);
+        }
+        mHistLastTime[i] = timestamp;
+    }
+}
+
+void FpsCounter::resetHistogram() {
+    for (size_t i = 0; i < HIST_NUM; i++) {
+        mHist[i].reset();
+        mHistLastTime[i] = -1;
+    }
+}
+
 void FpsCounter::RingBufferFps::WriteToBuffer(const FpsCounter& obj) {
     BufContent now;
     gettimeofday(&now.mTv, NULL);
@@ -134,6 +251,21 @@ void FpsCounter::dump(String8* result, const char* prefix) {
         }
     }
 
+    static const char* const hist_names[HIST_NUM] = { "all", "ui", "mm", "glai" };
+    result->appendFormat("%s Frame interval histogram (ms):\n", prefix);
+    for (size_t i = 0; i < HIST_NUM; i++) {
+        const FrameTimeHistogram& hist = mHist[i];
+        if (hist.getCount() == 0) {
+            continue;
+        }
+
+        result->appendFormat("%s %-5s n=%-8" PRIu64 " p50=%-6.2f p90=%-6.2f p99=%-6.2f p99.9=%-6.2f max=%-6.2f"
+            " jank=%" PRIu64 " idle=%" PRIu64 "\n",
+            prefix, hist_names[i], hist.getCount(),
+            hist.getPercentile(500) / 1e6, hist.getPercentile(900) / 1e6,
+            hist.getPercentile(990) / 1e6, hist.getPercentile(999) / 1e6,
+            hist.getMax() / 1e6, hist.getJankCount(), hist.getIdleCount());
+    }
 }
 
 // ----------------------------------------------------------------------------
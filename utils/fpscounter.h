@@ -2,12 +2,54 @@
 
 #ifndef ANDROID_GUI_FPSCOUNTER_H
 #define ANDROID_GUI_FPSCOUNTER_H
+#include <atomic>
 #include <vector>
 #include <sys/time.h>
 
 namespace android {
 // ----------------------------------------------------------------------------
 
+// tool class for frame interval percentiles, HDR histogram style
+// * every power of two of microseconds is split into 16 linear sub-buckets,
+//   so a percentile has less than 6.25% error from 1us to about 2 minutes
+// * record() and reset() are called by one thread, the getters may be called
+//   by any thread without lock
+class FrameTimeHistogram {
+public:
+    enum {
+        SUB_BUCKET_BITS = 4,
+        SUB_BUCKET_NUM = 1 << SUB_BUCKET_BITS,
+        BUCKET_NUM = SUB_BUCKET_NUM * 24,
+    };
+
+    // an interval longer than this is an idle gap, not a frame
+    static const nsecs_t IDLE_INTERVAL = 500000000LL;
+
+    FrameTimeHistogram() { reset(); }
+
+    // a frame is a jank if it takes more vsync periods than its previous one
+    void record(const nsecs_t& interval, const nsecs_t& vsync_period);
+    void reset();
+
+    // permille is from 0 to 1000, e.g. 999 for p99.9
+    nsecs_t getPercentile(uint32_t permille) const;
+    inline uint64_t getCount()     const{ return mCount.load(std::memory_order_relaxed);     }
+    inline uint64_t getJankCount() const{ return mJankCount.load(std::memory_order_relaxed); }
+    inline uint64_t getIdleCount() const{ return mIdleCount.load(std::memory_order_relaxed); }
+    inline nsecs_t  getMax()       const{ return mMax.load(std::memory_order_relaxed);       }
+
+private:
+    static size_t getBucket(uint64_t us);
+    static uint64_t getBucketValue(size_t idx);
+
+    std::atomic<uint32_t> mBuckets[BUCKET_NUM];
+    std::atomic<uint64_t> mCount;
+    std::atomic<uint64_t> mJankCount;
+    std::atomic<uint64_t> mIdleCount;
+    std::atomic<nsecs_t>  mMax;
+    std::atomic<int64_t>  mPrevVsyncs;
+};
+
 // tool class for FPS statistics, provide AVG, MAX, MIN message
 // * AVG for FPS in a given duration
 // * MAX and MIN for stability reference
@@ -63,11 +105,32 @@ private:
 
     RingBufferFps mRingBuffer;
 
+public:
+    // histograms of frame interval, a frame is recorded into the histogram
+    // of each layer type it contains, and HIST_ALL takes every frame
+    enum {
+        HIST_ALL = 0,
+        HIST_UI,
+        HIST_MM,
+        HIST_GLAI,
+        HIST_NUM,
+    };
+
+private:
+    FrameTimeHistogram mHist[HIST_NUM];
+    nsecs_t mHistLastTime[HIST_NUM];
+
+    // set by requestHistogramReset() and handled by updateHistogram(), so
+    // the histograms are only written by the present thread
+    std::atomic<bool> mHistResetRequested;
+
+    void resetHistogram();
+
 public:
     // the given counting interval, read system property by default
     nsecs_t     mCountInterval;
 
-    FpsCounter() { reset(); }
+    FpsCounter() : mHistResetRequested(false) { reset(); resetHistogram(); }
     ~FpsCounter() {}
 
     // main control
@@ -75,6 +138,12 @@ public:
     bool update(const nsecs_t& time);
     bool update();
 
+    // hist_mask is the bits of HIST_UI, HIST_MM and HIST_GLAI in this frame
+    void updateHistogram(const nsecs_t& timestamp, const nsecs_t& vsync_period, uint32_t hist_mask);
+
+    // the histograms are reset at the next updateHistogram()
+    void requestHistogramReset() { mHistResetRequested.store(true, std::memory_order_relaxed); }
+
     // get result
     inline float   getFps()             const{ return mFps;             }
     inline nsecs_t getMaxDuration()     const{ return mMaxDuration;     }
@@ -2,9 +2,11 @@
 
 #include <utils/tools.h>
 
+#include <atomic>
 #include <chrono>
 #include <ctime>
 #include <iomanip>
+#include <new>
 #include <sstream>
 
 #if PROFILE_MAPPER
@@ -37,6 +39,7 @@
 #include "DpAsyncBlitStream.h"
 
 #include "dispatcher.h"
+#include "mcycle_model.h"
 #include "platform_wrap.h"
 
 // for CheckIonSupport
@@ -1567,7 +1570,9 @@ void copyOverlayPortParam(const OverlayPortParam& src, OverlayPortParam* dst)
     // assign ori pointer back
     dst->mml_cfg = dst_mml_submit;
 
-    if (NULL != src.mml_cfg)
+    // mml_cfg of a port is kept after the layer leaves MML, and its content
+    // is only read when is_mml is set, so skip the deep copy for other layers
+    if (NULL != src.mml_cfg && src.is_mml)
     {
         if (NULL == dst->mml_cfg)
         {
@@ -1577,6 +1582,82 @@ void copyOverlayPortParam(const OverlayPortParam& src, OverlayPortParam* dst)
     }
 }
 
+static std::atomic<uint64_t> g_frame_alloc_count(0);
+static thread_local int t_frame_alloc_scope_depth = 0;
+
+FrameAllocScope::FrameAllocScope()
+{
+    ++t_frame_alloc_scope_depth;
+}
+
+FrameAllocScope::~FrameAllocScope()
+{
+    --t_frame_alloc_scope_depth;
+}
+
+uint64_t getFrameAllocCount()
+{
+    return g_frame_alloc_count.load(std::memory_order_relaxed);
+}
+
+#ifdef MTK_HWC_USE_NULL_DEVICE
+// the replaced operator new is used by the whole process, so it is only built
+// with null device, where HWCBench reads the count. The nothrow and aligned
+// variants of the library also pair with malloc and free, so they are left as
+// they are
+static inline void* frameAllocHook(size_t size)
+{
+    if (t_frame_alloc_scope_depth > 0)
+    {
+        g_frame_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // follow the library: retry with the new handler, and abort without one
+    // since exceptions are disabled
+    void* ptr = nullptr;
+    while ((ptr = malloc(size ? size : 1)) == nullptr)
+    {
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr)
+        {
+            abort();
+        }
+        handler();
+    }
+    return ptr;
+}
+
+void* operator new(size_t size)
+{
+    return frameAllocHook(size);
+}
+
+void* operator new[](size_t size)
+{
+    return frameAllocHook(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+#endif
+
 bool boundaryCut(const hwc_frect_t& src_source_crop,
                  const hwc_rect_t& src_display_frame,
                  unsigned int transform,
@@ -1860,11 +1941,11 @@ UClampCpuTable cpuMHzToUClamp(uint32_t cpu_mhz)
     return error_ret_val;
 }
 
-const HwcMCycleInfo& getScenarioMCInfo(DispatcherJob* job)
+HwcMCycleInfo getScenarioMCInfo(DispatcherJob* job)
 {
     if (!job)
     {
-        return Platform::getInstance().m_config.hwc_mcycle_table.back();
+        return HWCMCycleModel::getInstance().apply(Platform::getInstance().m_config.hwc_mcycle_table.back());
     }
 
     int num_ui = job->num_ui_layers + (job->fbt_exist ? 1 : 0);
@@ -1934,10 +2015,10 @@ const HwcMCycleInfo& getScenarioMCInfo(DispatcherJob* job)
             continue;
         }
 
-        return p;
+        return HWCMCycleModel::getInstance().apply(p);
     }
 
-    return Platform::getInstance().m_config.hwc_mcycle_table.back();
+    return HWCMCycleModel::getInstance().apply(Platform::getInstance().m_config.hwc_mcycle_table.back());
 }
 
 #endif // USE_HWC2
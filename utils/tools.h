@@ -1410,6 +1410,23 @@ int32_t initSecureM4U();
 void copyMMLCfg(mml_submit* src, mml_submit* dst);
 void copyOverlayPortParam(const OverlayPortParam& src, OverlayPortParam* dst);
 
+// FrameAllocScope marks the frame path on the current thread. With null
+// device, operator new is hooked and every call inside a scope is counted by
+// getFrameAllocCount(), it should stop increasing once the layer
+// configuration becomes stable. The hook is only built for HWCBench, so the
+// count is always 0 in other builds
+class FrameAllocScope
+{
+public:
+    FrameAllocScope();
+    ~FrameAllocScope();
+
+    FrameAllocScope(const FrameAllocScope&) = delete;
+    FrameAllocScope& operator=(const FrameAllocScope&) = delete;
+};
+
+uint64_t getFrameAllocCount();
+
 bool boundaryCut(const hwc_frect_t& src_source_crop,
                  const hwc_rect_t& src_display_frame,
                  unsigned int transform,
@@ -1424,7 +1441,9 @@ void changeCpuSet(pid_t tid, unsigned int cpu_set);
 
 uint32_t calculateCpuMHz(float mc, nsecs_t remain_time);
 UClampCpuTable cpuMHzToUClamp(uint32_t cpu_mhz);
-const HwcMCycleInfo& getScenarioMCInfo(DispatcherJob* job);
+// getScenarioMCInfo() returns the cycles of job's scenario, the static values
+// of hwc_mcycle_table are replaced by the ones learned by HWCMCycleModel
+HwcMCycleInfo getScenarioMCInfo(DispatcherJob* job);
 
 #endif // USE_HWC2
 